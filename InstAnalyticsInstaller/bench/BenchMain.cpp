@@ -0,0 +1,768 @@
+// Data-path benchmarks: digests, extraction of synthetic archives,
+// post-install verification, and downloads and upgrades from a loopback
+// server. Timings go to stderr as
+// they finish; the JSON report goes to stdout or --output, for tracking
+// over time.
+//
+//   InstAnalyticsBench [--filter text] [--warmup n] [--iterations n]
+//                      [--bandwidth MB/s] [--latency ms] [--handshake ms] [--quick]
+//                      [--work-dir path] [--output file.json]
+
+#include "Benchmark.h"
+#include "LoopbackServer.h"
+#include "SyntheticZip.h"
+#include "BinaryPatch.h"
+#include "CpuFeatures.h"
+#include "Crc32.h"
+#include "DeltaUpdater.h"
+#include "Downloader.h"
+#include "FileSystem.h"
+#include "InstallVerifier.h"
+#include "ReleaseManifest.h"
+#include "Sha256.h"
+#include "SocketHttpTransport.h"
+#include "Stream.h"
+#include "ThreadPool.h"
+#include "ZipExtractor.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+
+using namespace InstAnalyticsInstaller;
+using namespace InstAnalyticsInstaller::Bench;
+
+namespace {
+
+struct Settings {
+    std::string filter;
+    unsigned warmup = 1;
+    unsigned iterations = 5;
+    double bandwidthMBps = 0;       // Per connection; 0 = unthrottled
+    unsigned latencyMs = 0;
+    unsigned handshakeMs = 0;       // Per new connection
+    bool quick = false;             // Smaller inputs, for CI smoke runs
+    std::wstring workDirectory;
+    std::string output;
+};
+
+class NullOutput : public OutputStream {
+public:
+    bool Write(const void*, size_t) override { return true; }
+};
+
+bool ParseArguments(int argc, char* argv[], Settings& settings)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--quick") {
+            settings.quick = true;
+        } else if (arg == "--filter" && hasValue) {
+            settings.filter = argv[++i];
+        } else if (arg == "--warmup" && hasValue) {
+            settings.warmup = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--iterations" && hasValue) {
+            settings.iterations = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--bandwidth" && hasValue) {
+            settings.bandwidthMBps = atof(argv[++i]);
+        } else if (arg == "--latency" && hasValue) {
+            settings.latencyMs = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--handshake" && hasValue) {
+            settings.handshakeMs = (unsigned)atoi(argv[++i]);
+        } else if (arg == "--work-dir" && hasValue) {
+            settings.workDirectory = FileSystem::FromUtf8(argv[++i]);
+        } else if (arg == "--output" && hasValue) {
+            settings.output = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown or incomplete option: %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void DigestBenchmarks(Runner& runner, const Settings& settings)
+{
+    const CpuFeatures& cpu = CpuFeatures::Get();
+    fprintf(stderr, "  kernels: crc32 %s, sha256 %s\n", cpu.pclmul ? "pclmul" : "portable",
+        cpu.sha ? "sha-ni" : "portable");
+
+    size_t size = (settings.quick ? 16 : 128) * 1024 * 1024;
+    std::vector<uint8_t> data = SyntheticContent(size, 1);
+
+    // The dispatched kernel, then the portable code on the same data
+    for (bool accelerated : { true, false }) {
+        std::string suffix = accelerated ? "" : ".portable";
+        runner.Run("digest.sha256" + suffix, nullptr, [&](Work& work) {
+            CpuFeatures::SetAccelerationEnabled(accelerated);
+            Sha256 sha;
+            sha.Update(data.data(), data.size());
+            uint8_t digest[Sha256::DIGEST_SIZE];
+            sha.Final(digest);
+            CpuFeatures::SetAccelerationEnabled(true);
+            work.bytes = data.size();
+            return true;
+        });
+
+        runner.Run("digest.crc32" + suffix, nullptr, [&](Work& work) {
+            CpuFeatures::SetAccelerationEnabled(accelerated);
+            volatile uint32_t crc = Crc32::Update(0, data.data(), data.size());
+            (void)crc;
+            CpuFeatures::SetAccelerationEnabled(true);
+            work.bytes = data.size();
+            return true;
+        });
+    }
+}
+
+// The same archive through the extraction paths: serial, one worker per
+// core, and streamed (as while downloading) serially and with the workers
+void ExtractBenchmarks(Runner& runner, const Settings& settings, const std::string& name,
+    const std::vector<SyntheticEntry>& entries)
+{
+    std::string prefix = "extract." + name;
+    if (!runner.Selected(prefix)) {
+        return;
+    }
+
+    std::wstring zipPath = FileSystem::JoinPath(settings.workDirectory, FileSystem::FromUtf8(name) + L".zip");
+    std::wstring outputPath = FileSystem::JoinPath(settings.workDirectory, L"out");
+
+    uint64_t archiveSize = WriteZip(zipPath, entries, true);
+    Work expected;
+    for (const auto& entry : entries) {
+        expected.bytes += entry.data.size();
+        ++expected.files;
+    }
+
+    auto prepare = [&] { return FileSystem::RemoveTree(outputPath); };
+
+    auto extract = [&](unsigned threads) {
+        return [&, threads](Work& work) {
+            ExtractionOptions options;
+            options.threadCount = threads;
+            work = expected;
+            return archiveSize > 0 && ZipExtractor::Extract(zipPath, outputPath, nullptr, options);
+        };
+    };
+
+    runner.Run(prefix + ".serial", prepare, extract(1));
+    if (ThreadPool::DefaultThreadCount() > 1) {
+        runner.Run(prefix + ".parallel", prepare, extract(0));
+    }
+
+    auto stream = [&](unsigned threads) {
+        return [&, threads](Work& work) {
+            FileInput input;
+            if (!input.Open(zipPath)) {
+                return false;
+            }
+            RangeInputStream stream(input, 0, input.Size());
+            ExtractionOptions options;
+            options.threadCount = threads;
+            work = expected;
+            return ZipExtractor::ExtractStream(stream, outputPath, nullptr, options);
+        };
+    };
+
+    runner.Run(prefix + ".stream", prepare, stream(1));
+    if (ThreadPool::DefaultThreadCount() > 1) {
+        runner.Run(prefix + ".stream-parallel", prepare, stream(0));
+    }
+
+    FileSystem::RemoveTree(outputPath);
+    FileSystem::RemoveFile(zipPath);
+}
+
+// An installed release checked against its manifest: the verifier on one
+// worker and on all of them, and the upgrade's buffered comparison for scale
+void VerifyBenchmarks(Runner& runner, const Settings& settings)
+{
+    if (!runner.Selected("verify.")) {
+        return;
+    }
+
+    std::wstring installPath = FileSystem::JoinPath(settings.workDirectory, L"verified");
+    size_t assemblySize = (settings.quick ? 4 : 16) * 1024 * 1024;
+    unsigned resources = settings.quick ? 200 : 1000;
+    auto write = [&](const std::wstring& name, const std::vector<uint8_t>& data) {
+        std::wstring path = FileSystem::JoinPath(installPath, name);
+        File file;
+        return FileSystem::CreateDirectories(FileSystem::ParentPath(path)) && file.Open(path, File::Mode::Write) &&
+               file.Write(data.data(), data.size());
+    };
+
+    bool written = FileSystem::RemoveTree(installPath);
+    for (unsigned i = 0; written && i < 8; ++i) {
+        written = write(L"assembly" + std::to_wstring(i) + L".dll", SyntheticContent(assemblySize, 300 + i));
+    }
+    for (unsigned i = 0; written && i < resources; ++i) {
+        written = write(L"res/file" + std::to_wstring(i) + L".dat", SyntheticContent(4096 + (i * 7919) % 28672, 5000 + i));
+    }
+    ReleaseManifest manifest;
+    if (!written || !ReleaseManifest::FromDirectory(installPath, manifest)) {
+        fprintf(stderr, "Cannot prepare the installed release\n");
+        return;
+    }
+    Work expected;
+    expected.bytes = manifest.TotalSize();
+    expected.files = manifest.files.size();
+
+    // One damaged byte must be the only mismatch
+    std::vector<uint8_t> damaged = SyntheticContent(assemblySize, 305);
+    damaged[damaged.size() / 3] ^= 1;
+    VerifyReport report;
+    if (!write(L"assembly5.dll", damaged) || !InstallVerifier::Verify(manifest, installPath, report) ||
+        report.mismatches.size() != 1 || report.mismatches[0].path != L"assembly5.dll" ||
+        !write(L"assembly5.dll", SyntheticContent(assemblySize, 305))) {
+        fprintf(stderr, "The verifier missed a damaged file\n");
+        FileSystem::RemoveTree(installPath);
+        return;
+    }
+
+    auto verify = [&](unsigned threads) {
+        return [&, threads](Work& work) {
+            VerifyReport result;
+            work = expected;
+            return InstallVerifier::Verify(manifest, installPath, result, threads) && result.Passed();
+        };
+    };
+    runner.Run("verify.serial", nullptr, verify(1));
+    if (ThreadPool::DefaultThreadCount() > 1) {
+        runner.Run("verify.parallel", nullptr, verify(0));
+    }
+    runner.Run("verify.buffered", nullptr, [&](Work& work) {
+        std::vector<size_t> changed;
+        work = expected;
+        return manifest.FindChanged(installPath, 0, changed) && changed.empty();
+    });
+
+    FileSystem::RemoveTree(installPath);
+}
+
+void DownloadBenchmarks(Runner& runner, const Settings& settings)
+{
+    if (!runner.Selected("download.")) {
+        return;
+    }
+
+    size_t size = (settings.quick ? 16 : 64) * 1024 * 1024;
+    auto payload = std::make_shared<std::vector<uint8_t>>(SyntheticContent(size, 2));
+
+    Sha256 sha;
+    sha.Update(payload->data(), payload->size());
+    std::wstring digest = sha.FinalHex();
+
+    LoopbackOptions options;
+    options.bytesPerSecond = (uint64_t)(settings.bandwidthMBps * 1024 * 1024);
+    options.latencyMs = settings.latencyMs;
+    options.handshakeMs = settings.handshakeMs;
+
+    LoopbackServer server(payload, options);
+    if (!server.Start()) {
+        fprintf(stderr, "Loopback server failed to start\n");
+        return;
+    }
+
+    auto transport = std::make_shared<SocketHttpTransport>();
+    std::wstring outputPath = FileSystem::JoinPath(settings.workDirectory, L"payload.bin");
+    auto prepare = [&] {
+        FileSystem::RemoveFile(DownloadJournal::PathFor(outputPath));
+        return !FileSystem::FileExists(outputPath) || FileSystem::RemoveFile(outputPath);
+    };
+
+    auto download = [&](unsigned connections) {
+        return [&, connections](Work& work) {
+            Downloader downloader(transport);
+            DownloadOptions downloadOptions;
+            downloadOptions.connections = connections;
+            downloader.SetOptions(downloadOptions);
+            work.bytes = payload->size();
+            return downloader.DownloadFile(server.Url(), outputPath, nullptr, digest);
+        };
+    };
+
+    runner.Run("download.file.single", prepare, download(1));
+    runner.Run("download.file.segmented", prepare, download(4));
+
+    runner.Run("download.stream", nullptr, [&](Work& work) {
+        Downloader downloader(transport);
+        NullOutput output;
+        work.bytes = payload->size();
+        return downloader.DownloadToStream(server.Url(), output, nullptr, digest);
+    });
+
+    server.Stop();
+    prepare();
+
+    // Many small files behind a redirect, as the installer's phases fetch
+    // them: one session for all of them against a new session per file
+    auto smallPayload = std::make_shared<std::vector<uint8_t>>(SyntheticContent(256 * 1024, 3));
+    LoopbackServer smallServer(smallPayload, options);
+    if (!smallServer.Start()) {
+        return;
+    }
+
+    const unsigned smallFiles = settings.quick ? 16 : 64;
+    auto smallFilesRun = [&](bool shareSession) {
+        return [&, shareSession](Work& work) {
+            auto shared = std::make_shared<SocketHttpTransport>();
+            for (unsigned i = 0; i < smallFiles; ++i) {
+                Downloader downloader(shareSession ? shared : std::make_shared<SocketHttpTransport>());
+                if (!prepare() || !downloader.DownloadFile(smallServer.RedirectUrl(), outputPath)) {
+                    return false;
+                }
+            }
+            work.bytes = (uint64_t)smallFiles * smallPayload->size();
+            work.files = smallFiles;
+            return true;
+        };
+    };
+
+    runner.Run("download.small-files.new-session", nullptr, smallFilesRun(false));
+    runner.Run("download.small-files.shared-session", nullptr, smallFilesRun(true));
+
+    smallServer.Stop();
+    prepare();
+}
+
+// One payload on three servers at different speeds, like the public CDN
+// and two internal mirrors: the public URL alone, all three raced, and the
+// fastest mirror going down halfway through
+void MirrorBenchmarks(Runner& runner, const Settings& settings)
+{
+    if (!runner.Selected("download.mirrors.")) {
+        return;
+    }
+
+    size_t size = (settings.quick ? 8 : 32) * 1024 * 1024;
+    auto payload = std::make_shared<std::vector<uint8_t>>(SyntheticContent(size, 4));
+
+    Sha256 sha;
+    sha.Update(payload->data(), payload->size());
+    std::wstring digest = sha.FinalHex();
+
+    // Unthrottled, every loopback mirror would be equally fast
+    double rate = (settings.bandwidthMBps > 0 ? settings.bandwidthMBps : 16) * 1024 * 1024;
+    LoopbackOptions options;
+    options.latencyMs = settings.latencyMs;
+    options.handshakeMs = settings.handshakeMs;
+
+    LoopbackOptions slow = options;
+    slow.bytesPerSecond = (uint64_t)(rate / 4);
+    LoopbackOptions medium = options;
+    medium.bytesPerSecond = (uint64_t)(rate / 2);
+    LoopbackOptions fast = options;
+    fast.bytesPerSecond = (uint64_t)rate;
+    LoopbackOptions dying = fast;
+    dying.failAfterBytes = size / 2;
+
+    LoopbackServer publicCdn(payload, slow);
+    LoopbackServer mirror(payload, medium);
+    LoopbackServer fastMirror(payload, fast);
+    LoopbackServer dyingMirror(payload, dying);
+    if (!publicCdn.Start() || !mirror.Start() || !fastMirror.Start() || !dyingMirror.Start()) {
+        fprintf(stderr, "Loopback servers failed to start\n");
+        return;
+    }
+
+    auto transport = std::make_shared<SocketHttpTransport>();
+    std::wstring outputPath = FileSystem::JoinPath(settings.workDirectory, L"mirrored.bin");
+    auto prepare = [&] {
+        dyingMirror.Revive();
+        FileSystem::RemoveFile(DownloadJournal::PathFor(outputPath));
+        return !FileSystem::FileExists(outputPath) || FileSystem::RemoveFile(outputPath);
+    };
+
+    // Segments as small relative to the payload as they are for the SDK
+    DownloadOptions downloadOptions;
+    downloadOptions.minSegmentSize = 1024 * 1024;
+
+    auto download = [&](std::vector<std::wstring> sources) {
+        return [&, sources](Work& work) {
+            Downloader downloader(transport);
+            downloader.SetOptions(downloadOptions);
+            work.bytes = payload->size();
+            return downloader.DownloadFile(sources, outputPath, nullptr, digest);
+        };
+    };
+
+    runner.Run("download.mirrors.public-only", prepare, download({ publicCdn.Url() }));
+    runner.Run("download.mirrors.raced", prepare, download({ publicCdn.Url(), mirror.Url(), fastMirror.Url() }));
+    runner.Run("download.mirrors.failover", prepare, download({ publicCdn.Url(), mirror.Url(), dyingMirror.Url() }));
+
+    runner.Run("download.mirrors.stream-failover", prepare, [&](Work& work) {
+        Downloader downloader(transport);
+        NullOutput output;
+        work.bytes = payload->size();
+        return downloader.DownloadToStream({ publicCdn.Url(), mirror.Url(), dyingMirror.Url() }, output, nullptr, digest);
+    });
+
+    prepare();
+}
+
+// Time from Cancel() to the operation returning, which must stay within
+// CANCEL_BUDGET_SECONDS. False when the operation finished before the cancel
+constexpr double CANCEL_BUDGET_SECONDS = 0.05;
+
+bool MeasureCancel(unsigned delayMs, const std::function<void()>& cancel, const std::function<bool()>& operation,
+    double& latency)
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point cancelled;
+    std::thread canceller([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+        cancelled = Clock::now();
+        cancel();
+    });
+    bool finished = operation();
+    Clock::time_point returned = Clock::now();
+    canceller.join();
+
+    latency = std::chrono::duration<double>(returned - cancelled).count();
+    if (finished || latency < 0) {
+        fprintf(stderr, "finished before the cancel ");
+        return false;
+    }
+    if (latency > CANCEL_BUDGET_SECONDS) {
+        fprintf(stderr, "cancel took %.0f ms ", latency * 1000);
+        return false;
+    }
+    return true;
+}
+
+// Cancel latency of each stage, mid-transfer: a throttled segmented
+// download, a streamed one, a request stuck waiting for the server's
+// headers, and an extraction (whose interrupted entry must not be left
+// behind). The figures are milliseconds, not throughput
+void CancelBenchmarks(Runner& runner, const Settings& settings)
+{
+    if (!runner.Selected("cancel.")) {
+        return;
+    }
+
+    size_t size = (settings.quick ? 8 : 32) * 1024 * 1024;
+    auto payload = std::make_shared<std::vector<uint8_t>>(SyntheticContent(size, 5));
+
+    // Slow enough that no transfer ends before the cancel
+    LoopbackOptions throttled;
+    throttled.bytesPerSecond = 2 * 1024 * 1024;
+    LoopbackOptions stalled;
+    stalled.latencyMs = 2000;
+
+    LoopbackServer server(payload, throttled);
+    LoopbackServer stalledServer(payload, stalled);
+    if (!server.Start() || !stalledServer.Start()) {
+        fprintf(stderr, "Loopback servers failed to start\n");
+        return;
+    }
+
+    auto transport = std::make_shared<SocketHttpTransport>();
+    std::wstring outputPath = FileSystem::JoinPath(settings.workDirectory, L"cancelled.bin");
+    auto prepare = [&] {
+        FileSystem::RemoveFile(DownloadJournal::PathFor(outputPath));
+        return !FileSystem::FileExists(outputPath) || FileSystem::RemoveFile(outputPath);
+    };
+
+    runner.Run("cancel.download", prepare, [&](Work& work) {
+        Downloader downloader(transport);
+        return MeasureCancel(200, [&] { downloader.Cancel(); },
+            [&] { return downloader.DownloadFile(server.Url(), outputPath); }, work.seconds);
+    });
+
+    runner.Run("cancel.stream", nullptr, [&](Work& work) {
+        Downloader downloader(transport);
+        NullOutput output;
+        return MeasureCancel(200, [&] { downloader.Cancel(); },
+            [&] { return downloader.DownloadToStream(server.Url(), output); }, work.seconds);
+    });
+
+    runner.Run("cancel.stalled", prepare, [&](Work& work) {
+        Downloader downloader(transport);
+        return MeasureCancel(200, [&] { downloader.Cancel(); },
+            [&] { return downloader.DownloadFile(stalledServer.Url(), outputPath); }, work.seconds);
+    });
+
+    std::vector<SyntheticEntry> entries;
+    for (unsigned i = 0; i < 8; ++i) {
+        entries.push_back({ "InstAnalytics/assembly" + std::to_string(i) + ".dll", SyntheticContent(size / 2, 200 + i) });
+    }
+    std::wstring zipPath = FileSystem::JoinPath(settings.workDirectory, L"cancelled.zip");
+    std::wstring extractPath = FileSystem::JoinPath(settings.workDirectory, L"cancelled");
+    if (WriteZip(zipPath, entries, true) == 0) {
+        fprintf(stderr, "Cannot write %s\n", FileSystem::ToUtf8(zipPath).c_str());
+        return;
+    }
+
+    runner.Run("cancel.extract", [&] { return FileSystem::RemoveTree(extractPath); }, [&](Work& work) {
+        CancellationToken cancel;
+        ExtractionOptions options;
+        options.cancel = &cancel;
+        if (!MeasureCancel(50, [&] { cancel.Cancel(); },
+                [&] { return ZipExtractor::Extract(zipPath, extractPath, nullptr, options); }, work.seconds)) {
+            return false;
+        }
+
+        // Entries done before the cancel stay whole; the one in progress is gone
+        for (const auto& entry : entries) {
+            std::wstring path = FileSystem::JoinPath(extractPath, FileSystem::FromUtf8(entry.name));
+            File file;
+            uint64_t written = 0;
+            if (FileSystem::FileExists(path) &&
+                (!file.Open(path, File::Mode::Read) || !file.GetSize(written) || written != entry.data.size())) {
+                fprintf(stderr, "partial entry left behind ");
+                return false;
+            }
+        }
+        return true;
+    });
+
+    FileSystem::RemoveTree(extractPath);
+    FileSystem::RemoveFile(zipPath);
+    prepare();
+}
+
+// An upgrade where one assembly and a few resources changed: the whole
+// archive downloaded and extracted, against the manifest compared with the
+// install and only the changed entries fetched, and against binary patches
+// fetched for those entries instead
+void UpdateBenchmarks(Runner& runner, const Settings& settings)
+{
+    if (!runner.Selected("update.")) {
+        return;
+    }
+
+    // Version 2 edits version 1 the way a rebuild does: a few constants
+    // changed here and there, and new code in the middle shifting the rest
+    auto edited = [](std::vector<uint8_t> data, uint64_t seed) {
+        for (size_t at = 4096; at + 16 <= data.size(); at += 256 * 1024) {
+            for (size_t i = 0; i < 16; ++i) {
+                data[at + i] ^= (uint8_t)(seed + i);
+            }
+        }
+        std::vector<uint8_t> inserted = SyntheticContent(data.size() / 512 + 64, seed);
+        data.insert(data.begin() + data.size() / 2, inserted.begin(), inserted.end());
+        return data;
+    };
+
+    size_t assemblySize = (settings.quick ? 4 : 16) * 1024 * 1024;
+    unsigned resources = settings.quick ? 200 : 1000;
+    auto release = [&](unsigned version) {
+        std::vector<SyntheticEntry> entries;
+        for (unsigned i = 0; i < 8; ++i) {
+            std::vector<uint8_t> data = SyntheticContent(assemblySize, 300 + i);
+            entries.push_back({ "InstAnalytics/assembly" + std::to_string(i) + ".dll",
+                i == 3 && version > 1 ? edited(data, version) : data });
+        }
+        for (unsigned i = 0; i < resources; ++i) {
+            std::vector<uint8_t> data = SyntheticContent(4096 + (i * 7919) % 28672, 5000 + i);
+            entries.push_back({ "InstAnalytics/res/file" + std::to_string(i) + ".dat",
+                i % 100 == 7 && version > 1 ? edited(data, version) : data });
+        }
+        return entries;
+    };
+
+    // Patches from version 1 for the files version 2 changed
+    std::vector<SyntheticEntry> oldFiles = release(1);
+    std::vector<SyntheticEntry> newFiles = release(2);
+    std::vector<SyntheticEntry> patches;
+    for (size_t i = 0; i < newFiles.size(); ++i) {
+        if (newFiles[i].data == oldFiles[i].data) {
+            continue;
+        }
+        Sha256 sha;
+        sha.Update(oldFiles[i].data.data(), oldFiles[i].data.size());
+        std::wstring path = FileSystem::FromUtf8(newFiles[i].name.substr(newFiles[i].name.find('/') + 1));
+        SyntheticEntry patch{ FileSystem::ToUtf8(BinaryPatch::EntryName(path, sha.FinalHex())), {} };
+        if (!BinaryPatch::Create(oldFiles[i].data, newFiles[i].data, patch.data)) {
+            fprintf(stderr, "Cannot create the patch for %s\n", newFiles[i].name.c_str());
+            return;
+        }
+        patches.push_back(std::move(patch));
+    }
+
+    std::wstring oldZip = FileSystem::JoinPath(settings.workDirectory, L"release-1.zip");
+    std::wstring newZip = FileSystem::JoinPath(settings.workDirectory, L"release-2.zip");
+    std::wstring patchesZip = FileSystem::JoinPath(settings.workDirectory, L"release-2.patches.zip");
+    std::wstring installPath = FileSystem::JoinPath(settings.workDirectory, L"installed");
+    std::wstring downloadPath = FileSystem::JoinPath(settings.workDirectory, L"release-2.download.zip");
+    std::wstring spoolDirectory = FileSystem::JoinPath(settings.workDirectory, L"spool");
+
+    ExtractionOptions stripRoot;
+    stripRoot.stripCommonRoot = true;
+
+    // The manifest published with release 2, from its extracted files
+    ReleaseManifest manifest;
+    uint64_t newSize = WriteZip(newZip, newFiles, true);
+    uint64_t patchesSize = WriteZip(patchesZip, patches, true);
+    if (WriteZip(oldZip, oldFiles, true) == 0 || newSize == 0 || patchesSize == 0 || !FileSystem::RemoveTree(installPath) ||
+        !ZipExtractor::Extract(newZip, installPath, nullptr, stripRoot) ||
+        !ReleaseManifest::FromDirectory(installPath, manifest)) {
+        fprintf(stderr, "Cannot prepare the update releases\n");
+        return;
+    }
+    std::string manifestText = manifest.Serialize();
+    Sha256 manifestSha;
+    manifestSha.Update(manifestText.data(), manifestText.size());
+    std::wstring manifestSha256 = manifestSha.FinalHex();
+
+    auto load = [](const std::wstring& path, uint64_t size) {
+        auto data = std::make_shared<std::vector<uint8_t>>((size_t)size);
+        File file;
+        size_t bytesRead = 0;
+        if (!file.Open(path, File::Mode::Read) || !file.ReadAt(0, data->data(), data->size(), bytesRead) ||
+            bytesRead != data->size()) {
+            data->clear();
+        }
+        return data;
+    };
+    auto archive = load(newZip, newSize);
+    auto patchArchive = load(patchesZip, patchesSize);
+    if (archive->empty() || patchArchive->empty()) {
+        fprintf(stderr, "Cannot read the update archives\n");
+        return;
+    }
+
+    LoopbackOptions options;
+    options.bytesPerSecond = (uint64_t)(settings.bandwidthMBps * 1024 * 1024);
+    options.latencyMs = settings.latencyMs;
+    options.handshakeMs = settings.handshakeMs;
+    LoopbackServer archiveServer(archive, options);
+    LoopbackServer patchServer(patchArchive, options);
+    LoopbackServer manifestServer(std::make_shared<std::vector<uint8_t>>(manifestText.begin(), manifestText.end()), options);
+    if (!archiveServer.Start() || !patchServer.Start() || !manifestServer.Start()) {
+        fprintf(stderr, "Loopback servers failed to start\n");
+        return;
+    }
+
+    // Release 1 installed before every run
+    auto prepare = [&] {
+        FileSystem::RemoveFile(DownloadJournal::PathFor(downloadPath));
+        FileSystem::RemoveFile(downloadPath);
+        return FileSystem::RemoveTree(installPath) && ZipExtractor::Extract(oldZip, installPath, nullptr, stripRoot);
+    };
+    auto upToDate = [&] {
+        std::vector<size_t> changed;
+        if (!manifest.FindChanged(installPath, 0, changed) || !changed.empty()) {
+            fprintf(stderr, "install differs from the manifest ");
+            return false;
+        }
+        return true;
+    };
+
+    auto transport = std::make_shared<SocketHttpTransport>();
+
+    runner.Run("update.full", prepare, [&](Work& work) {
+        Downloader downloader(transport);
+        work.bytes = manifest.TotalSize();
+        return downloader.DownloadFile(archiveServer.Url(), downloadPath) &&
+               ZipExtractor::Extract(downloadPath, installPath, nullptr, stripRoot) && upToDate();
+    });
+
+    auto delta = [&](const std::wstring& patchesUrl, uint64_t& fetched) {
+        return [&, patchesUrl](Work& work) {
+            DeltaUpdater updater(transport, nullptr);
+            work.bytes = manifest.TotalSize();
+            if (!updater.Update(manifestServer.Url(), manifestSha256, patchesUrl, archiveServer.Url(), installPath,
+                    spoolDirectory)) {
+                return false;
+            }
+            fetched = updater.BytesFetched();
+            return updater.ChangedFiles() > 0 && updater.PatchedFiles() == (patchesUrl.empty() ? 0 : patches.size()) &&
+                   upToDate();
+        };
+    };
+
+    uint64_t deltaFetched = 0;
+    uint64_t patchFetched = 0;
+    runner.Run("update.delta", prepare, delta(L"", deltaFetched));
+    runner.Run("update.patch", prepare, delta(patchServer.Url(), patchFetched));
+    for (auto fetched : { std::make_pair("delta", deltaFetched), std::make_pair("patch", patchFetched) }) {
+        if (fetched.second > 0) {
+            fprintf(stderr, "  update.%s fetched %.2f of %.1f MB\n", fetched.first, fetched.second / 1048576.0,
+                newSize / 1048576.0);
+        }
+    }
+
+    archiveServer.Stop();
+    patchServer.Stop();
+    manifestServer.Stop();
+    prepare();
+    FileSystem::RemoveTree(installPath);
+    FileSystem::RemoveTree(spoolDirectory);
+    FileSystem::RemoveFile(oldZip);
+    FileSystem::RemoveFile(newZip);
+    FileSystem::RemoveFile(patchesZip);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    if (!ParseArguments(argc, argv, settings)) {
+        return 2;
+    }
+    if (settings.workDirectory.empty()) {
+        settings.workDirectory = L"/tmp/InstAnalyticsBench-" + std::to_wstring(getpid());
+    }
+    if (!FileSystem::CreateDirectories(settings.workDirectory)) {
+        fprintf(stderr, "Cannot create %s\n", FileSystem::ToUtf8(settings.workDirectory).c_str());
+        return 2;
+    }
+
+    Runner runner(settings.warmup, settings.iterations, settings.filter);
+
+    DigestBenchmarks(runner, settings);
+
+    // A release archive's two extremes: thousands of small resources, and a
+    // handful of large assemblies
+    {
+        std::vector<SyntheticEntry> tiny;
+        unsigned count = settings.quick ? 1000 : 5000;
+        for (unsigned i = 0; i < count; ++i) {
+            tiny.push_back({ "InstAnalytics/res" + std::to_string(i % 50) + "/file" + std::to_string(i) + ".dat",
+                SyntheticContent(256 + (i * 7919) % 3840, i) });
+        }
+        ExtractBenchmarks(runner, settings, "tiny-files", tiny);
+    }
+    {
+        std::vector<SyntheticEntry> large;
+        size_t size = (settings.quick ? 8 : 32) * 1024 * 1024;
+        for (unsigned i = 0; i < 4; ++i) {
+            large.push_back({ "InstAnalytics/assembly" + std::to_string(i) + ".dll", SyntheticContent(size, 100 + i) });
+        }
+        ExtractBenchmarks(runner, settings, "large-files", large);
+    }
+
+    VerifyBenchmarks(runner, settings);
+    DownloadBenchmarks(runner, settings);
+    MirrorBenchmarks(runner, settings);
+    CancelBenchmarks(runner, settings);
+    UpdateBenchmarks(runner, settings);
+
+    char config[256];
+    snprintf(config, sizeof(config),
+        "{\"warmup\": %u, \"iterations\": %u, \"quick\": %s, \"bandwidthMBps\": %g, \"latencyMs\": %u, "
+        "\"handshakeMs\": %u, \"threads\": %u}",
+        settings.warmup, settings.iterations, settings.quick ? "true" : "false", settings.bandwidthMBps,
+        settings.latencyMs, settings.handshakeMs, ThreadPool::DefaultThreadCount());
+    std::string json = runner.Json(config);
+
+    if (settings.output.empty()) {
+        fputs(json.c_str(), stdout);
+    } else {
+        FILE* file = fopen(settings.output.c_str(), "w");
+        if (!file || fputs(json.c_str(), file) < 0) {
+            fprintf(stderr, "Cannot write %s\n", settings.output.c_str());
+            return 1;
+        }
+        fclose(file);
+    }
+
+    FileSystem::RemoveTree(settings.workDirectory);
+    return runner.AllOk() ? 0 : 1;
+}
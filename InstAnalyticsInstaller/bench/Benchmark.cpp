@@ -0,0 +1,139 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace InstAnalyticsInstaller {
+namespace Bench {
+
+namespace {
+
+std::string Number(double value)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "%.6g", value);
+    return text;
+}
+
+} // namespace
+
+double Result::Min() const
+{
+    return seconds.empty() ? 0 : *std::min_element(seconds.begin(), seconds.end());
+}
+
+double Result::Max() const
+{
+    return seconds.empty() ? 0 : *std::max_element(seconds.begin(), seconds.end());
+}
+
+double Result::Median() const
+{
+    if (seconds.empty()) {
+        return 0;
+    }
+    std::vector<double> sorted = seconds;
+    std::sort(sorted.begin(), sorted.end());
+    size_t middle = sorted.size() / 2;
+    return sorted.size() % 2 ? sorted[middle] : (sorted[middle - 1] + sorted[middle]) / 2;
+}
+
+double Result::Mean() const
+{
+    double total = 0;
+    for (double value : seconds) {
+        total += value;
+    }
+    return seconds.empty() ? 0 : total / seconds.size();
+}
+
+Runner::Runner(unsigned warmup, unsigned iterations, const std::string& filter)
+    : warmup_(warmup)
+    , iterations_(iterations > 0 ? iterations : 1)
+    , filter_(filter)
+{
+}
+
+bool Runner::Selected(const std::string& name) const
+{
+    return filter_.empty() || name.find(filter_) != std::string::npos;
+}
+
+void Runner::Run(const std::string& name, const std::function<bool()>& prepare,
+    const std::function<bool(Work&)>& iteration)
+{
+    if (!Selected(name)) {
+        return;
+    }
+
+    Result result;
+    result.name = name;
+    fprintf(stderr, "%-40s", name.c_str());
+    fflush(stderr);
+
+    for (unsigned run = 0; run < warmup_ + iterations_ && result.ok; ++run) {
+        if (prepare && !prepare()) {
+            result.ok = false;
+            break;
+        }
+
+        Work work;
+        auto start = std::chrono::steady_clock::now();
+        result.ok = iteration(work);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (run >= warmup_) {
+            result.seconds.push_back(work.seconds > 0 ? work.seconds : elapsed);
+            result.work = work;
+        }
+    }
+
+    double median = result.Median();
+    if (!result.ok) {
+        fprintf(stderr, "FAILED\n");
+    } else if (result.work.bytes == 0) {
+        fprintf(stderr, "%10.1f ms\n", median * 1000);
+    } else if (result.work.files > 0) {
+        fprintf(stderr, "%10.1f MB/s %12.0f files/s\n", result.work.bytes / 1048576.0 / median,
+            result.work.files / median);
+    } else {
+        fprintf(stderr, "%10.1f MB/s\n", result.work.bytes / 1048576.0 / median);
+    }
+    results_.push_back(result);
+}
+
+bool Runner::AllOk() const
+{
+    return std::all_of(results_.begin(), results_.end(), [](const Result& result) { return result.ok; });
+}
+
+std::string Runner::Json(const std::string& config) const
+{
+    std::string json = "{\n  \"config\": " + config + ",\n  \"results\": [";
+    for (size_t i = 0; i < results_.size(); ++i) {
+        const Result& result = results_[i];
+        double median = result.Median();
+
+        json += i > 0 ? ",\n    {" : "\n    {";
+        json += "\"name\": \"" + result.name + "\"";
+        json += ", \"ok\": " + std::string(result.ok ? "true" : "false");
+        json += ", \"warmup\": " + std::to_string(warmup_);
+        json += ", \"iterations\": " + std::to_string(result.seconds.size());
+        json += ", \"bytes\": " + std::to_string(result.work.bytes);
+        json += ", \"files\": " + std::to_string(result.work.files);
+        json += ", \"seconds\": {\"min\": " + Number(result.Min()) + ", \"median\": " + Number(median) +
+                ", \"mean\": " + Number(result.Mean()) + ", \"max\": " + Number(result.Max()) + "}";
+        if (result.ok && median > 0 && result.work.bytes > 0) {
+            json += ", \"MBps\": " + Number(result.work.bytes / 1048576.0 / median);
+            if (result.work.files > 0) {
+                json += ", \"filesPerSecond\": " + Number(result.work.files / median);
+            }
+        }
+        json += "}";
+    }
+    json += "\n  ]\n}\n";
+    return json;
+}
+
+} // namespace Bench
+} // namespace InstAnalyticsInstaller
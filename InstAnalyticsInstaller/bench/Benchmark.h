@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+namespace Bench {
+
+// What one timed iteration processed
+struct Work {
+    uint64_t bytes = 0;
+    uint64_t files = 0;
+    // Set by iterations that time a part of themselves (e.g. the latency of
+    // a cancel); 0 = the whole iteration is timed
+    double seconds = 0;
+};
+
+struct Result {
+    std::string name;
+    bool ok = true;
+    Work work;                      // Per iteration
+    std::vector<double> seconds;    // One per measured iteration
+
+    double Min() const;
+    double Median() const;
+    double Mean() const;
+    double Max() const;
+};
+
+// Runs each benchmark warmup + iterations times and keeps the timings of
+// the measured runs. prepare is not timed (e.g. emptying the output folder);
+// an iteration that returns false marks the benchmark failed and stops it
+class Runner {
+public:
+    Runner(unsigned warmup, unsigned iterations, const std::string& filter);
+
+    bool Selected(const std::string& name) const;
+
+    void Run(const std::string& name, const std::function<bool()>& prepare,
+        const std::function<bool(Work&)>& iteration);
+
+    const std::vector<Result>& Results() const { return results_; }
+    bool AllOk() const;
+
+    // {"config": {...}, "results": [...]}; MBps is MiB per second of the median run
+    std::string Json(const std::string& config) const;
+
+private:
+    unsigned warmup_;
+    unsigned iterations_;
+    std::string filter_;
+    std::vector<Result> results_;
+};
+
+} // namespace Bench
+} // namespace InstAnalyticsInstaller
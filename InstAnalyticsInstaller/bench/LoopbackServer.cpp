@@ -0,0 +1,287 @@
+#include "LoopbackServer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace InstAnalyticsInstaller {
+namespace Bench {
+
+namespace {
+
+constexpr size_t SEND_CHUNK = 64 * 1024;
+constexpr size_t MAX_HEADER_SIZE = 16 * 1024;
+
+std::string ToLower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char ch) { return (char)tolower(ch); });
+    return text;
+}
+
+// Value of a request header, lower-cased, or empty
+std::string HeaderValue(const std::string& request, const char* name)
+{
+    std::string lower = ToLower(request);
+    std::string key = std::string("\r\n") + name + ":";
+    size_t start = lower.find(key);
+    if (start == std::string::npos) {
+        return "";
+    }
+    start += key.size();
+    size_t end = lower.find("\r\n", start);
+    std::string value = lower.substr(start, end - start);
+    value.erase(0, value.find_first_not_of(' '));
+    return value;
+}
+
+} // namespace
+
+LoopbackServer::LoopbackServer(std::shared_ptr<const std::vector<uint8_t>> payload, const LoopbackOptions& options)
+    : payload_(payload)
+    , options_(options)
+    , listener_(-1)
+    , port_(0)
+    , stopping_(false)
+    , requests_(0)
+    , connections_(0)
+    , bytesServed_(0)
+{
+}
+
+LoopbackServer::~LoopbackServer()
+{
+    Stop();
+}
+
+bool LoopbackServer::Start()
+{
+    listener_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener_ < 0) {
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+
+    socklen_t length = sizeof(address);
+    if (bind(listener_, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener_, 64) != 0 ||
+        getsockname(listener_, (sockaddr*)&address, &length) != 0) {
+        close(listener_);
+        listener_ = -1;
+        return false;
+    }
+
+    port_ = ntohs(address.sin_port);
+    acceptThread_ = std::thread(&LoopbackServer::AcceptLoop, this);
+    return true;
+}
+
+void LoopbackServer::Stop()
+{
+    if (listener_ < 0) {
+        return;
+    }
+
+    // shutdown() wakes the threads blocked in accept() and recv()
+    stopping_ = true;
+    shutdown(listener_, SHUT_RDWR);
+    acceptThread_.join();
+    close(listener_);
+    listener_ = -1;
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(clientsMutex_);
+        for (int client : clients_) {
+            shutdown(client, SHUT_RDWR);
+        }
+        threads.swap(clientThreads_);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+std::wstring LoopbackServer::Url() const
+{
+    return L"http://127.0.0.1:" + std::to_wstring(port_) + L"/payload.bin";
+}
+
+std::wstring LoopbackServer::RedirectUrl() const
+{
+    return L"http://127.0.0.1:" + std::to_wstring(port_) + L"/redirect/payload.bin";
+}
+
+void LoopbackServer::AcceptLoop()
+{
+    while (!stopping_) {
+        int client = accept(listener_, nullptr, nullptr);
+        if (client < 0) {
+            if (stopping_) {
+                return;
+            }
+            continue;
+        }
+
+        int noDelay = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        ++connections_;
+        std::lock_guard<std::mutex> lock(clientsMutex_);
+        clients_.push_back(client);
+        clientThreads_.emplace_back(&LoopbackServer::Serve, this, client);
+    }
+}
+
+void LoopbackServer::Serve(int client)
+{
+    if (options_.handshakeMs > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(options_.handshakeMs));
+    }
+
+    std::string pending;
+    char buffer[4096];
+    bool keepAlive = true;
+
+    while (keepAlive && !stopping_) {
+        size_t end;
+        while ((end = pending.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+            if (received <= 0 || pending.size() > MAX_HEADER_SIZE) {
+                keepAlive = false;
+                break;
+            }
+            pending.append(buffer, (size_t)received);
+        }
+        if (!keepAlive) {
+            break;
+        }
+
+        std::string request = pending.substr(0, end + 2);
+        pending.erase(0, end + 4);
+        ++requests_;
+        if (!Respond(client, request, keepAlive)) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(clientsMutex_);
+    clients_.erase(std::remove(clients_.begin(), clients_.end(), client), clients_.end());
+    close(client);
+}
+
+bool LoopbackServer::Respond(int client, const std::string& request, bool& keepAlive)
+{
+    // A server that went down drops every connection, including this one
+    if (Down()) {
+        return false;
+    }
+
+    keepAlive = HeaderValue(request, "connection") != "close";
+    bool head = request.compare(0, 5, "HEAD ") == 0;
+
+    if (options_.latencyMs > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(options_.latencyMs));
+    }
+
+    size_t pathStart = request.find(' ') + 1;
+    if (request.compare(pathStart, 10, "/redirect/") == 0) {
+        const char redirect[] = "HTTP/1.1 302 Found\r\nLocation: /payload.bin\r\nContent-Length: 0\r\n\r\n";
+        return SendAll(client, redirect, sizeof(redirect) - 1);
+    }
+
+    const std::vector<uint8_t>& payload = *payload_;
+    uint64_t total = payload.size();
+    uint64_t first = 0;
+    uint64_t last = total - 1;
+    bool partial = false;
+
+    // "bytes=first-" or "bytes=first-last"; anything else gets the whole payload
+    std::string range = HeaderValue(request, "range");
+    if (options_.ranges && range.compare(0, 6, "bytes=") == 0) {
+        char* next = nullptr;
+        uint64_t start = strtoull(range.c_str() + 6, &next, 10);
+        if (next && *next == '-' && start < total) {
+            first = start;
+            if (next[1] != '\0') {
+                last = std::min<uint64_t>(strtoull(next + 1, nullptr, 10), total - 1);
+            }
+            partial = last >= first;
+        }
+        if (!partial) {
+            first = 0;
+            last = total - 1;
+        }
+    }
+
+    uint64_t length = last - first + 1;
+    char header[512];
+    int headerSize = snprintf(header, sizeof(header),
+        "HTTP/1.1 %s\r\n"
+        "Content-Length: %llu\r\n"
+        "%s"
+        "%s"
+        "ETag: \"bench\"\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        partial ? "206 Partial Content" : "200 OK",
+        (unsigned long long)length,
+        options_.ranges ? "Accept-Ranges: bytes\r\n" : "",
+        partial ? ("Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" +
+                   std::to_string(total) + "\r\n").c_str() : "",
+        keepAlive ? "keep-alive" : "close");
+
+    if (!SendAll(client, header, (size_t)headerSize)) {
+        return false;
+    }
+    if (head) {
+        return true;
+    }
+
+    // Throttled bodies go out in paced chunks: the rate is held per connection
+    auto start = std::chrono::steady_clock::now();
+    uint64_t sent = 0;
+    while (sent < length && !stopping_) {
+        size_t chunk = (size_t)std::min<uint64_t>(SEND_CHUNK, length - sent);
+        if (!SendAll(client, (const char*)payload.data() + first + sent, chunk)) {
+            return false;
+        }
+        sent += chunk;
+        bytesServed_ += chunk;
+        if (Down()) {
+            return false;
+        }
+
+        if (options_.bytesPerSecond > 0) {
+            auto due = start + std::chrono::microseconds(sent * 1000000 / options_.bytesPerSecond);
+            std::this_thread::sleep_until(due);
+        }
+    }
+    return sent == length;
+}
+
+bool LoopbackServer::SendAll(int client, const char* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t sent = send(client, data, size, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+} // namespace Bench
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+namespace Bench {
+
+struct LoopbackOptions {
+    uint64_t bytesPerSecond = 0;    // Per connection; 0 = as fast as loopback goes
+    unsigned latencyMs = 0;         // Added before every response
+    unsigned handshakeMs = 0;       // Added once per connection, like TCP and TLS setup
+    bool ranges = true;             // Accept-Ranges and 206 responses
+    uint64_t failAfterBytes = 0;    // Body bytes served before the server goes down; 0 = never
+};
+
+// HTTP/1.1 server on 127.0.0.1 serving one payload at any path, with
+// keep-alive, HEAD, single ranges, an ETag and optional throttling.
+// Paths under /redirect/ answer 302 to the payload, like release links.
+// Stands in for the release CDN (or one of its mirrors, failAfterBytes
+// making it one that dies mid-download) so downloads can be timed
+// reproducibly
+class LoopbackServer {
+public:
+    LoopbackServer(std::shared_ptr<const std::vector<uint8_t>> payload, const LoopbackOptions& options);
+    ~LoopbackServer();
+
+    LoopbackServer(const LoopbackServer&) = delete;
+    LoopbackServer& operator=(const LoopbackServer&) = delete;
+
+    bool Start();       // Binds an ephemeral port
+    void Stop();
+
+    std::wstring Url() const;
+    std::wstring RedirectUrl() const;
+    uint64_t Requests() const { return requests_; }
+    uint64_t Connections() const { return connections_; }
+    uint64_t BytesServed() const { return bytesServed_; }
+
+    // Back up after failAfterBytes, with the count starting over
+    void Revive() { bytesServed_ = 0; }
+
+private:
+    void AcceptLoop();
+    void Serve(int client);
+    bool Respond(int client, const std::string& request, bool& keepAlive);
+    bool SendAll(int client, const char* data, size_t size);
+    bool Down() const { return options_.failAfterBytes > 0 && bytesServed_ >= options_.failAfterBytes; }
+
+    std::shared_ptr<const std::vector<uint8_t>> payload_;
+    LoopbackOptions options_;
+    int listener_;
+    unsigned short port_;
+    std::atomic<bool> stopping_;
+    std::atomic<uint64_t> requests_;
+    std::atomic<uint64_t> connections_;
+    std::atomic<uint64_t> bytesServed_;
+    std::thread acceptThread_;
+
+    std::mutex clientsMutex_;
+    std::vector<int> clients_;
+    std::vector<std::thread> clientThreads_;
+};
+
+} // namespace Bench
+} // namespace InstAnalyticsInstaller
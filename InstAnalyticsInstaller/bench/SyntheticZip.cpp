@@ -0,0 +1,284 @@
+#include "SyntheticZip.h"
+#include "Crc32.h"
+#include "FileSystem.h"
+#include <algorithm>
+#include <cstring>
+
+namespace InstAnalyticsInstaller {
+namespace Bench {
+
+namespace {
+
+constexpr size_t WINDOW_SIZE = 32768;
+constexpr size_t MIN_MATCH = 4;     // The hash covers four bytes
+constexpr size_t MAX_MATCH = 258;
+constexpr unsigned HASH_BITS = 15;
+
+const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out)
+        : out_(out)
+        , bits_(0)
+        , count_(0)
+    {
+    }
+
+    // Extra bits and header fields: least significant bit first
+    void Put(uint32_t value, unsigned count)
+    {
+        bits_ |= (uint64_t)value << count_;
+        count_ += count;
+        while (count_ >= 8) {
+            out_.push_back((uint8_t)bits_);
+            bits_ >>= 8;
+            count_ -= 8;
+        }
+    }
+
+    // Huffman codes: most significant bit first
+    void PutCode(uint32_t code, unsigned length)
+    {
+        uint32_t reversed = 0;
+        for (unsigned i = 0; i < length; ++i) {
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        }
+        Put(reversed, length);
+    }
+
+    void Flush()
+    {
+        if (count_ > 0) {
+            out_.push_back((uint8_t)bits_);
+        }
+        bits_ = 0;
+        count_ = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    uint64_t bits_;
+    unsigned count_;
+};
+
+void PutLiteralLength(BitWriter& writer, unsigned symbol)
+{
+    if (symbol < 144) {
+        writer.PutCode(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        writer.PutCode(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        writer.PutCode(symbol - 256, 7);
+    } else {
+        writer.PutCode(0xC0 + symbol - 280, 8);
+    }
+}
+
+void PutMatch(BitWriter& writer, size_t length, size_t distance)
+{
+    unsigned code = 28;
+    while (LENGTH_BASE[code] > length) {
+        --code;
+    }
+    PutLiteralLength(writer, 257 + code);
+    writer.Put((uint32_t)(length - LENGTH_BASE[code]), LENGTH_EXTRA[code]);
+
+    unsigned distanceCode = 29;
+    while (DISTANCE_BASE[distanceCode] > distance) {
+        --distanceCode;
+    }
+    writer.PutCode(distanceCode, 5);
+    writer.Put((uint32_t)(distance - DISTANCE_BASE[distanceCode]), DISTANCE_EXTRA[distanceCode]);
+}
+
+uint32_t Hash(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void Put16(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back((uint8_t)value);
+    out.push_back((uint8_t)(value >> 8));
+}
+
+void Put32(std::vector<uint8_t>& out, uint32_t value)
+{
+    Put16(out, value & 0xFFFF);
+    Put16(out, value >> 16);
+}
+
+} // namespace
+
+std::vector<uint8_t> DeflateEncoder::Compress(const uint8_t* data, size_t size)
+{
+    std::vector<uint8_t> out;
+    out.reserve(size / 2 + 64);
+    BitWriter writer(out);
+
+    // One final block with the fixed codes
+    writer.Put(1, 1);
+    writer.Put(1, 2);
+
+    std::vector<int64_t> head((size_t)1 << HASH_BITS, -1);
+    size_t position = 0;
+    while (position < size) {
+        size_t length = 0;
+        size_t distance = 0;
+
+        if (position + MIN_MATCH <= size) {
+            uint32_t hash = Hash(data + position);
+            int64_t candidate = head[hash];
+            head[hash] = (int64_t)position;
+
+            if (candidate >= 0 && position - (size_t)candidate <= WINDOW_SIZE) {
+                size_t limit = std::min(MAX_MATCH, size - position);
+                while (length < limit && data[candidate + length] == data[position + length]) {
+                    ++length;
+                }
+                distance = position - (size_t)candidate;
+            }
+        }
+
+        if (length >= MIN_MATCH) {
+            PutMatch(writer, length, distance);
+            // Index the skipped positions too, or long runs never match again
+            for (size_t i = 1; i < length && position + i + MIN_MATCH <= size; ++i) {
+                head[Hash(data + position + i)] = (int64_t)(position + i);
+            }
+            position += length;
+        } else {
+            PutLiteralLength(writer, data[position]);
+            ++position;
+        }
+    }
+
+    PutLiteralLength(writer, 256);
+    writer.Flush();
+    return out;
+}
+
+uint64_t WriteZip(const std::wstring& path, const std::vector<SyntheticEntry>& entries, bool deflate)
+{
+    File file;
+    if (!file.Open(path, File::Mode::Write)) {
+        return 0;
+    }
+
+    std::vector<uint8_t> central;
+    uint64_t offset = 0;
+
+    for (const auto& entry : entries) {
+        uint32_t crc = Crc32::Update(0, entry.data.data(), entry.data.size());
+        std::vector<uint8_t> compressed;
+        uint16_t method = 0;
+        if (deflate && !entry.data.empty()) {
+            compressed = DeflateEncoder::Compress(entry.data.data(), entry.data.size());
+            method = 8;
+        }
+        const std::vector<uint8_t>& payload = method == 8 ? compressed : entry.data;
+
+        std::vector<uint8_t> local;
+        Put32(local, 0x04034b50);
+        Put16(local, 20);                       // Version needed
+        Put16(local, 0x0800);                   // UTF-8 names
+        Put16(local, method);
+        Put16(local, 0);                        // Time
+        Put16(local, 0x21);                     // Date: 1980-01-01
+        Put32(local, crc);
+        Put32(local, (uint32_t)payload.size());
+        Put32(local, (uint32_t)entry.data.size());
+        Put16(local, (uint32_t)entry.name.size());
+        Put16(local, 0);
+        local.insert(local.end(), entry.name.begin(), entry.name.end());
+
+        Put32(central, 0x02014b50);
+        Put16(central, 20);                     // Version made by
+        Put16(central, 20);
+        Put16(central, 0x0800);
+        Put16(central, method);
+        Put16(central, 0);
+        Put16(central, 0x21);
+        Put32(central, crc);
+        Put32(central, (uint32_t)payload.size());
+        Put32(central, (uint32_t)entry.data.size());
+        Put16(central, (uint32_t)entry.name.size());
+        Put16(central, 0);                      // Extra
+        Put16(central, 0);                      // Comment
+        Put16(central, 0);                      // Disk
+        Put16(central, 0);                      // Internal attributes
+        Put32(central, 0);                      // External attributes
+        Put32(central, (uint32_t)offset);
+        central.insert(central.end(), entry.name.begin(), entry.name.end());
+
+        if (!file.Write(local.data(), local.size()) || !file.Write(payload.data(), payload.size())) {
+            return 0;
+        }
+        offset += local.size() + payload.size();
+    }
+
+    std::vector<uint8_t> end;
+    Put32(end, 0x06054b50);
+    Put16(end, 0);
+    Put16(end, 0);
+    Put16(end, (uint32_t)entries.size());
+    Put16(end, (uint32_t)entries.size());
+    Put32(end, (uint32_t)central.size());
+    Put32(end, (uint32_t)offset);
+    Put16(end, 0);
+
+    if (!file.Write(central.data(), central.size()) || !file.Write(end.data(), end.size())) {
+        return 0;
+    }
+    return offset + central.size() + end.size();
+}
+
+std::vector<uint8_t> SyntheticContent(size_t size, uint64_t seed)
+{
+    static const char* const WORDS[] = { "System", "Runtime", "Collections", "Generic", "Linq",
+        "Threading", "Tasks", "InstAnalytics", "Instagram", "Analytics", "Microsoft", "Extensions",
+        "public", "static", "async", "Task", "string", "return", "await", "private" };
+    const size_t wordCount = sizeof(WORDS) / sizeof(WORDS[0]);
+
+    std::vector<uint8_t> data;
+    data.reserve(size);
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    auto next = [&state] {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    };
+
+    // Runs of identifiers (compressible) between runs of noise (not)
+    while (data.size() < size) {
+        uint64_t pick = next();
+        if (pick % 4 == 0) {
+            for (int i = 0; i < 24 && data.size() < size; ++i) {
+                data.push_back((uint8_t)next());
+            }
+        } else {
+            const char* word = WORDS[(pick >> 8) % wordCount];
+            for (const char* c = word; *c && data.size() < size; ++c) {
+                data.push_back((uint8_t)*c);
+            }
+            if (data.size() < size) {
+                data.push_back('.');
+            }
+        }
+    }
+    return data;
+}
+
+} // namespace Bench
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+namespace Bench {
+
+// Raw deflate (RFC 1951) with the fixed Huffman codes and greedy LZ77
+// matching: far from zlib's ratio, but real back-references and real
+// Huffman codes, which is what the inflater's speed depends on
+class DeflateEncoder {
+public:
+    static std::vector<uint8_t> Compress(const uint8_t* data, size_t size);
+};
+
+struct SyntheticEntry {
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+// Writes a plain ZIP (no ZIP64, no data descriptors) of the given entries,
+// deflated or stored. Returns the archive size, 0 on failure
+uint64_t WriteZip(const std::wstring& path, const std::vector<SyntheticEntry>& entries, bool deflate);
+
+// Deterministic contents, partly compressible like the binaries and
+// resources in a release archive
+std::vector<uint8_t> SyntheticContent(size_t size, uint64_t seed);
+
+} // namespace Bench
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "CancellationToken.h"
+#include "FileSystem.h"
+#include "SpscQueue.h"
+
+namespace InstAnalyticsInstaller {
+
+// Moves disk writes off the network thread. The producer fills buffers from
+// a fixed pool of large aligned buffers and submits each with its file
+// offset; a dedicated writer thread performs the positional writes in
+// submission order and hands the buffers back. While buffers are queued the
+// receive loop keeps going, so a slow or scanned disk no longer stalls it.
+class AsyncFileWriter {
+public:
+    // Runs on the writer thread once a block is on disk
+    using WrittenCallback = std::function<void(uint64_t offset, const uint8_t* data, size_t size)>;
+
+    static constexpr size_t MIN_BUFFER_SIZE = 64 * 1024;
+    static constexpr size_t BUFFER_ALIGNMENT = 4096;
+
+    // Once cancel fires the queued blocks are dropped instead of written and
+    // the writer reports failure: BytesWritten() stays the prefix on disk
+    AsyncFileWriter(File& file, size_t bufferCount, size_t bufferSize, WrittenCallback onWritten = nullptr,
+        const CancellationToken* cancel = nullptr);
+    ~AsyncFileWriter();
+
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    // Producer side. Acquire returns the buffer to fill (waiting while all of
+    // them are queued), or nullptr once a write has failed. Fill up to
+    // TargetSize() bytes, which follows the measured receive rate so each
+    // block holds a few tens of milliseconds of data.
+    uint8_t* Acquire();
+    size_t TargetSize() const { return targetSize_; }
+
+    // Queues the first size bytes of the acquired buffer for offset; 0 keeps the buffer
+    bool Submit(uint64_t offset, size_t size);
+
+    // Waits for every queued write and stops the writer thread
+    bool Finish();
+
+    // Bytes already on disk, in submission order
+    uint64_t BytesWritten() const { return bytesWritten_.load(std::memory_order_acquire); }
+    bool Failed() const { return failed_.load(std::memory_order_acquire); }
+
+private:
+    struct Block {
+        size_t buffer;
+        uint64_t offset;
+        size_t size;
+    };
+
+    void WriterLoop();
+    void AdaptTargetSize(size_t size);
+
+    File& file_;
+    WrittenCallback onWritten_;
+    const CancellationToken* cancel_;
+    size_t bufferSize_;
+    std::vector<uint8_t*> buffers_;
+
+    SpscQueue<Block> filled_;       // Producer -> writer
+    SpscQueue<size_t> free_;        // Writer -> producer
+
+    // Producer-only state
+    static constexpr size_t NO_BUFFER = (size_t)-1;
+    size_t current_;
+    size_t targetSize_;
+    std::chrono::steady_clock::time_point fillStart_;
+    bool finished_;
+
+    std::atomic<uint64_t> bytesWritten_;
+    std::atomic<bool> failed_;
+    std::thread writer_;
+};
+
+} // namespace InstAnalyticsInstaller
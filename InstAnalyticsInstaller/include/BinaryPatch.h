@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CancellationToken.h"
+#include "Sha256.h"
+#include "Stream.h"
+#include "ZipArchive.h"
+
+namespace InstAnalyticsInstaller {
+
+// Binary delta from one version of a file to the next, in the bsdiff
+// layout: the target is rebuilt from runs of base bytes plus small
+// corrections (mostly zeros where code only moved) and runs of new bytes.
+// Patches are stored deflated in a patch archive, which is where the zeros
+// go away. Little-endian:
+//
+//   "IAPATCH1"  base size (8)  base SHA-256 (32)  target size (8)  target SHA-256 (32)
+//   then until the target is complete, records of
+//   diff length (8)  extra length (8)  seek (8, signed)
+//   <diff length bytes added to the base>  <extra length bytes copied as is>
+//
+// The records come in the order they are applied, so a patch can be applied
+// while it is being inflated, with no temporary copy of the patch itself
+class BinaryPatch {
+public:
+    static constexpr size_t HEADER_SIZE = 8 + 8 + Sha256::DIGEST_SIZE + 8 + Sha256::DIGEST_SIZE;
+    static constexpr size_t RECORD_SIZE = 24;
+
+    // Patch turning base into target (release tooling, benchmarks). Files up
+    // to 2 GB; the suffix sort needs about 12 bytes per base byte
+    static bool Create(const std::vector<uint8_t>& base, const std::vector<uint8_t>& target,
+        std::vector<uint8_t>& patch);
+
+    // A patch archive holds one entry per file and base version:
+    // "<path>.<base sha256>.patch", path as in the release manifest
+    static std::wstring EntryName(const std::wstring& path, const std::wstring& baseSha256);
+    static bool ParseEntryName(const std::wstring& name, std::wstring& path, std::wstring& baseSha256);
+
+    // Inflates one patch entry into a PatchApplier; targetPath (which may
+    // be basePath) is only written once the result checks out.
+    // expectedSha256 (manifest) is checked on top of the patch's own hash
+    static bool ApplyEntry(const ZipArchive& archive, RandomAccessInput& input, const ZipEntry& entry,
+        const std::wstring& basePath, const std::wstring& targetPath, const std::wstring& expectedSha256 = L"",
+        const CancellationToken* cancel = nullptr);
+
+    // Applies every patch of a local patch archive whose base is what is
+    // installed; the others (other versions, files not installed) are
+    // skipped. The results go to a StagedInstall, with the other installed
+    // files carried over, and the whole is switched in only once every patch
+    // applied and checked out: a patch that fails leaves the install as it
+    // was, and a rollback puts back the version that was patched
+    static bool ApplyArchive(const std::wstring& archivePath, const std::wstring& installPath,
+        std::function<void(int progress, const std::wstring& file)> callback = nullptr,
+        const CancellationToken* cancel = nullptr, size_t* applied = nullptr);
+};
+
+// Applies a patch as its bytes are written in. The target goes to a
+// temporary file beside targetPath, hashed on the way; Finish checks size
+// and hash, then renames it over targetPath. targetPath may be basePath.
+// Anything else leaves targetPath untouched and removes the temporary file
+class PatchApplier : public OutputStream {
+public:
+    PatchApplier(const std::wstring& basePath, const std::wstring& targetPath,
+        const CancellationToken* cancel = nullptr);
+    ~PatchApplier() override;
+
+    PatchApplier(const PatchApplier&) = delete;
+    PatchApplier& operator=(const PatchApplier&) = delete;
+
+    bool Write(const void* data, size_t size) override;
+
+    // After the last byte of the patch. expectedSha256 (optional) must also match
+    bool Finish(const std::wstring& expectedSha256 = L"");
+
+    uint64_t TargetSize() const { return targetSize_; }
+
+private:
+    // Complete: the whole target is out, waiting for Finish
+    enum class State { Header, Record, Diff, Extra, Complete, Finished, Failed };
+
+    static constexpr size_t BUFFER_SIZE = 256 * 1024;
+
+    bool ParseHeader();
+    bool ParseRecord();
+    bool ApplyDiff(const uint8_t* data, size_t size);
+    bool Output(const uint8_t* data, size_t size);
+    bool Flush();
+    bool Fail();
+
+    std::wstring basePath_;
+    std::wstring targetPath_;
+    std::wstring tempPath_;
+    const CancellationToken* cancel_;
+
+    std::unique_ptr<FileInput> base_;
+    File output_;
+    Sha256 sha_;
+    std::vector<uint8_t> buffer_;       // Output not yet written
+    std::vector<uint8_t> baseBytes_;
+
+    State state_;
+    uint8_t pending_[BinaryPatch::HEADER_SIZE];     // Header or record being assembled
+    size_t pendingSize_;
+
+    uint64_t baseSize_;
+    uint8_t targetSha_[Sha256::DIGEST_SIZE];
+    uint64_t targetSize_;
+    uint64_t produced_;
+    uint64_t basePosition_;
+    uint64_t diffLeft_;
+    uint64_t extraLeft_;
+    int64_t seek_;
+};
+
+} // namespace InstAnalyticsInstaller
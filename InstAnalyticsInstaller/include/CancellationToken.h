@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace InstAnalyticsInstaller {
+
+// One-shot cancellation shared by every stage of an installation: a flag
+// that loops check between chunks, and a handle that is signalled on
+// Cancel() so blocking waits (sockets, the SDK setup process) can wait on it
+// beside their own handle and wake at once. A cancelled token stays cancelled
+class CancellationToken {
+public:
+    CancellationToken();
+    ~CancellationToken();
+
+    CancellationToken(const CancellationToken&) = delete;
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    void Cancel();
+    bool IsCancelled() const { return cancelled_.load(std::memory_order_acquire); }
+
+    // Sleeps for up to timeout; true as soon as the token is cancelled
+    bool WaitFor(std::chrono::milliseconds timeout) const;
+
+#ifdef _WIN32
+    // Manual-reset event, for WaitForMultipleObjects
+    void* WaitHandle() const { return event_; }
+#else
+    // Read end of a pipe that turns readable on Cancel(), for poll()
+    int WaitHandle() const { return pipe_[0]; }
+#endif
+
+private:
+    std::atomic<bool> cancelled_;
+#ifdef _WIN32
+    void* event_;
+#else
+    int pipe_[2];
+#endif
+};
+
+} // namespace InstAnalyticsInstaller
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace InstAnalyticsInstaller {
 
@@ -19,8 +20,60 @@ namespace URLs {
     const std::wstring DOTNET_X64 = L"https://builds.dotnet.microsoft.com/dotnet/Sdk/10.0.100/dotnet-sdk-10.0.100-win-x64.exe";
     const std::wstring DOTNET_X86 = L"https://builds.dotnet.microsoft.com/dotnet/Sdk/10.0.100/dotnet-sdk-10.0.100-win-x86.exe";
     const std::wstring INSTANALYTICS_ZIP = L"https://github.com/FabiodAgostino/InstAnalytics/releases/download/release/InstAnalytics.1.0.0.zip";
+    // Per-file manifest published beside the archive (see ReleaseManifest):
+    // upgrades fetch only the entries that changed. Without it they
+    // download the whole archive
+    const std::wstring INSTANALYTICS_MANIFEST = L"https://github.com/FabiodAgostino/InstAnalytics/releases/download/release/InstAnalytics.1.0.0.manifest";
+    // Binary patches from earlier versions (see BinaryPatch); optional
+    const std::wstring INSTANALYTICS_PATCHES = L"https://github.com/FabiodAgostino/InstAnalytics/releases/download/release/InstAnalytics.1.0.0.patches.zip";
 }
 
+// Further copies of each download (internal mirrors), raced against the URL
+// above: the fastest ones serve most of the ranges and the others take over
+// when one fails. They must serve exactly the same file
+namespace Mirrors {
+    const std::vector<std::wstring> DOTNET_X64 = {};
+    const std::vector<std::wstring> DOTNET_X86 = {};
+    const std::vector<std::wstring> INSTANALYTICS_ZIP = {};
+}
+
+// Expected SHA-256 (hex) of each download, checked while the file is written.
+// An empty digest skips the check and the run reports a warning for it; the
+// SDK setup then only runs with Microsoft's signature. Development builds
+// accept that: with INSTANALYTICS_DISTRIBUTION (see CMakeLists.txt) the
+// build fails until every one holds the release hash
+namespace Digests {
+    constexpr wchar_t DOTNET_X64[] = L"";
+    constexpr wchar_t DOTNET_X86[] = L"";
+    constexpr wchar_t INSTANALYTICS_ZIP[] = L"";
+    // Pins the manifest, which in turn vouches for every file an upgrade
+    // fetches by range or patches: without it whoever serves the manifest
+    // decides what gets installed. A manifest that differs is not used
+    // and the whole archive is installed (and checked) instead; so it is
+    // while this is empty, with a warning
+    constexpr wchar_t INSTANALYTICS_MANIFEST[] = L"";
+
+    // 64 hex digits
+    constexpr bool IsPinned(const wchar_t* digest)
+    {
+        size_t length = 0;
+        for (; digest[length] != L'\0'; ++length) {
+            wchar_t c = digest[length];
+            if (!((c >= L'0' && c <= L'9') || (c >= L'a' && c <= L'f') || (c >= L'A' && c <= L'F'))) {
+                return false;
+            }
+        }
+        return length == 64;
+    }
+}
+
+#ifdef INSTANALYTICS_DISTRIBUTION
+static_assert(Digests::IsPinned(Digests::DOTNET_X64), "Digests::DOTNET_X64 must hold the SDK installer's SHA-256");
+static_assert(Digests::IsPinned(Digests::DOTNET_X86), "Digests::DOTNET_X86 must hold the SDK installer's SHA-256");
+static_assert(Digests::IsPinned(Digests::INSTANALYTICS_ZIP), "Digests::INSTANALYTICS_ZIP must hold the release archive's SHA-256");
+static_assert(Digests::IsPinned(Digests::INSTANALYTICS_MANIFEST), "Digests::INSTANALYTICS_MANIFEST must hold the release manifest's SHA-256");
+#endif
+
 // Application info
 namespace AppInfo {
     const std::wstring NAME = L"InstAnalytics Installer";
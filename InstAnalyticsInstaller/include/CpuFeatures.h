@@ -0,0 +1,33 @@
+#pragma once
+
+namespace InstAnalyticsInstaller {
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define INSTANALYTICS_X86 1
+#endif
+
+// GCC and Clang only emit an extension's instructions in functions marked
+// for it; MSVC emits any intrinsic anywhere
+#if defined(__GNUC__)
+#define INSTANALYTICS_TARGET(features) __attribute__((target(features)))
+#else
+#define INSTANALYTICS_TARGET(features)
+#endif
+
+// The x86 extensions the hashing kernels use, detected once with CPUID.
+// On other architectures everything is false and the portable code runs
+struct CpuFeatures {
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool pclmul = false;    // Carry-less multiply: CRC-32 folding
+    bool sha = false;       // SHA-NI: SHA-256 rounds
+
+    // The detected features, or none while acceleration is disabled
+    static const CpuFeatures& Get();
+
+    // Benchmarks and reference checks compare the kernels with the portable
+    // code by turning them off; not meant to change while hashing
+    static void SetAccelerationEnabled(bool enabled);
+};
+
+} // namespace InstAnalyticsInstaller
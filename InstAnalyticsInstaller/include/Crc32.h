@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace InstAnalyticsInstaller {
+
+// CRC-32 (IEEE 802.3, as used by ZIP). Update takes and returns the
+// finalized value, so Update(Update(0, a), b) == Update(0, a + b).
+// Runs of 64 bytes or more are folded with carry-less multiplies where the
+// CPU has them (PCLMULQDQ), 16 bytes per instruction pair.
+class Crc32 {
+public:
+    static uint32_t Update(uint32_t crc, const void* data, size_t size);
+
+    // Slicing-by-8 tables only: the fallback, and the folding's reference
+    static uint32_t UpdatePortable(uint32_t crc, const void* data, size_t size);
+};
+
+} // namespace InstAnalyticsInstaller
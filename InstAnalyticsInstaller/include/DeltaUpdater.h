@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <string>
+#include "CancellationToken.h"
+#include "Downloader.h"
+#include "HttpTransport.h"
+
+namespace InstAnalyticsInstaller {
+
+class ReleaseManifest;
+class StagedInstall;
+
+// Upgrades an existing install file by file. The release manifest is
+// compared with what is on disk (hashed on every core), then only the
+// entries that differ are read from the remote archive: its central
+// directory first, then just those entries' bytes, with range requests.
+// When the release also publishes a patch archive (see BinaryPatch), a
+// changed file whose installed version has a patch there gets the patch
+// instead. An upgrade costs the size of what changed, not the size of the
+// release
+class DeltaUpdater {
+public:
+    // Parallel range requests while fetching the changed entries
+    static constexpr unsigned CONNECTIONS = 4;
+
+    DeltaUpdater(std::shared_ptr<HttpTransport> transport, std::shared_ptr<CancellationToken> cancel);
+
+    // True once installPath matches the manifest. False when no delta
+    // applies (nothing installed yet, no manifest, a server without ranges,
+    // an archive that disagrees with the manifest) and on failures: the
+    // caller then installs the whole archive, unless the token was
+    // cancelled or InsufficientSpace() is set. A manifest that does not
+    // match manifestSha256 is not used either, and none is without it.
+    // Installed files the manifest does not list are removed by the switch.
+    // patchesUrl may be empty or missing on the server. workDirectory holds
+    // the fetched spans while they are applied
+    bool Update(const std::wstring& manifestUrl, const std::wstring& manifestSha256, const std::wstring& patchesUrl,
+        const std::wstring& archiveUrl, const std::wstring& installPath, const std::wstring& workDirectory,
+        ProgressCallback callback = nullptr);
+
+    // Workers inflating the fetched entries: 1 = serial, 0 = one per hardware thread
+    void SetExtractThreads(unsigned threadCount) { extractThreads_ = threadCount; }
+
+    bool InsufficientSpace() const { return insufficientSpace_; }
+    // The last Update replaced the install (it may also have found it up to date)
+    bool Switched() const { return switched_; }
+
+    // What the last Update found and fetched
+    size_t ChangedFiles() const { return changedFiles_; }
+    size_t PatchedFiles() const { return patchedFiles_; }
+    uint64_t BytesFetched() const { return bytesFetched_; }
+    uint64_t ArchiveSize() const { return archiveSize_; }
+
+private:
+    // Carries the unchanged files the manifest lists over and switches
+    bool Switch(StagedInstall& staged, const ReleaseManifest& manifest, const std::set<std::wstring>& rebuilt);
+
+    std::shared_ptr<HttpTransport> transport_;
+    std::shared_ptr<CancellationToken> cancel_;
+    std::atomic<bool> insufficientSpace_;
+    unsigned extractThreads_;
+    bool switched_;
+    size_t changedFiles_;
+    size_t patchedFiles_;
+    uint64_t bytesFetched_;
+    uint64_t archiveSize_;
+};
+
+} // namespace InstAnalyticsInstaller
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <windows.h>
 
 namespace InstAnalyticsInstaller {
@@ -16,13 +17,22 @@ public:
     static bool IsDotNet10Installed();
     static Architecture GetSystemArchitecture();
     static std::wstring GetDotNetDownloadUrl();
+    static std::vector<std::wstring> GetDotNetMirrors();
+    static std::wstring GetDotNetDownloadSha256();
+    // Valid Authenticode signature (chain and revocation checked) whose
+    // signer is Microsoft Corporation
+    static bool IsSignedByMicrosoft(const std::wstring& path);
     static bool VerifyAndFixDotNetPath();
 
 private:
     static bool CheckRegistryForDotNet();
-    static bool CheckCommandLineForDotNet();
+    static bool CheckCommandLineForDotNet(const wchar_t* command);
     static bool AddDotNetToPath();
     static std::wstring FindDotNetInstallPath();
+    // Install folders worth scanning for sdk\<version>: known locations,
+    // DOTNET_ROOT and the setup's InstallLocation registry values
+    static std::vector<std::wstring> FindDotNetRoots();
+    static std::vector<std::wstring> PathDirectories();
 };
 
 } // namespace InstAnalyticsInstaller
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+
+struct CacheEntry {
+    std::wstring url;
+    std::wstring sha256;        // Content hash, also the blob's file name
+    std::wstring etag;
+    std::wstring lastModified;
+    uint64_t size = 0;
+    uint64_t lastUsed = 0;      // Use sequence number, higher = more recent
+};
+
+// Persistent download cache shared by installer runs. Payloads are stored
+// once per content hash under "<directory>/objects"; an index maps each URL
+// to its blob and the validators needed for a conditional GET. When the
+// blobs outgrow maxBytes the least recently used ones are evicted.
+class DownloadCache {
+public:
+    static constexpr uint64_t DEFAULT_MAX_BYTES = 2ull * 1024 * 1024 * 1024;
+
+    explicit DownloadCache(const std::wstring& directory, uint64_t maxBytes = DEFAULT_MAX_BYTES);
+
+    // Entry recorded for url, provided its blob is still on disk
+    bool Lookup(const std::wstring& url, CacheEntry& entry);
+    bool Contains(const std::wstring& sha256);
+
+    // Copies the blob to outputPath and marks it as used
+    bool Restore(const std::wstring& sha256, const std::wstring& outputPath);
+    // For readers that consume the blob in place
+    std::wstring BlobPath(const std::wstring& sha256) const;
+    void MarkUsed(const std::wstring& sha256);
+
+    // Adds a downloaded file under its content hash, moving it into the cache
+    // when keepSource is false, then evicts down to the size limit
+    bool Store(const std::wstring& url, const std::wstring& sourcePath, const std::wstring& sha256,
+        const std::wstring& etag, const std::wstring& lastModified, bool keepSource = true);
+
+    // Scratch file name inside the cache, on the same volume as the blobs
+    std::wstring NewTempPath();
+
+    const std::wstring& Directory() const { return directory_; }
+
+private:
+    std::wstring IndexPath() const;
+
+    void Load();
+    bool Save() const;
+    void Touch(const std::wstring& sha256);
+    void Evict(const std::wstring& keep);
+
+    std::wstring directory_;
+    uint64_t maxBytes_;
+    uint64_t useCounter_;
+    uint64_t tempCounter_;
+    std::vector<CacheEntry> entries_;   // One per URL; several URLs may share a blob
+    std::mutex mutex_;
+};
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+
+struct ByteRange {
+    uint64_t start;
+    uint64_t end;   // Exclusive
+};
+
+// Sidecar file recording which byte ranges of a partial download are
+// already on disk, plus the validators needed to trust them on resume
+class DownloadJournal {
+public:
+    std::wstring url;
+    std::wstring etag;
+    std::wstring lastModified;
+    uint64_t totalSize = 0;
+
+    static std::wstring PathFor(const std::wstring& outputPath);
+
+    bool Load(const std::wstring& path);
+    bool Save(const std::wstring& path) const;   // Written to a temp file, then renamed
+
+    // Adds [start, end), merging with neighbouring ranges
+    void MarkCompleted(uint64_t start, uint64_t end);
+    uint64_t CompletedBytes() const;
+    std::vector<ByteRange> MissingRanges() const;
+    const std::vector<ByteRange>& CompletedRanges() const { return completed_; }
+
+private:
+    std::vector<ByteRange> completed_;   // Sorted, non-overlapping
+};
+
+} // namespace InstAnalyticsInstaller
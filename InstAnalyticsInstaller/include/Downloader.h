@@ -1,34 +1,146 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <functional>
-#include <windows.h>
+#include <memory>
+#include <vector>
+#include "CancellationToken.h"
+#include "DownloadJournal.h"
+#include "FileSystem.h"
+#include "HttpTransport.h"
+#include "Stream.h"
 
 namespace InstAnalyticsInstaller {
 
 using ProgressCallback = std::function<void(int progress, const std::wstring& status)>;
 
+struct DownloadOptions {
+    // Concurrent ranged connections; 1 disables segmented mode
+    unsigned connections = 4;
+    // Files smaller than two segments of this size use a single connection
+    uint64_t minSegmentSize = 4 * 1024 * 1024;
+    // Reconnects per segment (resuming at the last written byte) before giving up
+    unsigned segmentRetries = 3;
+    // Pause before reconnecting to the same source, times the attempt number
+    unsigned retryDelayMs = 200;
+    // Bytes a segment writes between journal checkpoints
+    uint64_t journalInterval = 8 * 1024 * 1024;
+    // Write buffers queued to the disk writer per connection, and their
+    // largest size; the size in use follows the measured download rate
+    unsigned writeBuffers = 4;
+    size_t writeBufferSize = 4 * 1024 * 1024;
+    // Bytes fetched from every mirror at once to rank them by throughput
+    uint64_t probeSize = 256 * 1024;
+};
+
+class DownloadCache;
+
 class Downloader {
 public:
-    Downloader();
+    explicit Downloader(std::shared_ptr<HttpTransport> transport = nullptr);
     ~Downloader();
 
-    bool DownloadFile(const std::wstring& url, const std::wstring& outputPath, ProgressCallback callback = nullptr);
+    // Servers that support ranges and send an ETag or Last-Modified get a
+    // "<outputPath>.journal" sidecar: a failed or cancelled download keeps its
+    // partial file and the next call for the same URL resumes it.
+    // A non-empty expectedSha256 (hex) is checked while the bytes are written;
+    // a mismatch deletes the file and fails the download
+    bool DownloadFile(const std::wstring& url, const std::wstring& outputPath, ProgressCallback callback = nullptr,
+        const std::wstring& expectedSha256 = L"");
+
+    // The same from several copies of one payload (mirrors); sources[0] names
+    // it for the journal and the cache. A small range is fetched from every
+    // source at once, connections then go to them in proportion to the
+    // measured throughput, and a source that fails mid-download hands its
+    // ranges to the next one without losing what already arrived. Sources
+    // are only mixed when they report the same size: expectedSha256 is what
+    // proves they serve the same bytes
+    bool DownloadFile(const std::vector<std::wstring>& sources, const std::wstring& outputPath,
+        ProgressCallback callback = nullptr, const std::wstring& expectedSha256 = L"");
+
+    // Sequential download into a consumer (e.g. a StreamPipe feeding the
+    // extractor): nothing touches the disk and there is no journal. Dropped
+    // connections resume with a Range request when the server allows it. The
+    // output is not closed here; on success every byte matched expectedSha256.
+    bool DownloadToStream(const std::wstring& url, OutputStream& output, ProgressCallback callback = nullptr,
+        const std::wstring& expectedSha256 = L"");
+
+    // Streams from the fastest of several mirrors; when it drops for good the
+    // stream resumes from the next one that serves the same size
+    bool DownloadToStream(const std::vector<std::wstring>& sources, OutputStream& output,
+        ProgressCallback callback = nullptr, const std::wstring& expectedSha256 = L"");
+
+    // Aborts the transfer in progress within a socket poll: blocked reads
+    // and connects wake up, the writer drops what it has queued. The token
+    // stays cancelled, so later calls fail at once
     void Cancel();
 
+    // Shares one token with the rest of an install: cancelling it stops this
+    // downloader too. By default each downloader has a token of its own
+    void SetCancellationToken(std::shared_ptr<CancellationToken> cancel) { cancel_ = cancel; }
+
+    // True when the last DownloadFile failed because the payload did not match its digest
+    bool IntegrityFailed() const { return integrityFailed_; }
+
+    // True when the last DownloadFile failed because the target volume lacks space
+    bool InsufficientSpace() const { return insufficientSpace_; }
+
+    // Stable local file name for a URL (its last path segment)
+    static std::wstring FileNameFromUrl(const std::wstring& url);
+
+    // With a cache, DownloadFile and DownloadToStream serve payloads from it
+    // (after a conditional GET, or without asking the server when a pinned
+    // digest names the content) and store what they fetch
+    void SetCache(std::shared_ptr<DownloadCache> cache) { cache_ = cache; }
+
+    void SetOptions(const DownloadOptions& options) { options_ = options; }
+    const DownloadOptions& GetOptions() const { return options_; }
+
 private:
-    bool cancelled_;
-    static DWORD CALLBACK ProgressRoutine(
-        LARGE_INTEGER TotalFileSize,
-        LARGE_INTEGER TotalBytesTransferred,
-        LARGE_INTEGER StreamSize,
-        LARGE_INTEGER StreamBytesTransferred,
-        DWORD dwStreamNumber,
-        DWORD dwCallbackReason,
-        HANDLE hSourceFile,
-        HANDLE hDestinationFile,
-        LPVOID lpData
-    );
+    class TransferProgress;
+    class OrderedDigest;
+    struct RangedTransfer;
+
+    // A location of the payload and how it did in the race
+    struct Source {
+        std::wstring url;
+        size_t index;               // Position in the caller's list
+        HttpResponse resource;      // The whole payload as this source describes it
+        double bytesPerSecond;      // Over the probe range; 0 = not raced
+    };
+
+    struct Segment {
+        uint64_t offset;
+        uint64_t length;
+        uint64_t done;
+        uint64_t journaled;     // Prefix of done on disk and recorded in the journal
+    };
+
+    HttpRequest Request(const std::wstring& url) const;
+    bool Cancelled() const { return cancel_->IsCancelled(); }
+    bool FetchFile(const std::vector<std::wstring>& urls, const std::wstring& outputPath, ProgressCallback callback,
+        const std::wstring& expectedSha256, std::wstring& sha256, HttpResponse& info);
+    std::vector<Source> RaceSources(const std::vector<std::wstring>& urls);
+    bool FetchWhole(const std::vector<Source>& sources, File& file, ProgressCallback callback, uint64_t totalSize,
+        const std::wstring& expectedSha256, std::wstring& sha256);
+    bool FindCached(const std::wstring& url, const std::wstring& expectedSha256, std::wstring& sha256);
+    bool StreamCached(const std::wstring& sha256, OutputStream& output, ProgressCallback callback);
+    bool DownloadSingle(const std::wstring& url, File& file, TransferProgress& progress, OrderedDigest* digest);
+    bool DownloadRanges(const std::vector<Source>& sources, DownloadJournal& journal, const std::wstring& journalPath,
+        File& file, TransferProgress& progress, OrderedDigest* digest, bool& rangesIgnored);
+    bool FetchSegment(Segment& segment, size_t& source, File& file, TransferProgress& progress,
+        OrderedDigest* digest, RangedTransfer& transfer);
+    bool HasSpaceFor(const std::wstring& outputPath, uint64_t size, uint64_t present);
+    bool VerifyDigest(OrderedDigest* digest, uint64_t size, const std::wstring& expectedSha256, std::wstring& sha256);
+    void Checkpoint(Segment& segment, RangedTransfer& transfer, uint64_t written);
+
+    std::shared_ptr<HttpTransport> transport_;
+    std::shared_ptr<DownloadCache> cache_;
+    DownloadOptions options_;
+    std::shared_ptr<CancellationToken> cancel_;
+    bool integrityFailed_;
+    bool insufficientSpace_;
 };
 
 } // namespace InstAnalyticsInstaller
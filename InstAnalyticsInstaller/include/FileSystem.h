@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+
+// Thin file handle wrapper shared by the extraction and download paths.
+// Win32 handles on Windows, POSIX descriptors everywhere else.
+class File {
+public:
+    enum class Mode {
+        Read,       // Existing file, read only
+        Write,      // Create or truncate, write only
+        ReadWrite,  // Open or create without truncating
+        ReadShared  // Existing file, read only, while another process keeps writing it
+    };
+
+    File();
+    ~File();
+
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+    File(File&& other) noexcept;
+    File& operator=(File&& other) noexcept;
+
+    bool Open(const std::wstring& path, Mode mode);
+    void Close();
+    bool IsOpen() const;
+
+    // Sequential I/O from the current file position
+    bool Read(void* buffer, size_t size, size_t& bytesRead);
+    bool Write(const void* data, size_t size);
+
+    // Positional I/O, safe to call from several threads on the same handle
+    bool ReadAt(uint64_t offset, void* buffer, size_t size, size_t& bytesRead);
+    bool WriteAt(uint64_t offset, const void* data, size_t size);
+
+    bool GetSize(uint64_t& size) const;
+    bool Truncate(uint64_t size);
+
+    // Reserves disk space for size bytes and extends the file to that size,
+    // so large writes don't grow it block by block. False only when the
+    // volume is out of space; file systems without support just get the size
+    bool Preallocate(uint64_t size);
+
+private:
+#ifdef _WIN32
+    void* handle_;
+#else
+    int fd_;
+#endif
+};
+
+// Read-only view of a whole file, for hashing without copying through a
+// buffer. An empty file opens with no view (Data() is null)
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // False if the file can't be opened or mapped (e.g. no address space left)
+    bool Open(const std::wstring& path);
+    void Close();
+
+    const uint8_t* Data() const { return data_; }
+    uint64_t Size() const { return size_; }
+
+private:
+    const uint8_t* data_;
+    uint64_t size_;
+};
+
+struct DirectoryEntry {
+    std::wstring name;
+    bool isDirectory;
+};
+
+class FileSystem {
+public:
+    static const wchar_t PathSeparator;
+
+    static bool CreateDirectories(const std::wstring& path);
+    static bool FileExists(const std::wstring& path);
+    static bool DirectoryExists(const std::wstring& path);
+    static bool RemoveFile(const std::wstring& path);
+    static bool RenameFile(const std::wstring& from, const std::wstring& to);   // Replaces an existing target
+    static bool RenameDirectory(const std::wstring& from, const std::wstring& to);  // Same volume; fails if the target exists
+    static bool RemoveEmptyDirectory(const std::wstring& path);                   // Fails if not empty
+    static bool RemoveTree(const std::wstring& path);                              // Directory and everything in it; true if absent
+    static bool DuplicateFile(const std::wstring& from, const std::wstring& to);   // Copy, replacing the target
+    static bool LinkFile(const std::wstring& from, const std::wstring& to);        // Hard link, else a copy; the target must not exist
+    static bool AvailableSpace(const std::wstring& directory, uint64_t& bytes);      // Free bytes for this user
+    static bool ListDirectory(const std::wstring& path, std::vector<DirectoryEntry>& entries);  // Without "." and ".."
+
+    static std::wstring JoinPath(const std::wstring& base, const std::wstring& relative);
+    static std::wstring ParentPath(const std::wstring& path);
+
+    static std::string ToUtf8(const std::wstring& text);
+    static std::wstring FromUtf8(const std::string& text);
+};
+
+} // namespace InstAnalyticsInstaller
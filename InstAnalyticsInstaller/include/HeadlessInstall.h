@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "InstallPipeline.h"
+
+namespace InstAnalyticsInstaller {
+
+// Options of an unattended run ("--headless"); front ends fill in their
+// platform defaults first, then let the command line override them
+struct HeadlessOptions {
+    std::wstring installPath;
+    std::wstring downloadDirectory;
+    std::wstring cacheDirectory;        // Empty = no download cache
+    std::wstring appUrl;
+    std::vector<std::wstring> appMirrors;
+    std::wstring appSha256;
+    std::wstring appManifestUrl;        // Empty = upgrades download the whole archive
+    std::wstring appManifestSha256;
+    std::wstring appPatchesUrl;         // Empty = changed files come whole
+    unsigned extractThreads = 0;        // "--extract-threads": 1 = serial, 0 = one per hardware thread
+    std::wstring tracePath;             // Chrome trace JSON written at the end; empty = no tracing
+    // Stand-in environments only: Windows takes the SDK from DotNetChecker
+    std::wstring dotnetRoot;
+    std::wstring dotnetUrl;
+    std::vector<std::wstring> dotnetMirrors;
+    std::wstring dotnetSha256;
+    bool rollback = false;              // Put back the previous version instead of installing
+    bool verify = false;                // Only check the install against the manifest
+    std::wstring patchesPath;           // "--apply-patches": only apply this local patch archive
+};
+
+// Unattended installation: no UI, newline-delimited JSON events on the
+// output (start, phase, progress, patch, warning, result) and the
+// InstallError as exit code. "--trace <file>" also records the run for
+// chrome://tracing; "--rollback" swaps the installed version with the one
+// the last install replaced; "--verify" checks the install against the
+// manifest (URL or local file) and reports every file that differs;
+// "--apply-patches <file>" upgrades the install from a downloaded patch
+// archive (see InstallPipeline::ApplyPatches)
+class HeadlessInstall {
+public:
+    static const int EXIT_BAD_ARGUMENTS = 2;
+
+    static bool IsRequested(const std::vector<std::wstring>& args);
+
+    // "--option value" or "--option=value"; false with a message on unknown
+    // options or missing values. "--app-mirror" and "--dotnet-mirror" may be
+    // repeated, the first one replacing the built-in list
+    static bool ParseArguments(const std::vector<std::wstring>& args, HeadlessOptions& options, std::wstring& error);
+
+    // Runs the pipeline to the end and returns the process exit code
+    static int Run(InstallPipeline& pipeline, const HeadlessOptions& options, FILE* output);
+
+    static const char* ErrorName(InstallError error);
+    static std::string JsonString(const std::wstring& text);     // Quoted and escaped, UTF-8
+};
+
+} // namespace InstAnalyticsInstaller
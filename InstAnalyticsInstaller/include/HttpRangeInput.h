@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "CancellationToken.h"
+#include "DownloadJournal.h"
+#include "FileSystem.h"
+#include "HttpTransport.h"
+#include "Stream.h"
+
+namespace InstAnalyticsInstaller {
+
+// A remote file read through HTTP range requests, so a ZIP's central
+// directory and a few of its entries can be read without downloading the
+// rest. Every fetched span is kept in a local spool file and each byte
+// crosses the network once: a read outside the spans fetches at least
+// MIN_FETCH_SIZE bytes from there, and Prefetch brings in spans known in
+// advance on parallel connections. Every response must come from the
+// version Open saw (same size and validators)
+class HttpRangeInput : public RandomAccessInput {
+public:
+    static constexpr uint64_t MIN_FETCH_SIZE = 64 * 1024;
+
+    using FetchCallback = std::function<void(uint64_t fetched, uint64_t total)>;
+
+    explicit HttpRangeInput(std::shared_ptr<HttpTransport> transport = nullptr,
+        const CancellationToken* cancel = nullptr);
+    ~HttpRangeInput() override;     // Deletes the spool file
+
+    HttpRangeInput(const HttpRangeInput&) = delete;
+    HttpRangeInput& operator=(const HttpRangeInput&) = delete;
+
+    // Asks for the first byte to learn the size and validators; false when
+    // the server does not answer with a range
+    bool Open(const std::wstring& url, const std::wstring& spoolPath);
+
+    uint64_t Size() const override { return size_; }
+    bool ReadAt(uint64_t offset, void* buffer, size_t size, size_t& bytesRead) override;
+
+    // Fetches the ranges on up to `connections` requests at a time. Ranges
+    // closer than MERGE_GAP go out as one request; the rest is split so
+    // every connection has work. The callback runs on the fetching threads
+    bool Prefetch(std::vector<ByteRange> ranges, unsigned connections, FetchCallback callback = nullptr);
+
+    uint64_t BytesFetched() const { return bytesFetched_; }
+    uint64_t Requests() const { return requests_; }
+
+private:
+    static constexpr uint64_t MERGE_GAP = 16 * 1024;
+    static constexpr uint64_t PREFETCH_CHUNK = 4 * 1024 * 1024;
+    static constexpr uint64_t MIN_CHUNK = 256 * 1024;
+    static constexpr unsigned FETCH_RETRIES = 3;
+
+    // Bytes [start, end) of the remote file, stored at spoolOffset
+    struct Span {
+        uint64_t end;
+        uint64_t spoolOffset;
+    };
+
+    bool Fetch(uint64_t start, uint64_t end, const std::function<void(uint64_t)>& onBytes = nullptr);
+    bool SameVersion(const HttpResponse& response) const;
+
+    std::shared_ptr<HttpTransport> transport_;
+    const CancellationToken* cancel_;
+    std::wstring url_;
+    std::wstring spoolPath_;
+    HttpResponse resource_;
+    uint64_t size_;
+
+    File spool_;
+    std::mutex mutex_;
+    std::map<uint64_t, Span> spans_;    // By start
+    uint64_t spoolEnd_;
+
+    std::atomic<uint64_t> bytesFetched_;
+    std::atomic<uint64_t> requests_;
+};
+
+} // namespace InstAnalyticsInstaller
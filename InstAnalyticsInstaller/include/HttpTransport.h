@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Stream.h"
+
+namespace InstAnalyticsInstaller {
+
+class CancellationToken;
+
+struct HttpRequest {
+    std::wstring url;
+    bool headOnly = false;
+
+    // Byte range [rangeStart, rangeStart + rangeLength); length 0 = to the end
+    bool useRange = false;
+    uint64_t rangeStart = 0;
+    uint64_t rangeLength = 0;
+
+    // Conditional GET: a server holding the same version answers 304 without a body
+    std::wstring ifNoneMatch;
+    std::wstring ifModifiedSince;
+
+    // Wakes a connect or read blocked on this request's connection, which
+    // then fails; nullptr = only the transport's timeouts end it
+    const CancellationToken* cancel = nullptr;
+};
+
+struct HttpResponse {
+    int statusCode = 0;
+    bool hasContentLength = false;
+    uint64_t contentLength = 0;     // Length of this response body
+    uint64_t totalLength = 0;       // Full resource size (from Content-Range on 206)
+    uint64_t rangeStart = 0;        // Offset of the first byte served (from Content-Range on 206)
+    bool acceptRanges = false;
+    std::wstring etag;
+    std::wstring lastModified;
+};
+
+// Response body of an open request
+class HttpStream : public InputStream {
+public:
+    virtual const HttpResponse& Response() const = 0;
+};
+
+// Pluggable HTTP client used by Downloader. WinINet on Windows; a plain
+// HTTP/1.1 socket client elsewhere so the download paths can run against
+// local stand-in servers. Implementations are thread-safe and keep
+// connections alive between requests, so one instance should serve as many
+// downloads as possible.
+class HttpTransport {
+public:
+    virtual ~HttpTransport() = default;
+
+    // Sends the request and returns once the response headers are in.
+    // Returns nullptr on connection or protocol errors; HTTP error statuses
+    // are reported through Response().statusCode.
+    virtual std::unique_ptr<HttpStream> Open(const HttpRequest& request) = 0;
+
+    static std::shared_ptr<HttpTransport> CreateDefault();
+
+    // The process-wide session every Downloader uses unless given its own:
+    // its pooled connections and TLS sessions carry over from one phase's
+    // downloads to the next
+    static std::shared_ptr<HttpTransport> Shared();
+};
+
+// Where redirected URLs ended up (e.g. a GitHub release asset and its CDN
+// location), kept for the process so later requests skip the redirect hops.
+// A target that stops working is forgotten and the original URL asked again
+class RedirectCache {
+public:
+    // The remembered target of url, or url itself
+    std::wstring Resolve(const std::wstring& url) const;
+    void Remember(const std::wstring& url, const std::wstring& target);
+    void Forget(const std::wstring& url);
+
+private:
+    mutable std::mutex mutex_;
+    std::map<std::wstring, std::wstring> targets_;
+};
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Stream.h"
+
+namespace InstAnalyticsInstaller {
+
+// Raw DEFLATE (RFC 1951) decoder. One instance owns its sliding window and
+// output buffer, so it can be reused across entries but not shared between
+// threads.
+class Inflater {
+public:
+    Inflater();
+
+    // Decodes one DEFLATE stream from input, handing output to sink in large
+    // chunks. Stops after the final block and gives back to input any whole
+    // bytes it read past the end of the stream.
+    bool Inflate(ByteReader& input, OutputStream& output);
+
+    uint64_t TotalOut() const { return totalOut_; }
+
+private:
+    static constexpr unsigned FAST_BITS = 10;
+    static constexpr size_t WINDOW_SIZE = 32768;
+    static constexpr size_t OUTPUT_CHUNK = 256 * 1024;
+    static constexpr size_t MAX_MATCH = 258;
+
+    struct HuffmanTable {
+        uint16_t fast[1 << FAST_BITS];  // (symbol << 4) | length, 0 = use slow path
+        uint16_t count[16];
+        uint16_t symbol[288];
+    };
+
+    static bool BuildTable(HuffmanTable& table, const uint8_t* lengths, int symbolCount);
+    static const HuffmanTable& FixedLiteralTable();
+    static const HuffmanTable& FixedDistanceTable();
+
+    bool InflateStored();
+    bool InflateDynamic();
+    bool InflateCodes(const HuffmanTable& literals, const HuffmanTable& distances);
+    bool DecodeSymbol(const HuffmanTable& table, int& symbol);
+    bool NeedBits(unsigned count);
+    uint32_t TakeBits(unsigned count);
+    void Refill();
+    bool FlushOutput();
+
+    ByteReader* input_;
+    OutputStream* output_;
+    uint64_t bitBuffer_;
+    unsigned bitCount_;
+
+    std::vector<uint8_t> window_;
+    size_t pos_;
+    size_t flushed_;
+    uint64_t totalOut_;
+
+    HuffmanTable literals_;
+    HuffmanTable distances_;
+};
+
+} // namespace InstAnalyticsInstaller
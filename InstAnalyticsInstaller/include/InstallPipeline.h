@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Downloader.h"
+#include "InstallVerifier.h"
+#include "TaskGraph.h"
+
+namespace InstAnalyticsInstaller {
+
+class DownloadCache;
+class HttpTransport;
+
+// Why an installation stopped. The values double as process exit codes for
+// unattended runs (2 is left to front ends for bad arguments)
+enum class InstallError {
+    None = 0,
+    Failed = 1,                 // Unexpected
+    Cancelled = 3,
+    DotNetDownload = 10,
+    DotNetCorrupted = 11,       // SHA-256 mismatch
+    DotNetInstall = 12,
+    DotNetPath = 13,
+    DotNetUntrusted = 14,       // No pinned SHA-256 and the setup's signature isn't Microsoft's
+    AppDownload = 20,           // Download or extraction
+    AppCorrupted = 21,
+    AppSwitch = 22,             // The new version could not replace the installed one
+    AppVerify = 23,             // Installed files differ from the release manifest
+    AppPatch = 24,              // A patch archive did not apply; the install is unchanged
+    InsufficientSpace = 30
+};
+
+// Everything the installation needs from the operating system. The Windows
+// implementation wraps DotNetChecker and Installer; other builds plug in
+// local stand-ins so the pipeline itself runs anywhere
+class InstallEnvironment {
+public:
+    virtual ~InstallEnvironment() = default;
+
+    virtual bool IsDotNetInstalled() = 0;
+    virtual std::wstring DotNetDownloadUrl() = 0;
+    virtual std::vector<std::wstring> DotNetMirrors() = 0;     // Raced against the URL; may be empty
+    virtual std::wstring DotNetDownloadSha256() = 0;
+    // What vouches for a downloaded SDK when DotNetDownloadSha256 is empty
+    // (on Windows, Microsoft's code signature); false keeps it from running
+    virtual bool IsTrustedDotNetInstaller(const std::wstring& installerPath) = 0;
+
+    // Runs the downloaded SDK installer; exitCode is its process exit code.
+    // Returns promptly once cancel fires, leaving nothing half-running
+    virtual bool InstallDotNet(const std::wstring& installerPath, const ProgressCallback& callback,
+        const std::shared_ptr<CancellationToken>& cancel, unsigned long& exitCode) = 0;
+    virtual bool ConfigureDotNetPath() = 0;
+
+    virtual bool CreateShortcuts(const std::wstring& installPath) = 0;
+};
+
+struct InstallSettings {
+    std::wstring installPath;
+    std::wstring downloadDirectory;         // Partial downloads resume from here
+    std::wstring appUrl;
+    std::vector<std::wstring> appMirrors;   // Raced against appUrl; may be empty
+    std::wstring appSha256;                 // Empty skips verification
+    std::wstring appManifestUrl;            // Lets an existing install fetch only what changed; may be empty
+    std::wstring appManifestSha256;         // Empty skips verification
+    std::wstring appPatchesUrl;             // Patches from earlier versions for those files; may be empty
+    unsigned extractThreads = 0;            // Inflating workers: 1 = serial, 0 = one per hardware thread
+    std::shared_ptr<DownloadCache> cache;   // Optional
+    std::shared_ptr<HttpTransport> transport;   // nullptr = platform default
+};
+
+// The installation as a task graph: the .NET branch (check, SDK download,
+// SDK install) runs beside the app branch (download extracted as it streams,
+// then checked against the release manifest when there is one), and both
+// meet at the shortcuts. No pauses for the UI's sake anywhere. A run that
+// fails or is cancelled after the app phase switched in the new version
+// rolls it back, so the install is left as the run found it.
+class InstallPipeline {
+public:
+    static const wchar_t* const PHASE_CHECK;
+    static const wchar_t* const PHASE_SDK_DOWNLOAD;
+    static const wchar_t* const PHASE_SDK_INSTALL;
+    static const wchar_t* const PHASE_APP;
+    static const wchar_t* const PHASE_VERIFY;
+    static const wchar_t* const PHASE_SHORTCUTS;
+
+    enum class PhaseEvent { Started, Succeeded, Failed, Skipped };
+
+    // seconds is the phase's duration for Succeeded/Failed, 0 otherwise.
+    // Called from the phase threads, possibly concurrently
+    using PhaseCallback = std::function<void(const std::wstring& phase, PhaseEvent event, double seconds)>;
+
+    InstallPipeline(InstallEnvironment& environment, const InstallSettings& settings);
+
+    // Blocks until the installation finished, failed or was cancelled
+    bool Run(ProgressCallback progress = nullptr, PhaseCallback phases = nullptr);
+    void Cancel();
+
+    // Upgrades the install from a local patch archive instead of running
+    // the phases (see BinaryPatch::ApplyArchive): the patched version is
+    // switched in whole, or the install is left as it was. applied
+    // (optional) receives the number of files patched
+    bool ApplyPatches(const std::wstring& archivePath, ProgressCallback progress = nullptr, size_t* applied = nullptr);
+
+    InstallError Error() const { return error_; }
+    std::wstring ErrorMessage() const;      // For the user, in Italian
+    // A run that failed after switching in the new version put the one it
+    // replaced back (see StagedInstall::Rollback)
+    bool RolledBack() const { return rolledBack_; }
+    unsigned long DotNetExitCode() const { return dotnetExitCode_; }
+    const VerifyReport& Verification() const { return verifyReport_; }    // Empty if the phase didn't run
+    // What went wrong without stopping the installation (e.g. shortcuts
+    // that could not be created), for the user, in Italian
+    std::vector<std::wstring> Warnings() const;
+
+private:
+    bool CheckDotNet(const TaskGraph::ReportCallback& report);
+    bool DownloadDotNet(const TaskGraph::ReportCallback& report);
+    bool InstallDotNet(const TaskGraph::ReportCallback& report);
+    bool DeployApp(const TaskGraph::ReportCallback& report);
+    bool VerifyApp(const TaskGraph::ReportCallback& report);
+    void Fail(InstallError error);
+    std::wstring Describe(InstallError error) const;
+    void Warn(const std::wstring& message);
+
+    InstallEnvironment& environment_;
+    InstallSettings settings_;
+    Downloader dotnetDownloader_;
+    Downloader appDownloader_;
+
+    std::wstring dotnetInstallerPath_;
+    std::atomic<bool> dotnetInstalled_;
+    std::atomic<bool> appSwitched_;     // The app phase replaced the install
+    bool rolledBack_;
+    // One token for every stage: the downloads, the extraction and the SDK
+    // setup all stop on it
+    std::shared_ptr<CancellationToken> cancel_;
+    std::atomic<InstallError> error_;
+    unsigned long dotnetExitCode_;
+    VerifyReport verifyReport_;
+    mutable std::mutex warningsMutex_;
+    std::vector<std::wstring> warnings_;
+
+    std::mutex graphMutex_;
+    TaskGraph* graph_;              // Set while Run is active
+    bool cancelRequested_;
+};
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CancellationToken.h"
+#include "ReleaseManifest.h"
+
+namespace InstAnalyticsInstaller {
+
+struct VerifyMismatch {
+    enum class Kind { Missing, Size, Hash };
+
+    std::wstring path;          // As in the manifest
+    Kind kind;
+};
+
+struct VerifyReport {
+    size_t files = 0;
+    uint64_t bytes = 0;         // Hashed
+    double seconds = 0;
+    std::vector<VerifyMismatch> mismatches;     // In manifest order
+
+    bool Passed() const { return mismatches.empty(); }
+    double MegabytesPerSecond() const;
+};
+
+// Checks an installed release file by file against its manifest. Files are
+// hashed on a pool of workers, the small ones memory-mapped; they go in batches
+// of up to BATCH_FILES / BATCH_BYTES per task so opening thousands of tiny
+// assemblies costs one task each batch, not one each file. Largest first,
+// so a big file never starts last
+class InstallVerifier {
+public:
+    static constexpr size_t BATCH_FILES = 64;
+    static constexpr uint64_t BATCH_BYTES = 4 * 1024 * 1024;
+
+    // Fills report; false only if cancelled. threadCount 0 = one per core
+    static bool Verify(const ReleaseManifest& manifest, const std::wstring& directory, VerifyReport& report,
+        unsigned threadCount = 0, const CancellationToken* cancel = nullptr);
+
+    static const char* KindName(VerifyMismatch::Kind kind);
+};
+
+} // namespace InstAnalyticsInstaller
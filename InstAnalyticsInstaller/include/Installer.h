@@ -2,7 +2,9 @@
 
 #include <string>
 #include <functional>
+#include <memory>
 #include <windows.h>
+#include "CancellationToken.h"
 
 namespace InstAnalyticsInstaller {
 
@@ -11,18 +13,25 @@ using InstallProgressCallback = std::function<void(int progress, const std::wstr
 class Installer {
 public:
     Installer();
+    ~Installer();
+
+    Installer(const Installer&) = delete;
+    Installer& operator=(const Installer&) = delete;
 
     bool InstallDotNet(const std::wstring& installerPath, InstallProgressCallback callback = nullptr);
-    bool ExtractInstAnalytics(const std::wstring& zipPath, const std::wstring& destinationPath, InstallProgressCallback callback = nullptr);
     bool CreateShortcuts(const std::wstring& installPath);
+    // Terminates the SDK setup in progress; the token stays cancelled for
+    // the later calls
     void Cancel();
+    // Shares the install's token: its event wakes the process wait at once
+    void SetCancellationToken(std::shared_ptr<CancellationToken> cancel) { cancel_ = cancel; }
     DWORD GetLastExitCode() const { return lastExitCode_; }
 
 private:
-    bool cancelled_;
+    std::shared_ptr<CancellationToken> cancel_;
     DWORD lastExitCode_;
     bool RunInstaller(const std::wstring& path);
-    bool WaitForProcessCompletion(HANDLE hProcess, InstallProgressCallback callback);
+    bool WaitForProcessCompletion(HANDLE hProcess, const std::wstring& logPath, InstallProgressCallback callback);
 };
 
 } // namespace InstAnalyticsInstaller
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "FileSystem.h"
+
+namespace InstAnalyticsInstaller {
+
+// Follows a log file another process is still writing. Each Poll reads from
+// the offset where the previous one stopped and returns only the lines
+// completed since; a trailing partial line waits for its newline.
+class LogTailer {
+public:
+    explicit LogTailer(const std::wstring& path);
+
+    // Appends new complete lines (without line endings). A file that doesn't
+    // exist yet is not an error: the writer may simply not have created it
+    bool Poll(std::vector<std::string>& lines);
+
+    uint64_t Offset() const { return offset_; }
+
+private:
+    std::wstring path_;
+    File file_;
+    uint64_t offset_;
+    std::string partial_;
+    std::vector<char> buffer_;
+};
+
+// Turns a WiX Burn bundle log (what "/log <file>" makes the .NET SDK
+// installer write) into package progress: the plan says how many packages
+// will be executed, and each "Applied execute package" line completes one.
+class BurnLogProgress {
+public:
+    BurnLogProgress();
+
+    // True when the line changed the progress or the current package
+    bool ParseLine(const std::string& line);
+
+    int Progress() const;                      // 0-100
+    bool Complete() const { return complete_; }
+    unsigned PlannedPackages() const { return planned_; }
+    unsigned AppliedPackages() const { return applied_; }
+    const std::string& CurrentPackage() const { return currentPackage_; }
+
+private:
+    unsigned planned_;
+    unsigned applied_;
+    bool planComplete_;
+    bool complete_;
+    std::string currentPackage_;
+};
+
+} // namespace InstAnalyticsInstaller
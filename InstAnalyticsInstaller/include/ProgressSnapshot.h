@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace InstAnalyticsInstaller {
+
+// Latest installation progress, published by worker threads and sampled by
+// the UI on a timer. The percentage and the status text sit behind one
+// seqlock, so a sample always pairs them as they were published. Writers
+// serialize on the odd sequence, which is a spinlock held for the few
+// hundred stores of one publish; the reader never blocks a writer and only
+// retries when it raced one.
+class ProgressSnapshot {
+public:
+    static constexpr size_t MAX_STATUS = 256;
+
+    ProgressSnapshot();
+
+    ProgressSnapshot(const ProgressSnapshot&) = delete;
+    ProgressSnapshot& operator=(const ProgressSnapshot&) = delete;
+
+    void Publish(int progress, const std::wstring& status);
+
+    // Copies the latest values when they changed since version (updated on return)
+    bool Sample(uint64_t& version, int& progress, std::wstring& status) const;
+
+private:
+    std::atomic<int> progress_;
+    std::atomic<uint64_t> version_;
+    std::atomic<uint32_t> sequence_;    // Odd while a writer is in
+    std::atomic<size_t> length_;
+    std::atomic<wchar_t> status_[MAX_STATUS];
+};
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CancellationToken.h"
+#include "HttpTransport.h"
+
+namespace InstAnalyticsInstaller {
+
+struct ManifestFile {
+    std::wstring path;          // Relative to the install directory, '/' separated
+    uint64_t size = 0;
+    std::wstring sha256;        // Lower-case hex
+};
+
+// Per-file listing of a release, published beside its archive: every file
+// the archive installs, with its size and SHA-256. Comparing it with what
+// is on disk tells an upgrade which files it actually has to fetch.
+//
+//   InstAnalytics-manifest 1
+//   <sha256> <size> <path>
+class ReleaseManifest {
+public:
+    std::vector<ManifestFile> files;
+
+    // False on a bad header, a malformed line or an unsafe path
+    bool Parse(const std::string& text);
+    std::string Serialize() const;
+
+    bool Load(const std::wstring& path);
+    bool Save(const std::wstring& path) const;
+
+    // Fetches and parses the manifest published at url; bytes (optional)
+    // receives its size on the wire. False when it does not match
+    // expectedSha256 (empty skips the check)
+    bool Download(const std::wstring& url, const std::wstring& expectedSha256, std::shared_ptr<HttpTransport> transport,
+        std::shared_ptr<CancellationToken> cancel = nullptr, uint64_t* bytes = nullptr);
+
+    uint64_t TotalSize() const;
+
+    // Indices of the files that are missing under directory or differ from
+    // the manifest. Sizes are compared first; only files of the right size
+    // are hashed, largest first on a pool of threadCount workers (0 = one
+    // per core). False if cancelled
+    bool FindChanged(const std::wstring& directory, unsigned threadCount, std::vector<size_t>& changed,
+        const CancellationToken* cancel = nullptr) const;
+
+    // Files under directory the manifest does not list ('/' separated):
+    // what an earlier release installed and this one dropped
+    bool FindExtra(const std::wstring& directory, std::vector<std::wstring>& extra) const;
+
+    // Manifest of every file under directory (release tooling, benchmarks)
+    static bool FromDirectory(const std::wstring& directory, ReleaseManifest& manifest, unsigned threadCount = 0);
+
+    static bool HashFile(const std::wstring& path, std::wstring& sha256, uint64_t& size,
+        const CancellationToken* cancel = nullptr);
+};
+
+} // namespace InstAnalyticsInstaller
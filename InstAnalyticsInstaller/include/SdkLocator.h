@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+
+// "10.0.100" or "10.0.100-rc.1.25451.107"
+struct SdkVersion {
+    unsigned major = 0;
+    unsigned minor = 0;
+    unsigned patch = 0;
+    std::wstring prerelease;
+    std::wstring name;          // Folder name as found on disk
+};
+
+// Finds installed .NET SDKs by listing <dotnet root>/sdk/<version> folders,
+// the layout the dotnet host itself resolves, without starting the host.
+// Pure file system work, so it behaves the same on a fake tree off Windows.
+class SdkLocator {
+public:
+    static bool ParseVersion(const std::wstring& name, SdkVersion& version);
+
+    // SDK folders under root/sdk that hold an SDK (dotnet.dll), lowest version first
+    static std::vector<SdkVersion> ListSdks(const std::wstring& dotnetRoot);
+
+    // Highest SDK with this major version under any of the roots
+    static bool FindSdk(const std::vector<std::wstring>& roots, unsigned major, SdkVersion* found = nullptr);
+
+    static bool IsNewer(const SdkVersion& a, const SdkVersion& b);
+};
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace InstAnalyticsInstaller {
+
+// Incremental SHA-256 (FIPS 180-4). Blocks go through the SHA-NI
+// instructions where the CPU has them, the portable rounds otherwise
+class Sha256 {
+public:
+    static constexpr size_t DIGEST_SIZE = 32;
+
+    Sha256();
+
+    void Reset();
+    void Update(const void* data, size_t size);
+    void Final(uint8_t digest[DIGEST_SIZE]);
+
+    // Lower-case hex of the digest; resets the hasher
+    std::wstring FinalHex();
+
+    static std::wstring ToHex(const uint8_t digest[DIGEST_SIZE]);
+    // Case-insensitive comparison of two hex digests
+    static bool HexEquals(const std::wstring& a, const std::wstring& b);
+
+private:
+    void ProcessBlocks(const uint8_t* data, size_t blocks);
+
+    uint32_t state_[8];
+    uint8_t buffer_[64];
+    size_t bufferSize_;
+    uint64_t totalSize_;
+};
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "HttpTransport.h"
+#include <cstdint>
+#include <memory>
+
+namespace InstAnalyticsInstaller {
+
+// Minimal HTTP/1.1 client over POSIX sockets (http:// only). Follows
+// redirects and understands Content-Length, chunked and close-delimited bodies.
+// Connections whose response was read to the end go back to a per-host
+// pool and serve the next request; redirects are remembered.
+class SocketHttpTransport : public HttpTransport {
+public:
+    SocketHttpTransport();
+    ~SocketHttpTransport() override;
+
+    std::unique_ptr<HttpStream> Open(const HttpRequest& request) override;
+
+    // TCP connections opened so far; requests beyond this count reused one
+    uint64_t ConnectionsOpened() const;
+
+    class ConnectionPool;
+
+private:
+    std::unique_ptr<HttpStream> Follow(const HttpRequest& request, std::string& finalUrl);
+
+    std::shared_ptr<ConnectionPool> pool_;      // Shared with open streams, which return their connection to it
+    RedirectCache redirects_;
+};
+
+} // namespace InstAnalyticsInstaller
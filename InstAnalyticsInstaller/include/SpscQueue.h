@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+
+// Bounded single-producer single-consumer queue. Push and Pop are lock-free
+// while the queue is neither full nor empty; only a side that has to wait
+// takes the mutex, and the other side wakes it after its next operation.
+template <typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity)
+        : slots_(capacity > 0 ? capacity : 1)
+        , head_(0)
+        , tail_(0)
+        , closed_(false)
+        , producerWaiting_(false)
+        , consumerWaiting_(false)
+    {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Blocks while full; false once the queue was closed
+    bool Push(const T& value)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) >= slots_.size()) {
+            Wait(producerWaiting_, [&] { return tail - head_.load() < slots_.size() || closed_.load(); });
+        }
+        if (closed_.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        slots_[tail % slots_.size()] = value;
+        tail_.store(tail + 1);
+        Wake(consumerWaiting_);
+        return true;
+    }
+
+    // Blocks while empty; false once the queue was closed and drained
+    bool Pop(T& value)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            Wait(consumerWaiting_, [&] { return head != tail_.load() || closed_.load(); });
+            if (head == tail_.load()) {
+                return false;
+            }
+        }
+
+        value = slots_[head % slots_.size()];
+        head_.store(head + 1);
+        Wake(producerWaiting_);
+        return true;
+    }
+
+    void Close()
+    {
+        closed_.store(true);
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.notify_all();
+    }
+
+private:
+    // The waiting flag and the indices use sequentially consistent accesses:
+    // either the other side sees the flag and notifies, or we see its update
+    template <typename Predicate>
+    void Wait(std::atomic<bool>& waiting, Predicate done)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiting.store(true);
+        while (!done()) {
+            ready_.wait(lock);
+        }
+        waiting.store(false, std::memory_order_relaxed);
+    }
+
+    void Wake(std::atomic<bool>& waiting)
+    {
+        if (waiting.load()) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_.notify_all();
+        }
+    }
+
+    std::vector<T> slots_;
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+    std::atomic<bool> closed_;
+    std::atomic<bool> producerWaiting_;
+    std::atomic<bool> consumerWaiting_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+};
+
+} // namespace InstAnalyticsInstaller
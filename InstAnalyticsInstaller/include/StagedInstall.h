@@ -0,0 +1,67 @@
+#pragma once
+
+#include <set>
+#include <string>
+
+namespace InstAnalyticsInstaller {
+
+// Installs a release beside the live directory and switches over with
+// renames, so the install is never half old and half new:
+//
+//   <install>.staging    filled by the extraction
+//   <install>.previous   the version the last switch replaced, for Rollback
+//
+// Siblings are on the same volume, so the switch is two directory renames
+// however many files the release has. A run interrupted between them
+// leaves only <install>.previous, which the next Prepare puts back.
+// An upgrade that rebuilds only some files carries the others over into
+// the staging directory, so it switches the same way and keeps the
+// version it replaced
+class StagedInstall {
+public:
+    explicit StagedInstall(const std::wstring& installPath);
+    ~StagedInstall();       // Removes the staging directory unless committed
+
+    StagedInstall(const StagedInstall&) = delete;
+    StagedInstall& operator=(const StagedInstall&) = delete;
+
+    // Clears whatever an earlier failed run left in the staging directory
+    bool Prepare();
+    const std::wstring& StagingPath() const { return stagingPath_; }
+
+    // Deletes the older previous version (the live one is untouched while
+    // that takes its time), then install -> previous and staging -> install.
+    // If the second rename fails the first is undone. Fails on Windows while
+    // files of the installed version are open
+    bool Commit();
+    void Abort();
+
+    // Puts the installed file at relativePath ('/' separated) into the
+    // staging directory as well: a hard link where the volume supports it,
+    // so unchanged files cost neither time nor space, a copy otherwise.
+    // Linked files are shared with <install>.previous after the switch;
+    // replacing one (as every later install does) never touches the other
+    bool CarryOver(const std::wstring& relativePath);
+
+    // The same for every installed file and directory outside skip
+    bool CarryOverAll(const std::set<std::wstring>& skip);
+
+    // Swaps the installed version with the previous one; running it again
+    // swaps them back. False when there is no previous version
+    static bool Rollback(const std::wstring& installPath);
+
+    static std::wstring StagingPathFor(const std::wstring& installPath);
+    static std::wstring PreviousPathFor(const std::wstring& installPath);
+
+private:
+    static std::wstring Normalized(const std::wstring& path);
+    static bool Recover(const std::wstring& installPath);
+    bool CarryOverDirectory(const std::wstring& relativePath, const std::set<std::wstring>& skip);
+
+    std::wstring installPath_;
+    std::wstring stagingPath_;
+    std::wstring previousPath_;
+    bool committed_;
+};
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "FileSystem.h"
+
+namespace InstAnalyticsInstaller {
+
+// Sequential byte source. Read returns true with bytesRead == 0 at end of stream.
+class InputStream {
+public:
+    virtual ~InputStream() = default;
+    virtual bool Read(void* buffer, size_t size, size_t& bytesRead) = 0;
+};
+
+// Sequential byte sink. Write must consume the whole buffer or fail.
+class OutputStream {
+public:
+    virtual ~OutputStream() = default;
+    virtual bool Write(const void* data, size_t size) = 0;
+};
+
+// Positional byte source; ReadAt may be called concurrently.
+class RandomAccessInput {
+public:
+    virtual ~RandomAccessInput() = default;
+    virtual uint64_t Size() const = 0;
+    virtual bool ReadAt(uint64_t offset, void* buffer, size_t size, size_t& bytesRead) = 0;
+};
+
+// Read-only file exposed as a RandomAccessInput
+class FileInput : public RandomAccessInput {
+public:
+    bool Open(const std::wstring& path);
+    uint64_t Size() const override { return size_; }
+    bool ReadAt(uint64_t offset, void* buffer, size_t size, size_t& bytesRead) override;
+
+private:
+    File file_;
+    uint64_t size_ = 0;
+};
+
+// Window [offset, offset + length) of a RandomAccessInput read as a stream
+class RangeInputStream : public InputStream {
+public:
+    RangeInputStream(RandomAccessInput& input, uint64_t offset, uint64_t length);
+    bool Read(void* buffer, size_t size, size_t& bytesRead) override;
+
+private:
+    RandomAccessInput& input_;
+    uint64_t position_;
+    uint64_t end_;
+};
+
+// Buffered reader used by the ZIP parsers and the inflater. The last
+// HISTORY bytes handed out always stay in the buffer so a decoder that
+// over-read can give them back with Unget.
+class ByteReader {
+public:
+    static constexpr size_t HISTORY = 8;
+
+    explicit ByteReader(InputStream& stream, size_t bufferSize = 64 * 1024);
+
+    inline bool ReadByte(uint8_t& value)
+    {
+        if (pos_ == end_ && !Fill()) {
+            return false;
+        }
+        value = buffer_[pos_++];
+        return true;
+    }
+
+    bool ReadExact(void* destination, size_t size);
+    bool Skip(uint64_t size);
+    void Unget(size_t count) { pos_ -= count; }
+
+    // Direct access to the buffered bytes for decoders with a bulk fast path
+    size_t Available() const { return end_ - pos_; }
+    const uint8_t* Data() const { return buffer_.data() + pos_; }
+    void Consume(size_t count) { pos_ += count; }
+
+    bool Failed() const { return failed_; }
+    uint64_t Position() const { return base_ + pos_; }
+
+private:
+    bool Fill();
+
+    InputStream& stream_;
+    std::vector<uint8_t> buffer_;
+    size_t pos_;
+    size_t end_;
+    uint64_t base_;
+    bool failed_;
+};
+
+} // namespace InstAnalyticsInstaller
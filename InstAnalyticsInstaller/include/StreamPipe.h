@@ -0,0 +1,45 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "Stream.h"
+
+namespace InstAnalyticsInstaller {
+
+// Bounded in-memory pipe between two threads: the producer writes through the
+// OutputStream side, the consumer reads through the InputStream side. Writes
+// block while the buffer is full, so a slow consumer throttles the producer
+// instead of growing memory.
+class StreamPipe : public InputStream, public OutputStream {
+public:
+    explicit StreamPipe(size_t capacity = 4 * 1024 * 1024);
+
+    StreamPipe(const StreamPipe&) = delete;
+    StreamPipe& operator=(const StreamPipe&) = delete;
+
+    // Blocks until data is available; 0 bytes once the writer closed and the buffer drained
+    bool Read(void* buffer, size_t size, size_t& bytesRead) override;
+    // Blocks until everything is buffered; fails once the pipe was aborted
+    bool Write(const void* data, size_t size) override;
+
+    // Producer side: no more data, the reader sees end of stream
+    void CloseWrite();
+    // Either side: wakes both ends and fails all further reads and writes
+    void Abort();
+
+    bool Aborted() const;
+
+private:
+    std::vector<uint8_t> buffer_;
+    size_t head_;       // Next byte to read
+    size_t size_;       // Bytes buffered
+    bool closed_;
+    bool aborted_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable readable_;
+    std::condition_variable writable_;
+};
+
+} // namespace InstAnalyticsInstaller
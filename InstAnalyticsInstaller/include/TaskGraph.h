@@ -0,0 +1,100 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+
+// Runs installation phases as a dependency graph. A task starts on its own
+// thread as soon as all its dependencies have succeeded, so independent
+// phases (the SDK and the app download) overlap. Overall progress is the
+// weight-averaged progress of the tasks. A failure or Cancel() keeps
+// pending tasks from starting and calls the cancel handlers of running ones.
+class TaskGraph {
+public:
+    using TaskId = size_t;
+    using ReportCallback = std::function<void(int progress, const std::wstring& status)>;
+    using TaskFunction = std::function<bool(const ReportCallback& report)>;
+
+    enum class TaskState {
+        Pending,
+        Running,
+        Succeeded,
+        Failed,
+        Skipped     // Never started: cancelled, or a dependency failed
+    };
+
+    static constexpr TaskId NO_TASK = (TaskId)-1;
+
+    TaskGraph();
+    ~TaskGraph();
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    // Dependencies must already be in the graph, which keeps it acyclic.
+    // weight is the task's share of the overall progress
+    TaskId Add(const std::wstring& name, unsigned weight, TaskFunction run,
+        const std::vector<TaskId>& dependencies = {});
+
+    // Called (from the cancelling thread) when the task must stop early
+    void SetCancelHandler(TaskId task, std::function<void()> handler);
+
+    // Sees Running when a task starts, its outcome when it ends and Skipped
+    // for tasks that never ran. Called from task threads, possibly at once
+    using StateCallback = std::function<void(TaskId task, TaskState state)>;
+    void SetStateCallback(StateCallback callback) { stateCallback_ = callback; }
+
+    // Blocks until no task can make progress; true when every task succeeded.
+    // The callback is never invoked concurrently and never goes backwards
+    bool Run(ReportCallback callback = nullptr);
+
+    void Cancel();
+    bool Cancelled() const;
+
+    TaskState State(TaskId task) const;
+    const std::wstring& Name(TaskId task) const { return tasks_[task].name; }
+
+    // First task that failed, NO_TASK if none did
+    TaskId FailedTask() const;
+
+private:
+    struct Task {
+        std::wstring name;
+        unsigned weight;
+        TaskFunction run;
+        std::function<void()> cancelHandler;
+        std::vector<TaskId> dependents;
+        size_t waitingFor;      // Dependencies not yet succeeded
+        TaskState state;
+        int progress;
+    };
+
+    void Start(TaskId task);    // Requires mutex_
+    void Execute(TaskId task);
+    void Report(TaskId task, int progress, const std::wstring& status);
+    void StopAll();             // Requires mutex_ not held
+
+    std::vector<Task> tasks_;
+    std::vector<std::thread> threads_;
+    ReportCallback callback_;
+    StateCallback stateCallback_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable finished_;
+    size_t running_;
+    bool stopping_;
+    bool cancelled_;
+    TaskId failedTask_;
+
+    std::mutex reportMutex_;
+    int reported_;
+    std::wstring status_;       // Last non-empty status, kept while other tasks finish
+};
+
+} // namespace InstAnalyticsInstaller
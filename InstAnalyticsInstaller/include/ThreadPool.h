@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+
+// Work-stealing thread pool. Each worker owns a deque: it pops its own
+// tasks from the front and, when idle, steals from the back of the others.
+// Tasks receive the index of the worker running them so callers can keep
+// per-thread state (buffers, decoders) without locking. Tasks must not throw.
+class ThreadPool {
+public:
+    using Task = std::function<void(unsigned worker)>;
+
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Tasks are dealt round-robin, so submitting in priority order keeps the
+    // most important work at the front of every queue
+    void Submit(Task task);
+    void Wait();
+
+    unsigned ThreadCount() const { return (unsigned)threads_.size(); }
+    static unsigned DefaultThreadCount();
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void WorkerLoop(unsigned index);
+    bool TryPop(unsigned index, Task& task);
+    bool TrySteal(unsigned index, Task& task);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    size_t queued_;
+    size_t outstanding_;
+    unsigned nextQueue_;
+    bool stopping_;
+};
+
+} // namespace InstAnalyticsInstaller
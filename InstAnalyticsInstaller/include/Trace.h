@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace InstAnalyticsInstaller {
+
+// One span or counter sample as stored in a thread's ring buffer
+struct TraceEvent {
+    static const unsigned MAX_ARGS = 4;
+
+    const char* name;
+    const char* category;
+    char type;                  // 'X' span, 'C' counter
+    uint64_t start;             // Nanoseconds since Trace::Enable()
+    uint64_t duration;
+    unsigned argCount;
+    const char* argNames[MAX_ARGS];
+    int64_t argValues[MAX_ARGS];
+};
+
+// Lightweight tracing of where installation time goes. Spans and counters
+// land in per-thread ring buffers (no locks on the hot path) stamped with a
+// steady clock, and are exported as a Chrome trace_event JSON file that
+// chrome://tracing or Perfetto can open. Until Enable() is called a span
+// costs one relaxed atomic load.
+//
+// Names, categories and argument keys are not copied: pass string literals.
+class Trace {
+public:
+    static void Enable();
+    static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static void Counter(const char* name, int64_t value);
+    static void SetThreadName(const std::string& name);
+
+    // Writes everything recorded so far. Call once the traced work is done:
+    // a thread still recording may overwrite events while they are copied
+    static bool WriteChromeTrace(const std::wstring& path);
+
+    static uint64_t Now();      // Nanoseconds since Enable()
+
+private:
+    friend class TraceSpan;
+
+    static void Record(const TraceEvent& event);
+
+    static std::atomic<bool> enabled_;
+};
+
+// Times the enclosing scope: TraceSpan span("extract"); ... span.SetArg(...)
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, const char* category = "install")
+        : active_(Trace::Enabled())
+    {
+        if (active_) {
+            event_.name = name;
+            event_.category = category;
+            event_.type = 'X';
+            event_.argCount = 0;
+            event_.start = Trace::Now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (active_) {
+            event_.duration = Trace::Now() - event_.start;
+            Trace::Record(event_);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    void SetArg(const char* key, int64_t value)
+    {
+        if (active_ && event_.argCount < TraceEvent::MAX_ARGS) {
+            event_.argNames[event_.argCount] = key;
+            event_.argValues[event_.argCount] = value;
+            ++event_.argCount;
+        }
+    }
+
+    // Adds "bytes" and the span's throughput in KB/s
+    void SetBytes(uint64_t bytes)
+    {
+        if (active_) {
+            uint64_t elapsed = Trace::Now() - event_.start;
+            SetArg("bytes", (int64_t)bytes);
+            SetArg("KBps", elapsed > 0 ? (int64_t)(bytes * 1000000000.0 / 1024.0 / elapsed) : 0);
+        }
+    }
+
+private:
+    bool active_;
+    TraceEvent event_;
+};
+
+} // namespace InstAnalyticsInstaller
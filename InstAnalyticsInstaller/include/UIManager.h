@@ -3,6 +3,7 @@
 #include <windows.h>
 #include <string>
 #include <functional>
+#include "ProgressSnapshot.h"
 
 namespace InstAnalyticsInstaller {
 
@@ -14,6 +15,7 @@ enum class InstallState {
     SelectingPath,
     DownloadingApp,
     ExtractingApp,
+    VerifyingApp,
     Completed,
     Error
 };
@@ -26,6 +28,8 @@ public:
     bool Initialize();
     int Run();
     void SetState(InstallState state);
+    // Safe and cheap from any thread: publishes into the progress snapshot,
+    // which the window applies on its refresh timer
     void UpdateProgress(int progress, const std::wstring& status);
     void SetError(const std::wstring& errorMessage);
     std::wstring GetInstallPath() const { return installPath_; }
@@ -33,6 +37,9 @@ public:
 
     using InstallCallback = std::function<void()>;
     void SetInstallCallback(InstallCallback callback) { installCallback_ = callback; }
+    // Runs when the user confirms closing while an installation is in progress;
+    // the window is destroyed after it returns
+    void SetCancelCallback(InstallCallback callback) { cancelCallback_ = callback; }
 
 private:
     HINSTANCE hInstance_;
@@ -64,6 +71,10 @@ private:
     bool trackingMouse_;
 
     InstallCallback installCallback_;
+    InstallCallback cancelCallback_;
+
+    ProgressSnapshot progress_;
+    uint64_t shownProgressVersion_;
 
     static LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
     static LRESULT CALLBACK ButtonSubclassProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam, UINT_PTR uIdSubclass, DWORD_PTR dwRefData);
@@ -71,6 +82,7 @@ private:
 
     void CreateControls();
     void UpdateUI();
+    void ApplyProgress();
     void OnInstallButtonClick();
     void OnBrowseButtonClick();
     void OnCancelButtonClick();
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "HttpTransport.h"
+#include <map>
+#include <mutex>
+#include <string>
+#include <windows.h>
+#include <wininet.h>
+
+namespace InstAnalyticsInstaller {
+
+// HttpTransport on top of WinINet. One internet session is shared by every
+// request issued through the same transport: WinINet keeps its sockets
+// alive between requests and resumes TLS sessions, as long as the session
+// and the per-server connection handles stay open.
+class WinInetTransport : public HttpTransport {
+public:
+    WinInetTransport();
+    ~WinInetTransport() override;
+
+    std::unique_ptr<HttpStream> Open(const HttpRequest& request) override;
+
+private:
+    std::unique_ptr<HttpStream> OpenUrl(const HttpRequest& request, std::wstring& finalUrl);
+    HINTERNET Connection(const std::wstring& host, INTERNET_PORT port);
+
+    HINTERNET session_;
+    std::mutex connectionsMutex_;
+    std::map<std::wstring, HINTERNET> connections_;     // By "host:port", closed with the session
+    RedirectCache redirects_;
+};
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "InstallPipeline.h"
+#include "Installer.h"
+
+namespace InstAnalyticsInstaller {
+
+// The installation's system side on Windows: DotNetChecker for detection
+// and PATH, the elevated SDK setup and the shell shortcuts from Installer
+class WindowsInstallEnvironment : public InstallEnvironment {
+public:
+    bool IsDotNetInstalled() override;
+    std::wstring DotNetDownloadUrl() override;
+    std::vector<std::wstring> DotNetMirrors() override;
+    std::wstring DotNetDownloadSha256() override;
+    bool IsTrustedDotNetInstaller(const std::wstring& installerPath) override;
+    bool InstallDotNet(const std::wstring& installerPath, const ProgressCallback& callback,
+        const std::shared_ptr<CancellationToken>& cancel, unsigned long& exitCode) override;
+    bool ConfigureDotNetPath() override;
+    bool CreateShortcuts(const std::wstring& installPath) override;
+
+private:
+    Installer dotnetInstaller_;
+    Installer shortcutInstaller_;
+};
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Stream.h"
+
+namespace InstAnalyticsInstaller {
+
+struct ZipEntry {
+    std::wstring name;          // Decoded path as stored, '/' separated
+    uint16_t method = 0;        // 0 = stored, 8 = deflate
+    uint16_t flags = 0;
+    uint32_t crc32 = 0;
+    uint64_t compressedSize = 0;
+    uint64_t uncompressedSize = 0;
+    uint64_t localHeaderOffset = 0;
+    bool isDirectory = false;
+};
+
+// Central directory reader (ZIP and ZIP64) over any positional source
+class ZipArchive {
+public:
+    static constexpr uint16_t METHOD_STORED = 0;
+    static constexpr uint16_t METHOD_DEFLATE = 8;
+    static constexpr uint16_t FLAG_ENCRYPTED = 0x0001;
+    static constexpr uint16_t FLAG_DATA_DESCRIPTOR = 0x0008;
+    static constexpr uint16_t FLAG_UTF8 = 0x0800;
+
+    bool Open(RandomAccessInput& input);
+
+    const std::vector<ZipEntry>& Entries() const { return entries_; }
+
+    // Where the central directory starts: the end of the last entry's data
+    uint64_t DirectoryOffset() const { return directoryOffset_; }
+
+    // Resolves the offset of the entry's compressed data by reading its local header
+    bool GetDataOffset(const ZipEntry& entry, uint64_t& offset) const;
+
+    // Rejects absolute paths, drive letters and ".." components
+    static bool IsSafePath(const std::wstring& name);
+    static std::wstring DecodeName(const std::string& raw, bool utf8);
+
+private:
+    friend class ZipStreamReader;
+
+    // Decodes one central directory record; recordSize includes name, extra and comment
+    static bool ParseCentralHeader(const uint8_t* header, size_t available, ZipEntry& entry, size_t& recordSize);
+
+    bool ReadCentralDirectory(uint64_t offset, uint64_t size, uint64_t count);
+    bool ReadExactAt(uint64_t offset, void* buffer, size_t size) const;
+
+    RandomAccessInput* input_ = nullptr;
+    std::vector<ZipEntry> entries_;
+    uint64_t directoryOffset_ = 0;
+};
+
+// Forward-only reader for an archive that arrives as a stream. Entries come
+// from their local headers in file order; the central directory at the end
+// is then checked against everything that was read.
+class ZipStreamReader {
+public:
+    explicit ZipStreamReader(ByteReader& input);
+
+    // Reads the next local header and leaves the input at the entry's data.
+    // Returns false at the central directory (Finished()) or on a bad header.
+    // Entries with a data descriptor report zero sizes until EndEntry.
+    bool NextEntry(ZipEntry& entry);
+
+    // Call after the entry's data has been consumed: reads the data descriptor
+    // when present and checks the compressed size against the bytes used
+    bool EndEntry(ZipEntry& entry);
+
+    // Reads the central directory and end records, which must describe
+    // exactly the entries returned by NextEntry
+    bool VerifyDirectory();
+
+    bool Finished() const { return finished_; }
+
+private:
+    ByteReader& input_;
+    std::vector<ZipEntry> entries_;
+    uint64_t dataStart_;
+    uint32_t nextSignature_;
+    bool zip64_;
+    bool finished_;
+};
+
+} // namespace InstAnalyticsInstaller
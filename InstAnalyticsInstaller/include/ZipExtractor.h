@@ -1,18 +1,114 @@
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <functional>
+#include <set>
+#include <vector>
+#include "CancellationToken.h"
+#include "Inflater.h"
+#include "ZipArchive.h"
 
 namespace InstAnalyticsInstaller {
 
 using ExtractionProgressCallback = std::function<void(int progress, const std::wstring& currentFile)>;
 
+struct ExtractionOptions {
+    // 1 = serial, 0 = one worker per hardware thread
+    unsigned threadCount = 1;
+
+    // Path rewriting applied while writing, so each file lands directly at
+    // its final location: drop N leading components (entries with fewer are
+    // skipped), then optionally the directory prefix shared by all entries
+    unsigned stripComponents = 0;
+    bool stripCommonRoot = false;
+
+    // Set when extraction stopped because the destination volume is full
+    std::atomic<bool>* insufficientSpace = nullptr;
+
+    // Checked on every block written: a cancelled extraction stops within
+    // one buffer and removes the entry it was writing
+    const CancellationToken* cancel = nullptr;
+
+    // Extract only: when set, just the files whose relative path (as
+    // ListFiles reports it) is in here are written, and only their
+    // directories are created
+    const std::set<std::wstring>* only = nullptr;
+};
+
 class ZipExtractor {
 public:
-    static bool Extract(const std::wstring& zipPath, const std::wstring& destinationPath, ExtractionProgressCallback callback = nullptr);
+    // A file the archive places under the destination, after the options'
+    // path rewriting: '/' separated and relative to the destination
+    struct ArchiveFile {
+        const ZipEntry* entry;
+        std::wstring relativePath;
+    };
+
+    // The callback may be invoked from worker threads, but never concurrently
+    static bool Extract(const std::wstring& zipPath, const std::wstring& destinationPath,
+        ExtractionProgressCallback callback = nullptr, const ExtractionOptions& options = ExtractionOptions());
+
+    // The same from any positional source, e.g. a remote archive read with ranges
+    static bool Extract(RandomAccessInput& input, const std::wstring& destinationPath,
+        ExtractionProgressCallback callback = nullptr, const ExtractionOptions& options = ExtractionOptions());
+
+    // Decompresses one entry into output, checking its size and CRC
+    static bool ReadEntry(const ZipArchive& archive, RandomAccessInput& input, const ZipEntry& entry,
+        OutputStream& output, const CancellationToken* cancel = nullptr);
+
+    // The files Extract would write, in central directory order; false on an unsafe name
+    static bool ListFiles(const ZipArchive& archive, const ExtractionOptions& options, std::vector<ArchiveFile>& files);
+
+    // Extracts an archive while it is still arriving (e.g. from a download
+    // pipe), entry by entry from the local headers, and only succeeds once the
+    // central directory has been checked and the input reached its end.
+    // With threadCount other than 1, an entry whose sizes are in its local
+    // header is read into memory and inflated on a worker while the stream
+    // moves on; entries behind a data descriptor are decoded in line.
+    // archiveSize (0 = unknown) is only used for progress.
+    static bool ExtractStream(InputStream& input, const std::wstring& destinationPath,
+        ExtractionProgressCallback callback = nullptr, const ExtractionOptions& options = ExtractionOptions(),
+        uint64_t archiveSize = 0);
 
 private:
-    static bool ExtractWithShell(const std::wstring& zipPath, const std::wstring& destinationPath);
+    // Per-thread decoder state and copy buffer
+    struct WorkerContext {
+        Inflater inflater;
+        std::vector<uint8_t> buffer;
+    };
+
+    struct ExtractionJob {
+        const ZipEntry* entry;
+        std::wstring relativePath;
+        std::wstring outputPath;
+    };
+
+    // Entry already placed by ExtractStream, kept so a narrowing common root can move it
+    struct StreamedEntry {
+        std::wstring name;
+        std::wstring outputPath;
+        bool isDirectory;
+    };
+
+    static bool ExtractEntry(const ZipArchive& archive, RandomAccessInput& input, const ZipEntry& entry,
+        const std::wstring& outputPath, WorkerContext& context, const ExtractionOptions& options);
+    // Stored or inflated data of the entry into writer
+    static bool DecodeEntry(const ZipArchive& archive, RandomAccessInput& input, const ZipEntry& entry,
+        OutputStream& writer, WorkerContext& context);
+    static bool ExtractStreamedEntry(ByteReader& reader, ZipStreamReader& zip, ZipEntry& entry,
+        const std::wstring& outputPath, WorkerContext& context, const ExtractionOptions& options);
+    // An entry's compressed data, read ahead by ExtractStream, into outputPath
+    static bool ExtractBufferedEntry(const std::vector<uint8_t>& data, const ZipEntry& entry,
+        const std::wstring& outputPath, WorkerContext& context, const ExtractionOptions& options);
+    static bool PreallocateEntry(File& output, uint64_t size, const ExtractionOptions& options);
+    static bool Relocate(std::vector<StreamedEntry>& placed, const std::wstring& destinationPath,
+        const std::wstring& root, std::set<std::wstring>& directories);
+    // Relative path of each entry, empty for the ones stripped away entirely
+    static bool RelativePaths(const std::vector<ZipEntry>& entries, const ExtractionOptions& options,
+        std::vector<std::wstring>& paths);
+    static std::wstring StripComponents(const std::wstring& name, unsigned count);
+    static std::wstring FindCommonRoot(const std::vector<std::wstring>& names);
 };
 
 } // namespace InstAnalyticsInstaller
@@ -0,0 +1,160 @@
+#include "AsyncFileWriter.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+// Aim for blocks that take this long to receive: big enough to amortize the
+// write call, small enough that the writer starts early
+constexpr double TARGET_FILL_SECONDS = 0.05;
+
+uint8_t* AllocateAligned(size_t size)
+{
+#ifdef _WIN32
+    return (uint8_t*)_aligned_malloc(size, AsyncFileWriter::BUFFER_ALIGNMENT);
+#else
+    return (uint8_t*)aligned_alloc(AsyncFileWriter::BUFFER_ALIGNMENT, size);
+#endif
+}
+
+void FreeAligned(uint8_t* buffer)
+{
+#ifdef _WIN32
+    _aligned_free(buffer);
+#else
+    free(buffer);
+#endif
+}
+
+} // namespace
+
+AsyncFileWriter::AsyncFileWriter(File& file, size_t bufferCount, size_t bufferSize, WrittenCallback onWritten,
+    const CancellationToken* cancel)
+    : file_(file)
+    , onWritten_(onWritten)
+    , cancel_(cancel)
+    , bufferSize_(std::max(MIN_BUFFER_SIZE, (bufferSize + BUFFER_ALIGNMENT - 1) & ~(BUFFER_ALIGNMENT - 1)))
+    , filled_(std::max<size_t>(bufferCount, 2))
+    , free_(std::max<size_t>(bufferCount, 2))
+    , current_(NO_BUFFER)
+    , targetSize_(std::min<size_t>(bufferSize_, 4 * MIN_BUFFER_SIZE))
+    , finished_(false)
+    , bytesWritten_(0)
+    , failed_(false)
+{
+    // At least two buffers, so one can fill while the other is written
+    for (size_t i = 0; i < std::max<size_t>(bufferCount, 2); ++i) {
+        uint8_t* buffer = AllocateAligned(bufferSize_);
+        if (!buffer) {
+            failed_ = true;
+            break;
+        }
+        buffers_.push_back(buffer);
+        free_.Push(i);
+    }
+
+    writer_ = std::thread(&AsyncFileWriter::WriterLoop, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    Finish();
+    for (uint8_t* buffer : buffers_) {
+        FreeAligned(buffer);
+    }
+}
+
+uint8_t* AsyncFileWriter::Acquire()
+{
+    if (failed_ || finished_) {
+        return nullptr;
+    }
+
+    if (current_ == NO_BUFFER && !free_.Pop(current_)) {
+        current_ = NO_BUFFER;
+        return nullptr;
+    }
+
+    fillStart_ = std::chrono::steady_clock::now();
+    return buffers_[current_];
+}
+
+bool AsyncFileWriter::Submit(uint64_t offset, size_t size)
+{
+    if (current_ == NO_BUFFER || size == 0) {
+        return current_ != NO_BUFFER;
+    }
+
+    AdaptTargetSize(size);
+
+    Block block = { current_, offset, size };
+    current_ = NO_BUFFER;
+    return filled_.Push(block) && !failed_;
+}
+
+void AsyncFileWriter::AdaptTargetSize(size_t size)
+{
+    // Only full blocks say something about the link; short ones end a stream
+    if (size < targetSize_) {
+        return;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fillStart_).count();
+    double wanted = seconds > 0 ? size / seconds * TARGET_FILL_SECONDS : (double)bufferSize_;
+
+    // One step per block keeps a single slow read from collapsing the size
+    if (wanted > targetSize_ * 2.0 && targetSize_ < bufferSize_) {
+        targetSize_ = std::min(targetSize_ * 2, bufferSize_);
+    } else if (wanted < targetSize_ / 2.0 && targetSize_ > MIN_BUFFER_SIZE) {
+        targetSize_ = std::max(targetSize_ / 2, MIN_BUFFER_SIZE);
+    }
+}
+
+bool AsyncFileWriter::Finish()
+{
+    if (!finished_) {
+        finished_ = true;
+        filled_.Close();
+        if (writer_.joinable()) {
+            writer_.join();
+        }
+    }
+    return !failed_;
+}
+
+void AsyncFileWriter::WriterLoop()
+{
+    Trace::SetThreadName("file writer");
+
+    Block block;
+    while (filled_.Pop(block)) {
+        if (cancel_ && cancel_->IsCancelled()) {
+            failed_.store(true, std::memory_order_release);
+        }
+
+        // After a failure blocks are only recycled, so the producer never blocks forever
+        if (!failed_.load(std::memory_order_relaxed)) {
+            const uint8_t* data = buffers_[block.buffer];
+            TraceSpan span("disk.write", "io");
+            span.SetBytes(block.size);
+            if (file_.WriteAt(block.offset, data, block.size)) {
+                if (onWritten_) {
+                    onWritten_(block.offset, data, block.size);
+                }
+                bytesWritten_.fetch_add(block.size, std::memory_order_release);
+            } else {
+                failed_.store(true, std::memory_order_release);
+            }
+        }
+        free_.Push(block.buffer);
+    }
+}
+
+} // namespace InstAnalyticsInstaller
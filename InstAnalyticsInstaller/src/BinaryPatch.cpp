@@ -0,0 +1,591 @@
+#include "BinaryPatch.h"
+#include "FileSystem.h"
+#include "ReleaseManifest.h"
+#include "StagedInstall.h"
+#include "Trace.h"
+#include "ZipExtractor.h"
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+#include <limits>
+#include <map>
+#include <set>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+const char PATCH_MAGIC[8] = { 'I', 'A', 'P', 'A', 'T', 'C', 'H', '1' };
+const wchar_t PATCH_SUFFIX[] = L".patch";
+constexpr size_t SUFFIX_LENGTH = 6;
+constexpr size_t HEX_DIGEST_LENGTH = Sha256::DIGEST_SIZE * 2;
+
+void Put64(std::vector<uint8_t>& out, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) {
+        out.push_back((uint8_t)(value >> (i * 8)));
+    }
+}
+
+uint64_t Get64(const uint8_t* data)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+void PutDigest(std::vector<uint8_t>& out, const std::vector<uint8_t>& data)
+{
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    Sha256 sha;
+    sha.Update(data.data(), data.size());
+    sha.Final(digest);
+    out.insert(out.end(), digest, digest + sizeof(digest));
+}
+
+// Suffix array by prefix doubling: each round sorts, within every group of
+// suffixes still tied on their first k bytes, by the rank of the suffix k
+// bytes further on. Only tied groups are touched, so rounds get cheaper
+std::vector<int32_t> SuffixArray(const std::vector<uint8_t>& data)
+{
+    int64_t n = (int64_t)data.size();
+    std::vector<int32_t> sa(n), rank(n), next(n);
+
+    size_t starts[257] = {};
+    for (uint8_t byte : data) {
+        ++starts[byte + 1];
+    }
+    for (int i = 1; i <= 256; ++i) {
+        starts[i] += starts[i - 1];
+    }
+    for (int64_t i = 0; i < n; ++i) {
+        rank[i] = (int32_t)starts[data[i]];
+    }
+    for (int64_t i = 0; i < n; ++i) {
+        sa[starts[data[i]]++] = (int32_t)i;
+    }
+
+    // A suffix's rank is where its group starts in the array
+    for (int64_t k = 1; ; k *= 2) {
+        auto key = [&](int32_t i) { return i + k < n ? rank[i + k] : -1; };
+        bool tied = false;
+        next = rank;
+        for (int64_t start = 0; start < n;) {
+            int64_t end = start + 1;
+            while (end < n && rank[sa[end]] == rank[sa[start]]) {
+                ++end;
+            }
+            if (end - start > 1) {
+                std::sort(sa.begin() + start, sa.begin() + end, [&](int32_t a, int32_t b) { return key(a) < key(b); });
+                for (int64_t j = start; j < end; ++j) {
+                    if (j > start && key(sa[j]) == key(sa[j - 1])) {
+                        next[sa[j]] = next[sa[j - 1]];
+                        tied = true;
+                    } else {
+                        next[sa[j]] = (int32_t)j;
+                    }
+                }
+            }
+            start = end;
+        }
+        rank.swap(next);
+        if (!tied) {
+            break;
+        }
+    }
+    return sa;
+}
+
+int64_t MatchLength(const uint8_t* a, int64_t aSize, const uint8_t* b, int64_t bSize)
+{
+    int64_t length = 0;
+    while (length < aSize && length < bSize && a[length] == b[length]) {
+        ++length;
+    }
+    return length;
+}
+
+// Longest match for target in base, by binary search over the suffix array
+int64_t Search(const std::vector<int32_t>& sa, const std::vector<uint8_t>& base, const uint8_t* target,
+    int64_t targetSize, int64_t& position)
+{
+    int64_t baseSize = (int64_t)base.size();
+    int64_t low = 0;
+    int64_t high = baseSize - 1;
+    while (high - low >= 2) {
+        int64_t middle = low + (high - low) / 2;
+        size_t length = (size_t)std::min(baseSize - sa[middle], targetSize);
+        if (memcmp(base.data() + sa[middle], target, length) < 0) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    int64_t lowLength = MatchLength(base.data() + sa[low], baseSize - sa[low], target, targetSize);
+    int64_t highLength = MatchLength(base.data() + sa[high], baseSize - sa[high], target, targetSize);
+    position = lowLength > highLength ? sa[low] : sa[high];
+    return std::max(lowLength, highLength);
+}
+
+} // namespace
+
+bool BinaryPatch::Create(const std::vector<uint8_t>& base, const std::vector<uint8_t>& target,
+    std::vector<uint8_t>& patch)
+{
+    if (base.size() >= (size_t)std::numeric_limits<int32_t>::max() ||
+        target.size() >= (size_t)std::numeric_limits<int32_t>::max()) {
+        return false;
+    }
+
+    patch.assign(PATCH_MAGIC, PATCH_MAGIC + sizeof(PATCH_MAGIC));
+    Put64(patch, base.size());
+    PutDigest(patch, base);
+    Put64(patch, target.size());
+    PutDigest(patch, target);
+
+    auto record = [&](int64_t lastScan, int64_t lastPosition, int64_t diffLength, int64_t extraLength, int64_t seek) {
+        Put64(patch, (uint64_t)diffLength);
+        Put64(patch, (uint64_t)extraLength);
+        Put64(patch, (uint64_t)seek);
+        for (int64_t i = 0; i < diffLength; ++i) {
+            patch.push_back((uint8_t)(target[lastScan + i] - base[lastPosition + i]));
+        }
+        patch.insert(patch.end(), target.begin() + lastScan + diffLength,
+            target.begin() + lastScan + diffLength + extraLength);
+    };
+
+    int64_t baseSize = (int64_t)base.size();
+    int64_t targetSize = (int64_t)target.size();
+    if (baseSize == 0) {
+        if (targetSize > 0) {
+            record(0, 0, 0, targetSize, 0);
+        }
+        return true;
+    }
+
+    std::vector<int32_t> sa = SuffixArray(base);
+    const uint8_t* newData = target.data();
+    const uint8_t* oldData = base.data();
+
+    // bsdiff's scan: extend each exact match found through the suffix array
+    // forwards and backwards while at least half the bytes still agree, so
+    // code that only shifted becomes a diff of mostly zeros
+    int64_t scan = 0;
+    int64_t length = 0;
+    int64_t position = 0;
+    int64_t lastScan = 0;
+    int64_t lastPosition = 0;
+    int64_t lastOffset = 0;
+    while (scan < targetSize) {
+        int64_t oldScore = 0;
+        int64_t scoreScan = scan += length;
+        for (; scan < targetSize; ++scan) {
+            length = Search(sa, base, newData + scan, targetSize - scan, position);
+            for (; scoreScan < scan + length; ++scoreScan) {
+                if (scoreScan + lastOffset < baseSize && oldData[scoreScan + lastOffset] == newData[scoreScan]) {
+                    ++oldScore;
+                }
+            }
+            if ((length == oldScore && length != 0) || length > oldScore + 8) {
+                break;
+            }
+            if (scan + lastOffset < baseSize && oldData[scan + lastOffset] == newData[scan]) {
+                --oldScore;
+            }
+        }
+        if (length == oldScore && scan != targetSize) {
+            continue;
+        }
+
+        int64_t score = 0;
+        int64_t bestForward = 0;
+        int64_t forward = 0;
+        for (int64_t i = 0; lastScan + i < scan && lastPosition + i < baseSize;) {
+            if (oldData[lastPosition + i] == newData[lastScan + i]) {
+                ++score;
+            }
+            ++i;
+            if (score * 2 - i > bestForward * 2 - forward) {
+                bestForward = score;
+                forward = i;
+            }
+        }
+
+        int64_t backward = 0;
+        if (scan < targetSize) {
+            int64_t bestBackward = 0;
+            score = 0;
+            for (int64_t i = 1; scan >= lastScan + i && position >= i; ++i) {
+                if (oldData[position - i] == newData[scan - i]) {
+                    ++score;
+                }
+                if (score * 2 - i > bestBackward * 2 - backward) {
+                    bestBackward = score;
+                    backward = i;
+                }
+            }
+        }
+
+        // Both extensions claimed the same bytes: split where it scores best
+        if (lastScan + forward > scan - backward) {
+            int64_t overlap = (lastScan + forward) - (scan - backward);
+            int64_t bestSplit = 0;
+            int64_t split = 0;
+            score = 0;
+            for (int64_t i = 0; i < overlap; ++i) {
+                if (newData[lastScan + forward - overlap + i] == oldData[lastPosition + forward - overlap + i]) {
+                    ++score;
+                }
+                if (newData[scan - backward + i] == oldData[position - backward + i]) {
+                    --score;
+                }
+                if (score > bestSplit) {
+                    bestSplit = score;
+                    split = i + 1;
+                }
+            }
+            forward += split - overlap;
+            backward -= split;
+        }
+
+        record(lastScan, lastPosition, forward, (scan - backward) - (lastScan + forward),
+            (position - backward) - (lastPosition + forward));
+
+        lastScan = scan - backward;
+        lastPosition = position - backward;
+        lastOffset = position - scan;
+    }
+    return true;
+}
+
+std::wstring BinaryPatch::EntryName(const std::wstring& path, const std::wstring& baseSha256)
+{
+    std::wstring sha = baseSha256;
+    std::transform(sha.begin(), sha.end(), sha.begin(), towlower);
+    return path + L"." + sha + PATCH_SUFFIX;
+}
+
+bool BinaryPatch::ParseEntryName(const std::wstring& name, std::wstring& path, std::wstring& baseSha256)
+{
+    size_t tail = 1 + HEX_DIGEST_LENGTH + SUFFIX_LENGTH;
+    if (name.size() <= tail || name.compare(name.size() - SUFFIX_LENGTH, SUFFIX_LENGTH, PATCH_SUFFIX) != 0 ||
+        name[name.size() - tail] != L'.') {
+        return false;
+    }
+
+    std::wstring sha = name.substr(name.size() - tail + 1, HEX_DIGEST_LENGTH);
+    for (wchar_t& c : sha) {
+        if (!iswxdigit(c)) {
+            return false;
+        }
+        c = towlower(c);
+    }
+    path = name.substr(0, name.size() - tail);
+    baseSha256 = sha;
+    return true;
+}
+
+bool BinaryPatch::ApplyEntry(const ZipArchive& archive, RandomAccessInput& input, const ZipEntry& entry,
+    const std::wstring& basePath, const std::wstring& targetPath, const std::wstring& expectedSha256,
+    const CancellationToken* cancel)
+{
+    TraceSpan span("patch.apply", "patch");
+
+    PatchApplier applier(basePath, targetPath, cancel);
+    if (!ZipExtractor::ReadEntry(archive, input, entry, applier, cancel) || !applier.Finish(expectedSha256)) {
+        return false;
+    }
+    span.SetBytes(applier.TargetSize());
+    return true;
+}
+
+bool BinaryPatch::ApplyArchive(const std::wstring& archivePath, const std::wstring& installPath,
+    std::function<void(int progress, const std::wstring& file)> callback, const CancellationToken* cancel,
+    size_t* applied)
+{
+    TraceSpan span("patch.archive", "patch");
+
+    FileInput input;
+    ZipArchive archive;
+    if (!input.Open(archivePath) || !archive.Open(input)) {
+        return false;
+    }
+
+    // Patched files are built and checked in the staging directory; the
+    // install only changes in the switch once every patch has applied
+    StagedInstall staged(installPath);
+    if (!staged.Prepare()) {
+        return false;
+    }
+
+    // Installed files are hashed once, however many base versions have a patch
+    std::map<std::wstring, std::wstring> installed;
+    std::vector<std::wstring> patched;
+    const std::vector<ZipEntry>& entries = archive.Entries();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        std::wstring path;
+        std::wstring baseSha256;
+        if (entries[i].isDirectory || !ParseEntryName(entries[i].name, path, baseSha256)) {
+            continue;
+        }
+        if (!ZipArchive::IsSafePath(path)) {
+            return false;
+        }
+
+        std::wstring filePath = FileSystem::JoinPath(installPath, path);
+        auto hashed = installed.find(path);
+        if (hashed == installed.end()) {
+            std::wstring sha256;
+            uint64_t size = 0;
+            if (FileSystem::FileExists(filePath) && !ReleaseManifest::HashFile(filePath, sha256, size, cancel)) {
+                return false;
+            }
+            hashed = installed.emplace(path, sha256).first;
+        }
+        if (hashed->second.empty() || !Sha256::HexEquals(hashed->second, baseSha256)) {
+            continue;
+        }
+        // The base is the installed file, which an earlier entry may already have patched
+        if (std::find(patched.begin(), patched.end(), path) != patched.end()) {
+            continue;
+        }
+
+        if (callback) {
+            callback((int)(i * 100 / entries.size()), path);
+        }
+        std::wstring target = FileSystem::JoinPath(staged.StagingPath(), path);
+        if (!FileSystem::CreateDirectories(FileSystem::ParentPath(target)) ||
+            !ApplyEntry(archive, input, entries[i], filePath, target, L"", cancel)) {
+            return false;
+        }
+        patched.push_back(path);
+    }
+
+    // Everything else is carried over, so the switch replaces the install
+    // whole and keeps the one it replaced for a rollback
+    if (cancel && cancel->IsCancelled()) {
+        return false;
+    }
+    if (!patched.empty() &&
+        (!staged.CarryOverAll(std::set<std::wstring>(patched.begin(), patched.end())) || !staged.Commit())) {
+        return false;
+    }
+    span.SetArg("patched", (int64_t)patched.size());
+    if (applied) {
+        *applied = patched.size();
+    }
+    if (callback) {
+        callback(100, L"");
+    }
+    return true;
+}
+
+PatchApplier::PatchApplier(const std::wstring& basePath, const std::wstring& targetPath,
+    const CancellationToken* cancel)
+    : basePath_(basePath)
+    , targetPath_(targetPath)
+    , tempPath_(targetPath + L".patching")
+    , cancel_(cancel)
+    , state_(State::Header)
+    , pendingSize_(0)
+    , baseSize_(0)
+    , targetSize_(0)
+    , produced_(0)
+    , basePosition_(0)
+    , diffLeft_(0)
+    , extraLeft_(0)
+    , seek_(0)
+{
+    memset(targetSha_, 0, sizeof(targetSha_));
+}
+
+PatchApplier::~PatchApplier()
+{
+    if (state_ != State::Header && state_ != State::Finished && state_ != State::Failed) {
+        Fail();
+    }
+}
+
+bool PatchApplier::Write(const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    if (cancel_ && cancel_->IsCancelled()) {
+        return Fail();
+    }
+
+    while (size > 0) {
+        size_t used = 0;
+        switch (state_) {
+        case State::Header:
+        case State::Record: {
+            size_t wanted = state_ == State::Header ? BinaryPatch::HEADER_SIZE : BinaryPatch::RECORD_SIZE;
+            used = std::min(wanted - pendingSize_, size);
+            memcpy(pending_ + pendingSize_, bytes, used);
+            pendingSize_ += used;
+            if (pendingSize_ == wanted) {
+                pendingSize_ = 0;
+                if (!(state_ == State::Header ? ParseHeader() : ParseRecord())) {
+                    return Fail();
+                }
+            }
+            break;
+        }
+        case State::Diff:
+            used = (size_t)std::min<uint64_t>(diffLeft_, size);
+            if (!ApplyDiff(bytes, used)) {
+                return Fail();
+            }
+            diffLeft_ -= used;
+            break;
+        case State::Extra:
+            used = (size_t)std::min<uint64_t>(extraLeft_, size);
+            if (!Output(bytes, used)) {
+                return Fail();
+            }
+            extraLeft_ -= used;
+            break;
+        default:
+            return Fail();      // Bytes past the end of the patch
+        }
+        bytes += used;
+        size -= used;
+
+        // The record is done once its diff and extra bytes are
+        if ((state_ == State::Diff || state_ == State::Extra) && diffLeft_ == 0) {
+            if (extraLeft_ > 0) {
+                state_ = State::Extra;
+            } else {
+                basePosition_ = (uint64_t)((int64_t)basePosition_ + seek_);
+                state_ = produced_ == targetSize_ ? State::Complete : State::Record;
+            }
+        }
+    }
+    return true;
+}
+
+bool PatchApplier::ParseHeader()
+{
+    if (memcmp(pending_, PATCH_MAGIC, sizeof(PATCH_MAGIC)) != 0) {
+        return false;
+    }
+    baseSize_ = Get64(pending_ + 8);
+    targetSize_ = Get64(pending_ + 16 + Sha256::DIGEST_SIZE);
+    memcpy(targetSha_, pending_ + 24 + Sha256::DIGEST_SIZE, Sha256::DIGEST_SIZE);
+
+    // Which base the patch expects is settled by whoever picked it (by hash);
+    // a wrong one still cannot get past the target hash
+    base_.reset(new FileInput());
+    if (!base_->Open(basePath_) || base_->Size() != baseSize_) {
+        return false;
+    }
+    if (!output_.Open(tempPath_, File::Mode::Write)) {
+        return false;
+    }
+    state_ = targetSize_ > 0 ? State::Record : State::Complete;
+    return true;
+}
+
+bool PatchApplier::ParseRecord()
+{
+    diffLeft_ = Get64(pending_);
+    extraLeft_ = Get64(pending_ + 8);
+    seek_ = (int64_t)Get64(pending_ + 16);
+
+    uint64_t remaining = targetSize_ - produced_;
+    if (diffLeft_ > remaining || extraLeft_ > remaining - diffLeft_ || diffLeft_ > baseSize_ - basePosition_) {
+        return false;
+    }
+    int64_t nextPosition = (int64_t)(basePosition_ + diffLeft_) + seek_;
+    if (nextPosition < 0 || (uint64_t)nextPosition > baseSize_) {
+        return false;
+    }
+
+    if (diffLeft_ > 0) {
+        state_ = State::Diff;
+    } else if (extraLeft_ > 0) {
+        state_ = State::Extra;
+    } else {
+        basePosition_ = (uint64_t)nextPosition;
+        state_ = produced_ == targetSize_ ? State::Complete : State::Record;
+    }
+    return true;
+}
+
+bool PatchApplier::ApplyDiff(const uint8_t* data, size_t size)
+{
+    baseBytes_.resize(std::min(size, BUFFER_SIZE));
+    while (size > 0) {
+        size_t chunk = std::min(size, baseBytes_.size());
+        size_t filled = 0;
+        while (filled < chunk) {
+            size_t bytesRead = 0;
+            if (!base_->ReadAt(basePosition_ + filled, baseBytes_.data() + filled, chunk - filled, bytesRead) ||
+                bytesRead == 0) {
+                return false;
+            }
+            filled += bytesRead;
+        }
+        for (size_t i = 0; i < chunk; ++i) {
+            baseBytes_[i] = (uint8_t)(baseBytes_[i] + data[i]);
+        }
+        if (!Output(baseBytes_.data(), chunk)) {
+            return false;
+        }
+        basePosition_ += chunk;
+        data += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool PatchApplier::Output(const uint8_t* data, size_t size)
+{
+    sha_.Update(data, size);
+    produced_ += size;
+    buffer_.insert(buffer_.end(), data, data + size);
+    return buffer_.size() < BUFFER_SIZE || Flush();
+}
+
+bool PatchApplier::Flush()
+{
+    bool written = buffer_.empty() || output_.Write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+    return written;
+}
+
+bool PatchApplier::Finish(const std::wstring& expectedSha256)
+{
+    if (state_ != State::Complete || !Flush()) {
+        return Fail();
+    }
+    output_.Close();
+
+    uint8_t digest[Sha256::DIGEST_SIZE];
+    sha_.Final(digest);
+    if (memcmp(digest, targetSha_, sizeof(digest)) != 0 ||
+        (!expectedSha256.empty() && !Sha256::HexEquals(Sha256::ToHex(digest), expectedSha256))) {
+        return Fail();
+    }
+
+    // The base may be the target: closed before it is replaced
+    base_.reset();
+    if (!FileSystem::RenameFile(tempPath_, targetPath_)) {
+        return Fail();
+    }
+    state_ = State::Finished;
+    return true;
+}
+
+bool PatchApplier::Fail()
+{
+    state_ = State::Failed;
+    output_.Close();
+    base_.reset();
+    FileSystem::RemoveFile(tempPath_);
+    return false;
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,79 @@
+#include "CancellationToken.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace InstAnalyticsInstaller {
+
+CancellationToken::CancellationToken()
+    : cancelled_(false)
+{
+#ifdef _WIN32
+    event_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+#else
+    if (pipe2(pipe_, O_CLOEXEC | O_NONBLOCK) != 0) {
+        pipe_[0] = pipe_[1] = -1;
+    }
+#endif
+}
+
+CancellationToken::~CancellationToken()
+{
+#ifdef _WIN32
+    if (event_) {
+        CloseHandle(event_);
+    }
+#else
+    if (pipe_[0] >= 0) {
+        close(pipe_[0]);
+        close(pipe_[1]);
+    }
+#endif
+}
+
+void CancellationToken::Cancel()
+{
+    if (cancelled_.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+
+#ifdef _WIN32
+    if (event_) {
+        SetEvent(event_);
+    }
+#else
+    // Never read back: the pipe stays readable for every later poll
+    if (pipe_[1] >= 0) {
+        char signal = 1;
+        ssize_t written = write(pipe_[1], &signal, 1);
+        (void)written;
+    }
+#endif
+}
+
+bool CancellationToken::WaitFor(std::chrono::milliseconds timeout) const
+{
+    if (IsCancelled()) {
+        return true;
+    }
+
+#ifdef _WIN32
+    if (event_) {
+        WaitForSingleObject(event_, (DWORD)timeout.count());
+    } else {
+        Sleep((DWORD)timeout.count());
+    }
+#else
+    // A failed pipe (fd -1) is ignored by poll, which then just sleeps
+    pollfd handle = { pipe_[0], POLLIN, 0 };
+    poll(&handle, 1, (int)timeout.count());
+#endif
+    return IsCancelled();
+}
+
+} // namespace InstAnalyticsInstaller
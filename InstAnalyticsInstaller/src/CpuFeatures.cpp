@@ -0,0 +1,67 @@
+#include "CpuFeatures.h"
+#include <atomic>
+
+#if defined(INSTANALYTICS_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(INSTANALYTICS_X86)
+#include <cpuid.h>
+#endif
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+std::atomic<bool> g_accelerationEnabled(true);
+
+#ifdef INSTANALYTICS_X86
+// registers: eax, ebx, ecx, edx; zeros for a leaf the CPU doesn't have
+void Cpuid(unsigned leaf, unsigned registers[4])
+{
+#ifdef _MSC_VER
+    int highest[4];
+    __cpuid(highest, 0);
+    int values[4] = {};
+    if (leaf <= (unsigned)highest[0]) {
+        __cpuidex(values, (int)leaf, 0);
+    }
+    for (int i = 0; i < 4; ++i) {
+        registers[i] = (unsigned)values[i];
+    }
+#else
+    registers[0] = registers[1] = registers[2] = registers[3] = 0;
+    __get_cpuid_count(leaf, 0, &registers[0], &registers[1], &registers[2], &registers[3]);
+#endif
+}
+#endif
+
+CpuFeatures Detect()
+{
+    CpuFeatures features;
+#ifdef INSTANALYTICS_X86
+    unsigned basic[4];
+    unsigned extended[4];
+    Cpuid(1, basic);
+    Cpuid(7, extended);
+    features.ssse3 = (basic[2] & (1u << 9)) != 0;
+    features.sse41 = (basic[2] & (1u << 19)) != 0;
+    features.pclmul = features.sse41 && (basic[2] & (1u << 1)) != 0;
+    features.sha = features.sse41 && (extended[1] & (1u << 29)) != 0;
+#endif
+    return features;
+}
+
+} // namespace
+
+const CpuFeatures& CpuFeatures::Get()
+{
+    static const CpuFeatures detected = Detect();
+    static const CpuFeatures none;
+    return g_accelerationEnabled.load(std::memory_order_relaxed) ? detected : none;
+}
+
+void CpuFeatures::SetAccelerationEnabled(bool enabled)
+{
+    g_accelerationEnabled = enabled;
+}
+
+} // namespace InstAnalyticsInstaller
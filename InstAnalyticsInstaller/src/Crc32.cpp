@@ -0,0 +1,169 @@
+#include "Crc32.h"
+#include "CpuFeatures.h"
+
+#ifdef INSTANALYTICS_X86
+#include <immintrin.h>
+#endif
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+// Slicing-by-8 tables, built once on first use
+struct Crc32Tables {
+    uint32_t table[8][256];
+
+    Crc32Tables()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+            }
+            table[0][i] = crc;
+        }
+
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int slice = 1; slice < 8; ++slice) {
+                uint32_t previous = table[slice - 1][i];
+                table[slice][i] = (previous >> 8) ^ table[0][previous & 0xFF];
+            }
+        }
+    }
+};
+
+const Crc32Tables& Tables()
+{
+    static const Crc32Tables tables;
+    return tables;
+}
+
+#ifdef INSTANALYTICS_X86
+
+// Folding with carry-less multiplies (Intel, "Fast CRC Computation for
+// Generic Polynomials Using PCLMULQDQ"), constants for the reflected
+// polynomial: four 128-bit lanes folded 64 bytes at a time, merged into one,
+// folded 16 bytes at a time, then reduced to 32 bits (Barrett). size is a
+// multiple of 16, at least 64; crc is the running (inverted) value
+constexpr size_t FOLD_MINIMUM = 64;
+
+alignas(16) const uint64_t FOLD_BY_4[2] = { 0x0154442bd4, 0x01c6e41596 };
+alignas(16) const uint64_t FOLD_BY_1[2] = { 0x01751997d0, 0x00ccaa009e };
+alignas(16) const uint64_t FOLD_TO_64[2] = { 0x0163cd6124, 0 };
+alignas(16) const uint64_t BARRETT[2] = { 0x01db710641, 0x01f7011641 };
+
+// value carried 128 bits further on, plus the next block
+INSTANALYTICS_TARGET("pclmul,sse4.1")
+inline __m128i Fold(__m128i value, __m128i next, __m128i k)
+{
+    __m128i low = _mm_clmulepi64_si128(value, k, 0x00);
+    __m128i high = _mm_clmulepi64_si128(value, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(high, next), low);
+}
+
+INSTANALYTICS_TARGET("pclmul,sse4.1")
+uint32_t FoldClmul(const uint8_t* p, size_t size, uint32_t crc)
+{
+    __m128i x1 = _mm_loadu_si128((const __m128i*)(p + 0x00));
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(p + 0x10));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(p + 0x20));
+    __m128i x4 = _mm_loadu_si128((const __m128i*)(p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+    __m128i k = _mm_load_si128((const __m128i*)FOLD_BY_4);
+    p += 64;
+    size -= 64;
+
+    while (size >= 64) {
+        __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+        __m128i x6 = _mm_clmulepi64_si128(x2, k, 0x00);
+        __m128i x7 = _mm_clmulepi64_si128(x3, k, 0x00);
+        __m128i x8 = _mm_clmulepi64_si128(x4, k, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(p + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(p + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(p + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(p + 0x30)));
+        p += 64;
+        size -= 64;
+    }
+
+    // Four lanes into one, then the remaining 16-byte blocks
+    k = _mm_load_si128((const __m128i*)FOLD_BY_1);
+    x1 = Fold(x1, x2, k);
+    x1 = Fold(x1, x3, k);
+    x1 = Fold(x1, x4, k);
+    while (size >= 16) {
+        x1 = Fold(x1, _mm_loadu_si128((const __m128i*)p), k);
+        p += 16;
+        size -= 16;
+    }
+
+    // 128 bits to 64
+    __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    k = _mm_loadl_epi64((const __m128i*)FOLD_TO_64);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    k = _mm_load_si128((const __m128i*)BARRETT);
+    x2 = _mm_and_si128(x1, mask);
+    x2 = _mm_clmulepi64_si128(x2, k, 0x10);
+    x2 = _mm_and_si128(x2, mask);
+    x2 = _mm_clmulepi64_si128(x2, k, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+#endif
+
+} // namespace
+
+uint32_t Crc32::Update(uint32_t crc, const void* data, size_t size)
+{
+#ifdef INSTANALYTICS_X86
+    if (size >= FOLD_MINIMUM && CpuFeatures::Get().pclmul) {
+        size_t folded = size & ~(size_t)15;
+        crc = ~FoldClmul((const uint8_t*)data, folded, ~crc);
+        data = (const uint8_t*)data + folded;
+        size -= folded;
+    }
+#endif
+    return UpdatePortable(crc, data, size);
+}
+
+uint32_t Crc32::UpdatePortable(uint32_t crc, const void* data, size_t size)
+{
+    const auto& t = Tables().table;
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+
+    while (size >= 8) {
+        uint32_t low = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+                              ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+        uint32_t high = (uint32_t)p[4] | ((uint32_t)p[5] << 8) |
+                        ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^
+              t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+              t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^
+              t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+
+        p += 8;
+        size -= 8;
+    }
+
+    while (size--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    }
+
+    return ~crc;
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,328 @@
+#include "DeltaUpdater.h"
+#include "BinaryPatch.h"
+#include "FileSystem.h"
+#include "HttpRangeInput.h"
+#include "ReleaseManifest.h"
+#include "StagedInstall.h"
+#include "Sha256.h"
+#include "Trace.h"
+#include "ZipArchive.h"
+#include "ZipExtractor.h"
+#include <algorithm>
+#include <cwchar>
+#include <map>
+#include <set>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+// An entry's bytes (local header, data, descriptor) run up to the next
+// entry's local header, or to the central directory for the last one
+class EntryRanges {
+public:
+    explicit EntryRanges(const ZipArchive& archive)
+        : directoryOffset_(archive.DirectoryOffset())
+    {
+        for (const auto& entry : archive.Entries()) {
+            starts_.push_back(entry.localHeaderOffset);
+        }
+        std::sort(starts_.begin(), starts_.end());
+    }
+
+    ByteRange For(const ZipEntry& entry) const
+    {
+        uint64_t start = entry.localHeaderOffset;
+        auto next = std::upper_bound(starts_.begin(), starts_.end(), start);
+        uint64_t end = next == starts_.end() ? directoryOffset_ : *next;
+        return { start, std::max(end, start) };
+    }
+
+private:
+    std::vector<uint64_t> starts_;
+    uint64_t directoryOffset_;
+};
+
+} // namespace
+
+DeltaUpdater::DeltaUpdater(std::shared_ptr<HttpTransport> transport, std::shared_ptr<CancellationToken> cancel)
+    : transport_(transport ? transport : HttpTransport::Shared())
+    , cancel_(cancel ? cancel : std::make_shared<CancellationToken>())
+    , insufficientSpace_(false)
+    , extractThreads_(0)
+    , switched_(false)
+    , changedFiles_(0)
+    , patchedFiles_(0)
+    , bytesFetched_(0)
+    , archiveSize_(0)
+{
+}
+
+bool DeltaUpdater::Update(const std::wstring& manifestUrl, const std::wstring& manifestSha256,
+    const std::wstring& patchesUrl, const std::wstring& archiveUrl, const std::wstring& installPath,
+    const std::wstring& workDirectory, ProgressCallback callback)
+{
+    TraceSpan span("update.delta", "update");
+
+    insufficientSpace_ = false;
+    switched_ = false;
+    changedFiles_ = 0;
+    patchedFiles_ = 0;
+    bytesFetched_ = 0;
+    archiveSize_ = 0;
+
+    // A first install has nothing to compare with
+    std::vector<DirectoryEntry> installed;
+    if (manifestUrl.empty() || !FileSystem::ListDirectory(installPath, installed) || installed.empty()) {
+        return false;
+    }
+
+    // The manifest's hashes are all that vouch for the ranges and patches
+    // fetched below, so it must be the pinned one; an unpinned manifest
+    // could name any bytes, so without a digest there is no delta
+    if (manifestSha256.empty()) {
+        span.SetArg("unpinned", 1);
+        return false;
+    }
+
+    ReleaseManifest manifest;
+    uint64_t manifestBytes = 0;
+    if (!manifest.Download(manifestUrl, manifestSha256, transport_, cancel_, &manifestBytes)) {
+        return false;
+    }
+    bytesFetched_ = manifestBytes;
+
+    if (callback) {
+        callback(0, L"Confronto con i file installati...");
+    }
+    std::vector<size_t> changed;
+    if (!manifest.FindChanged(installPath, 0, changed, cancel_.get())) {
+        return false;
+    }
+    // Files the release dropped are left out of the new version
+    std::vector<std::wstring> dropped;
+    if (!manifest.FindExtra(installPath, dropped)) {
+        return false;
+    }
+    changedFiles_ = changed.size();
+    span.SetArg("files", (int64_t)manifest.files.size());
+    span.SetArg("changed", (int64_t)changed.size());
+    span.SetArg("dropped", (int64_t)dropped.size());
+
+    if (changed.empty()) {
+        if (dropped.empty()) {
+            if (callback) {
+                callback(100, L"InstAnalytics è già aggiornato");
+            }
+            return true;
+        }
+        // Nothing to fetch: the switch alone removes them
+        if (callback) {
+            callback(90, L"Rimozione dei file non più utilizzati...");
+        }
+        StagedInstall staged(installPath);
+        return staged.Prepare() && Switch(staged, manifest, {});
+    }
+    // Nothing reusable and nothing to patch: one streamed download does better than many ranges
+    if (changed.size() == manifest.files.size() && patchesUrl.empty()) {
+        return false;
+    }
+
+    HttpRangeInput remote(transport_, cancel_.get());
+    std::wstring spoolPath = FileSystem::JoinPath(workDirectory, Downloader::FileNameFromUrl(archiveUrl) + L".delta");
+    ZipArchive archive;
+    if (!FileSystem::CreateDirectories(workDirectory) || !remote.Open(archiveUrl, spoolPath) || !archive.Open(remote)) {
+        return false;
+    }
+    archiveSize_ = remote.Size();
+
+    // Patches are optional: without the patch archive every changed file
+    // comes whole from the release archive
+    HttpRangeInput patchRemote(transport_, cancel_.get());
+    ZipArchive patchArchive;
+    std::map<std::wstring, const ZipEntry*> patchEntries;
+    if (!patchesUrl.empty() &&
+        patchRemote.Open(patchesUrl,
+            FileSystem::JoinPath(workDirectory, Downloader::FileNameFromUrl(patchesUrl) + L".delta")) &&
+        patchArchive.Open(patchRemote)) {
+        for (const auto& entry : patchArchive.Entries()) {
+            patchEntries[entry.name] = &entry;
+        }
+    }
+    if (cancel_->IsCancelled()) {
+        return false;
+    }
+
+    // The same path rewriting as a full install, so paths match the manifest
+    ExtractionOptions options;
+    options.stripCommonRoot = true;
+    std::vector<ZipExtractor::ArchiveFile> files;
+    if (!ZipExtractor::ListFiles(archive, options, files)) {
+        return false;
+    }
+    std::map<std::wstring, const ZipEntry*> byPath;
+    for (const auto& file : files) {
+        byPath[file.relativePath] = file.entry;
+    }
+
+    EntryRanges archiveRanges(archive);
+    EntryRanges patchRanges(patchArchive);
+    std::set<std::wstring> selected;
+    std::vector<std::pair<size_t, const ZipEntry*>> patches;    // Manifest index, patch entry
+    std::vector<ByteRange> ranges;
+    std::vector<ByteRange> patchByteRanges;
+    for (size_t index : changed) {
+        const ManifestFile& file = manifest.files[index];
+        auto found = byPath.find(file.path);
+        if (found == byPath.end() || found->second->uncompressedSize != file.size) {
+            return false;   // The archive is not the release the manifest describes
+        }
+        ByteRange whole = archiveRanges.For(*found->second);
+
+        // A patch for exactly the installed version, when it is the cheaper download
+        if (!patchEntries.empty()) {
+            std::wstring installedSha256;
+            uint64_t installedSize = 0;
+            std::wstring filePath = FileSystem::JoinPath(installPath, file.path);
+            if (FileSystem::FileExists(filePath) &&
+                ReleaseManifest::HashFile(filePath, installedSha256, installedSize, cancel_.get())) {
+                auto patch = patchEntries.find(BinaryPatch::EntryName(file.path, installedSha256));
+                if (patch != patchEntries.end()) {
+                    ByteRange range = patchRanges.For(*patch->second);
+                    if (range.end - range.start < whole.end - whole.start) {
+                        patches.push_back({ index, patch->second });
+                        patchByteRanges.push_back(range);
+                        continue;
+                    }
+                }
+            }
+            if (cancel_->IsCancelled()) {
+                return false;
+            }
+        }
+
+        ranges.push_back(whole);
+        selected.insert(file.path);
+    }
+    // Every file whole after all
+    if (selected.size() == manifest.files.size()) {
+        return false;
+    }
+
+    if (callback) {
+        wchar_t status[256];
+        swprintf(status, 256, L"Aggiornamento di %zu file su %zu...", changed.size(), manifest.files.size());
+        callback(10, status);
+    }
+    uint64_t patchBytes = 0;
+    uint64_t totalBytes = 0;
+    for (const ByteRange& range : patchByteRanges) {
+        patchBytes += range.end - range.start;
+    }
+    for (const ByteRange& range : ranges) {
+        totalBytes += range.end - range.start;
+    }
+    totalBytes += patchBytes;
+    auto fetchProgress = [&callback, totalBytes](uint64_t before) {
+        return [&callback, totalBytes, before](uint64_t done, uint64_t) {
+            if (callback && totalBytes > 0) {
+                callback(10 + (int)((before + done) * 80 / totalBytes), L"");
+            }
+        };
+    };
+    bool fetched = (patchByteRanges.empty() ||
+                       patchRemote.Prefetch(patchByteRanges, CONNECTIONS, fetchProgress(0))) &&
+                   (ranges.empty() || remote.Prefetch(ranges, CONNECTIONS, fetchProgress(patchBytes)));
+    bytesFetched_ += remote.BytesFetched() + patchRemote.BytesFetched();
+    if (!fetched) {
+        return false;
+    }
+
+    // Every new file is built and checked in the staging directory; the
+    // install only changes in the switch at the end
+    StagedInstall staged(installPath);
+    if (!staged.Prepare()) {
+        return false;
+    }
+
+    // A patch that fails leaves nothing behind; its file is extracted whole
+    // instead, the entry read on demand
+    for (const auto& patch : patches) {
+        const ManifestFile& file = manifest.files[patch.first];
+        if (callback) {
+            callback(90, L"Aggiornamento: " + file.path);
+        }
+        std::wstring target = FileSystem::JoinPath(staged.StagingPath(), file.path);
+        if (FileSystem::CreateDirectories(FileSystem::ParentPath(target)) &&
+            BinaryPatch::ApplyEntry(patchArchive, patchRemote, *patch.second,
+                FileSystem::JoinPath(installPath, file.path), target, file.sha256, cancel_.get())) {
+            ++patchedFiles_;
+        } else if (cancel_->IsCancelled()) {
+            return false;
+        } else {
+            selected.insert(file.path);
+        }
+    }
+    span.SetArg("patched", (int64_t)patchedFiles_);
+
+    bool extracted = true;
+    if (!selected.empty()) {
+        // Straight from the spooled spans: the extractor never goes back to the network
+        options.only = &selected;
+        options.threadCount = extractThreads_;
+        options.cancel = cancel_.get();
+        std::atomic<bool> outOfSpace(false);
+        options.insufficientSpace = &outOfSpace;
+        extracted = ZipExtractor::Extract(remote, staged.StagingPath(),
+            [&callback](int progress, const std::wstring& file) {
+                if (callback) {
+                    callback(90 + progress / 10, L"Aggiornamento: " + file);
+                }
+            }, options);
+        insufficientSpace_ = outOfSpace.load();
+    }
+    bytesFetched_ = manifestBytes + remote.BytesFetched() + patchRemote.BytesFetched();
+    span.SetBytes(bytesFetched_);
+    if (!extracted) {
+        return false;
+    }
+
+    // The entry CRCs vouch for the archive; the manifest's hashes for the release
+    std::set<std::wstring> rebuilt;
+    for (size_t index : changed) {
+        const ManifestFile& file = manifest.files[index];
+        rebuilt.insert(file.path);
+        if (selected.count(file.path) == 0) {
+            continue;   // Patched: already checked against the manifest
+        }
+        std::wstring sha256;
+        uint64_t size = 0;
+        if (!ReleaseManifest::HashFile(FileSystem::JoinPath(staged.StagingPath(), file.path), sha256, size,
+                cancel_.get()) ||
+            size != file.size || !Sha256::HexEquals(sha256, file.sha256)) {
+            return false;
+        }
+    }
+
+    return Switch(staged, manifest, rebuilt);
+}
+
+bool DeltaUpdater::Switch(StagedInstall& staged, const ReleaseManifest& manifest, const std::set<std::wstring>& rebuilt)
+{
+    // The rest of the release is what is installed already: with it the
+    // staging directory is the whole new version, switched in one go, and
+    // the installed one stays behind for a rollback. Only files the
+    // manifest lists come along, so whatever the release dropped goes too
+    for (const auto& file : manifest.files) {
+        if (cancel_->IsCancelled() || (rebuilt.count(file.path) == 0 && !staged.CarryOver(file.path))) {
+            return false;
+        }
+    }
+    if (!staged.Commit()) {
+        return false;
+    }
+    switched_ = true;
+    return true;
+}
+
+} // namespace InstAnalyticsInstaller
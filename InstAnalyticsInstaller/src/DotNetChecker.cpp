@@ -1,28 +1,103 @@
 #include "DotNetChecker.h"
 #include "Constants.h"
+#include "FileSystem.h"
+#include "SdkLocator.h"
+#include "Trace.h"
+#include <softpub.h>
+#include <wintrust.h>
 #include <string>
 #include <sstream>
 #include <array>
+#include <cwchar>
 #include <memory>
 #include <vector>
 
 namespace InstAnalyticsInstaller {
 
+namespace {
+
+constexpr unsigned REQUIRED_SDK_MAJOR = 10;
+
+std::wstring ReadEnvironment(const wchar_t* name)
+{
+    std::vector<wchar_t> value(32768);
+    DWORD length = GetEnvironmentVariableW(name, value.data(), (DWORD)value.size());
+    return length > 0 && length < value.size() ? std::wstring(value.data(), length) : L"";
+}
+
+std::wstring ReadRegistryString(HKEY root, const wchar_t* path, const wchar_t* name, DWORD flags)
+{
+    // REG_EXPAND_SZ values pass the REG_SZ filter once expanded
+    std::vector<wchar_t> value(32768);
+    DWORD size = (DWORD)(value.size() * sizeof(wchar_t));
+    if (RegGetValueW(root, path, name, RRF_RT_REG_SZ | flags, nullptr, value.data(), &size) != ERROR_SUCCESS) {
+        return L"";
+    }
+    return value.data();
+}
+
+void AddUnique(std::vector<std::wstring>& list, std::wstring path)
+{
+    while (path.size() > 3 && (path.back() == L'\\' || path.back() == L'/')) {
+        path.pop_back();
+    }
+    if (path.empty()) {
+        return;
+    }
+    for (const auto& existing : list) {
+        if (_wcsicmp(existing.c_str(), path.c_str()) == 0) {
+            return;
+        }
+    }
+    list.push_back(path);
+}
+
+} // namespace
+
 bool DotNetChecker::IsDotNet10Installed()
 {
-    // Try checking via command line first (most reliable)
-    if (CheckCommandLineForDotNet()) {
+    TraceSpan span("dotnet.detect", "dotnet");
+
+    // Fast path: list <root>\sdk\* directly, in milliseconds
+    std::vector<std::wstring> roots = FindDotNetRoots();
+    span.SetArg("roots", (int64_t)roots.size());
+    if (SdkLocator::FindSdk(roots, REQUIRED_SDK_MAJOR)) {
         return true;
     }
 
-    // Fallback to registry check
+    // No SDK 10 where dotnet normally lives. The host may resolve one the
+    // scan cannot see (a root outside the list), so ask it (slow), then the registry
+    if (CheckCommandLineForDotNet(L"dotnet --list-sdks 2>&1")) {
+        return true;
+    }
     return CheckRegistryForDotNet();
 }
 
-bool DotNetChecker::CheckCommandLineForDotNet()
+std::vector<std::wstring> DotNetChecker::FindDotNetRoots()
 {
-    // Execute 'dotnet --list-sdks' command
-    FILE* pipe = _wpopen(L"dotnet --list-sdks 2>&1", L"r");
+    std::vector<std::wstring> roots;
+    AddUnique(roots, FindDotNetInstallPath());
+    AddUnique(roots, ReadEnvironment(L"DOTNET_ROOT"));
+    AddUnique(roots, ReadEnvironment(L"DOTNET_ROOT(x86)"));
+
+    // The setup records InstallLocation in the 32-bit registry view for every architecture
+    const wchar_t* keys[] = {
+        L"SOFTWARE\\dotnet\\Setup\\InstalledVersions\\x64",
+        L"SOFTWARE\\dotnet\\Setup\\InstalledVersions\\x86"
+    };
+    for (const auto& key : keys) {
+        AddUnique(roots, ReadRegistryString(HKEY_LOCAL_MACHINE, key, L"InstallLocation", RRF_SUBKEY_WOW6432KEY));
+        AddUnique(roots, ReadRegistryString(HKEY_LOCAL_MACHINE, key, L"InstallLocation", RRF_SUBKEY_WOW6464KEY));
+    }
+
+    return roots;
+}
+
+bool DotNetChecker::CheckCommandLineForDotNet(const wchar_t* command)
+{
+    TraceSpan span("dotnet.command", "dotnet");
+
+    FILE* pipe = _wpopen(command, L"r");
     if (!pipe) {
         return false;
     }
@@ -35,6 +110,7 @@ bool DotNetChecker::CheckCommandLineForDotNet()
     }
 
     int exitCode = _pclose(pipe);
+    span.SetArg("exitCode", exitCode);
 
     // Check if command succeeded
     if (exitCode != 0) {
@@ -115,33 +191,97 @@ std::wstring DotNetChecker::GetDotNetDownloadUrl()
     }
 }
 
-bool DotNetChecker::VerifyAndFixDotNetPath()
+std::vector<std::wstring> DotNetChecker::GetDotNetMirrors()
 {
-    // First, check if dotnet command works
-    FILE* pipe = _wpopen(L"dotnet --version 2>&1", L"r");
-    if (!pipe) {
-        // Command not found, try to add to PATH
-        return AddDotNetToPath();
-    }
+    return GetSystemArchitecture() == Architecture::X86 ? Mirrors::DOTNET_X86 : Mirrors::DOTNET_X64;
+}
 
-    std::array<char, 128> buffer;
-    std::string result;
+std::wstring DotNetChecker::GetDotNetDownloadSha256()
+{
+    return GetSystemArchitecture() == Architecture::X86 ? Digests::DOTNET_X86 : Digests::DOTNET_X64;
+}
 
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
+bool DotNetChecker::IsSignedByMicrosoft(const std::wstring& path)
+{
+    TraceSpan span("dotnet.signature", "dotnet");
+
+    WINTRUST_FILE_INFO file = {};
+    file.cbStruct = sizeof(file);
+    file.pcwszFilePath = path.c_str();
+
+    WINTRUST_DATA data = {};
+    data.cbStruct = sizeof(data);
+    data.dwUIChoice = WTD_UI_NONE;
+    data.fdwRevocationChecks = WTD_REVOKE_WHOLECHAIN;
+    data.dwUnionChoice = WTD_CHOICE_FILE;
+    data.pFile = &file;
+    data.dwStateAction = WTD_STATEACTION_VERIFY;
+
+    GUID action = WINTRUST_ACTION_GENERIC_VERIFY_V2;
+    bool trusted = WinVerifyTrust((HWND)INVALID_HANDLE_VALUE, &action, &data) == ERROR_SUCCESS;
+
+    // A valid chain only says someone signed it: the leaf has to be Microsoft's
+    if (trusted) {
+        CRYPT_PROVIDER_DATA* provider = WTHelperProvDataFromStateData(data.hWVTStateData);
+        CRYPT_PROVIDER_SGNR* signer = provider ? WTHelperGetProvSignerFromChain(provider, 0, FALSE, 0) : nullptr;
+        CRYPT_PROVIDER_CERT* certificate = signer ? WTHelperGetProvCertFromChain(signer, 0) : nullptr;
+        wchar_t name[256] = {};
+        if (certificate) {
+            CertGetNameStringW(certificate->pCert, CERT_NAME_SIMPLE_DISPLAY_TYPE, 0, nullptr, name, 256);
+        }
+        trusted = wcscmp(name, L"Microsoft Corporation") == 0;
     }
 
-    int exitCode = _pclose(pipe);
+    data.dwStateAction = WTD_STATEACTION_CLOSE;
+    WinVerifyTrust((HWND)INVALID_HANDLE_VALUE, &action, &data);
 
-    // Check if command succeeded and version 10 is present
-    if (exitCode == 0 && result.find("10.0.") != std::string::npos) {
-        return true; // dotnet command works and version 10 is available
+    span.SetArg("trusted", trusted ? 1 : 0);
+    return trusted;
+}
+
+bool DotNetChecker::VerifyAndFixDotNetPath()
+{
+    TraceSpan span("dotnet.path", "dotnet");
+
+    // Fast path: a PATH entry with dotnet.exe and an SDK 10 beside it is what
+    // "dotnet --version" would find, without starting the host
+    for (const auto& directory : PathDirectories()) {
+        if (FileSystem::FileExists(FileSystem::JoinPath(directory, L"dotnet.exe")) &&
+            SdkLocator::FindSdk({ directory }, REQUIRED_SDK_MAJOR)) {
+            return true;
+        }
+    }
+
+    // Slow fallback: let the host resolve it (e.g. through a shim)
+    if (CheckCommandLineForDotNet(L"dotnet --version 2>&1")) {
+        return true;
     }
 
     // Command failed or version 10 not found, try to fix PATH
     return AddDotNetToPath();
 }
 
+std::vector<std::wstring> DotNetChecker::PathDirectories()
+{
+    // This process's PATH predates the SDK setup: read the machine value as well
+    std::wstring path = ReadEnvironment(L"PATH") + L";" +
+        ReadRegistryString(HKEY_LOCAL_MACHINE, L"SYSTEM\\CurrentControlSet\\Control\\Session Manager\\Environment",
+            L"Path", 0);
+
+    std::vector<std::wstring> directories;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find(L';', start);
+        if (end == std::wstring::npos) {
+            end = path.size();
+        }
+
+        AddUnique(directories, path.substr(start, end - start));
+        start = end + 1;
+    }
+    return directories;
+}
+
 std::wstring DotNetChecker::FindDotNetInstallPath()
 {
     // Common installation paths for .NET
@@ -0,0 +1,273 @@
+#include "DownloadCache.h"
+#include "FileSystem.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+const char* const INDEX_HEADER = "InstAnalyticsInstaller-cache 1";
+
+bool IsDigest(const std::wstring& text)
+{
+    return text.size() == Sha256::DIGEST_SIZE * 2 &&
+           text.find_first_not_of(L"0123456789abcdef") == std::wstring::npos;
+}
+
+std::wstring Lower(std::wstring text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](wchar_t ch) {
+        return ch >= L'A' && ch <= L'Z' ? (wchar_t)(ch - L'A' + L'a') : ch;
+    });
+    return text;
+}
+
+} // namespace
+
+DownloadCache::DownloadCache(const std::wstring& directory, uint64_t maxBytes)
+    : directory_(directory)
+    , maxBytes_(maxBytes)
+    , useCounter_(0)
+    , tempCounter_(0)
+{
+    FileSystem::CreateDirectories(FileSystem::JoinPath(directory_, L"objects"));
+    Load();
+}
+
+std::wstring DownloadCache::BlobPath(const std::wstring& sha256) const
+{
+    return FileSystem::JoinPath(directory_, L"objects/" + Lower(sha256));
+}
+
+std::wstring DownloadCache::IndexPath() const
+{
+    return FileSystem::JoinPath(directory_, L"index");
+}
+
+std::wstring DownloadCache::NewTempPath()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+    return FileSystem::JoinPath(directory_, L"tmp-" + std::to_wstring(ticks) + L"-" + std::to_wstring(++tempCounter_));
+}
+
+void DownloadCache::Load()
+{
+    entries_.clear();
+
+    File file;
+    if (!file.Open(IndexPath(), File::Mode::Read)) {
+        return;
+    }
+
+    std::string content;
+    char buffer[4096];
+    size_t bytesRead = 0;
+    while (file.Read(buffer, sizeof(buffer), bytesRead) && bytesRead > 0) {
+        content.append(buffer, bytesRead);
+    }
+
+    std::istringstream lines(content);
+    std::string line;
+    if (!std::getline(lines, line) || line != INDEX_HEADER) {
+        return;
+    }
+
+    // "entry <sha256> <size> <last used>" opens a record, key/value lines follow
+    while (std::getline(lines, line)) {
+        size_t space = line.find(' ');
+        std::string key = line.substr(0, space);
+        std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+
+        if (key == "entry") {
+            std::istringstream fields(value);
+            std::string sha256;
+            CacheEntry entry;
+            if (fields >> sha256 >> entry.size >> entry.lastUsed) {
+                entry.sha256 = FileSystem::FromUtf8(sha256);
+                entries_.push_back(entry);
+                useCounter_ = std::max(useCounter_, entry.lastUsed);
+            }
+        } else if (entries_.empty()) {
+            continue;
+        } else if (key == "url") {
+            entries_.back().url = FileSystem::FromUtf8(value);
+        } else if (key == "etag") {
+            entries_.back().etag = FileSystem::FromUtf8(value);
+        } else if (key == "last-modified") {
+            entries_.back().lastModified = FileSystem::FromUtf8(value);
+        }
+    }
+
+    // Drop records that are malformed or whose blob was removed behind our back
+    entries_.erase(std::remove_if(entries_.begin(), entries_.end(), [this](const CacheEntry& entry) {
+        return entry.url.empty() || !IsDigest(entry.sha256) || !FileSystem::FileExists(BlobPath(entry.sha256));
+    }), entries_.end());
+}
+
+bool DownloadCache::Save() const
+{
+    std::string content = std::string(INDEX_HEADER) + "\n";
+    for (const auto& entry : entries_) {
+        content += "entry " + FileSystem::ToUtf8(entry.sha256) + " " + std::to_string(entry.size) + " " +
+                   std::to_string(entry.lastUsed) + "\n";
+        content += "url " + FileSystem::ToUtf8(entry.url) + "\n";
+        content += "etag " + FileSystem::ToUtf8(entry.etag) + "\n";
+        content += "last-modified " + FileSystem::ToUtf8(entry.lastModified) + "\n";
+    }
+
+    std::wstring tempPath = IndexPath() + L".tmp";
+    File file;
+    if (!file.Open(tempPath, File::Mode::Write) || !file.Write(content.data(), content.size())) {
+        return false;
+    }
+    file.Close();
+
+    return FileSystem::RenameFile(tempPath, IndexPath());
+}
+
+bool DownloadCache::Lookup(const std::wstring& url, CacheEntry& entry)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& candidate : entries_) {
+        if (candidate.url == url && FileSystem::FileExists(BlobPath(candidate.sha256))) {
+            entry = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DownloadCache::Contains(const std::wstring& sha256)
+{
+    std::wstring key = Lower(sha256);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : entries_) {
+        if (entry.sha256 == key) {
+            return FileSystem::FileExists(BlobPath(key));
+        }
+    }
+    return false;
+}
+
+void DownloadCache::Touch(const std::wstring& sha256)
+{
+    ++useCounter_;
+    for (auto& entry : entries_) {
+        if (entry.sha256 == sha256) {
+            entry.lastUsed = useCounter_;
+        }
+    }
+}
+
+void DownloadCache::MarkUsed(const std::wstring& sha256)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Touch(Lower(sha256));
+    Save();
+}
+
+bool DownloadCache::Restore(const std::wstring& sha256, const std::wstring& outputPath)
+{
+    std::wstring key = Lower(sha256);
+    if (!FileSystem::DuplicateFile(BlobPath(key), outputPath)) {
+        FileSystem::RemoveFile(outputPath);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Touch(key);
+    Save();
+    return true;
+}
+
+bool DownloadCache::Store(const std::wstring& url, const std::wstring& sourcePath, const std::wstring& sha256,
+    const std::wstring& etag, const std::wstring& lastModified, bool keepSource)
+{
+    std::wstring key = Lower(sha256);
+    if (!IsDigest(key)) {
+        return false;
+    }
+
+    uint64_t size = 0;
+    {
+        File source;
+        if (!source.Open(sourcePath, File::Mode::Read) || !source.GetSize(size)) {
+            return false;
+        }
+    }
+
+    // Content-addressed: identical payloads under another URL are stored once
+    std::wstring blobPath = BlobPath(key);
+    if (!FileSystem::FileExists(blobPath)) {
+        if (keepSource) {
+            std::wstring tempPath = NewTempPath();
+            if (!FileSystem::DuplicateFile(sourcePath, tempPath) || !FileSystem::RenameFile(tempPath, blobPath)) {
+                FileSystem::RemoveFile(tempPath);
+                return false;
+            }
+        } else if (!FileSystem::RenameFile(sourcePath, blobPath)) {
+            return false;
+        }
+    } else if (!keepSource) {
+        FileSystem::RemoveFile(sourcePath);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+        [&url](const CacheEntry& entry) { return entry.url == url; }), entries_.end());
+
+    CacheEntry entry;
+    entry.url = url;
+    entry.sha256 = key;
+    entry.etag = etag;
+    entry.lastModified = lastModified;
+    entry.size = size;
+    entries_.push_back(entry);
+    Touch(key);
+
+    Evict(key);
+    return Save();
+}
+
+void DownloadCache::Evict(const std::wstring& keep)
+{
+    // Blob sizes and recency; a blob is as recent as its most recent URL
+    std::map<std::wstring, std::pair<uint64_t, uint64_t>> blobs;
+    for (const auto& entry : entries_) {
+        auto& blob = blobs[entry.sha256];
+        blob.first = entry.size;
+        blob.second = std::max(blob.second, entry.lastUsed);
+    }
+
+    uint64_t total = 0;
+    for (const auto& blob : blobs) {
+        total += blob.second.first;
+    }
+
+    while (total > maxBytes_) {
+        auto oldest = blobs.end();
+        for (auto it = blobs.begin(); it != blobs.end(); ++it) {
+            if (it->first != keep && (oldest == blobs.end() || it->second.second < oldest->second.second)) {
+                oldest = it;
+            }
+        }
+        if (oldest == blobs.end()) {
+            break; // Only the payload we just stored is left
+        }
+
+        std::wstring sha256 = oldest->first;
+        FileSystem::RemoveFile(BlobPath(sha256));
+        entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+            [&sha256](const CacheEntry& entry) { return entry.sha256 == sha256; }), entries_.end());
+        total -= oldest->second.first;
+        blobs.erase(oldest);
+    }
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,135 @@
+#include "DownloadJournal.h"
+#include "FileSystem.h"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+const char* const JOURNAL_HEADER = "InstAnalyticsInstaller-journal 1";
+
+} // namespace
+
+std::wstring DownloadJournal::PathFor(const std::wstring& outputPath)
+{
+    return outputPath + L".journal";
+}
+
+bool DownloadJournal::Load(const std::wstring& path)
+{
+    File file;
+    if (!file.Open(path, File::Mode::Read)) {
+        return false;
+    }
+
+    std::string content;
+    char buffer[4096];
+    size_t bytesRead = 0;
+    while (file.Read(buffer, sizeof(buffer), bytesRead) && bytesRead > 0) {
+        content.append(buffer, bytesRead);
+    }
+
+    std::istringstream lines(content);
+    std::string line;
+    if (!std::getline(lines, line) || line != JOURNAL_HEADER) {
+        return false;
+    }
+
+    completed_.clear();
+    while (std::getline(lines, line)) {
+        size_t space = line.find(' ');
+        std::string key = line.substr(0, space);
+        std::string value = space == std::string::npos ? "" : line.substr(space + 1);
+
+        if (key == "url") {
+            url = FileSystem::FromUtf8(value);
+        } else if (key == "etag") {
+            etag = FileSystem::FromUtf8(value);
+        } else if (key == "last-modified") {
+            lastModified = FileSystem::FromUtf8(value);
+        } else if (key == "size") {
+            totalSize = strtoull(value.c_str(), nullptr, 10);
+        } else if (key == "range") {
+            char* next = nullptr;
+            uint64_t start = strtoull(value.c_str(), &next, 10);
+            uint64_t end = strtoull(next, nullptr, 10);
+            if (start < end && end <= totalSize) {
+                MarkCompleted(start, end);
+            }
+        }
+    }
+
+    return !url.empty() && totalSize > 0;
+}
+
+bool DownloadJournal::Save(const std::wstring& path) const
+{
+    std::string content = std::string(JOURNAL_HEADER) + "\n";
+    content += "url " + FileSystem::ToUtf8(url) + "\n";
+    content += "etag " + FileSystem::ToUtf8(etag) + "\n";
+    content += "last-modified " + FileSystem::ToUtf8(lastModified) + "\n";
+    content += "size " + std::to_string(totalSize) + "\n";
+    for (const auto& range : completed_) {
+        content += "range " + std::to_string(range.start) + " " + std::to_string(range.end) + "\n";
+    }
+
+    // A crash mid-write must never leave a journal claiming bytes we don't have
+    std::wstring tempPath = path + L".tmp";
+    File file;
+    if (!file.Open(tempPath, File::Mode::Write) || !file.Write(content.data(), content.size())) {
+        return false;
+    }
+    file.Close();
+
+    return FileSystem::RenameFile(tempPath, path);
+}
+
+void DownloadJournal::MarkCompleted(uint64_t start, uint64_t end)
+{
+    if (start >= end) {
+        return;
+    }
+
+    auto it = std::lower_bound(completed_.begin(), completed_.end(), start,
+        [](const ByteRange& range, uint64_t value) { return range.end < value; });
+
+    // Absorb every range that overlaps or touches [start, end)
+    auto last = it;
+    while (last != completed_.end() && last->start <= end) {
+        start = std::min(start, last->start);
+        end = std::max(end, last->end);
+        ++last;
+    }
+
+    it = completed_.erase(it, last);
+    completed_.insert(it, { start, end });
+}
+
+uint64_t DownloadJournal::CompletedBytes() const
+{
+    uint64_t total = 0;
+    for (const auto& range : completed_) {
+        total += range.end - range.start;
+    }
+    return total;
+}
+
+std::vector<ByteRange> DownloadJournal::MissingRanges() const
+{
+    std::vector<ByteRange> missing;
+    uint64_t cursor = 0;
+    for (const auto& range : completed_) {
+        if (range.start > cursor) {
+            missing.push_back({ cursor, range.start });
+        }
+        cursor = std::max(cursor, range.end);
+    }
+    if (cursor < totalSize) {
+        missing.push_back({ cursor, totalSize });
+    }
+    return missing;
+}
+
+} // namespace InstAnalyticsInstaller
@@ -1,19 +1,237 @@
 #include "Downloader.h"
-#include <urlmon.h>
-#include <wininet.h>
-
-#pragma comment(lib, "urlmon.lib")
-#pragma comment(lib, "wininet.lib")
+#include "AsyncFileWriter.h"
+#include "DownloadCache.h"
+#include "Sha256.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cwchar>
+#include <map>
+#include <mutex>
+#include <thread>
 
 namespace InstAnalyticsInstaller {
 
-struct DownloadCallbackData {
-    ProgressCallback callback;
-    bool* cancelled;
+namespace {
+
+constexpr size_t BUFFER_SIZE = 64 * 1024;
+constexpr size_t READ_BACK_SIZE = 1024 * 1024;
+
+// With mirrors the missing bytes are cut finer than one segment per
+// connection, so the connections on faster mirrors take more of them
+constexpr unsigned MIRROR_SEGMENTS_PER_CONNECTION = 4;
+
+// Source index for each connection, in proportion to the measured rates
+// (highest averages: each connection goes to the source whose rate per
+// connection would stay the highest). A source too slow to earn one is
+// still there for failover
+std::vector<size_t> AssignConnections(const std::vector<double>& rates, size_t connections)
+{
+    std::vector<size_t> assigned(rates.size(), 0);
+    std::vector<size_t> sources;
+    for (size_t i = 0; i < connections; ++i) {
+        size_t best = 0;
+        for (size_t s = 1; s < rates.size(); ++s) {
+            if (rates[s] / (assigned[s] + 1) > rates[best] / (assigned[best] + 1)) {
+                best = s;
+            }
+        }
+        ++assigned[best];
+        sources.push_back(best);
+    }
+    return sources;
+}
+
+bool SameSize(const HttpResponse& a, const HttpResponse& b)
+{
+    return a.hasContentLength == b.hasContentLength && a.contentLength == b.contentLength;
+}
+
+// A 206 carrying the bytes from rangeStart of the version resource (a
+// probe's whole-payload response) describes. A source that answers with
+// another range or another version would splice foreign bytes in
+bool ServesRange(const HttpResponse& response, uint64_t rangeStart, const HttpResponse& resource)
+{
+    return response.statusCode == 206 && response.rangeStart == rangeStart &&
+           response.totalLength == resource.contentLength &&
+           (resource.etag.empty() || response.etag == resource.etag) &&
+           (resource.lastModified.empty() || response.lastModified == resource.lastModified);
+}
+
+} // namespace
+
+// Shared byte counter for all connections of one transfer. Per chunk it is
+// one atomic add; the callback (and its string formatting) only runs when
+// the percentage advances, serialized so segment threads never call into
+// the UI concurrently or out of order
+class Downloader::TransferProgress {
+public:
+    TransferProgress(ProgressCallback callback, uint64_t totalBytes)
+        : callback_(callback)
+        , totalBytes_(totalBytes)
+        , doneBytes_(0)
+        , lastProgress_(-1)
+        , delivered_(-1)
+    {
+    }
+
+    void SetTotal(uint64_t totalBytes) { totalBytes_ = totalBytes; }
+
+    void Add(uint64_t bytes)
+    {
+        uint64_t done = doneBytes_ += bytes;
+        uint64_t total = totalBytes_;
+        if (total == 0) {
+            return;
+        }
+
+        // Only the thread that moves the percentage forward reports it
+        int progress = (int)(done * 100 / total);
+        int last = lastProgress_.load(std::memory_order_relaxed);
+        do {
+            if (progress <= last) {
+                return;
+            }
+        } while (!lastProgress_.compare_exchange_weak(last, progress, std::memory_order_relaxed));
+
+        Trace::Counter("download.bytes", (int64_t)done);
+        if (!callback_) {
+            return;
+        }
+
+        double downloadedMB = done / (1024.0 * 1024.0);
+        double totalMB = total / (1024.0 * 1024.0);
+
+        wchar_t statusBuffer[256];
+        swprintf(statusBuffer, 256, L"Download in corso: %.1f MB / %.1f MB", downloadedMB, totalMB);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (progress > delivered_) {
+            delivered_ = progress;
+            callback_(progress, statusBuffer);
+        }
+    }
+
+    uint64_t Done() const { return doneBytes_; }
+
+private:
+    ProgressCallback callback_;
+    std::atomic<uint64_t> totalBytes_;
+    std::atomic<uint64_t> doneBytes_;
+    std::atomic<int> lastProgress_;
+    int delivered_;     // Guarded by mutex_
+    std::mutex mutex_;
 };
 
-Downloader::Downloader()
-    : cancelled_(false)
+// SHA-256 of the output file computed while it is being written. Bytes that
+// land at the hash cursor are hashed straight from the write buffer; ranges
+// written ahead of it (other connections, earlier runs) are read back from
+// the file once the contiguous prefix reaches them, so the digest is ready
+// shortly after the last byte arrives instead of after a second full pass
+class Downloader::OrderedDigest {
+public:
+    explicit OrderedDigest(File& file)
+        : file_(file)
+        , cursor_(0)
+        , busy_(false)
+        , failed_(false)
+    {
+    }
+
+    // [offset, offset + size) holds its final bytes; data is null when they
+    // are only on disk
+    void Written(uint64_t offset, const uint8_t* data, uint64_t size)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (size == 0) {
+            return;
+        }
+
+        if (busy_ || offset != cursor_ || !data) {
+            pending_[offset] = offset + size;
+            if (!busy_) {
+                Drain(lock);
+            }
+            return;
+        }
+
+        // Only the busy thread touches sha_, so hash outside the lock
+        busy_ = true;
+        lock.unlock();
+        sha_.Update(data, (size_t)size);
+        lock.lock();
+        cursor_ += size;
+        Drain(lock);
+    }
+
+    // Call once every writer has stopped
+    bool Finish(uint64_t size, std::wstring& hex)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        Drain(lock);
+        if (failed_ || cursor_ != size) {
+            return false;
+        }
+        hex = sha_.FinalHex();
+        return true;
+    }
+
+private:
+    // Hashes pending ranges that have become contiguous with the cursor
+    void Drain(std::unique_lock<std::mutex>& lock)
+    {
+        busy_ = true;
+        while (!failed_ && !pending_.empty() && pending_.begin()->first <= cursor_) {
+            uint64_t end = pending_.begin()->second;
+            pending_.erase(pending_.begin());
+            if (end <= cursor_) {
+                continue;
+            }
+
+            uint64_t start = cursor_;
+            lock.unlock();
+            bool success = ReadBack(start, end);
+            lock.lock();
+
+            if (success) {
+                cursor_ = end;
+            } else {
+                failed_ = true;
+            }
+        }
+        busy_ = false;
+    }
+
+    bool ReadBack(uint64_t start, uint64_t end)
+    {
+        buffer_.resize(READ_BACK_SIZE);
+        while (start < end) {
+            size_t request = (size_t)std::min<uint64_t>(buffer_.size(), end - start);
+            size_t bytesRead = 0;
+            if (!file_.ReadAt(start, buffer_.data(), request, bytesRead) || bytesRead == 0) {
+                return false;
+            }
+            sha_.Update(buffer_.data(), bytesRead);
+            start += bytesRead;
+        }
+        return true;
+    }
+
+    File& file_;
+    Sha256 sha_;
+    std::vector<uint8_t> buffer_;
+    std::map<uint64_t, uint64_t> pending_;  // start -> end of ranges ahead of the cursor
+    std::mutex mutex_;
+    uint64_t cursor_;
+    bool busy_;
+    bool failed_;
+};
+
+Downloader::Downloader(std::shared_ptr<HttpTransport> transport)
+    : transport_(transport ? transport : HttpTransport::Shared())
+    , cancel_(std::make_shared<CancellationToken>())
+    , integrityFailed_(false)
+    , insufficientSpace_(false)
 {
 }
 
@@ -23,130 +241,910 @@ Downloader::~Downloader()
 
 void Downloader::Cancel()
 {
-    cancelled_ = true;
+    cancel_->Cancel();
 }
 
-DWORD CALLBACK Downloader::ProgressRoutine(
-    LARGE_INTEGER TotalFileSize,
-    LARGE_INTEGER TotalBytesTransferred,
-    LARGE_INTEGER StreamSize,
-    LARGE_INTEGER StreamBytesTransferred,
-    DWORD dwStreamNumber,
-    DWORD dwCallbackReason,
-    HANDLE hSourceFile,
-    HANDLE hDestinationFile,
-    LPVOID lpData)
+// Every request carries the token, so the transport can abort it mid-read
+HttpRequest Downloader::Request(const std::wstring& url) const
 {
-    if (lpData == nullptr) {
-        return PROGRESS_CONTINUE;
+    HttpRequest request;
+    request.url = url;
+    request.cancel = cancel_.get();
+    return request;
+}
+
+std::wstring Downloader::FileNameFromUrl(const std::wstring& url)
+{
+    std::wstring path = url.substr(0, url.find_first_of(L"?#"));
+    size_t slash = path.find_last_of(L'/');
+    std::wstring name = slash == std::wstring::npos ? path : path.substr(slash + 1);
+    return name.empty() ? L"download.bin" : name;
+}
+
+// State shared by the connections of one ranged transfer
+struct Downloader::RangedTransfer {
+    DownloadJournal& journal;
+    const std::wstring& journalPath;
+    const std::vector<Source>& sources;     // Fastest first
+    std::mutex journalMutex;
+    std::atomic<bool> failed{ false };
+    std::atomic<bool> rangesIgnored{ false };
+    std::atomic<size_t> nextSegment{ 0 };
+
+    RangedTransfer(DownloadJournal& journal, const std::wstring& journalPath, const std::vector<Source>& sources)
+        : journal(journal)
+        , journalPath(journalPath)
+        , sources(sources)
+        , dropped_(sources.size(), false)
+    {
     }
 
-    DownloadCallbackData* data = (DownloadCallbackData*)lpData;
+    // A source that ran out of retries or ignores ranges; every connection
+    // on it moves on at its next request
+    void Drop(size_t source)
+    {
+        std::lock_guard<std::mutex> lock(sourcesMutex_);
+        dropped_[source] = true;
+    }
 
-    if (data->cancelled && *(data->cancelled)) {
-        return PROGRESS_CANCEL;
+    // Keeps source if it still works, else the fastest one that does
+    bool Pick(size_t& source)
+    {
+        std::lock_guard<std::mutex> lock(sourcesMutex_);
+        if (!dropped_[source]) {
+            return true;
+        }
+        for (size_t i = 0; i < dropped_.size(); ++i) {
+            if (!dropped_[i]) {
+                source = i;
+                return true;
+            }
+        }
+        return false;
     }
 
-    if (TotalFileSize.QuadPart > 0 && data->callback) {
-        int progress = (int)((TotalBytesTransferred.QuadPart * 100) / TotalFileSize.QuadPart);
+private:
+    std::mutex sourcesMutex_;
+    std::vector<bool> dropped_;
+};
 
-        // Calculate download size in MB
-        double downloadedMB = TotalBytesTransferred.QuadPart / (1024.0 * 1024.0);
-        double totalMB = TotalFileSize.QuadPart / (1024.0 * 1024.0);
+bool Downloader::VerifyDigest(OrderedDigest* digest, uint64_t size, const std::wstring& expectedSha256,
+    std::wstring& sha256)
+{
+    if (!digest) {
+        return true;
+    }
 
-        wchar_t statusBuffer[256];
-        swprintf_s(statusBuffer, L"Download in corso: %.1f MB / %.1f MB", downloadedMB, totalMB);
+    if (!digest->Finish(size, sha256) ||
+        (!expectedSha256.empty() && !Sha256::HexEquals(sha256, expectedSha256))) {
+        integrityFailed_ = true;
+        return false;
+    }
+    return true;
+}
 
-        data->callback(progress, statusBuffer);
+// Checked before the first byte is written, so a full disk fails in seconds
+// rather than after most of a 200 MB download
+bool Downloader::HasSpaceFor(const std::wstring& outputPath, uint64_t size, uint64_t present)
+{
+    uint64_t available = 0;
+    if (size > present && FileSystem::AvailableSpace(FileSystem::ParentPath(outputPath), available) &&
+        available < size - present) {
+        insufficientSpace_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool Downloader::FindCached(const std::wstring& url, const std::wstring& expectedSha256, std::wstring& sha256)
+{
+    // A pinned digest names the content exactly: no need to ask the server
+    if (!expectedSha256.empty() && cache_->Contains(expectedSha256)) {
+        sha256 = expectedSha256;
+        return true;
+    }
+
+    CacheEntry entry;
+    if (!cache_->Lookup(url, entry) || (entry.etag.empty() && entry.lastModified.empty())) {
+        return false;
     }
+    if (!expectedSha256.empty() && !Sha256::HexEquals(entry.sha256, expectedSha256)) {
+        return false;
+    }
+
+    HttpRequest request = Request(url);
+    request.ifNoneMatch = entry.etag;
+    request.ifModifiedSince = entry.lastModified;
 
-    return PROGRESS_CONTINUE;
+    // Anything but 304 means a new version: the body is dropped so the full
+    // download can still choose its own (segmented) strategy
+    auto stream = transport_->Open(request);
+    if (!stream || stream->Response().statusCode != 304) {
+        return false;
+    }
+
+    sha256 = entry.sha256;
+    return true;
+}
+
+bool Downloader::DownloadFile(const std::wstring& url, const std::wstring& outputPath, ProgressCallback callback,
+    const std::wstring& expectedSha256)
+{
+    return DownloadFile(std::vector<std::wstring>{ url }, outputPath, callback, expectedSha256);
 }
 
-bool Downloader::DownloadFile(const std::wstring& url, const std::wstring& outputPath, ProgressCallback callback)
+bool Downloader::DownloadFile(const std::vector<std::wstring>& sources, const std::wstring& outputPath,
+    ProgressCallback callback, const std::wstring& expectedSha256)
 {
-    cancelled_ = false;
+    TraceSpan span("download", "download");
+    span.SetArg("sources", (int64_t)sources.size());
+
+    integrityFailed_ = false;
+    insufficientSpace_ = false;
+
+    if (sources.empty()) {
+        return false;
+    }
+    const std::wstring& url = sources.front();
+
+    std::wstring sha256;
+    if (cache_ && FindCached(url, expectedSha256, sha256) && cache_->Restore(sha256, outputPath)) {
+        span.SetArg("cached", 1);
+        if (callback) {
+            callback(100, L"File recuperato dalla cache");
+        }
+        return true;
+    }
+
+    HttpResponse info;
+    if (!FetchFile(sources, outputPath, callback, expectedSha256, sha256, info)) {
+        return false;
+    }
+    if (info.hasContentLength) {
+        span.SetBytes(info.contentLength);
+    }
+
+    // A full cache or a failed copy only costs the next run a download
+    if (cache_ && !sha256.empty()) {
+        cache_->Store(url, outputPath, sha256, info.etag, info.lastModified);
+    }
+    return true;
+}
+
+bool Downloader::FetchFile(const std::vector<std::wstring>& urls, const std::wstring& outputPath,
+    ProgressCallback callback, const std::wstring& expectedSha256, std::wstring& sha256, HttpResponse& info)
+{
+    const std::wstring& url = urls.front();
+    std::vector<Source> sources;
+
+    if (urls.size() == 1) {
+        // Probe size, range support and validators before choosing a strategy
+        HttpRequest probe = Request(url);
+        probe.headOnly = true;
+
+        if (auto head = transport_->Open(probe)) {
+            if (head->Response().statusCode == 200) {
+                info = head->Response();
+            }
+        }
+        sources.push_back({ url, 0, info, 0 });
+    } else {
+        // The race answers the same questions for every mirror
+        sources = RaceSources(urls);
+        if (sources.empty()) {
+            return false;
+        }
+
+        // Validators come from the first source in the caller's order, so the
+        // journal still matches when the next run finds another mirror fastest
+        const Source* anchor = &sources.front();
+        for (const Source& source : sources) {
+            if (source.index < anchor->index) {
+                anchor = &source;
+            }
+        }
+        info = anchor->resource;
+
+        sources.erase(std::remove_if(sources.begin(), sources.end(),
+            [&info](const Source& source) { return !SameSize(source.resource, info); }), sources.end());
+    }
+
+    uint64_t totalSize = info.hasContentLength ? info.contentLength : 0;
+    bool resumable = info.acceptRanges && totalSize > 0 && (!info.etag.empty() || !info.lastModified.empty());
+    std::wstring journalPath = DownloadJournal::PathFor(outputPath);
+
+    if (!resumable) {
+        FileSystem::RemoveFile(journalPath);
+
+        if (!HasSpaceFor(outputPath, totalSize, 0)) {
+            return false;
+        }
+
+        File file;
+        if (!file.Open(outputPath, File::Mode::Write)) {
+            return false;
+        }
+
+        bool success = FetchWhole(sources, file, callback, totalSize, expectedSha256, sha256);
+        file.Close();
+
+        // Without ranges a partial file can't be resumed
+        if (!success) {
+            FileSystem::RemoveFile(outputPath);
+        }
+        return success;
+    }
+
+    // Resume only when the journal describes this exact version of the resource
+    DownloadJournal journal;
+    bool resume = journal.Load(journalPath) && journal.url == url && journal.totalSize == totalSize &&
+                  journal.etag == info.etag && journal.lastModified == info.lastModified &&
+                  FileSystem::FileExists(outputPath);
+
+    if (!resume) {
+        journal = DownloadJournal();
+        journal.url = url;
+        journal.etag = info.etag;
+        journal.lastModified = info.lastModified;
+        journal.totalSize = totalSize;
+    }
+
+    // Size the file once; every connection writes its ranges at their own offsets.
+    // Opened for reading too, so the digest can read back out-of-order ranges
+    File file;
+    if (!file.Open(outputPath, File::Mode::ReadWrite) || (!resume && !file.Truncate(0))) {
+        return false;
+    }
+
+    // Allocated up front rather than left sparse, so the ranges don't fragment it
+    uint64_t present = 0;
+    file.GetSize(present);
+    if (!HasSpaceFor(outputPath, totalSize, present) || !file.Preallocate(totalSize)) {
+        insufficientSpace_ = true;
+        if (!resume) {
+            file.Truncate(0);
+            file.Close();
+            FileSystem::RemoveFile(outputPath);
+        }
+        return false;
+    }
+
+    // Record the validators before the first byte lands
+    if (!journal.Save(journalPath)) {
+        return false;
+    }
+
+    std::unique_ptr<OrderedDigest> digest;
+    if (!expectedSha256.empty() || cache_) {
+        digest = std::make_unique<OrderedDigest>(file);
+    }
+
+    TransferProgress progress(callback, totalSize);
+    if (resume) {
+        progress.Add(journal.CompletedBytes());
+
+        // Bytes from the earlier run are only on disk
+        if (digest) {
+            for (const auto& range : journal.CompletedRanges()) {
+                digest->Written(range.start, nullptr, range.end - range.start);
+            }
+        }
+    }
 
-    // Use URLDownloadToFile with progress callback
-    DownloadCallbackData callbackData;
-    callbackData.callback = callback;
-    callbackData.cancelled = &cancelled_;
+    // Mirrors that answered the race without a range can't take part
+    std::vector<Source> ranged;
+    for (const Source& source : sources) {
+        if (source.resource.acceptRanges) {
+            ranged.push_back(source);
+        }
+    }
 
-    // Use WinINet for download with progress
-    HINTERNET hInternet = InternetOpenW(L"InstAnalyticsInstaller",
-        INTERNET_OPEN_TYPE_DIRECT, nullptr, nullptr, 0);
+    bool rangesIgnored = false;
+    bool success = DownloadRanges(ranged, journal, journalPath, file, progress, digest.get(), rangesIgnored);
 
-    if (!hInternet) {
+    // The HEAD answer advertised ranges but GETs ignore them: start over on one connection
+    if (!success && rangesIgnored && !Cancelled() && file.Truncate(0)) {
+        FileSystem::RemoveFile(journalPath);
+        digest.reset();
+        success = FetchWhole(sources, file, callback, totalSize, expectedSha256, sha256);
+        file.Close();
+        if (!success) {
+            FileSystem::RemoveFile(outputPath);
+        }
+        return success;
+    }
+
+    if (success && !VerifyDigest(digest.get(), totalSize, expectedSha256, sha256)) {
+        // Every range arrived but the content is wrong: nothing worth resuming
+        file.Close();
+        FileSystem::RemoveFile(outputPath);
+        FileSystem::RemoveFile(journalPath);
         return false;
     }
 
-    // Open URL with flags to follow redirects automatically
-    HINTERNET hUrl = InternetOpenUrlW(hInternet, url.c_str(), nullptr, 0,
-        INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_KEEP_CONNECTION, 0);
+    file.Close();
+
+    // Failed or cancelled transfers keep the partial file and journal for the next attempt
+    if (success) {
+        FileSystem::RemoveFile(journalPath);
+    }
+
+    return success;
+}
+
+std::vector<Downloader::Source> Downloader::RaceSources(const std::vector<std::wstring>& urls)
+{
+    TraceSpan span("download.race", "download");
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<Source> sources(urls.size());
+    std::vector<std::thread> probes;
+
+    for (size_t i = 0; i < urls.size(); ++i) {
+        probes.emplace_back([this, &urls, &sources, i] {
+            TraceSpan probeSpan("download.probe", "download");
+            probeSpan.SetArg("source", (int64_t)i);
+
+            Source& source = sources[i];
+            source.url = urls[i];
+            source.index = i;
+            source.bytesPerSecond = 0;
+
+            HttpRequest request = Request(urls[i]);
+            request.useRange = true;
+            request.rangeLength = options_.probeSize;
+
+            // Connection setup is part of the time: a distant mirror pays it on every range
+            Clock::time_point start = Clock::now();
+            auto stream = transport_->Open(request);
+            if (!stream) {
+                return;
+            }
 
-    if (!hUrl) {
-        InternetCloseHandle(hInternet);
+            HttpResponse response = stream->Response();
+            if (response.statusCode == 206) {
+                response.statusCode = 200;
+                response.hasContentLength = response.totalLength > 0;
+                response.contentLength = response.totalLength;
+                response.acceptRanges = true;
+            } else if (response.statusCode == 200) {
+                response.acceptRanges = false;  // It just ignored the range
+            } else {
+                return;
+            }
+
+            std::vector<uint8_t> buffer(BUFFER_SIZE);
+            uint64_t received = 0;
+            while (received < options_.probeSize && !Cancelled()) {
+                size_t bytesRead = 0;
+                size_t chunk = (size_t)std::min<uint64_t>(buffer.size(), options_.probeSize - received);
+                if (!stream->Read(buffer.data(), chunk, bytesRead) || bytesRead == 0) {
+                    break;
+                }
+                received += bytesRead;
+            }
+
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            probeSpan.SetBytes(received);
+            if (received > 0) {
+                source.resource = response;
+                source.bytesPerSecond = received / std::max(seconds, 1e-6);
+            }
+        });
+    }
+    for (auto& probe : probes) {
+        probe.join();
+    }
+
+    // Fastest first; the ones that failed to answer drop out
+    sources.erase(std::remove_if(sources.begin(), sources.end(),
+        [](const Source& source) { return source.bytesPerSecond == 0; }), sources.end());
+    std::stable_sort(sources.begin(), sources.end(),
+        [](const Source& a, const Source& b) { return a.bytesPerSecond > b.bytesPerSecond; });
+    span.SetArg("answered", (int64_t)sources.size());
+    return sources;
+}
+
+// One connection from the first byte, moving to the next source when one
+// fails; without ranges nothing received so far can be kept
+bool Downloader::FetchWhole(const std::vector<Source>& sources, File& file, ProgressCallback callback,
+    uint64_t totalSize, const std::wstring& expectedSha256, std::wstring& sha256)
+{
+    for (const Source& source : sources) {
+        TransferProgress progress(callback, totalSize);
+        std::unique_ptr<OrderedDigest> digest;
+        if (!expectedSha256.empty() || cache_) {
+            digest = std::make_unique<OrderedDigest>(file);
+        }
+
+        if (DownloadSingle(source.url, file, progress, digest.get())) {
+            uint64_t written = 0;
+            return file.GetSize(written) && VerifyDigest(digest.get(), written, expectedSha256, sha256);
+        }
+        if (Cancelled() || insufficientSpace_ || !file.Truncate(0)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool Downloader::DownloadToStream(const std::wstring& url, OutputStream& output, ProgressCallback callback,
+    const std::wstring& expectedSha256)
+{
+    return DownloadToStream(std::vector<std::wstring>{ url }, output, callback, expectedSha256);
+}
+
+bool Downloader::DownloadToStream(const std::vector<std::wstring>& urls, OutputStream& output,
+    ProgressCallback callback, const std::wstring& expectedSha256)
+{
+    TraceSpan span("download.stream", "download");
+
+    integrityFailed_ = false;
+    insufficientSpace_ = false;
+
+    if (urls.empty()) {
         return false;
     }
+    const std::wstring& url = urls.front();
 
-    // Get file size
-    DWORD fileSize = 0;
-    DWORD bufferSize = sizeof(fileSize);
-    DWORD index = 0;
-    HttpQueryInfoW(hUrl, HTTP_QUERY_CONTENT_LENGTH | HTTP_QUERY_FLAG_NUMBER,
-        &fileSize, &bufferSize, &index);
+    std::wstring cached;
+    if (cache_ && FindCached(url, expectedSha256, cached)) {
+        span.SetArg("cached", 1);
+        return StreamCached(cached, output, callback);
+    }
 
-    // Open output file
-    HANDLE hFile = CreateFileW(outputPath.c_str(), GENERIC_WRITE, 0, nullptr,
-        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    std::vector<Source> sources;
+    if (urls.size() == 1) {
+        sources.push_back({ url, 0, HttpResponse(), 0 });
+    } else {
+        sources = RaceSources(urls);
+    }
 
-    if (hFile == INVALID_HANDLE_VALUE) {
-        InternetCloseHandle(hUrl);
-        InternetCloseHandle(hInternet);
+    // Nothing has been consumed yet: a source that fails to answer is simply skipped
+    HttpRequest request = Request(url);
+    std::unique_ptr<HttpStream> stream;
+    size_t source = 0;
+    for (; source < sources.size() && !Cancelled(); ++source) {
+        request.url = sources[source].url;
+        stream = transport_->Open(request);
+        if (stream && stream->Response().statusCode == 200) {
+            break;
+        }
+        stream.reset();
+    }
+    if (!stream) {
         return false;
     }
+    const size_t firstSource = source;
+
+    // Validators of the first response; a resumed range must come from the
+    // same version. Other mirrors have validators of their own: from them a
+    // range is taken when they serve the same size, and the digest vouches
+    // for the content
+    const HttpResponse first = stream->Response();
+    auto resumable = [&](size_t index) {
+        if (index == firstSource) {
+            return first.acceptRanges && (!first.etag.empty() || !first.lastModified.empty());
+        }
+        return sources[index].resource.acceptRanges && first.hasContentLength &&
+               SameSize(sources[index].resource, first);
+    };
+
+    // The consumer keeps nothing on disk, so the cache gets its own copy
+    File cacheCopy;
+    std::wstring cacheCopyPath;
+    if (cache_) {
+        cacheCopyPath = cache_->NewTempPath();
+        if (!cacheCopy.Open(cacheCopyPath, File::Mode::Write)) {
+            cacheCopyPath.clear();
+        }
+    }
+
+    TransferProgress progress(callback, first.hasContentLength ? first.contentLength : 0);
+    Sha256 sha;
+    std::vector<uint8_t> buffer(BUFFER_SIZE);
+    uint64_t done = 0;
+    unsigned attempts = 0;
+    unsigned failovers = 0;
+    bool failed = false;
+    // Sources given up on mid-stream; one that would not send the whole
+    // payload may still serve the rest as a range
+    std::vector<bool> abandoned(sources.size(), false);
+
+    while (!Cancelled() && !failed) {
+        size_t bytesRead = 0;
+        bool readOk = stream && stream->Read(buffer.data(), buffer.size(), bytesRead);
+
+        if (readOk && bytesRead == 0 && (!first.hasContentLength || done == first.contentLength)) {
+            break;
+        }
 
-    // Download in chunks
-    const DWORD BUFFER_SIZE = 8192;
-    BYTE buffer[BUFFER_SIZE];
-    DWORD totalBytesRead = 0;
-    DWORD bytesRead = 0;
-    DWORD bytesWritten = 0;
+        if (!readOk || bytesRead == 0) {
+            // Connection dropped (or closed early): pick up where the consumer
+            // left off, from the next mirror once this one is out of retries
+            // or answers with other bytes or another version
+            stream.reset();
+            bool moveOn = !resumable(source) || ++attempts > options_.segmentRetries;
+            while (!stream && !Cancelled()) {
+                if (moveOn) {
+                    abandoned[source] = true;
+                    size_t next = 0;
+                    while (next < sources.size() && (abandoned[next] || !resumable(next))) {
+                        ++next;
+                    }
+                    if (next >= sources.size()) {
+                        failed = true;
+                        break;
+                    }
+                    source = next;
+                    attempts = 1;
+                    ++failovers;
+                } else {
+                    cancel_->WaitFor(std::chrono::milliseconds(options_.retryDelayMs * attempts));
+                }
 
-    bool success = true;
+                request.url = sources[source].url;
+                request.useRange = true;
+                request.rangeStart = done;
+                stream = transport_->Open(request);
+                if (!stream) {
+                    moveOn = ++attempts > options_.segmentRetries;
+                    continue;
+                }
+                const HttpResponse& resumed = stream->Response();
+                bool sameVersion = source == firstSource
+                    ? resumed.etag == first.etag && resumed.lastModified == first.lastModified
+                    : resumed.totalLength == first.contentLength;
+                if (resumed.statusCode != 206 || resumed.rangeStart != done || !sameVersion) {
+                    stream.reset();
+                    moveOn = true;
+                }
+            }
+            continue;
+        }
 
-    while (!cancelled_ && InternetReadFile(hUrl, buffer, BUFFER_SIZE, &bytesRead) && bytesRead > 0) {
-        if (!WriteFile(hFile, buffer, bytesRead, &bytesWritten, nullptr)) {
-            success = false;
+        if (!output.Write(buffer.data(), bytesRead)) {
+            failed = true;
             break;
         }
 
-        totalBytesRead += bytesRead;
+        // A failing cache copy is dropped, never the download
+        if (cacheCopy.IsOpen() && !cacheCopy.Write(buffer.data(), bytesRead)) {
+            cacheCopy.Close();
+        }
 
-        // Report progress
-        if (callback && fileSize > 0) {
-            int progress = (int)((totalBytesRead * 100) / fileSize);
+        sha.Update(buffer.data(), bytesRead);
+        done += bytesRead;
+        progress.Add(bytesRead);
+    }
 
-            double downloadedMB = totalBytesRead / (1024.0 * 1024.0);
-            double totalMB = fileSize / (1024.0 * 1024.0);
+    bool complete = !failed && !Cancelled() && done > 0;
+    span.SetArg("reconnects", attempts);
+    span.SetArg("failovers", failovers);
+    span.SetBytes(done);
 
-            wchar_t statusBuffer[256];
-            swprintf_s(statusBuffer, L"Download in corso: %.1f MB / %.1f MB", downloadedMB, totalMB);
+    std::wstring sha256 = sha.FinalHex();
+    if (complete && !expectedSha256.empty() && !Sha256::HexEquals(sha256, expectedSha256)) {
+        integrityFailed_ = true;
+        complete = false;
+    }
+
+    bool cacheable = cacheCopy.IsOpen();
+    cacheCopy.Close();
+    if (!cacheCopyPath.empty()) {
+        if (!complete || !cacheable || !cache_->Store(url, cacheCopyPath, sha256, first.etag, first.lastModified, false)) {
+            FileSystem::RemoveFile(cacheCopyPath);
+        }
+    }
 
-            callback(progress, statusBuffer);
+    return complete;
+}
+
+bool Downloader::StreamCached(const std::wstring& sha256, OutputStream& output, ProgressCallback callback)
+{
+    File blob;
+    uint64_t size = 0;
+    if (!blob.Open(cache_->BlobPath(sha256), File::Mode::Read) || !blob.GetSize(size)) {
+        return false;
+    }
+    cache_->MarkUsed(sha256);
+
+    TransferProgress progress(callback, size);
+    std::vector<uint8_t> buffer(BUFFER_SIZE);
+    while (!Cancelled()) {
+        size_t bytesRead = 0;
+        if (!blob.Read(buffer.data(), buffer.size(), bytesRead)) {
+            return false;
+        }
+        if (bytesRead == 0) {
+            return true;
+        }
+        if (!output.Write(buffer.data(), bytesRead)) {
+            return false;
         }
+        progress.Add(bytesRead);
     }
+    return false;
+}
+
+bool Downloader::DownloadSingle(const std::wstring& url, File& file, TransferProgress& progress, OrderedDigest* digest)
+{
+    TraceSpan span("download.single", "download");
 
-    CloseHandle(hFile);
-    InternetCloseHandle(hUrl);
-    InternetCloseHandle(hInternet);
+    HttpRequest request = Request(url);
 
-    if (cancelled_) {
-        DeleteFileW(outputPath.c_str());
+    auto stream = transport_->Open(request);
+    if (!stream || stream->Response().statusCode != 200) {
         return false;
     }
 
-    return success && totalBytesRead > 0;
+    const HttpResponse& response = stream->Response();
+    if (response.hasContentLength) {
+        progress.SetTotal(response.contentLength);
+
+        if (!file.Preallocate(response.contentLength)) {
+            insufficientSpace_ = true;
+            file.Truncate(0);
+            return false;
+        }
+    }
+
+    // Writes are sequential, so every block lands at the digest cursor and is
+    // hashed from the write buffer on the writer thread
+    AsyncFileWriter writer(file, options_.writeBuffers, options_.writeBufferSize,
+        [digest](uint64_t offset, const uint8_t* data, size_t size) {
+            if (digest) {
+                digest->Written(offset, data, size);
+            }
+        },
+        cancel_.get());
+
+    uint64_t totalBytesRead = 0;
+    bool complete = false;
+
+    while (!Cancelled() && !complete) {
+        uint8_t* buffer = writer.Acquire();
+        if (!buffer) {
+            break;
+        }
+
+        size_t target = writer.TargetSize();
+        size_t filled = 0;
+        bool readFailed = false;
+        while (filled < target && !Cancelled()) {
+            size_t bytesRead = 0;
+            if (!stream->Read(buffer + filled, target - filled, bytesRead)) {
+                readFailed = true;
+                break;
+            }
+            if (bytesRead == 0) {
+                complete = true;
+                break;
+            }
+            filled += bytesRead;
+            progress.Add(bytesRead);
+        }
+
+        bool queued = writer.Submit(totalBytesRead, filled);
+        totalBytesRead += filled;
+        if (!queued || readFailed) {
+            complete = false;
+            break;
+        }
+    }
+
+    bool success = writer.Finish() && complete && !Cancelled() && totalBytesRead > 0 &&
+                   (!response.hasContentLength || totalBytesRead == response.contentLength);
+    span.SetBytes(totalBytesRead);
+
+    // Don't leave a preallocated tail that looks like downloaded data
+    if (!success) {
+        file.Truncate(totalBytesRead);
+    }
+    return success;
+}
+
+bool Downloader::DownloadRanges(const std::vector<Source>& sources, DownloadJournal& journal,
+    const std::wstring& journalPath, File& file, TransferProgress& progress, OrderedDigest* digest, bool& rangesIgnored)
+{
+    std::vector<ByteRange> missing = journal.MissingRanges();
+
+    uint64_t missingBytes = 0;
+    for (const auto& range : missing) {
+        missingBytes += range.end - range.start;
+    }
+    if (missingBytes == 0) {
+        return true;
+    }
+
+    // About one segment per connection, never smaller than minSegmentSize
+    unsigned connections = options_.connections > 0 ? options_.connections : 1;
+    uint64_t pieces = (uint64_t)connections * (sources.size() > 1 ? MIRROR_SEGMENTS_PER_CONNECTION : 1);
+    uint64_t segmentSize = (missingBytes + pieces - 1) / pieces;
+    if (segmentSize < options_.minSegmentSize) {
+        segmentSize = options_.minSegmentSize;
+    }
+
+    std::vector<Segment> segments;
+    for (const auto& range : missing) {
+        for (uint64_t offset = range.start; offset < range.end; offset += segmentSize) {
+            uint64_t length = std::min(segmentSize, range.end - offset);
+            segments.push_back({ offset, length, 0, 0 });
+        }
+    }
+
+    RangedTransfer transfer(journal, journalPath, sources);
+    size_t workerCount = std::min<size_t>(connections, segments.size());
+    std::vector<std::thread> workers;
+
+    std::vector<double> rates;
+    for (const Source& source : sources) {
+        rates.push_back(source.bytesPerSecond);
+    }
+    std::vector<size_t> assignment = AssignConnections(rates, workerCount);
+
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back([this, &segments, &file, &progress, digest, &transfer, source = assignment[i]]() mutable {
+            for (;;) {
+                size_t index = transfer.nextSegment++;
+                if (index >= segments.size()) {
+                    return;
+                }
+
+                TraceSpan span("download.segment", "download");
+                uint64_t before = segments[index].done;
+                bool fetched = FetchSegment(segments[index], source, file, progress, digest, transfer);
+                span.SetArg("source", (int64_t)source);
+                span.SetBytes(segments[index].done - before);
+                if (!fetched) {
+                    return;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    rangesIgnored = transfer.rangesIgnored;
+    return !transfer.failed && !Cancelled();
+}
+
+void Downloader::Checkpoint(Segment& segment, RangedTransfer& transfer, uint64_t written)
+{
+    // Only bytes the writer has put on disk may be recorded as completed
+    if (written <= segment.journaled) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(transfer.journalMutex);
+    transfer.journal.MarkCompleted(segment.offset + segment.journaled, segment.offset + written);
+    transfer.journal.Save(transfer.journalPath);
+    segment.journaled = written;
+}
+
+bool Downloader::FetchSegment(Segment& segment, size_t& source, File& file, TransferProgress& progress,
+    OrderedDigest* digest, RangedTransfer& transfer)
+{
+    // Ranges from several connections: blocks ahead of the digest cursor are
+    // read back later, so they must be on disk before they are reported
+    AsyncFileWriter writer(file, options_.writeBuffers, options_.writeBufferSize,
+        [digest](uint64_t offset, const uint8_t* data, size_t size) {
+            if (digest) {
+                digest->Written(offset, data, size);
+            }
+        },
+        cancel_.get());
+    uint64_t base = segment.done;
+    auto written = [&] { return base + writer.BytesWritten(); };
+
+    // Drains the queue so the journal covers everything received
+    auto stop = [&] {
+        bool ok = writer.Finish();
+        Checkpoint(segment, transfer, written());
+        if (!ok) {
+            transfer.failed = true;
+        }
+        return ok;
+    };
+
+    unsigned attempts = 0;
+
+    while (segment.done < segment.length) {
+        if (Cancelled() || transfer.failed) {
+            stop();
+            return false;
+        }
+
+        // Another connection may have given up on this source meanwhile
+        if (!transfer.Pick(source)) {
+            stop();
+            transfer.failed = true;
+            return false;
+        }
+
+        HttpRequest request = Request(transfer.sources[source].url);
+        request.useRange = true;
+        request.rangeStart = segment.offset + segment.done;
+        request.rangeLength = segment.length - segment.done;
+
+        auto stream = transport_->Open(request);
+        if (stream && stream->Response().statusCode == 200) {
+            // This source ignores ranges; another one may not
+            transfer.Drop(source);
+            if (transfer.Pick(source)) {
+                attempts = 0;
+                continue;
+            }
+            writer.Finish();
+            transfer.rangesIgnored = true;
+            transfer.failed = true;
+            return false;
+        }
+
+        if (stream && stream->Response().statusCode == 206 &&
+            !ServesRange(stream->Response(), request.rangeStart, transfer.sources[source].resource)) {
+            // Not the bytes asked for, or the file changed on this source
+            transfer.Drop(source);
+            if (transfer.Pick(source)) {
+                attempts = 0;
+                continue;
+            }
+            stop();
+            transfer.failed = true;
+            return false;
+        }
+
+        if (stream && stream->Response().statusCode == 206) {
+            bool dropped = false;
+            while (!dropped && segment.done < segment.length && !Cancelled() && !transfer.failed) {
+                uint8_t* buffer = writer.Acquire();
+                if (!buffer) {
+                    stop();
+                    return false;
+                }
+
+                size_t target = (size_t)std::min<uint64_t>(writer.TargetSize(), segment.length - segment.done);
+                size_t filled = 0;
+                while (filled < target && !Cancelled()) {
+                    size_t bytesRead = 0;
+                    if (!stream->Read(buffer + filled, target - filled, bytesRead) || bytesRead == 0) {
+                        dropped = true; // Reconnect and resume at the last received byte
+                        break;
+                    }
+                    filled += bytesRead;
+                    progress.Add(bytesRead);
+                }
+
+                if (!writer.Submit(segment.offset + segment.done, filled)) {
+                    stop();
+                    return false;
+                }
+                segment.done += filled;
+
+                if (written() - segment.journaled >= options_.journalInterval) {
+                    Checkpoint(segment, transfer, written());
+                }
+            }
+        }
+
+        if (segment.done < segment.length && ++attempts > options_.segmentRetries) {
+            // The next source resumes at the last received byte
+            transfer.Drop(source);
+            if (transfer.Pick(source)) {
+                attempts = 0;
+                continue;
+            }
+            stop();
+            transfer.failed = true;
+            return false;
+        }
+        if (segment.done < segment.length) {
+            cancel_->WaitFor(std::chrono::milliseconds(options_.retryDelayMs * attempts));
+        }
+    }
+
+    return stop();
 }
 
 } // namespace InstAnalyticsInstaller
@@ -0,0 +1,810 @@
+#include "FileSystem.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#include <vector>
+#endif
+
+namespace InstAnalyticsInstaller {
+
+#ifdef _WIN32
+const wchar_t FileSystem::PathSeparator = L'\\';
+#else
+const wchar_t FileSystem::PathSeparator = L'/';
+#endif
+
+// ============================================================================
+// File
+// ============================================================================
+
+#ifdef _WIN32
+
+File::File()
+    : handle_(INVALID_HANDLE_VALUE)
+{
+}
+
+File::File(File&& other) noexcept
+    : handle_(other.handle_)
+{
+    other.handle_ = INVALID_HANDLE_VALUE;
+}
+
+File& File::operator=(File&& other) noexcept
+{
+    if (this != &other) {
+        Close();
+        handle_ = other.handle_;
+        other.handle_ = INVALID_HANDLE_VALUE;
+    }
+    return *this;
+}
+
+bool File::Open(const std::wstring& path, Mode mode)
+{
+    Close();
+
+    DWORD access = GENERIC_READ;
+    DWORD share = FILE_SHARE_READ;
+    DWORD disposition = OPEN_EXISTING;
+
+    if (mode == Mode::Write) {
+        access = GENERIC_WRITE;
+        share = 0;
+        disposition = CREATE_ALWAYS;
+    } else if (mode == Mode::ReadWrite) {
+        access = GENERIC_READ | GENERIC_WRITE;
+        share = 0;
+        disposition = OPEN_ALWAYS;
+    } else if (mode == Mode::ReadShared) {
+        share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+    }
+
+    handle_ = CreateFileW(path.c_str(), access, share, nullptr,
+        disposition, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    return handle_ != INVALID_HANDLE_VALUE;
+}
+
+void File::Close()
+{
+    if (handle_ != INVALID_HANDLE_VALUE) {
+        CloseHandle(handle_);
+        handle_ = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool File::IsOpen() const
+{
+    return handle_ != INVALID_HANDLE_VALUE;
+}
+
+bool File::Read(void* buffer, size_t size, size_t& bytesRead)
+{
+    DWORD read = 0;
+    DWORD request = size > MAXDWORD ? MAXDWORD : (DWORD)size;
+    if (!ReadFile(handle_, buffer, request, &read, nullptr)) {
+        bytesRead = 0;
+        return false;
+    }
+    bytesRead = read;
+    return true;
+}
+
+bool File::Write(const void* data, size_t size)
+{
+    const BYTE* cursor = (const BYTE*)data;
+    while (size > 0) {
+        DWORD request = size > MAXDWORD ? MAXDWORD : (DWORD)size;
+        DWORD written = 0;
+        if (!WriteFile(handle_, cursor, request, &written, nullptr) || written == 0) {
+            return false;
+        }
+        cursor += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool File::ReadAt(uint64_t offset, void* buffer, size_t size, size_t& bytesRead)
+{
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+    DWORD read = 0;
+    DWORD request = size > MAXDWORD ? MAXDWORD : (DWORD)size;
+    if (!ReadFile(handle_, buffer, request, &read, &overlapped)) {
+        bytesRead = 0;
+        return GetLastError() == ERROR_HANDLE_EOF;
+    }
+    bytesRead = read;
+    return true;
+}
+
+bool File::WriteAt(uint64_t offset, const void* data, size_t size)
+{
+    const BYTE* cursor = (const BYTE*)data;
+    while (size > 0) {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+        DWORD request = size > MAXDWORD ? MAXDWORD : (DWORD)size;
+        DWORD written = 0;
+        if (!WriteFile(handle_, cursor, request, &written, &overlapped) || written == 0) {
+            return false;
+        }
+        cursor += written;
+        offset += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool File::GetSize(uint64_t& size) const
+{
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle_, &fileSize)) {
+        return false;
+    }
+    size = (uint64_t)fileSize.QuadPart;
+    return true;
+}
+
+bool File::Truncate(uint64_t size)
+{
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG)size;
+    return SetFilePointerEx(handle_, position, nullptr, FILE_BEGIN) && SetEndOfFile(handle_);
+}
+
+bool File::Preallocate(uint64_t size)
+{
+    // Allocation first: NTFS reserves contiguous clusters where it can
+    FILE_ALLOCATION_INFO allocation = {};
+    allocation.AllocationSize.QuadPart = (LONGLONG)size;
+    if (!SetFileInformationByHandle(handle_, FileAllocationInfo, &allocation, sizeof(allocation)) &&
+        GetLastError() == ERROR_DISK_FULL) {
+        return false;
+    }
+
+    // Same as SetEndOfFile, without moving the file pointer sequential writes use
+    FILE_END_OF_FILE_INFO endOfFile = {};
+    endOfFile.EndOfFile.QuadPart = (LONGLONG)size;
+    return SetFileInformationByHandle(handle_, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile)) != 0;
+}
+
+#else
+
+File::File()
+    : fd_(-1)
+{
+}
+
+File::File(File&& other) noexcept
+    : fd_(other.fd_)
+{
+    other.fd_ = -1;
+}
+
+File& File::operator=(File&& other) noexcept
+{
+    if (this != &other) {
+        Close();
+        fd_ = other.fd_;
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+bool File::Open(const std::wstring& path, Mode mode)
+{
+    Close();
+
+    int flags = O_RDONLY;
+    if (mode == Mode::Write) {
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+    } else if (mode == Mode::ReadWrite) {
+        flags = O_RDWR | O_CREAT;
+    }
+
+    fd_ = open(FileSystem::ToUtf8(path).c_str(), flags | O_CLOEXEC, 0644);
+    return fd_ >= 0;
+}
+
+void File::Close()
+{
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool File::IsOpen() const
+{
+    return fd_ >= 0;
+}
+
+bool File::Read(void* buffer, size_t size, size_t& bytesRead)
+{
+    ssize_t result;
+    do {
+        result = read(fd_, buffer, size);
+    } while (result < 0 && errno == EINTR);
+
+    bytesRead = result > 0 ? (size_t)result : 0;
+    return result >= 0;
+}
+
+bool File::Write(const void* data, size_t size)
+{
+    const char* cursor = (const char*)data;
+    while (size > 0) {
+        ssize_t written = write(fd_, cursor, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        cursor += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+bool File::ReadAt(uint64_t offset, void* buffer, size_t size, size_t& bytesRead)
+{
+    ssize_t result;
+    do {
+        result = pread(fd_, buffer, size, (off_t)offset);
+    } while (result < 0 && errno == EINTR);
+
+    bytesRead = result > 0 ? (size_t)result : 0;
+    return result >= 0;
+}
+
+bool File::WriteAt(uint64_t offset, const void* data, size_t size)
+{
+    const char* cursor = (const char*)data;
+    while (size > 0) {
+        ssize_t written = pwrite(fd_, cursor, size, (off_t)offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        cursor += written;
+        offset += (uint64_t)written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+bool File::GetSize(uint64_t& size) const
+{
+    struct stat info;
+    if (fstat(fd_, &info) != 0) {
+        return false;
+    }
+    size = (uint64_t)info.st_size;
+    return true;
+}
+
+bool File::Truncate(uint64_t size)
+{
+    return ftruncate(fd_, (off_t)size) == 0;
+}
+
+bool File::Preallocate(uint64_t size)
+{
+#ifdef __linux__
+    int result;
+    do {
+        result = fallocate(fd_, 0, 0, (off_t)size);
+    } while (result != 0 && errno == EINTR);
+
+    if (result == 0) {
+        return true;
+    }
+    if (errno == ENOSPC || errno == EFBIG || errno == EDQUOT) {
+        return false;
+    }
+#endif
+    // No fallocate on this file system: a sparse extension still sets the size
+    return ftruncate(fd_, (off_t)size) == 0;
+}
+
+#endif
+
+File::~File()
+{
+    Close();
+}
+
+// ============================================================================
+// MappedFile
+// ============================================================================
+
+MappedFile::MappedFile()
+    : data_(nullptr)
+    , size_(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::wstring& path)
+{
+    Close();
+
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart > (uint64_t)SIZE_MAX) {
+        CloseHandle(file);
+        return false;
+    }
+    size_ = (uint64_t)size.QuadPart;
+    if (size_ == 0) {
+        CloseHandle(file);
+        return true;
+    }
+
+    // The view keeps the mapping, and the mapping the file, open
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) {
+        size_ = 0;
+        return false;
+    }
+    data_ = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data_) {
+        size_ = 0;
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data_) {
+        UnmapViewOfFile(data_);
+        data_ = nullptr;
+    }
+    size_ = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::wstring& path)
+{
+    Close();
+
+    int fd = open(FileSystem::ToUtf8(path).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (uint64_t)info.st_size > (uint64_t)SIZE_MAX) {
+        close(fd);
+        return false;
+    }
+    size_ = (uint64_t)info.st_size;
+    if (size_ == 0) {
+        close(fd);
+        return true;
+    }
+
+    void* data = mmap(nullptr, (size_t)size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        size_ = 0;
+        return false;
+    }
+    // Read once, front to back: let the kernel read ahead aggressively
+    madvise(data, (size_t)size_, MADV_SEQUENTIAL);
+    data_ = (const uint8_t*)data;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (data_) {
+        munmap((void*)data_, (size_t)size_);
+        data_ = nullptr;
+    }
+    size_ = 0;
+}
+
+#endif
+
+// ============================================================================
+// FileSystem
+// ============================================================================
+
+#ifdef _WIN32
+
+bool FileSystem::FileExists(const std::wstring& path)
+{
+    DWORD attributes = GetFileAttributesW(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool FileSystem::DirectoryExists(const std::wstring& path)
+{
+    DWORD attributes = GetFileAttributesW(path.c_str());
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+bool FileSystem::RemoveFile(const std::wstring& path)
+{
+    return DeleteFileW(path.c_str()) != 0;
+}
+
+bool FileSystem::RenameFile(const std::wstring& from, const std::wstring& to)
+{
+    return MoveFileExW(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+bool FileSystem::RenameDirectory(const std::wstring& from, const std::wstring& to)
+{
+    // MOVEFILE_REPLACE_EXISTING is not allowed for directories
+    return MoveFileExW(from.c_str(), to.c_str(), 0) != 0;
+}
+
+bool FileSystem::RemoveEmptyDirectory(const std::wstring& path)
+{
+    return RemoveDirectoryW(path.c_str()) != 0;
+}
+
+bool FileSystem::DuplicateFile(const std::wstring& from, const std::wstring& to)
+{
+    return CopyFileW(from.c_str(), to.c_str(), FALSE) != 0;
+}
+
+bool FileSystem::LinkFile(const std::wstring& from, const std::wstring& to)
+{
+    // FAT volumes and network shares may not support links
+    return CreateHardLinkW(to.c_str(), from.c_str(), nullptr) || CopyFileW(from.c_str(), to.c_str(), TRUE);
+}
+
+bool FileSystem::AvailableSpace(const std::wstring& directory, uint64_t& bytes)
+{
+    ULARGE_INTEGER available;
+    if (!GetDiskFreeSpaceExW(directory.empty() ? nullptr : directory.c_str(), &available, nullptr, nullptr)) {
+        return false;
+    }
+    bytes = available.QuadPart;
+    return true;
+}
+
+bool FileSystem::ListDirectory(const std::wstring& path, std::vector<DirectoryEntry>& entries)
+{
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileExW(JoinPath(path, L"*").c_str(), FindExInfoBasic, &data,
+        FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    do {
+        std::wstring name = data.cFileName;
+        if (name != L"." && name != L"..") {
+            entries.push_back({ name, (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 });
+        }
+    } while (FindNextFileW(find, &data));
+
+    FindClose(find);
+    return true;
+}
+
+static bool MakeDirectory(const std::wstring& path)
+{
+    return CreateDirectoryW(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+#else
+
+bool FileSystem::FileExists(const std::wstring& path)
+{
+    struct stat info;
+    return stat(ToUtf8(path).c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+bool FileSystem::DirectoryExists(const std::wstring& path)
+{
+    struct stat info;
+    return stat(ToUtf8(path).c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+bool FileSystem::RemoveFile(const std::wstring& path)
+{
+    return unlink(ToUtf8(path).c_str()) == 0;
+}
+
+bool FileSystem::RenameFile(const std::wstring& from, const std::wstring& to)
+{
+    return rename(ToUtf8(from).c_str(), ToUtf8(to).c_str()) == 0;
+}
+
+bool FileSystem::RenameDirectory(const std::wstring& from, const std::wstring& to)
+{
+    if (DirectoryExists(to)) {
+        return false;   // rename() would replace an empty one
+    }
+    return rename(ToUtf8(from).c_str(), ToUtf8(to).c_str()) == 0;
+}
+
+bool FileSystem::RemoveEmptyDirectory(const std::wstring& path)
+{
+    return rmdir(ToUtf8(path).c_str()) == 0;
+}
+
+bool FileSystem::DuplicateFile(const std::wstring& from, const std::wstring& to)
+{
+    File source;
+    File target;
+    if (!source.Open(from, File::Mode::Read) || !target.Open(to, File::Mode::Write)) {
+        return false;
+    }
+
+    std::vector<char> buffer(1024 * 1024);
+    for (;;) {
+        size_t bytesRead = 0;
+        if (!source.Read(buffer.data(), buffer.size(), bytesRead)) {
+            return false;
+        }
+        if (bytesRead == 0) {
+            return true;
+        }
+        if (!target.Write(buffer.data(), bytesRead)) {
+            return false;
+        }
+    }
+}
+
+bool FileSystem::LinkFile(const std::wstring& from, const std::wstring& to)
+{
+    if (link(ToUtf8(from).c_str(), ToUtf8(to).c_str()) == 0) {
+        return true;
+    }
+    // Other file systems (EXDEV) or none that supports links
+    return errno != EEXIST && DuplicateFile(from, to);
+}
+
+bool FileSystem::AvailableSpace(const std::wstring& directory, uint64_t& bytes)
+{
+    struct statvfs info;
+    if (statvfs(directory.empty() ? "." : ToUtf8(directory).c_str(), &info) != 0) {
+        return false;
+    }
+    bytes = (uint64_t)info.f_bavail * info.f_frsize;
+    return true;
+}
+
+bool FileSystem::ListDirectory(const std::wstring& path, std::vector<DirectoryEntry>& entries)
+{
+    std::string directory = ToUtf8(path);
+    DIR* handle = opendir(directory.c_str());
+    if (!handle) {
+        return false;
+    }
+
+    while (dirent* entry = readdir(handle)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+
+        // d_type is a hint some file systems leave unknown
+        bool isDirectory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            struct stat info;
+            isDirectory = stat((directory + "/" + name).c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+        }
+        entries.push_back({ FromUtf8(name), isDirectory });
+    }
+
+    closedir(handle);
+    return true;
+}
+
+static bool MakeDirectory(const std::wstring& path)
+{
+    return mkdir(FileSystem::ToUtf8(path).c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+#endif
+
+bool FileSystem::CreateDirectories(const std::wstring& path)
+{
+    if (path.empty() || DirectoryExists(path)) {
+        return true;
+    }
+
+    std::wstring parent = ParentPath(path);
+    if (!parent.empty() && parent != path && !CreateDirectories(parent)) {
+        return false;
+    }
+
+    return MakeDirectory(path);
+}
+
+bool FileSystem::RemoveTree(const std::wstring& path)
+{
+    std::vector<DirectoryEntry> entries;
+    if (!ListDirectory(path, entries)) {
+        return !DirectoryExists(path);
+    }
+    for (const auto& entry : entries) {
+        // A link to a directory goes with unlink (POSIX) or rmdir (Windows),
+        // before anything could recurse into its target
+        std::wstring child = JoinPath(path, entry.name);
+        bool removed = entry.isDirectory
+            ? RemoveFile(child) || RemoveEmptyDirectory(child) || RemoveTree(child)
+            : RemoveFile(child);
+        if (!removed) {
+            return false;
+        }
+    }
+    return RemoveEmptyDirectory(path);
+}
+
+std::wstring FileSystem::JoinPath(const std::wstring& base, const std::wstring& relative)
+{
+    if (base.empty()) {
+        return relative;
+    }
+
+    std::wstring result = base;
+    if (result.back() != L'/' && result.back() != L'\\') {
+        result += PathSeparator;
+    }
+
+    for (wchar_t ch : relative) {
+        result += (ch == L'/' || ch == L'\\') ? PathSeparator : ch;
+    }
+    return result;
+}
+
+std::wstring FileSystem::ParentPath(const std::wstring& path)
+{
+    size_t end = path.find_last_not_of(L"/\\");
+    if (end == std::wstring::npos) {
+        return L"";
+    }
+
+    size_t separator = path.find_last_of(L"/\\", end);
+    if (separator == std::wstring::npos) {
+        return L"";
+    }
+    if (separator == 0) {
+        return path.substr(0, 1);
+    }
+    return path.substr(0, separator);
+}
+
+std::string FileSystem::ToUtf8(const std::wstring& text)
+{
+    std::string result;
+    result.reserve(text.size());
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        uint32_t cp = (uint32_t)text[i];
+
+        // Combine UTF-16 surrogate pairs (wchar_t is 16 bits on Windows)
+        if (cp >= 0xD800 && cp <= 0xDBFF && i + 1 < text.size()) {
+            uint32_t low = (uint32_t)text[i + 1];
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                ++i;
+            }
+        }
+
+        if (cp < 0x80) {
+            result += (char)cp;
+        } else if (cp < 0x800) {
+            result += (char)(0xC0 | (cp >> 6));
+            result += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            result += (char)(0xE0 | (cp >> 12));
+            result += (char)(0x80 | ((cp >> 6) & 0x3F));
+            result += (char)(0x80 | (cp & 0x3F));
+        } else {
+            result += (char)(0xF0 | (cp >> 18));
+            result += (char)(0x80 | ((cp >> 12) & 0x3F));
+            result += (char)(0x80 | ((cp >> 6) & 0x3F));
+            result += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    return result;
+}
+
+std::wstring FileSystem::FromUtf8(const std::string& text)
+{
+    std::wstring result;
+    result.reserve(text.size());
+
+    size_t i = 0;
+    while (i < text.size()) {
+        uint8_t lead = (uint8_t)text[i];
+        uint32_t cp;
+        size_t extra;
+
+        if (lead < 0x80) {
+            cp = lead;
+            extra = 0;
+        } else if ((lead & 0xE0) == 0xC0) {
+            cp = lead & 0x1F;
+            extra = 1;
+        } else if ((lead & 0xF0) == 0xE0) {
+            cp = lead & 0x0F;
+            extra = 2;
+        } else if ((lead & 0xF8) == 0xF0) {
+            cp = lead & 0x07;
+            extra = 3;
+        } else {
+            result += L'\xFFFD';
+            ++i;
+            continue;
+        }
+
+        if (i + extra >= text.size() && extra > 0) {
+            result += L'\xFFFD';
+            break;
+        }
+
+        bool valid = true;
+        for (size_t k = 1; k <= extra; ++k) {
+            uint8_t next = (uint8_t)text[i + k];
+            if ((next & 0xC0) != 0x80) {
+                valid = false;
+                break;
+            }
+            cp = (cp << 6) | (next & 0x3F);
+        }
+
+        if (!valid) {
+            result += L'\xFFFD';
+            ++i;
+            continue;
+        }
+        i += extra + 1;
+
+        if (sizeof(wchar_t) == 2 && cp >= 0x10000) {
+            cp -= 0x10000;
+            result += (wchar_t)(0xD800 + (cp >> 10));
+            result += (wchar_t)(0xDC00 + (cp & 0x3FF));
+        } else {
+            result += (wchar_t)cp;
+        }
+    }
+
+    return result;
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,352 @@
+#include "HeadlessInstall.h"
+#include "Constants.h"
+#include "FileSystem.h"
+#include "InstallVerifier.h"
+#include "StagedInstall.h"
+#include "Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cwchar>
+#include <cwctype>
+#include <mutex>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+const char* PhaseEventName(InstallPipeline::PhaseEvent event)
+{
+    switch (event) {
+    case InstallPipeline::PhaseEvent::Started:
+        return "started";
+    case InstallPipeline::PhaseEvent::Succeeded:
+        return "succeeded";
+    case InstallPipeline::PhaseEvent::Failed:
+        return "failed";
+    default:
+        return "skipped";
+    }
+}
+
+std::string VerifyEvent(const VerifyReport& report)
+{
+    char numbers[128];
+    snprintf(numbers, sizeof(numbers), ",\"bytes\":%llu,\"seconds\":%.3f,\"mbps\":%.1f",
+        (unsigned long long)report.bytes, report.seconds, report.MegabytesPerSecond());
+
+    std::string line = "{\"event\":\"verify\",\"files\":" + std::to_string(report.files) + numbers
+        + ",\"mismatches\":[";
+    for (size_t i = 0; i < report.mismatches.size(); ++i) {
+        line += (i ? ",{\"path\":" : "{\"path\":") + HeadlessInstall::JsonString(report.mismatches[i].path)
+            + ",\"kind\":\"" + InstallVerifier::KindName(report.mismatches[i].kind) + "\"}";
+    }
+    return line + "]}";
+}
+
+} // namespace
+
+bool HeadlessInstall::IsRequested(const std::vector<std::wstring>& args)
+{
+    for (const std::wstring& arg : args) {
+        if (arg == L"--headless") {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HeadlessInstall::ParseArguments(const std::vector<std::wstring>& args, HeadlessOptions& options, std::wstring& error)
+{
+    struct Option {
+        const wchar_t* name;
+        std::wstring* value;
+        std::vector<std::wstring>* list;    // Repeatable options collect here instead
+    };
+    std::wstring extractThreads;
+    const Option known[] = {
+        { L"--install-path", &options.installPath, nullptr },
+        { L"--download-dir", &options.downloadDirectory, nullptr },
+        { L"--cache-dir", &options.cacheDirectory, nullptr },
+        { L"--app-url", &options.appUrl, nullptr },
+        { L"--app-mirror", nullptr, &options.appMirrors },
+        { L"--app-sha256", &options.appSha256, nullptr },
+        { L"--app-manifest", &options.appManifestUrl, nullptr },
+        { L"--app-manifest-sha256", &options.appManifestSha256, nullptr },
+        { L"--app-patches", &options.appPatchesUrl, nullptr },
+        { L"--apply-patches", &options.patchesPath, nullptr },
+        { L"--extract-threads", &extractThreads, nullptr },
+        { L"--trace", &options.tracePath, nullptr },
+        { L"--dotnet-root", &options.dotnetRoot, nullptr },
+        { L"--dotnet-url", &options.dotnetUrl, nullptr },
+        { L"--dotnet-mirror", nullptr, &options.dotnetMirrors },
+        { L"--dotnet-sha256", &options.dotnetSha256, nullptr },
+    };
+
+    // The front end's defaults give way to the first value on the command line
+    std::vector<std::vector<std::wstring>*> replaced;
+
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::wstring& arg = args[i];
+        if (arg == L"--headless") {
+            continue;
+        }
+        if (arg == L"--no-cache") {
+            options.cacheDirectory.clear();
+            continue;
+        }
+        if (arg == L"--rollback") {
+            options.rollback = true;
+            continue;
+        }
+        if (arg == L"--verify") {
+            options.verify = true;
+            continue;
+        }
+
+        size_t equals = arg.find(L'=');
+        std::wstring name = arg.substr(0, equals);
+
+        const Option* match = nullptr;
+        for (const Option& option : known) {
+            if (name == option.name) {
+                match = &option;
+                break;
+            }
+        }
+        if (!match) {
+            error = L"Opzione sconosciuta: " + arg;
+            return false;
+        }
+
+        std::wstring value;
+        if (equals != std::wstring::npos) {
+            value = arg.substr(equals + 1);
+        } else if (i + 1 < args.size()) {
+            value = args[++i];
+        } else {
+            error = L"Valore mancante per " + name;
+            return false;
+        }
+
+        if (match->value) {
+            *match->value = value;
+            continue;
+        }
+        if (std::find(replaced.begin(), replaced.end(), match->list) == replaced.end()) {
+            match->list->clear();
+            replaced.push_back(match->list);
+        }
+        match->list->push_back(value);
+    }
+
+    if (!extractThreads.empty()) {
+        wchar_t* end = nullptr;
+        unsigned long count = wcstoul(extractThreads.c_str(), &end, 10);
+        if (*end != L'\0' || !iswdigit(extractThreads[0]) || count > 256) {
+            error = L"Numero di thread non valido: " + extractThreads;
+            return false;
+        }
+        options.extractThreads = (unsigned)count;
+    }
+
+    if (options.verify && (options.installPath.empty() || options.appManifestUrl.empty())) {
+        error = L"La verifica richiede il percorso di installazione e il manifest";
+        return false;
+    }
+    // A rollback, a verification or a patch only needs to know where the installation is
+    if (options.installPath.empty() ||
+        (!options.rollback && !options.verify && options.patchesPath.empty() &&
+            (options.downloadDirectory.empty() || options.appUrl.empty()))) {
+        error = L"Percorso di installazione, cartella di download e URL dell'applicazione sono obbligatori";
+        return false;
+    }
+    return true;
+}
+
+int HeadlessInstall::Run(InstallPipeline& pipeline, const HeadlessOptions& options, FILE* output)
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point start = Clock::now();
+
+    if (!options.tracePath.empty()) {
+        Trace::Enable();
+    }
+
+    // Phases report from their own threads: one line at a time, flushed so a
+    // supervising process sees every event as it happens
+    std::mutex outputMutex;
+    auto emit = [&](const std::string& line) {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        fputs(line.c_str(), output);
+        fputc('\n', output);
+        fflush(output);
+    };
+
+    emit("{\"event\":\"start\",\"version\":" + JsonString(AppInfo::VERSION)
+        + ",\"installPath\":" + JsonString(options.installPath) + "}");
+
+    if (options.rollback) {
+        bool restored = StagedInstall::Rollback(options.installPath);
+        InstallError error = restored ? InstallError::None : InstallError::AppSwitch;
+        emit(std::string("{\"event\":\"result\",\"success\":") + (restored ? "true" : "false")
+            + ",\"exitCode\":" + std::to_string((int)error)
+            + ",\"error\":\"" + ErrorName(error) + "\""
+            + ",\"message\":" + JsonString(restored ? L"" : L"Nessuna versione precedente da ripristinare")
+            + ",\"seconds\":0.000}");
+        return (int)error;
+    }
+
+    if (options.verify) {
+        ReleaseManifest manifest;
+        VerifyReport report;
+        bool loaded = FileSystem::FileExists(options.appManifestUrl)
+            ? manifest.Load(options.appManifestUrl)
+            : manifest.Download(options.appManifestUrl, options.appManifestSha256, nullptr);
+        bool passed = false;
+        if (loaded) {
+            InstallVerifier::Verify(manifest, options.installPath, report);
+            emit(VerifyEvent(report));
+            passed = report.Passed();
+        }
+        InstallError error = passed ? InstallError::None : loaded ? InstallError::AppVerify : InstallError::AppDownload;
+        char duration[32];
+        snprintf(duration, sizeof(duration), "%.3f", std::chrono::duration<double>(Clock::now() - start).count());
+        emit(std::string("{\"event\":\"result\",\"success\":") + (passed ? "true" : "false")
+            + ",\"exitCode\":" + std::to_string((int)error)
+            + ",\"error\":\"" + ErrorName(error) + "\""
+            + ",\"message\":" + JsonString(passed ? L""
+                : loaded ? L"Alcuni file installati non corrispondono al manifest"
+                : L"Impossibile leggere il manifest della versione")
+            + ",\"seconds\":" + duration + "}");
+        return (int)error;
+    }
+
+    int lastProgress = -1;
+    auto onProgress = [&](int progress, const std::wstring& status) {
+        // Progress is monotonic; one line per percent is plenty
+        {
+            std::lock_guard<std::mutex> lock(outputMutex);
+            if (progress == lastProgress) {
+                return;
+            }
+            lastProgress = progress;
+        }
+        emit("{\"event\":\"progress\",\"progress\":" + std::to_string(progress)
+            + ",\"status\":" + JsonString(status) + "}");
+    };
+
+    bool success = false;
+    if (!options.patchesPath.empty()) {
+        size_t applied = 0;
+        success = pipeline.ApplyPatches(options.patchesPath, onProgress, &applied);
+        emit("{\"event\":\"patch\",\"files\":" + std::to_string(applied) + "}");
+    } else {
+        success = pipeline.Run(onProgress,
+            [&](const std::wstring& phase, InstallPipeline::PhaseEvent event, double seconds) {
+                std::string line = "{\"event\":\"phase\",\"phase\":" + JsonString(phase)
+                    + ",\"state\":\"" + PhaseEventName(event) + "\"";
+                if (event == InstallPipeline::PhaseEvent::Succeeded || event == InstallPipeline::PhaseEvent::Failed) {
+                    char duration[32];
+                    snprintf(duration, sizeof(duration), "%.3f", seconds);
+                    line += ",\"seconds\":";
+                    line += duration;
+                }
+                emit(line + "}");
+            });
+    }
+
+    // The verification's figures, and on a failure the files that differ
+    if (pipeline.Verification().files > 0) {
+        emit(VerifyEvent(pipeline.Verification()));
+    }
+    for (const std::wstring& warning : pipeline.Warnings()) {
+        emit("{\"event\":\"warning\",\"message\":" + JsonString(warning) + "}");
+    }
+
+    InstallError error = success ? InstallError::None : pipeline.Error();
+    char duration[32];
+    snprintf(duration, sizeof(duration), "%.3f", std::chrono::duration<double>(Clock::now() - start).count());
+
+    emit(std::string("{\"event\":\"result\",\"success\":") + (success ? "true" : "false")
+        + ",\"exitCode\":" + std::to_string((int)error)
+        + ",\"error\":\"" + ErrorName(error) + "\""
+        + ",\"message\":" + JsonString(pipeline.ErrorMessage())
+        + ",\"seconds\":" + duration + "}");
+
+    // A trace that can't be written doesn't change the installation's outcome
+    if (!options.tracePath.empty() && !Trace::WriteChromeTrace(options.tracePath)) {
+        fprintf(stderr, "Impossibile scrivere la traccia: %s\n", FileSystem::ToUtf8(options.tracePath).c_str());
+    }
+
+    return (int)error;
+}
+
+const char* HeadlessInstall::ErrorName(InstallError error)
+{
+    switch (error) {
+    case InstallError::None:
+        return "none";
+    case InstallError::Cancelled:
+        return "cancelled";
+    case InstallError::DotNetDownload:
+        return "dotnet-download";
+    case InstallError::DotNetCorrupted:
+        return "dotnet-corrupted";
+    case InstallError::DotNetInstall:
+        return "dotnet-install";
+    case InstallError::DotNetPath:
+        return "dotnet-path";
+    case InstallError::DotNetUntrusted:
+        return "dotnet-untrusted";
+    case InstallError::AppDownload:
+        return "app-download";
+    case InstallError::AppCorrupted:
+        return "app-corrupted";
+    case InstallError::AppSwitch:
+        return "app-switch";
+    case InstallError::AppVerify:
+        return "app-verify";
+    case InstallError::AppPatch:
+        return "app-patch";
+    case InstallError::InsufficientSpace:
+        return "insufficient-space";
+    default:
+        return "failed";
+    }
+}
+
+std::string HeadlessInstall::JsonString(const std::wstring& text)
+{
+    std::string utf8 = FileSystem::ToUtf8(text);
+    std::string quoted = "\"";
+    for (unsigned char c : utf8) {
+        switch (c) {
+        case '"':
+            quoted += "\\\"";
+            break;
+        case '\\':
+            quoted += "\\\\";
+            break;
+        case '\n':
+            quoted += "\\n";
+            break;
+        case '\r':
+            quoted += "\\r";
+            break;
+        case '\t':
+            quoted += "\\t";
+            break;
+        default:
+            if (c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                quoted += escaped;
+            } else {
+                quoted += (char)c;
+            }
+        }
+    }
+    return quoted + "\"";
+}
+
+} // namespace InstAnalyticsInstaller
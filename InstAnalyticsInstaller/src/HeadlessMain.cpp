@@ -0,0 +1,159 @@
+// Unattended installer for non-Windows builds. The pipeline is the one the
+// Windows installer runs; the operating system side is replaced by local
+// stand-ins: the SDK is a zip unpacked into a dotnet root and there are no
+// shortcuts. Used to exercise and time the installation in CI.
+
+#include "HeadlessInstall.h"
+#include "Constants.h"
+#include "DownloadCache.h"
+#include "FileSystem.h"
+#include "SdkLocator.h"
+#include "ZipExtractor.h"
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <pthread.h>
+#include <thread>
+
+using namespace InstAnalyticsInstaller;
+
+namespace {
+
+const unsigned REQUIRED_SDK_MAJOR = 10;
+
+class LocalInstallEnvironment : public InstallEnvironment {
+public:
+    explicit LocalInstallEnvironment(const HeadlessOptions& options)
+        : options_(options)
+    {
+    }
+
+    bool IsDotNetInstalled() override
+    {
+        return SdkLocator::FindSdk(Roots(), REQUIRED_SDK_MAJOR);
+    }
+
+    std::wstring DotNetDownloadUrl() override { return options_.dotnetUrl; }
+    std::vector<std::wstring> DotNetMirrors() override { return options_.dotnetMirrors; }
+    std::wstring DotNetDownloadSha256() override { return options_.dotnetSha256; }
+    // The stand-in SDK is a zip that is only unpacked, never run
+    bool IsTrustedDotNetInstaller(const std::wstring&) override { return true; }
+
+    bool InstallDotNet(const std::wstring& installerPath, const ProgressCallback& callback,
+        const std::shared_ptr<CancellationToken>& cancel, unsigned long& exitCode) override
+    {
+        exitCode = 1;
+        if (options_.dotnetRoot.empty()) {
+            return false;
+        }
+
+        ExtractionOptions extraction;
+        extraction.cancel = cancel.get();
+        bool extracted = ZipExtractor::Extract(installerPath, options_.dotnetRoot,
+            [&callback](int progress, const std::wstring& file) {
+                if (callback) {
+                    callback(progress * 90 / 100, L"Installazione .NET 10 - " + file);
+                }
+            }, extraction);
+        if (!extracted) {
+            return false;
+        }
+
+        exitCode = 0;
+        return true;
+    }
+
+    bool ConfigureDotNetPath() override
+    {
+        // Nothing to register: the SDK only has to be where dotnet looks for it
+        return IsDotNetInstalled();
+    }
+
+    bool CreateShortcuts(const std::wstring&) override { return true; }
+
+private:
+    std::vector<std::wstring> Roots() const
+    {
+        std::vector<std::wstring> roots;
+        if (!options_.dotnetRoot.empty()) {
+            roots.push_back(options_.dotnetRoot);
+        }
+        roots.push_back(L"/usr/share/dotnet");
+        roots.push_back(L"/usr/lib/dotnet");
+        return roots;
+    }
+
+    const HeadlessOptions& options_;
+};
+
+std::wstring EnvironmentPath(const char* name, const wchar_t* suffix)
+{
+    const char* value = getenv(name);
+    if (!value || !*value) {
+        return L"";
+    }
+    return FileSystem::JoinPath(FileSystem::FromUtf8(value), suffix);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::wstring> args;
+    for (int i = 1; i < argc; ++i) {
+        args.push_back(FileSystem::FromUtf8(argv[i]));
+    }
+
+    HeadlessOptions options;
+    options.installPath = EnvironmentPath("HOME", L".local/share/InstAnalytics");
+    options.downloadDirectory = L"/tmp/InstAnalyticsInstaller";
+    options.cacheDirectory = EnvironmentPath("HOME", L".cache/InstAnalyticsInstaller");
+    options.appUrl = URLs::INSTANALYTICS_ZIP;
+    options.appMirrors = Mirrors::INSTANALYTICS_ZIP;
+    options.appSha256 = Digests::INSTANALYTICS_ZIP;
+    options.appManifestUrl = URLs::INSTANALYTICS_MANIFEST;
+    options.appManifestSha256 = Digests::INSTANALYTICS_MANIFEST;
+    options.appPatchesUrl = URLs::INSTANALYTICS_PATCHES;
+    options.dotnetRoot = EnvironmentPath("DOTNET_ROOT", L"");
+
+    std::wstring error;
+    if (!HeadlessInstall::ParseArguments(args, options, error)) {
+        fprintf(stderr, "%s\n", FileSystem::ToUtf8(error).c_str());
+        return HeadlessInstall::EXIT_BAD_ARGUMENTS;
+    }
+
+    InstallSettings settings;
+    settings.installPath = options.installPath;
+    settings.downloadDirectory = options.downloadDirectory;
+    settings.appUrl = options.appUrl;
+    settings.appMirrors = options.appMirrors;
+    settings.appSha256 = options.appSha256;
+    settings.appManifestUrl = options.appManifestUrl;
+    settings.appManifestSha256 = options.appManifestSha256;
+    settings.appPatchesUrl = options.appPatchesUrl;
+    settings.extractThreads = options.extractThreads;
+    if (!options.cacheDirectory.empty()) {
+        settings.cache = std::make_shared<DownloadCache>(options.cacheDirectory);
+    }
+
+    LocalInstallEnvironment environment(options);
+    InstallPipeline pipeline(environment, settings);
+
+    // SIGINT/SIGTERM cancel the installation: blocked here, before any
+    // worker thread inherits the mask, and taken by a thread of their own
+    // so the cancellation does not run inside a signal handler
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::thread([&pipeline, signals] {
+        int signal = 0;
+        if (sigwait(&signals, &signal) == 0) {
+            pipeline.Cancel();
+        }
+    }).detach();
+
+    return HeadlessInstall::Run(pipeline, options, stdout);
+}
@@ -0,0 +1,228 @@
+#include "HttpRangeInput.h"
+#include "Trace.h"
+#include <algorithm>
+#include <thread>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+constexpr size_t BUFFER_SIZE = 256 * 1024;
+
+} // namespace
+
+HttpRangeInput::HttpRangeInput(std::shared_ptr<HttpTransport> transport, const CancellationToken* cancel)
+    : transport_(transport ? transport : HttpTransport::Shared())
+    , cancel_(cancel)
+    , size_(0)
+    , spoolEnd_(0)
+    , bytesFetched_(0)
+    , requests_(0)
+{
+}
+
+HttpRangeInput::~HttpRangeInput()
+{
+    spool_.Close();
+    if (!spoolPath_.empty()) {
+        FileSystem::RemoveFile(spoolPath_);
+    }
+}
+
+bool HttpRangeInput::Open(const std::wstring& url, const std::wstring& spoolPath)
+{
+    HttpRequest request;
+    request.url = url;
+    request.useRange = true;
+    request.rangeStart = 0;
+    request.rangeLength = 1;
+    request.cancel = cancel_;
+
+    ++requests_;
+    auto stream = transport_->Open(request);
+    if (!stream || stream->Response().statusCode != 206 || stream->Response().totalLength == 0) {
+        return false;
+    }
+    resource_ = stream->Response();
+    size_ = resource_.totalLength;
+
+    // Consumed, so the connection goes back to the pool
+    uint8_t first;
+    size_t bytesRead = 0;
+    stream->Read(&first, 1, bytesRead);
+
+    url_ = url;
+    spoolPath_ = spoolPath;
+    FileSystem::RemoveFile(spoolPath);
+    return spool_.Open(spoolPath, File::Mode::ReadWrite);
+}
+
+bool HttpRangeInput::SameVersion(const HttpResponse& response) const
+{
+    return response.totalLength == size_ &&
+           (resource_.etag.empty() || response.etag == resource_.etag) &&
+           (resource_.lastModified.empty() || response.lastModified == resource_.lastModified);
+}
+
+bool HttpRangeInput::ReadAt(uint64_t offset, void* buffer, size_t size, size_t& bytesRead)
+{
+    bytesRead = 0;
+    if (offset >= size_ || size == 0) {
+        return true;
+    }
+
+    for (;;) {
+        uint64_t fetchEnd;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto next = spans_.upper_bound(offset);
+            if (next != spans_.begin()) {
+                auto span = std::prev(next);
+                if (offset < span->second.end) {
+                    size_t available = (size_t)std::min<uint64_t>(size, span->second.end - offset);
+                    uint64_t at = span->second.spoolOffset + (offset - span->first);
+                    return spool_.ReadAt(at, buffer, available, bytesRead);
+                }
+            }
+
+            // Up to the next span, so nothing is fetched twice
+            uint64_t limit = next == spans_.end() ? size_ : next->first;
+            fetchEnd = std::min(limit, offset + std::max<uint64_t>(size, MIN_FETCH_SIZE));
+        }
+
+        if (!Fetch(offset, fetchEnd)) {
+            return false;
+        }
+    }
+}
+
+bool HttpRangeInput::Fetch(uint64_t start, uint64_t end, const std::function<void(uint64_t)>& onBytes)
+{
+    TraceSpan span("range.fetch", "download");
+    uint64_t length = end - start;
+    uint64_t spoolOffset;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        spoolOffset = spoolEnd_;
+        spoolEnd_ += length;
+    }
+
+    // A dropped connection resumes after the last byte spooled
+    std::vector<uint8_t> buffer((size_t)std::min<uint64_t>(length, BUFFER_SIZE));
+    uint64_t done = 0;
+    for (unsigned attempt = 0; attempt <= FETCH_RETRIES && done < length; ++attempt) {
+        if (cancel_ && cancel_->IsCancelled()) {
+            return false;
+        }
+
+        HttpRequest request;
+        request.url = url_;
+        request.useRange = true;
+        request.rangeStart = start + done;
+        request.rangeLength = length - done;
+        request.cancel = cancel_;
+
+        ++requests_;
+        auto stream = transport_->Open(request);
+        if (!stream) {
+            continue;
+        }
+        if (stream->Response().statusCode != 206 || stream->Response().rangeStart != request.rangeStart ||
+            !SameVersion(stream->Response())) {
+            return false;   // No ranges after all, or the release changed under us
+        }
+
+        while (done < length) {
+            size_t bytesRead = 0;
+            size_t chunk = (size_t)std::min<uint64_t>(buffer.size(), length - done);
+            if (!stream->Read(buffer.data(), chunk, bytesRead) || bytesRead == 0) {
+                break;
+            }
+            if (!spool_.WriteAt(spoolOffset + done, buffer.data(), bytesRead)) {
+                return false;
+            }
+            done += bytesRead;
+            bytesFetched_ += bytesRead;
+            if (onBytes) {
+                onBytes(bytesRead);
+            }
+        }
+    }
+    if (done < length) {
+        return false;
+    }
+
+    span.SetBytes(length);
+    std::lock_guard<std::mutex> lock(mutex_);
+    spans_.emplace(start, Span{ end, spoolOffset });
+    return true;
+}
+
+bool HttpRangeInput::Prefetch(std::vector<ByteRange> ranges, unsigned connections, FetchCallback callback)
+{
+    TraceSpan span("range.prefetch", "download");
+
+    std::sort(ranges.begin(), ranges.end(), [](const ByteRange& a, const ByteRange& b) { return a.start < b.start; });
+
+    // A few bytes in between cost less than another request
+    std::vector<ByteRange> merged;
+    for (ByteRange range : ranges) {
+        range.end = std::min(range.end, size_);
+        if (range.start >= range.end) {
+            continue;
+        }
+        if (!merged.empty() && range.start <= merged.back().end + MERGE_GAP) {
+            merged.back().end = std::max(merged.back().end, range.end);
+        } else {
+            merged.push_back(range);
+        }
+    }
+
+    // Chunks small enough that every connection gets a share
+    uint64_t total = 0;
+    for (const ByteRange& range : merged) {
+        total += range.end - range.start;
+    }
+    connections = std::max(connections, 1u);
+    uint64_t chunkSize = std::max(MIN_CHUNK, std::min(PREFETCH_CHUNK, (total + connections - 1) / connections));
+
+    std::vector<ByteRange> chunks;
+    for (const ByteRange& range : merged) {
+        for (uint64_t start = range.start; start < range.end; start += chunkSize) {
+            chunks.push_back({ start, std::min(range.end, start + chunkSize) });
+        }
+    }
+    span.SetBytes(total);
+    span.SetArg("requests", (int64_t)chunks.size());
+
+    std::atomic<size_t> next(0);
+    std::atomic<uint64_t> fetched(0);
+    std::atomic<bool> failed(false);
+    auto worker = [&] {
+        size_t index;
+        while (!failed && (index = next++) < chunks.size()) {
+            bool ok = Fetch(chunks[index].start, chunks[index].end, [&](uint64_t bytes) {
+                uint64_t now = fetched += bytes;
+                if (callback) {
+                    callback(now, total);
+                }
+            });
+            if (!ok) {
+                failed = true;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    size_t threadCount = std::min<size_t>(connections, chunks.size());
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return !failed;
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,48 @@
+#include "HttpTransport.h"
+
+#ifdef _WIN32
+#include "WinInetTransport.h"
+#else
+#include "SocketHttpTransport.h"
+#endif
+
+namespace InstAnalyticsInstaller {
+
+std::shared_ptr<HttpTransport> HttpTransport::CreateDefault()
+{
+#ifdef _WIN32
+    return std::make_shared<WinInetTransport>();
+#else
+    return std::make_shared<SocketHttpTransport>();
+#endif
+}
+
+std::shared_ptr<HttpTransport> HttpTransport::Shared()
+{
+    static std::shared_ptr<HttpTransport> shared = CreateDefault();
+    return shared;
+}
+
+std::wstring RedirectCache::Resolve(const std::wstring& url) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto target = targets_.find(url);
+    return target != targets_.end() ? target->second : url;
+}
+
+void RedirectCache::Remember(const std::wstring& url, const std::wstring& target)
+{
+    if (url == target) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    targets_[url] = target;
+}
+
+void RedirectCache::Forget(const std::wstring& url)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    targets_.erase(url);
+}
+
+} // namespace InstAnalyticsInstaller
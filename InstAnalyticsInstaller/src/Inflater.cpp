@@ -0,0 +1,463 @@
+#include "Inflater.h"
+#include <cstring>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+const uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+const uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+const uint16_t DISTANCE_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+
+const uint8_t DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+const uint8_t CODE_LENGTH_ORDER[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+} // namespace
+
+Inflater::Inflater()
+    : input_(nullptr)
+    , output_(nullptr)
+    , bitBuffer_(0)
+    , bitCount_(0)
+    , window_(WINDOW_SIZE + OUTPUT_CHUNK + MAX_MATCH)
+    , pos_(0)
+    , flushed_(0)
+    , totalOut_(0)
+{
+}
+
+bool Inflater::BuildTable(HuffmanTable& table, const uint8_t* lengths, int symbolCount)
+{
+    memset(table.count, 0, sizeof(table.count));
+    memset(table.fast, 0, sizeof(table.fast));
+
+    for (int i = 0; i < symbolCount; ++i) {
+        table.count[lengths[i]]++;
+    }
+    table.count[0] = 0;
+
+    // Reject over-subscribed codes; incomplete ones fail at decode time
+    int left = 1;
+    for (int len = 1; len < 16; ++len) {
+        left <<= 1;
+        left -= table.count[len];
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    uint16_t offsets[16];
+    offsets[1] = 0;
+    for (int len = 1; len < 15; ++len) {
+        offsets[len + 1] = offsets[len] + table.count[len];
+    }
+
+    for (int i = 0; i < symbolCount; ++i) {
+        if (lengths[i] != 0) {
+            table.symbol[offsets[lengths[i]]++] = (uint16_t)i;
+        }
+    }
+
+    // Canonical codes are assigned in (length, symbol) order; the stream
+    // sends them MSB first, so the lookup index is the bit-reversed code.
+    uint32_t code = 0;
+    int index = 0;
+    for (int len = 1; len <= (int)FAST_BITS; ++len) {
+        for (int n = 0; n < table.count[len]; ++n, ++index, ++code) {
+            uint32_t reversed = 0;
+            for (int bit = 0; bit < len; ++bit) {
+                reversed |= ((code >> bit) & 1) << (len - 1 - bit);
+            }
+
+            uint16_t entry = (uint16_t)((table.symbol[index] << 4) | len);
+            for (uint32_t fill = reversed; fill < (1u << FAST_BITS); fill += 1u << len) {
+                table.fast[fill] = entry;
+            }
+        }
+        code <<= 1;
+    }
+
+    return true;
+}
+
+const Inflater::HuffmanTable& Inflater::FixedLiteralTable()
+{
+    static const HuffmanTable table = [] {
+        HuffmanTable fixed;
+        uint8_t lengths[288];
+        int i = 0;
+        for (; i < 144; ++i) lengths[i] = 8;
+        for (; i < 256; ++i) lengths[i] = 9;
+        for (; i < 280; ++i) lengths[i] = 7;
+        for (; i < 288; ++i) lengths[i] = 8;
+        BuildTable(fixed, lengths, 288);
+        return fixed;
+    }();
+    return table;
+}
+
+const Inflater::HuffmanTable& Inflater::FixedDistanceTable()
+{
+    static const HuffmanTable table = [] {
+        HuffmanTable fixed;
+        uint8_t lengths[30];
+        memset(lengths, 5, sizeof(lengths));
+        BuildTable(fixed, lengths, 30);
+        return fixed;
+    }();
+    return table;
+}
+
+void Inflater::Refill()
+{
+    // Fast path: branch-free 8-byte load. Bits above bitCount_ may hold
+    // uncounted stream bits; they are reloaded with the same values later.
+    if (input_->Available() >= 8) {
+        uint64_t value;
+        memcpy(&value, input_->Data(), 8);
+        bitBuffer_ |= value << bitCount_;
+        size_t bytes = (63 - bitCount_) >> 3;
+        input_->Consume(bytes);
+        bitCount_ += (unsigned)bytes * 8;
+        return;
+    }
+
+    while (bitCount_ <= 56) {
+        uint8_t value;
+        if (!input_->ReadByte(value)) {
+            break;
+        }
+        bitBuffer_ |= (uint64_t)value << bitCount_;
+        bitCount_ += 8;
+    }
+}
+
+bool Inflater::NeedBits(unsigned count)
+{
+    if (bitCount_ < count) {
+        Refill();
+    }
+    return bitCount_ >= count;
+}
+
+uint32_t Inflater::TakeBits(unsigned count)
+{
+    uint32_t value = (uint32_t)(bitBuffer_ & ((1ull << count) - 1));
+    bitBuffer_ >>= count;
+    bitCount_ -= count;
+    return value;
+}
+
+bool Inflater::DecodeSymbol(const HuffmanTable& table, int& symbol)
+{
+    if (bitCount_ < 15) {
+        Refill();
+    }
+
+    uint16_t entry = table.fast[bitBuffer_ & ((1u << FAST_BITS) - 1)];
+    if (entry != 0) {
+        unsigned len = entry & 15;
+        if (len > bitCount_) {
+            return false;
+        }
+        bitBuffer_ >>= len;
+        bitCount_ -= len;
+        symbol = entry >> 4;
+        return true;
+    }
+
+    // Slow path for codes longer than FAST_BITS
+    uint64_t bits = bitBuffer_;
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (unsigned len = 1; len < 16; ++len) {
+        code |= (int)(bits & 1);
+        bits >>= 1;
+        int count = table.count[len];
+        if (code - count < first) {
+            if (len > bitCount_) {
+                return false;
+            }
+            bitBuffer_ >>= len;
+            bitCount_ -= len;
+            symbol = table.symbol[index + (code - first)];
+            return true;
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+
+    return false;
+}
+
+bool Inflater::FlushOutput()
+{
+    if (pos_ > flushed_) {
+        if (!output_->Write(window_.data() + flushed_, pos_ - flushed_)) {
+            return false;
+        }
+        totalOut_ += pos_ - flushed_;
+    }
+
+    // Keep the last 32 KB as match history
+    if (pos_ > WINDOW_SIZE) {
+        memmove(window_.data(), window_.data() + pos_ - WINDOW_SIZE, WINDOW_SIZE);
+        pos_ = WINDOW_SIZE;
+    }
+    flushed_ = pos_;
+    return true;
+}
+
+bool Inflater::Inflate(ByteReader& input, OutputStream& output)
+{
+    input_ = &input;
+    output_ = &output;
+    bitBuffer_ = 0;
+    bitCount_ = 0;
+    pos_ = 0;
+    flushed_ = 0;
+    totalOut_ = 0;
+
+    bool last = false;
+    while (!last) {
+        if (!NeedBits(3)) {
+            return false;
+        }
+        last = TakeBits(1) != 0;
+        uint32_t type = TakeBits(2);
+
+        bool ok;
+        switch (type) {
+        case 0:
+            ok = InflateStored();
+            break;
+        case 1:
+            ok = InflateCodes(FixedLiteralTable(), FixedDistanceTable());
+            break;
+        case 2:
+            ok = InflateDynamic();
+            break;
+        default:
+            ok = false;
+            break;
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    if (!FlushOutput()) {
+        return false;
+    }
+
+    // Hand back whole bytes that were read ahead of the end of the stream
+    TakeBits(bitCount_ & 7);
+    input.Unget(bitCount_ / 8);
+    bitBuffer_ = 0;
+    bitCount_ = 0;
+
+    return !input.Failed();
+}
+
+bool Inflater::InflateStored()
+{
+    TakeBits(bitCount_ & 7);
+
+    if (!NeedBits(32)) {
+        return false;
+    }
+    uint32_t length = TakeBits(16);
+    uint32_t complement = TakeBits(16);
+    if (length != (~complement & 0xFFFF)) {
+        return false;
+    }
+
+    // Drain bytes still held in the bit buffer, then copy straight from input
+    while (length > 0 && bitCount_ >= 8) {
+        window_[pos_++] = (uint8_t)TakeBits(8);
+        --length;
+    }
+    if (bitCount_ == 0) {
+        bitBuffer_ = 0;
+    }
+
+    while (length > 0) {
+        size_t room = WINDOW_SIZE + OUTPUT_CHUNK - pos_;
+        if (room == 0) {
+            if (!FlushOutput()) {
+                return false;
+            }
+            continue;
+        }
+
+        size_t chunk = length < room ? length : room;
+        if (!input_->ReadExact(window_.data() + pos_, chunk)) {
+            return false;
+        }
+        pos_ += chunk;
+        length -= (uint32_t)chunk;
+    }
+
+    return pos_ < WINDOW_SIZE + OUTPUT_CHUNK || FlushOutput();
+}
+
+bool Inflater::InflateDynamic()
+{
+    if (!NeedBits(14)) {
+        return false;
+    }
+    int literalCount = (int)TakeBits(5) + 257;
+    int distanceCount = (int)TakeBits(5) + 1;
+    int codeLengthCount = (int)TakeBits(4) + 4;
+
+    if (literalCount > 286 || distanceCount > 30) {
+        return false;
+    }
+
+    uint8_t codeLengths[19] = {};
+    for (int i = 0; i < codeLengthCount; ++i) {
+        if (!NeedBits(3)) {
+            return false;
+        }
+        codeLengths[CODE_LENGTH_ORDER[i]] = (uint8_t)TakeBits(3);
+    }
+
+    HuffmanTable codeLengthTable;
+    if (!BuildTable(codeLengthTable, codeLengths, 19)) {
+        return false;
+    }
+
+    uint8_t lengths[286 + 30];
+    int total = literalCount + distanceCount;
+    int index = 0;
+    while (index < total) {
+        int symbol;
+        if (!DecodeSymbol(codeLengthTable, symbol)) {
+            return false;
+        }
+
+        if (symbol < 16) {
+            lengths[index++] = (uint8_t)symbol;
+            continue;
+        }
+
+        uint8_t value = 0;
+        int repeat;
+        if (symbol == 16) {
+            if (index == 0 || !NeedBits(2)) {
+                return false;
+            }
+            value = lengths[index - 1];
+            repeat = 3 + (int)TakeBits(2);
+        } else if (symbol == 17) {
+            if (!NeedBits(3)) {
+                return false;
+            }
+            repeat = 3 + (int)TakeBits(3);
+        } else {
+            if (!NeedBits(7)) {
+                return false;
+            }
+            repeat = 11 + (int)TakeBits(7);
+        }
+
+        if (index + repeat > total) {
+            return false;
+        }
+        memset(lengths + index, value, repeat);
+        index += repeat;
+    }
+
+    // The end-of-block code must be present
+    if (lengths[256] == 0) {
+        return false;
+    }
+
+    if (!BuildTable(literals_, lengths, literalCount) ||
+        !BuildTable(distances_, lengths + literalCount, distanceCount)) {
+        return false;
+    }
+
+    return InflateCodes(literals_, distances_);
+}
+
+bool Inflater::InflateCodes(const HuffmanTable& literals, const HuffmanTable& distances)
+{
+    uint8_t* window = window_.data();
+    const size_t flushAt = WINDOW_SIZE + OUTPUT_CHUNK;
+
+    for (;;) {
+        int symbol;
+        if (!DecodeSymbol(literals, symbol)) {
+            return false;
+        }
+
+        if (symbol < 256) {
+            window[pos_++] = (uint8_t)symbol;
+        } else if (symbol == 256) {
+            return true;
+        } else {
+            symbol -= 257;
+            if (symbol >= 29) {
+                return false;
+            }
+
+            if (!NeedBits(LENGTH_EXTRA[symbol])) {
+                return false;
+            }
+            size_t length = LENGTH_BASE[symbol] + TakeBits(LENGTH_EXTRA[symbol]);
+
+            int distanceSymbol;
+            if (!DecodeSymbol(distances, distanceSymbol) || distanceSymbol >= 30) {
+                return false;
+            }
+            if (!NeedBits(DISTANCE_EXTRA[distanceSymbol])) {
+                return false;
+            }
+            size_t distance = DISTANCE_BASE[distanceSymbol] + TakeBits(DISTANCE_EXTRA[distanceSymbol]);
+
+            if (distance > pos_) {
+                return false;
+            }
+
+            uint8_t* to = window + pos_;
+            const uint8_t* from = to - distance;
+            if (distance >= length) {
+                memcpy(to, from, length);
+            } else {
+                for (size_t i = 0; i < length; ++i) {
+                    to[i] = from[i];
+                }
+            }
+            pos_ += length;
+        }
+
+        if (pos_ >= flushAt && !FlushOutput()) {
+            return false;
+        }
+    }
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,486 @@
+#include "InstallPipeline.h"
+#include "BinaryPatch.h"
+#include "DeltaUpdater.h"
+#include "FileSystem.h"
+#include "StagedInstall.h"
+#include "StreamPipe.h"
+#include "Trace.h"
+#include "ZipExtractor.h"
+#include <chrono>
+#include <cwchar>
+#include <thread>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+
+const wchar_t* const InstallPipeline::PHASE_CHECK = L"check";
+const wchar_t* const InstallPipeline::PHASE_SDK_DOWNLOAD = L"sdk-download";
+const wchar_t* const InstallPipeline::PHASE_SDK_INSTALL = L"sdk-install";
+const wchar_t* const InstallPipeline::PHASE_APP = L"app";
+const wchar_t* const InstallPipeline::PHASE_VERIFY = L"verify";
+const wchar_t* const InstallPipeline::PHASE_SHORTCUTS = L"shortcuts";
+
+InstallPipeline::InstallPipeline(InstallEnvironment& environment, const InstallSettings& settings)
+    : environment_(environment)
+    , settings_(settings)
+    , dotnetDownloader_(settings.transport)
+    , appDownloader_(settings.transport)
+    , dotnetInstalled_(false)
+    , appSwitched_(false)
+    , rolledBack_(false)
+    , cancel_(std::make_shared<CancellationToken>())
+    , error_(InstallError::None)
+    , dotnetExitCode_(0)
+    , graph_(nullptr)
+    , cancelRequested_(false)
+{
+    dotnetDownloader_.SetCache(settings.cache);
+    appDownloader_.SetCache(settings.cache);
+    dotnetDownloader_.SetCancellationToken(cancel_);
+    appDownloader_.SetCancellationToken(cancel_);
+}
+
+bool InstallPipeline::Run(ProgressCallback progress, PhaseCallback phases)
+{
+    using Clock = std::chrono::steady_clock;
+    TraceSpan span("install", "phase");
+
+    error_ = InstallError::None;
+    appSwitched_ = false;
+    rolledBack_ = false;
+    verifyReport_ = VerifyReport();
+    {
+        std::lock_guard<std::mutex> lock(warningsMutex_);
+        warnings_.clear();
+    }
+    FileSystem::CreateDirectories(settings_.downloadDirectory);
+
+    TaskGraph graph;
+    TaskGraph::TaskId check = graph.Add(PHASE_CHECK, 5,
+        [this](const TaskGraph::ReportCallback& report) { return CheckDotNet(report); });
+    TaskGraph::TaskId sdkDownload = graph.Add(PHASE_SDK_DOWNLOAD, 30,
+        [this](const TaskGraph::ReportCallback& report) { return DownloadDotNet(report); }, { check });
+    TaskGraph::TaskId sdkInstall = graph.Add(PHASE_SDK_INSTALL, 20,
+        [this](const TaskGraph::ReportCallback& report) { return InstallDotNet(report); }, { sdkDownload });
+    TaskGraph::TaskId app = graph.Add(PHASE_APP, 35,
+        [this](const TaskGraph::ReportCallback& report) { return DeployApp(report); });
+    TaskGraph::TaskId verify = graph.Add(PHASE_VERIFY, 3,
+        [this](const TaskGraph::ReportCallback& report) { return VerifyApp(report); }, { app });
+    graph.Add(PHASE_SHORTCUTS, 2, [this](const TaskGraph::ReportCallback& report) {
+        TraceSpan span("phase.shortcuts", "phase");
+        report(0, L"Creazione collegamenti...");
+        // The application is installed either way: missing shortcuts don't fail it
+        if (!environment_.CreateShortcuts(settings_.installPath)) {
+            span.SetArg("failed", 1);
+            Warn(L"Impossibile creare i collegamenti a InstAnalytics");
+        }
+        return true;
+    }, { sdkInstall, verify });
+
+    // A cancel or a failure stops every running phase through the shared token
+    auto stop = [this] { cancel_->Cancel(); };
+    graph.SetCancelHandler(sdkDownload, stop);
+    graph.SetCancelHandler(sdkInstall, stop);
+    graph.SetCancelHandler(app, stop);
+    graph.SetCancelHandler(verify, stop);
+
+    // Each phase is reported by its own thread, which also owns its start time
+    std::vector<Clock::time_point> started(6);
+    graph.SetStateCallback([&](TaskGraph::TaskId id, TaskGraph::TaskState state) {
+        if (!phases) {
+            return;
+        }
+
+        // With .NET already present the SDK phases do nothing, nor does the
+        // verification without a manifest: report them as skipped
+        bool notNeeded = ((id == sdkDownload || id == sdkInstall) && dotnetInstalled_) ||
+                         (id == verify && settings_.appManifestUrl.empty());
+        double seconds = std::chrono::duration<double>(Clock::now() - started[id]).count();
+
+        switch (state) {
+        case TaskGraph::TaskState::Running:
+            started[id] = Clock::now();
+            if (!notNeeded) {
+                phases(graph.Name(id), PhaseEvent::Started, 0);
+            }
+            break;
+        case TaskGraph::TaskState::Succeeded:
+            phases(graph.Name(id), notNeeded ? PhaseEvent::Skipped : PhaseEvent::Succeeded, notNeeded ? 0 : seconds);
+            break;
+        case TaskGraph::TaskState::Failed:
+            phases(graph.Name(id), PhaseEvent::Failed, seconds);
+            break;
+        default:
+            phases(graph.Name(id), PhaseEvent::Skipped, 0);
+            break;
+        }
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(graphMutex_);
+        if (cancelRequested_) {
+            error_ = InstallError::Cancelled;
+            return false;
+        }
+        graph_ = &graph;
+    }
+
+    bool success = graph.Run(progress);
+
+    {
+        std::lock_guard<std::mutex> lock(graphMutex_);
+        graph_ = nullptr;
+    }
+
+    if (graph.Cancelled()) {
+        error_ = InstallError::Cancelled;
+    } else if (!success && error_ == InstallError::None) {
+        error_ = InstallError::Failed;
+    }
+
+    // The version the app phase replaced goes back, e.g. after the new one
+    // failed its verification. A first install has nothing to go back to
+    if ((!success || graph.Cancelled()) && appSwitched_) {
+        rolledBack_ = StagedInstall::Rollback(settings_.installPath);
+        span.SetArg("rolledBack", rolledBack_ ? 1 : 0);
+    }
+    return success && !graph.Cancelled();
+}
+
+void InstallPipeline::Cancel()
+{
+    // The token first: it reaches a phase even before its cancel handler is set up
+    cancel_->Cancel();
+
+    std::lock_guard<std::mutex> lock(graphMutex_);
+    cancelRequested_ = true;
+    if (graph_) {
+        graph_->Cancel();
+    }
+}
+
+bool InstallPipeline::ApplyPatches(const std::wstring& archivePath, ProgressCallback progress, size_t* applied)
+{
+    TraceSpan span("patch", "phase");
+
+    error_ = InstallError::None;
+    appSwitched_ = false;
+    rolledBack_ = false;
+    {
+        std::lock_guard<std::mutex> lock(warningsMutex_);
+        warnings_.clear();
+    }
+
+    if (progress) {
+        progress(0, L"Aggiornamento files in corso...");
+    }
+    size_t patched = 0;
+    bool success = BinaryPatch::ApplyArchive(archivePath, settings_.installPath,
+        [&progress](int percent, const std::wstring& file) {
+            if (progress && !file.empty()) {
+                progress(percent, L"Aggiornamento: " + file);
+            }
+        }, cancel_.get(), &patched);
+    if (applied) {
+        *applied = patched;
+    }
+
+    if (!success) {
+        Fail(cancel_->IsCancelled() ? InstallError::Cancelled : InstallError::AppPatch);
+        return false;
+    }
+    appSwitched_ = patched > 0;
+
+    if (progress) {
+        wchar_t status[256];
+        swprintf(status, 256, L"Aggiornati %zu files", patched);
+        progress(100, status);
+    }
+    return true;
+}
+
+void InstallPipeline::Fail(InstallError error)
+{
+    // The first failure is the cause; the phases it cancels fail after it
+    InstallError none = InstallError::None;
+    error_.compare_exchange_strong(none, error);
+}
+
+void InstallPipeline::Warn(const std::wstring& message)
+{
+    std::lock_guard<std::mutex> lock(warningsMutex_);
+    warnings_.push_back(message);
+}
+
+std::vector<std::wstring> InstallPipeline::Warnings() const
+{
+    std::lock_guard<std::mutex> lock(warningsMutex_);
+    return warnings_;
+}
+
+bool InstallPipeline::CheckDotNet(const TaskGraph::ReportCallback& report)
+{
+    TraceSpan span("phase.check", "phase");
+    report(0, L"Controllo presenza .NET 10...");
+
+    dotnetInstalled_ = environment_.IsDotNetInstalled();
+    if (dotnetInstalled_) {
+        report(100, L".NET 10 già installato");
+    }
+    return true;
+}
+
+bool InstallPipeline::DownloadDotNet(const TaskGraph::ReportCallback& report)
+{
+    if (dotnetInstalled_) {
+        return true;
+    }
+
+    TraceSpan span("phase.sdk-download", "phase");
+    report(0, L"Download .NET 10 in corso...");
+
+    std::vector<std::wstring> sources = { environment_.DotNetDownloadUrl() };
+    std::vector<std::wstring> mirrors = environment_.DotNetMirrors();
+    sources.insert(sources.end(), mirrors.begin(), mirrors.end());
+    dotnetInstallerPath_ = FileSystem::JoinPath(settings_.downloadDirectory, Downloader::FileNameFromUrl(sources[0]));
+
+    bool downloaded = dotnetDownloader_.DownloadFile(sources, dotnetInstallerPath_,
+        [&report](int progress, const std::wstring& status) {
+            report(progress, L".NET 10 - " + status);
+        },
+        environment_.DotNetDownloadSha256());
+
+    // A payload that fails its digest never reaches the elevated installer.
+    // Stopped by the token, the cause is whatever fired it
+    if (!downloaded && !cancel_->IsCancelled()) {
+        Fail(dotnetDownloader_.IntegrityFailed() ? InstallError::DotNetCorrupted
+            : dotnetDownloader_.InsufficientSpace() ? InstallError::InsufficientSpace
+            : InstallError::DotNetDownload);
+    }
+
+    // Without a pinned digest nothing above proved what was downloaded: the
+    // environment's own check has to, or the setup doesn't run
+    if (downloaded && environment_.DotNetDownloadSha256().empty()) {
+        span.SetArg("unpinned", 1);
+        Warn(L"Nessun SHA-256 configurato per il pacchetto .NET 10: verificata solo la firma");
+        if (!environment_.IsTrustedDotNetInstaller(dotnetInstallerPath_)) {
+            FileSystem::RemoveFile(dotnetInstallerPath_);
+            Fail(InstallError::DotNetUntrusted);
+            return false;
+        }
+    }
+    return downloaded;
+}
+
+bool InstallPipeline::InstallDotNet(const TaskGraph::ReportCallback& report)
+{
+    if (dotnetInstalled_) {
+        return true;
+    }
+
+    TraceSpan span("phase.sdk-install", "phase");
+    report(0, L"Installazione .NET 10...");
+
+    bool installed = environment_.InstallDotNet(dotnetInstallerPath_, report, cancel_, dotnetExitCode_);
+    FileSystem::RemoveFile(dotnetInstallerPath_);
+
+    if (!installed) {
+        if (!cancel_->IsCancelled()) {
+            Fail(InstallError::DotNetInstall);
+        }
+        return false;
+    }
+
+    report(90, L"Verifica installazione .NET 10...");
+    if (!environment_.ConfigureDotNetPath()) {
+        Fail(InstallError::DotNetPath);
+        return false;
+    }
+
+    report(100, L".NET 10 configurato correttamente");
+    return true;
+}
+
+bool InstallPipeline::DeployApp(const TaskGraph::ReportCallback& report)
+{
+    TraceSpan span("phase.app", "phase");
+
+    // An existing install first tries to fetch just the files that changed,
+    // which only a pinned manifest can vouch for
+    if (!settings_.appManifestUrl.empty() && settings_.appManifestSha256.empty() &&
+        FileSystem::DirectoryExists(settings_.installPath)) {
+        span.SetArg("unpinnedManifest", 1);
+        Warn(L"Nessun SHA-256 configurato per il manifest di InstAnalytics: aggiornamento con l'archivio completo");
+    }
+    DeltaUpdater delta(settings_.transport, cancel_);
+    delta.SetExtractThreads(settings_.extractThreads);
+    if (delta.Update(settings_.appManifestUrl, settings_.appManifestSha256, settings_.appPatchesUrl, settings_.appUrl,
+            settings_.installPath, settings_.downloadDirectory,
+            [&report](int progress, const std::wstring& status) {
+                report(progress, status.empty() ? status : L"InstAnalytics - " + status);
+            })) {
+        appSwitched_ = delta.Switched();
+        span.SetArg("delta", 1);
+        report(100, L"Aggiornamento completato");
+        return true;
+    }
+    if (cancel_->IsCancelled()) {
+        return false;
+    }
+    if (delta.InsufficientSpace()) {
+        Fail(InstallError::InsufficientSpace);
+        return false;
+    }
+
+    report(0, L"Download ed estrazione InstAnalytics...");
+
+    // The release goes into a staging directory beside the install and
+    // replaces it with one switch: a failure never leaves a half-updated install
+    StagedInstall staged(settings_.installPath);
+    if (!staged.Prepare()) {
+        Fail(InstallError::AppDownload);
+        return false;
+    }
+
+    std::atomic<bool> outOfSpace(false);
+    ExtractionOptions options;
+    options.threadCount = settings_.extractThreads;
+    options.stripCommonRoot = true;
+    options.insufficientSpace = &outOfSpace;
+    options.cancel = cancel_.get();
+
+    // The download thread fills the pipe, this thread reads the entries from
+    // it and hands them to the extraction workers; the pipe's capacity bounds
+    // how far the network can run ahead of the disk
+    StreamPipe pipe;
+    bool downloaded = false;
+
+    std::vector<std::wstring> sources = { settings_.appUrl };
+    sources.insert(sources.end(), settings_.appMirrors.begin(), settings_.appMirrors.end());
+    if (settings_.appSha256.empty()) {
+        span.SetArg("unpinned", 1);
+        Warn(L"Nessun SHA-256 configurato per l'archivio di InstAnalytics: download non verificato");
+    }
+
+    std::thread producer([&] {
+        Trace::SetThreadName("app download");
+        downloaded = appDownloader_.DownloadToStream(sources, pipe,
+            [&report](int progress, const std::wstring& status) {
+                report(progress, L"InstAnalytics - " + status);
+            },
+            settings_.appSha256);
+        if (downloaded) {
+            pipe.CloseWrite();
+        } else {
+            pipe.Abort();
+        }
+    });
+
+    // A cancelled token stops the download, which aborts the pipe under the extractor
+    bool extracted = ZipExtractor::ExtractStream(pipe, staged.StagingPath(), nullptr, options);
+
+    // A bad archive stops the download instead of letting it finish for nothing
+    bool stopped = cancel_->IsCancelled();
+    if (!extracted) {
+        cancel_->Cancel();
+        pipe.Abort();
+    }
+    producer.join();
+
+    if (!downloaded || !extracted) {
+        if (stopped) {
+            return false;
+        }
+        Fail(appDownloader_.IntegrityFailed() ? InstallError::AppCorrupted
+            : outOfSpace ? InstallError::InsufficientSpace
+            : InstallError::AppDownload);
+        return false;
+    }
+    if (!staged.Commit()) {
+        Fail(InstallError::AppSwitch);
+        return false;
+    }
+    appSwitched_ = true;
+
+    report(100, L"Estrazione completata");
+    return true;
+}
+
+bool InstallPipeline::VerifyApp(const TaskGraph::ReportCallback& report)
+{
+    if (settings_.appManifestUrl.empty()) {
+        return true;
+    }
+
+    TraceSpan span("phase.verify", "phase");
+    report(0, L"Verifica dei file installati...");
+
+    // Releases published without a manifest (or not the pinned one) can't
+    // be checked: not a failure
+    ReleaseManifest manifest;
+    if (!manifest.Download(settings_.appManifestUrl, settings_.appManifestSha256, settings_.transport, cancel_)) {
+        if (cancel_->IsCancelled()) {
+            return false;
+        }
+        report(100, L"Verifica non disponibile per questa versione");
+        return true;
+    }
+
+    if (!InstallVerifier::Verify(manifest, settings_.installPath, verifyReport_, 0, cancel_.get())) {
+        return false;
+    }
+    if (!verifyReport_.Passed()) {
+        Fail(InstallError::AppVerify);
+        return false;
+    }
+
+    report(100, L"File installati verificati");
+    return true;
+}
+
+std::wstring InstallPipeline::ErrorMessage() const
+{
+    if (rolledBack_ && error_ != InstallError::Cancelled) {
+        return Describe(error_) + L". È stata ripristinata la versione precedente";
+    }
+    return Describe(error_);
+}
+
+std::wstring InstallPipeline::Describe(InstallError error) const
+{
+    switch (error) {
+    case InstallError::None:
+        return L"";
+    case InstallError::Cancelled:
+        return L"Installazione annullata";
+    case InstallError::DotNetDownload:
+        return L"Errore durante il download di .NET 10";
+    case InstallError::DotNetCorrupted:
+        return L"Il pacchetto .NET 10 scaricato è danneggiato (SHA-256 non valido)";
+    case InstallError::DotNetInstall: {
+        wchar_t message[256];
+        swprintf(message, 256, L"Errore durante l'installazione di .NET 10 (exit code: %lu)", dotnetExitCode_);
+        return message;
+    }
+    case InstallError::DotNetPath:
+        return L"Impossibile configurare il PATH per .NET 10";
+    case InstallError::DotNetUntrusted:
+        return L"Il pacchetto .NET 10 scaricato non è firmato da Microsoft: installazione interrotta";
+    case InstallError::AppDownload:
+        return L"Errore durante il download o l'estrazione di InstAnalytics";
+    case InstallError::AppCorrupted:
+        return L"L'archivio di InstAnalytics scaricato è danneggiato (SHA-256 non valido)";
+    case InstallError::AppSwitch:
+        return L"Impossibile sostituire la versione installata di InstAnalytics: chiudere l'applicazione e riprovare";
+    case InstallError::AppVerify:
+        return L"Alcuni file installati di InstAnalytics non corrispondono alla versione scaricata: ripetere l'installazione";
+    case InstallError::AppPatch:
+        return L"Impossibile applicare le patch di InstAnalytics: la versione installata non è stata modificata";
+    case InstallError::InsufficientSpace:
+        return L"Spazio su disco insufficiente per completare l'installazione";
+    default:
+        return L"Errore imprevisto durante l'installazione";
+    }
+}
+
+} // namespace InstAnalyticsInstaller
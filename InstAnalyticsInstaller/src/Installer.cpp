@@ -1,5 +1,6 @@
 #include "Installer.h"
-#include "ZipExtractor.h"
+#include "LogTailer.h"
+#include "Trace.h"
 #include <shlobj.h>
 #include <thread>
 #include <chrono>
@@ -7,26 +8,39 @@
 namespace InstAnalyticsInstaller {
 
 Installer::Installer()
-    : cancelled_(false)
+    : cancel_(std::make_shared<CancellationToken>())
     , lastExitCode_(0)
 {
 }
 
+Installer::~Installer()
+{
+}
+
 void Installer::Cancel()
 {
-    cancelled_ = true;
+    cancel_->Cancel();
 }
 
 bool Installer::InstallDotNet(const std::wstring& installerPath, InstallProgressCallback callback)
 {
-    cancelled_ = false;
+    TraceSpan span("dotnet.install", "dotnet");
+
+    // Cancelled before the UAC prompt: nothing to launch
+    if (cancel_->IsCancelled()) {
+        return false;
+    }
 
     if (callback) {
         callback(0, L"Avvio installazione .NET 10...");
     }
 
+    // The bundle log is what reports real progress; a stale one would replay old packages
+    std::wstring logPath = installerPath + L".log";
+    DeleteFileW(logPath.c_str());
+
     // Use ShellExecuteEx to launch installer with elevation (runas)
-    std::wstring parameters = L"/install /quiet /norestart";
+    std::wstring parameters = L"/install /quiet /norestart /log \"" + logPath + L"\"";
 
     SHELLEXECUTEINFOW sei = { sizeof(sei) };
     sei.fMask = SEE_MASK_NOCLOSEPROCESS;
@@ -35,10 +49,20 @@ bool Installer::InstallDotNet(const std::wstring& installerPath, InstallProgress
     sei.lpParameters = parameters.c_str();
     sei.nShow = SW_HIDE;
 
-    if (!ShellExecuteExW(&sei)) {
+    // The launch span includes the time the user spends on the UAC prompt
+    bool launched = false;
+    DWORD launchError = ERROR_SUCCESS;
+    {
+        TraceSpan launchSpan("dotnet.launch", "dotnet");
+        launched = ShellExecuteExW(&sei) != FALSE;
+        if (!launched) {
+            launchError = GetLastError();
+        }
+    }
+
+    if (!launched) {
         // Check if user cancelled UAC prompt
-        DWORD error = GetLastError();
-        if (error == ERROR_CANCELLED) {
+        if (launchError == ERROR_CANCELLED) {
             if (callback) {
                 callback(0, L"Installazione annullata dall'utente");
             }
@@ -51,16 +75,17 @@ bool Installer::InstallDotNet(const std::wstring& installerPath, InstallProgress
     }
 
     // Wait for installation to complete
-    bool success = WaitForProcessCompletion(sei.hProcess, callback);
+    bool success = WaitForProcessCompletion(sei.hProcess, logPath, callback);
 
     lastExitCode_ = 0;
     GetExitCodeProcess(sei.hProcess, &lastExitCode_);
 
     CloseHandle(sei.hProcess);
+    span.SetArg("exitCode", (int64_t)lastExitCode_);
 
     // Exit codes: 0 = success, 3010 = success with reboot required
     // 1638 = product already installed, 1641 = success with reboot initiated
-    bool isSuccess = success && !cancelled_ &&
+    bool isSuccess = success && !cancel_->IsCancelled() &&
                      (lastExitCode_ == 0 || lastExitCode_ == 3010 ||
                       lastExitCode_ == 1638 || lastExitCode_ == 1641);
 
@@ -73,65 +98,79 @@ bool Installer::InstallDotNet(const std::wstring& installerPath, InstallProgress
     return isSuccess;
 }
 
-bool Installer::WaitForProcessCompletion(HANDLE hProcess, InstallProgressCallback callback)
+bool Installer::WaitForProcessCompletion(HANDLE hProcess, const std::wstring& logPath, InstallProgressCallback callback)
 {
-    int progress = 10;
-    const int maxProgress = 90;
-    const int progressStep = 2;
+    // Exit and cancellation wake the wait immediately; the timeout only
+    // paces reading the log, which Burn appends as it applies packages
+    const DWORD LOG_POLL_MS = 250;
+
+    LogTailer tailer(logPath);
+    BurnLogProgress burn;
+    std::vector<std::string> lines;
+    int reported = -1;
+
+    HANDLE handles[] = { hProcess, (HANDLE)cancel_->WaitHandle() };
+    DWORD handleCount = handles[1] ? 2 : 1;
+
+    // Only the bytes appended since the last look are read and parsed
+    auto readLog = [&]() {
+        lines.clear();
+        tailer.Poll(lines);
+
+        bool changed = false;
+        for (const auto& line : lines) {
+            changed |= burn.ParseLine(line);
+        }
+        if (changed) {
+            Trace::Counter("dotnet.packagesApplied", burn.AppliedPackages());
+        }
+
+        int progress = burn.Progress();
+        if (callback && changed && progress >= reported) {
+            reported = progress;
+
+            wchar_t status[256];
+            if (burn.PlannedPackages() == 0) {
+                swprintf_s(status, L"Preparazione installazione...");
+            } else {
+                unsigned current = burn.AppliedPackages() + (burn.CurrentPackage().empty() ? 0 : 1);
+                swprintf_s(status, L"Installazione pacchetto %u di %u",
+                    current < burn.PlannedPackages() ? current : burn.PlannedPackages(), burn.PlannedPackages());
+            }
+            callback(progress, status);
+        }
+    };
 
     while (true) {
-        DWORD waitResult = WaitForSingleObject(hProcess, 1000);
+        DWORD waitResult = WaitForMultipleObjects(handleCount, handles, FALSE, LOG_POLL_MS);
 
         if (waitResult == WAIT_OBJECT_0) {
-            // Process completed
+            // Process completed: Burn's last lines land after the previous
+            // poll, usually right before it exits
+            readLog();
             if (callback) {
                 callback(100, L"Installazione completata");
             }
             return true;
         }
 
-        if (cancelled_) {
+        if (waitResult == WAIT_OBJECT_0 + 1 || cancel_->IsCancelled()) {
             TerminateProcess(hProcess, 1);
             return false;
         }
 
-        // Update progress (simulated)
-        if (callback && progress < maxProgress) {
-            progress += progressStep;
-            callback(progress, L"Installazione in corso...");
+        if (waitResult == WAIT_FAILED) {
+            return false;
         }
-    }
-}
-
-bool Installer::ExtractInstAnalytics(const std::wstring& zipPath, const std::wstring& destinationPath, InstallProgressCallback callback)
-{
-    cancelled_ = false;
-
-    if (callback) {
-        callback(0, L"Estrazione files in corso...");
-    }
-
-    // Create destination directory
-    SHCreateDirectoryEx(nullptr, destinationPath.c_str(), nullptr);
 
-    // Extract zip file
-    bool success = ZipExtractor::Extract(zipPath, destinationPath,
-        [this, callback](int progress, const std::wstring& currentFile) {
-            if (cancelled_) return;
-            if (callback) {
-                callback(progress, L"Estrazione: " + currentFile);
-            }
-        });
-
-    if (success && callback) {
-        callback(100, L"Estrazione completata");
+        readLog();
     }
-
-    return success && !cancelled_;
 }
 
 bool Installer::CreateShortcuts(const std::wstring& installPath)
 {
+    TraceSpan span("shortcuts", "install");
+
     // Get Desktop path
     wchar_t desktopPath[MAX_PATH];
     if (FAILED(SHGetFolderPathW(nullptr, CSIDL_DESKTOP, nullptr, 0, desktopPath))) {
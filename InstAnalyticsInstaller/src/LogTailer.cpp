@@ -0,0 +1,133 @@
+#include "LogTailer.h"
+#include <algorithm>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+constexpr size_t TAIL_READ_SIZE = 64 * 1024;
+
+// Value of "<key>: <value>," inside a Burn message, empty if absent
+std::string FieldValue(const std::string& line, const std::string& key)
+{
+    size_t start = line.find(key + ": ");
+    if (start == std::string::npos) {
+        return "";
+    }
+    start += key.size() + 2;
+    size_t end = line.find(',', start);
+    return line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+} // namespace
+
+LogTailer::LogTailer(const std::wstring& path)
+    : path_(path)
+    , offset_(0)
+    , buffer_(TAIL_READ_SIZE)
+{
+}
+
+bool LogTailer::Poll(std::vector<std::string>& lines)
+{
+    if (!file_.IsOpen() && !file_.Open(path_, File::Mode::ReadShared)) {
+        return true;
+    }
+
+    for (;;) {
+        size_t bytesRead = 0;
+        if (!file_.ReadAt(offset_, buffer_.data(), buffer_.size(), bytesRead)) {
+            return false;
+        }
+        if (bytesRead == 0) {
+            return true;
+        }
+        offset_ += bytesRead;
+
+        const char* data = buffer_.data();
+        const char* end = data + bytesRead;
+        while (data < end) {
+            const char* newline = std::find(data, end, '\n');
+            partial_.append(data, newline);
+            if (newline == end) {
+                break;
+            }
+
+            if (!partial_.empty() && partial_.back() == '\r') {
+                partial_.pop_back();
+            }
+            lines.push_back(std::move(partial_));
+            partial_.clear();
+            data = newline + 1;
+        }
+    }
+}
+
+BurnLogProgress::BurnLogProgress()
+    : planned_(0)
+    , applied_(0)
+    , planComplete_(false)
+    , complete_(false)
+{
+}
+
+bool BurnLogProgress::ParseLine(const std::string& line)
+{
+    // i201: Planned package: <id>, state: Absent, ..., execute: Install, rollback: ...
+    if (line.find("Planned package: ") != std::string::npos) {
+        std::string action = FieldValue(line, "execute");
+        if (!action.empty() && action != "None") {
+            ++planned_;
+        }
+        return false;
+    }
+
+    // i299: Plan complete, result: 0x0
+    if (line.find("Plan complete") != std::string::npos) {
+        planComplete_ = true;
+        return true;
+    }
+
+    // i301: Applying execute package: <id>, action: Install, path: ...
+    if (line.find("Applying execute package: ") != std::string::npos) {
+        currentPackage_ = FieldValue(line, "Applying execute package");
+        return true;
+    }
+
+    // i319: Applied execute package: <id>, result: 0x0, restart: None
+    if (line.find("Applied execute package: ") != std::string::npos) {
+        ++applied_;
+        currentPackage_.clear();
+        return true;
+    }
+
+    // i399: Apply complete, result: 0x0, ...
+    if (line.find("Apply complete") != std::string::npos) {
+        complete_ = true;
+        currentPackage_.clear();
+        return true;
+    }
+
+    return false;
+}
+
+int BurnLogProgress::Progress() const
+{
+    if (complete_) {
+        return 100;
+    }
+
+    // Planning and payload verification take a few seconds at the start
+    if (!planComplete_ || planned_ == 0) {
+        return planComplete_ ? 5 : 0;
+    }
+
+    // Half a package for the one being applied, so the bar moves as it starts
+    double done = std::min<double>(applied_, planned_);
+    if (!currentPackage_.empty() && applied_ < planned_) {
+        done += 0.5;
+    }
+    return 5 + (int)(done * 90 / planned_);
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,72 @@
+#include "ProgressSnapshot.h"
+
+namespace InstAnalyticsInstaller {
+
+ProgressSnapshot::ProgressSnapshot()
+    : progress_(0)
+    , version_(0)
+    , sequence_(0)
+    , length_(0)
+{
+    for (auto& ch : status_) {
+        ch.store(0, std::memory_order_relaxed);
+    }
+}
+
+void ProgressSnapshot::Publish(int progress, const std::wstring& status)
+{
+    // Claim the snapshot by moving the sequence from even to odd. Another
+    // writer holding it is done within a bounded number of stores
+    uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    while ((sequence & 1) != 0 ||
+           !sequence_.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire)) {
+        sequence = sequence_.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    size_t length = status.size() < MAX_STATUS ? status.size() : MAX_STATUS;
+    for (size_t i = 0; i < length; ++i) {
+        status_[i].store(status[i], std::memory_order_relaxed);
+    }
+    length_.store(length, std::memory_order_relaxed);
+    progress_.store(progress, std::memory_order_relaxed);
+
+    sequence_.store(sequence + 2, std::memory_order_release);
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+bool ProgressSnapshot::Sample(uint64_t& version, int& progress, std::wstring& status) const
+{
+    uint64_t current = version_.load(std::memory_order_acquire);
+    if (current == version) {
+        return false;
+    }
+
+    wchar_t buffer[MAX_STATUS];
+    size_t length;
+    int published;
+    for (;;) {
+        uint32_t before = sequence_.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue; // A writer is halfway through
+        }
+
+        published = progress_.load(std::memory_order_relaxed);
+        length = length_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < length; ++i) {
+            buffer[i] = status_[i].load(std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == before) {
+            break;
+        }
+    }
+
+    version = current;
+    progress = published;
+    status.assign(buffer, length);
+    return true;
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,286 @@
+#include "ReleaseManifest.h"
+#include "Downloader.h"
+#include "FileSystem.h"
+#include "Sha256.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include "ZipArchive.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cwctype>
+#include <set>
+#include <sstream>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+const char* const MANIFEST_HEADER = "InstAnalytics-manifest 1";
+constexpr size_t HASH_BUFFER_SIZE = 1024 * 1024;
+
+// Manifests are small: kept in memory
+class StringOutput : public OutputStream {
+public:
+    bool Write(const void* data, size_t size) override
+    {
+        text.append((const char*)data, size);
+        return text.size() <= MAX_MANIFEST_SIZE;
+    }
+
+    static constexpr size_t MAX_MANIFEST_SIZE = 16 * 1024 * 1024;
+    std::string text;
+};
+
+bool ListFiles(const std::wstring& directory, const std::wstring& prefix, std::vector<std::wstring>& files)
+{
+    std::vector<DirectoryEntry> entries;
+    if (!FileSystem::ListDirectory(directory, entries)) {
+        return false;
+    }
+    for (const auto& entry : entries) {
+        std::wstring relative = prefix + entry.name;
+        if (entry.isDirectory) {
+            if (!ListFiles(FileSystem::JoinPath(directory, entry.name), relative + L"/", files)) {
+                return false;
+            }
+        } else {
+            files.push_back(relative);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool ReleaseManifest::Parse(const std::string& text)
+{
+    std::istringstream lines(text);
+    std::string line;
+    if (!std::getline(lines, line) || line != MANIFEST_HEADER) {
+        return false;
+    }
+
+    files.clear();
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+
+        // The path goes last: it may contain spaces
+        size_t first = line.find(' ');
+        size_t second = first == std::string::npos ? std::string::npos : line.find(' ', first + 1);
+        if (second == std::string::npos || first != Sha256::DIGEST_SIZE * 2) {
+            return false;
+        }
+
+        ManifestFile file;
+        file.sha256 = FileSystem::FromUtf8(line.substr(0, first));
+        char* end = nullptr;
+        file.size = strtoull(line.c_str() + first + 1, &end, 10);
+        file.path = FileSystem::FromUtf8(line.substr(second + 1));
+        if (end != line.c_str() + second || file.path.empty() || !ZipArchive::IsSafePath(file.path)) {
+            return false;
+        }
+        std::transform(file.sha256.begin(), file.sha256.end(), file.sha256.begin(), towlower);
+        files.push_back(std::move(file));
+    }
+    return true;
+}
+
+std::string ReleaseManifest::Serialize() const
+{
+    std::string text = std::string(MANIFEST_HEADER) + "\n";
+    for (const auto& file : files) {
+        text += FileSystem::ToUtf8(file.sha256) + " " + std::to_string(file.size) + " " +
+                FileSystem::ToUtf8(file.path) + "\n";
+    }
+    return text;
+}
+
+bool ReleaseManifest::Load(const std::wstring& path)
+{
+    File file;
+    if (!file.Open(path, File::Mode::Read)) {
+        return false;
+    }
+
+    std::string content;
+    char buffer[4096];
+    size_t bytesRead = 0;
+    for (;;) {
+        if (!file.Read(buffer, sizeof(buffer), bytesRead)) {
+            return false;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        content.append(buffer, bytesRead);
+    }
+    return Parse(content);
+}
+
+bool ReleaseManifest::Save(const std::wstring& path) const
+{
+    std::string content = Serialize();
+    File file;
+    return file.Open(path, File::Mode::Write) && file.Write(content.data(), content.size());
+}
+
+bool ReleaseManifest::Download(const std::wstring& url, const std::wstring& expectedSha256,
+    std::shared_ptr<HttpTransport> transport, std::shared_ptr<CancellationToken> cancel, uint64_t* bytes)
+{
+    StringOutput text;
+    Downloader downloader(transport);
+    if (cancel) {
+        downloader.SetCancellationToken(cancel);
+    }
+    if (!downloader.DownloadToStream(url, text, nullptr, expectedSha256)) {
+        return false;
+    }
+    if (bytes) {
+        *bytes = text.text.size();
+    }
+    return Parse(text.text);
+}
+
+uint64_t ReleaseManifest::TotalSize() const
+{
+    uint64_t total = 0;
+    for (const auto& file : files) {
+        total += file.size;
+    }
+    return total;
+}
+
+bool ReleaseManifest::HashFile(const std::wstring& path, std::wstring& sha256, uint64_t& size,
+    const CancellationToken* cancel)
+{
+    File file;
+    if (!file.Open(path, File::Mode::Read) || !file.GetSize(size)) {
+        return false;
+    }
+
+    Sha256 sha;
+    std::vector<uint8_t> buffer((size_t)std::min<uint64_t>(std::max<uint64_t>(size, 1), HASH_BUFFER_SIZE));
+    size_t bytesRead = 0;
+    for (;;) {
+        if (!file.Read(buffer.data(), buffer.size(), bytesRead) || (cancel && cancel->IsCancelled())) {
+            return false;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        sha.Update(buffer.data(), bytesRead);
+    }
+    sha256 = sha.FinalHex();
+    return true;
+}
+
+bool ReleaseManifest::FindChanged(const std::wstring& directory, unsigned threadCount, std::vector<size_t>& changed,
+    const CancellationToken* cancel) const
+{
+    TraceSpan span("manifest.compare", "update");
+
+    // Missing files and size mismatches need no hashing
+    std::vector<uint8_t> differs(files.size(), 0);
+    std::vector<size_t> candidates;
+    uint64_t hashedBytes = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        File file;
+        uint64_t size = 0;
+        if (!file.Open(FileSystem::JoinPath(directory, files[i].path), File::Mode::Read) || !file.GetSize(size) ||
+            size != files[i].size) {
+            differs[i] = 1;
+        } else {
+            candidates.push_back(i);
+            hashedBytes += size;
+        }
+    }
+
+    // Largest first, so a big assembly never starts last
+    std::sort(candidates.begin(), candidates.end(),
+        [this](size_t a, size_t b) { return files[a].size > files[b].size; });
+
+    {
+        ThreadPool pool(threadCount);
+        for (size_t index : candidates) {
+            pool.Submit([this, &directory, &differs, cancel, index](unsigned) {
+                std::wstring sha256;
+                uint64_t size = 0;
+                if (!HashFile(FileSystem::JoinPath(directory, files[index].path), sha256, size, cancel) ||
+                    size != files[index].size || !Sha256::HexEquals(sha256, files[index].sha256)) {
+                    differs[index] = 1;
+                }
+            });
+        }
+        pool.Wait();
+    }
+
+    if (cancel && cancel->IsCancelled()) {
+        return false;
+    }
+
+    changed.clear();
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (differs[i]) {
+            changed.push_back(i);
+        }
+    }
+
+    span.SetBytes(hashedBytes);
+    span.SetArg("files", (int64_t)files.size());
+    span.SetArg("changed", (int64_t)changed.size());
+    return true;
+}
+
+bool ReleaseManifest::FindExtra(const std::wstring& directory, std::vector<std::wstring>& extra) const
+{
+    std::vector<std::wstring> paths;
+    if (!ListFiles(directory, L"", paths)) {
+        return false;
+    }
+
+    std::set<std::wstring> listed;
+    for (const auto& file : files) {
+        listed.insert(file.path);
+    }
+    extra.clear();
+    for (const auto& path : paths) {
+        if (listed.count(path) == 0) {
+            extra.push_back(path);
+        }
+    }
+    return true;
+}
+
+bool ReleaseManifest::FromDirectory(const std::wstring& directory, ReleaseManifest& manifest, unsigned threadCount)
+{
+    std::vector<std::wstring> paths;
+    if (!ListFiles(directory, L"", paths)) {
+        return false;
+    }
+    std::sort(paths.begin(), paths.end());
+
+    manifest.files.assign(paths.size(), ManifestFile());
+    std::atomic<bool> failed(false);
+    {
+        ThreadPool pool(threadCount);
+        for (size_t i = 0; i < paths.size(); ++i) {
+            pool.Submit([&, i](unsigned) {
+                ManifestFile& file = manifest.files[i];
+                file.path = paths[i];
+                if (!HashFile(FileSystem::JoinPath(directory, paths[i]), file.sha256, file.size)) {
+                    failed = true;
+                }
+            });
+        }
+        pool.Wait();
+    }
+    return !failed;
+}
+
+} // namespace InstAnalyticsInstaller
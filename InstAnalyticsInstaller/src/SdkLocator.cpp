@@ -0,0 +1,108 @@
+#include "SdkLocator.h"
+#include "FileSystem.h"
+#include <algorithm>
+#include <cwctype>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+bool ParseNumber(const std::wstring& text, size_t& pos, unsigned& value)
+{
+    size_t start = pos;
+    value = 0;
+    while (pos < text.size() && iswdigit(text[pos]) && pos - start < 9) {
+        value = value * 10 + (unsigned)(text[pos] - L'0');
+        ++pos;
+    }
+    return pos > start;
+}
+
+} // namespace
+
+bool SdkLocator::ParseVersion(const std::wstring& name, SdkVersion& version)
+{
+    size_t pos = 0;
+    SdkVersion parsed;
+    if (!ParseNumber(name, pos, parsed.major) || pos >= name.size() || name[pos++] != L'.' ||
+        !ParseNumber(name, pos, parsed.minor) || pos >= name.size() || name[pos++] != L'.' ||
+        !ParseNumber(name, pos, parsed.patch)) {
+        return false;
+    }
+
+    if (pos < name.size()) {
+        if (name[pos] != L'-' || pos + 1 == name.size()) {
+            return false;
+        }
+        parsed.prerelease = name.substr(pos + 1);
+    }
+
+    parsed.name = name;
+    version = parsed;
+    return true;
+}
+
+bool SdkLocator::IsNewer(const SdkVersion& a, const SdkVersion& b)
+{
+    if (a.major != b.major) return a.major > b.major;
+    if (a.minor != b.minor) return a.minor > b.minor;
+    if (a.patch != b.patch) return a.patch > b.patch;
+
+    // A release outranks its previews; previews compare by label
+    if (a.prerelease.empty() != b.prerelease.empty()) {
+        return a.prerelease.empty();
+    }
+    return a.prerelease > b.prerelease;
+}
+
+std::vector<SdkVersion> SdkLocator::ListSdks(const std::wstring& dotnetRoot)
+{
+    std::vector<SdkVersion> sdks;
+    if (dotnetRoot.empty()) {
+        return sdks;
+    }
+
+    std::wstring sdkDirectory = FileSystem::JoinPath(dotnetRoot, L"sdk");
+    std::vector<DirectoryEntry> entries;
+    if (!FileSystem::ListDirectory(sdkDirectory, entries)) {
+        return sdks;
+    }
+
+    for (const auto& entry : entries) {
+        SdkVersion version;
+        if (!entry.isDirectory || !ParseVersion(entry.name, version)) {
+            continue;
+        }
+
+        // Uninstallers can leave empty version folders behind
+        std::wstring marker = FileSystem::JoinPath(FileSystem::JoinPath(sdkDirectory, entry.name), L"dotnet.dll");
+        if (FileSystem::FileExists(marker)) {
+            sdks.push_back(version);
+        }
+    }
+
+    std::sort(sdks.begin(), sdks.end(), [](const SdkVersion& a, const SdkVersion& b) { return IsNewer(b, a); });
+    return sdks;
+}
+
+bool SdkLocator::FindSdk(const std::vector<std::wstring>& roots, unsigned major, SdkVersion* found)
+{
+    bool any = false;
+    SdkVersion best;
+
+    for (const auto& root : roots) {
+        for (const auto& sdk : ListSdks(root)) {
+            if (sdk.major == major && (!any || IsNewer(sdk, best))) {
+                best = sdk;
+                any = true;
+            }
+        }
+    }
+
+    if (any && found) {
+        *found = best;
+    }
+    return any;
+}
+
+} // namespace InstAnalyticsInstaller
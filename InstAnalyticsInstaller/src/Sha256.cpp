@@ -0,0 +1,255 @@
+#include "Sha256.h"
+#include "CpuFeatures.h"
+#include <cstring>
+#include <cwctype>
+#include <utility>
+
+#ifdef INSTANALYTICS_X86
+#include <immintrin.h>
+#endif
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+alignas(16) const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline uint32_t Rotr(uint32_t value, int count)
+{
+    return (value >> count) | (value << (32 - count));
+}
+
+inline uint32_t LoadBE32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+void ProcessBlocksPortable(uint32_t state[8], const uint8_t* data, size_t blocks)
+{
+    uint32_t w[64];
+
+    while (blocks--) {
+        for (int i = 0; i < 16; ++i) {
+            w[i] = LoadBE32(data + i * 4);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25);
+            uint32_t choose = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + choose + K[i] + w[i];
+            uint32_t s0 = Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+
+        data += 64;
+    }
+}
+
+#ifdef INSTANALYTICS_X86
+
+// SHA-NI: four rounds per pair of SHA256RNDS2, with the message schedule
+// (SHA256MSG1/MSG2) for the rounds ahead computed between them. message
+// holds W in four registers used round-robin; Group is the rounds' index / 4
+template <int Group>
+INSTANALYTICS_TARGET("sha,sse4.1,ssse3")
+inline void RoundsNi(__m128i& state0, __m128i& state1, __m128i message[4], const uint8_t* data, __m128i byteSwap)
+{
+    __m128i& current = message[Group % 4];
+    if (Group < 4) {
+        current = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + Group * 16)), byteSwap);
+    }
+    __m128i words = _mm_add_epi32(current, _mm_load_si128((const __m128i*)(K + Group * 4)));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+    if (Group >= 3 && Group <= 14) {
+        __m128i& next = message[(Group + 1) % 4];
+        next = _mm_add_epi32(next, _mm_alignr_epi8(current, message[(Group + 3) % 4], 4));
+        next = _mm_sha256msg2_epu32(next, current);
+    }
+    words = _mm_shuffle_epi32(words, 0x0E);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, words);
+    if (Group >= 1 && Group <= 12) {
+        message[(Group + 3) % 4] = _mm_sha256msg1_epu32(message[(Group + 3) % 4], current);
+    }
+}
+
+template <int... Groups>
+INSTANALYTICS_TARGET("sha,sse4.1,ssse3")
+inline void BlockNi(__m128i& state0, __m128i& state1, const uint8_t* data, __m128i byteSwap,
+    std::integer_sequence<int, Groups...>)
+{
+    __m128i message[4];
+    (RoundsNi<Groups>(state0, state1, message, data, byteSwap), ...);
+}
+
+INSTANALYTICS_TARGET("sha,sse4.1,ssse3")
+void ProcessBlocksNi(uint32_t state[8], const uint8_t* data, size_t blocks)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The instructions keep the state as ABEF and CDGH
+    __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(dcba, state1, 8);
+    state1 = _mm_blend_epi16(state1, dcba, 0xF0);
+
+    while (blocks--) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        BlockNi(state0, state1, data, byteSwap, std::make_integer_sequence<int, 16>());
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+        data += 64;
+    }
+
+    __m128i feba = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(feba, state1, 0xF0));
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, feba, 8));
+}
+
+#endif
+
+} // namespace
+
+Sha256::Sha256()
+{
+    Reset();
+}
+
+void Sha256::Reset()
+{
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(state_, initial, sizeof(state_));
+    bufferSize_ = 0;
+    totalSize_ = 0;
+}
+
+void Sha256::ProcessBlocks(const uint8_t* data, size_t blocks)
+{
+#ifdef INSTANALYTICS_X86
+    if (CpuFeatures::Get().sha) {
+        ProcessBlocksNi(state_, data, blocks);
+        return;
+    }
+#endif
+    ProcessBlocksPortable(state_, data, blocks);
+}
+
+void Sha256::Update(const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    totalSize_ += size;
+
+    if (bufferSize_ > 0) {
+        size_t take = 64 - bufferSize_ < size ? 64 - bufferSize_ : size;
+        memcpy(buffer_ + bufferSize_, p, take);
+        bufferSize_ += take;
+        p += take;
+        size -= take;
+
+        if (bufferSize_ < 64) {
+            return;
+        }
+        ProcessBlocks(buffer_, 1);
+        bufferSize_ = 0;
+    }
+
+    // Whole blocks straight from the caller's buffer
+    if (size >= 64) {
+        ProcessBlocks(p, size / 64);
+        p += size & ~(size_t)63;
+        size &= 63;
+    }
+
+    if (size > 0) {
+        memcpy(buffer_, p, size);
+        bufferSize_ = size;
+    }
+}
+
+void Sha256::Final(uint8_t digest[DIGEST_SIZE])
+{
+    uint64_t bitLength = totalSize_ * 8;
+
+    uint8_t padding[72] = { 0x80 };
+    size_t paddingSize = (bufferSize_ < 56 ? 56 : 120) - bufferSize_;
+    for (int i = 0; i < 8; ++i) {
+        padding[paddingSize + i] = (uint8_t)(bitLength >> (56 - i * 8));
+    }
+    Update(padding, paddingSize + 8);
+
+    for (int i = 0; i < 8; ++i) {
+        digest[i * 4] = (uint8_t)(state_[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(state_[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(state_[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)state_[i];
+    }
+
+    Reset();
+}
+
+std::wstring Sha256::FinalHex()
+{
+    uint8_t digest[DIGEST_SIZE];
+    Final(digest);
+    return ToHex(digest);
+}
+
+std::wstring Sha256::ToHex(const uint8_t digest[DIGEST_SIZE])
+{
+    static const wchar_t hex[] = L"0123456789abcdef";
+    std::wstring result;
+    result.reserve(DIGEST_SIZE * 2);
+    for (size_t i = 0; i < DIGEST_SIZE; ++i) {
+        result += hex[digest[i] >> 4];
+        result += hex[digest[i] & 15];
+    }
+    return result;
+}
+
+bool Sha256::HexEquals(const std::wstring& a, const std::wstring& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (towlower(a[i]) != towlower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace InstAnalyticsInstaller
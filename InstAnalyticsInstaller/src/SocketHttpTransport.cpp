@@ -0,0 +1,613 @@
+#include "SocketHttpTransport.h"
+#include "CancellationToken.h"
+#include "FileSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+
+// Idle keep-alive connections by "host:port". Streams hold a reference and
+// hand their connection back when their response was fully read
+class SocketHttpTransport::ConnectionPool {
+public:
+    ~ConnectionPool()
+    {
+        for (const auto& connection : idle_) {
+            close(connection.fd);
+        }
+    }
+
+    // A pooled connection to key, or -1
+    int Take(const std::string& key);
+    void Give(const std::string& key, int fd);
+
+    std::atomic<uint64_t> opened{ 0 };
+
+private:
+    struct Idle {
+        std::string key;
+        int fd;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    std::mutex mutex_;
+    std::vector<Idle> idle_;
+};
+
+namespace {
+
+constexpr int MAX_REDIRECTS = 5;
+constexpr int SOCKET_TIMEOUT_SECONDS = 30;
+constexpr size_t RECEIVE_BUFFER_SIZE = 64 * 1024;
+constexpr size_t MAX_IDLE_PER_HOST = 8;
+constexpr size_t MAX_REDIRECT_BODY = 64 * 1024;    // Larger redirect bodies close the connection instead
+// Servers drop idle connections after a few seconds; reusing one that is
+// about to go only costs a retry, but there is no point keeping them longer
+constexpr auto IDLE_TIMEOUT = std::chrono::seconds(15);
+
+struct ParsedUrl {
+    std::string host;
+    std::string port;
+    std::string path;
+};
+
+bool ParseUrl(const std::string& url, ParsedUrl& parsed)
+{
+    const std::string scheme = "http://";
+    if (url.compare(0, scheme.size(), scheme) != 0) {
+        return false; // TLS is the platform transport's job
+    }
+
+    size_t hostStart = scheme.size();
+    size_t pathStart = url.find('/', hostStart);
+    std::string authority = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos : pathStart - hostStart);
+    parsed.path = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+
+    size_t colon = authority.rfind(':');
+    if (colon != std::string::npos && authority.find(']') == std::string::npos) {
+        parsed.host = authority.substr(0, colon);
+        parsed.port = authority.substr(colon + 1);
+    } else {
+        parsed.host = authority;
+        parsed.port = "80";
+    }
+
+    return !parsed.host.empty();
+}
+
+std::string ToLower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char ch) { return (char)tolower(ch); });
+    return text;
+}
+
+std::string Trim(const std::string& text)
+{
+    size_t start = text.find_first_not_of(" \t");
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return start == std::string::npos ? "" : text.substr(start, end - start + 1);
+}
+
+// Waits for fd to become ready for events, or for the token. False when
+// cancelled or after the socket timeout; without a token there is nothing
+// to wait for beside the socket's own timeouts
+bool WaitReady(int fd, short events, const CancellationToken* cancel)
+{
+    if (!cancel) {
+        return true;
+    }
+
+    pollfd handles[2] = { { fd, events, 0 }, { cancel->WaitHandle(), POLLIN, 0 } };
+    for (;;) {
+        int result = poll(handles, 2, SOCKET_TIMEOUT_SECONDS * 1000);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        return result > 0 && !cancel->IsCancelled();
+    }
+}
+
+// A connect that the token can interrupt: non-blocking until it completes
+bool ConnectSocket(int fd, const sockaddr* address, socklen_t length, const CancellationToken* cancel)
+{
+    if (!cancel) {
+        return connect(fd, address, length) == 0;
+    }
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    bool connected = connect(fd, address, length) == 0;
+    if (!connected && errno == EINPROGRESS && WaitReady(fd, POLLOUT, cancel)) {
+        int error = 0;
+        socklen_t size = sizeof(error);
+        connected = getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size) == 0 && error == 0;
+    }
+
+    fcntl(fd, F_SETFL, flags);
+    return connected;
+}
+
+int Connect(const ParsedUrl& url, const CancellationToken* cancel)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &addresses) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo* address = addresses; address; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (ConnectSocket(fd, address->ai_addr, address->ai_addrlen, cancel)) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+
+    if (fd >= 0) {
+        timeval timeout = { SOCKET_TIMEOUT_SECONDS, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+    return fd;
+}
+
+bool SendAll(int fd, const std::string& data)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t result = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        sent += (size_t)result;
+    }
+    return true;
+}
+
+class SocketHttpStream : public HttpStream {
+public:
+    enum class BodyMode { None, Length, Chunked, UntilClose };
+
+    SocketHttpStream(int fd, std::shared_ptr<SocketHttpTransport::ConnectionPool> pool, const std::string& key,
+        const CancellationToken* cancel)
+        : fd_(fd)
+        , pool_(pool)
+        , key_(key)
+        , cancel_(cancel)
+        , buffer_(RECEIVE_BUFFER_SIZE)
+        , pos_(0)
+        , end_(0)
+        , mode_(BodyMode::None)
+        , remaining_(0)
+        , finished_(false)
+        , keepAlive_(false)
+    {
+    }
+
+    ~SocketHttpStream() override
+    {
+        // Only a connection positioned exactly at the next response can be reused
+        if (keepAlive_ && finished_ && mode_ != BodyMode::UntilClose && pos_ == end_) {
+            pool_->Give(key_, fd_);
+        } else {
+            close(fd_);
+        }
+    }
+
+    const HttpResponse& Response() const override { return response_; }
+    const std::string& Location() const { return location_; }
+
+    bool ReadHeaders(bool headOnly)
+    {
+        std::string line;
+        if (!ReadLine(line)) {
+            return false;
+        }
+
+        // "HTTP/1.1 206 Partial Content"
+        size_t space = line.find(' ');
+        if (line.compare(0, 5, "HTTP/") != 0 || space == std::string::npos) {
+            return false;
+        }
+        response_.statusCode = atoi(line.c_str() + space + 1);
+        keepAlive_ = line.compare(0, 8, "HTTP/1.1") == 0;
+
+        bool chunked = false;
+        for (;;) {
+            if (!ReadLine(line)) {
+                return false;
+            }
+            if (line.empty()) {
+                break;
+            }
+
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string name = ToLower(Trim(line.substr(0, colon)));
+            std::string value = Trim(line.substr(colon + 1));
+
+            if (name == "content-length") {
+                response_.hasContentLength = true;
+                response_.contentLength = strtoull(value.c_str(), nullptr, 10);
+            } else if (name == "accept-ranges") {
+                response_.acceptRanges = ToLower(value).find("bytes") != std::string::npos;
+            } else if (name == "etag") {
+                response_.etag = FileSystem::FromUtf8(value);
+            } else if (name == "last-modified") {
+                response_.lastModified = FileSystem::FromUtf8(value);
+            } else if (name == "content-range") {
+                // "bytes 0-1023/146515"
+                size_t space = value.find(' ');
+                if (space != std::string::npos) {
+                    response_.rangeStart = strtoull(value.c_str() + space + 1, nullptr, 10);
+                }
+                size_t slash = value.find('/');
+                if (slash != std::string::npos && value[slash + 1] != '*') {
+                    response_.totalLength = strtoull(value.c_str() + slash + 1, nullptr, 10);
+                }
+                response_.acceptRanges = true;
+            } else if (name == "transfer-encoding") {
+                chunked = ToLower(value).find("chunked") != std::string::npos;
+            } else if (name == "location") {
+                location_ = value;
+            } else if (name == "connection") {
+                keepAlive_ = keepAlive_ && ToLower(value).find("close") == std::string::npos;
+            }
+        }
+
+        if (response_.statusCode == 200 && response_.hasContentLength) {
+            response_.totalLength = response_.contentLength;
+        }
+
+        int status = response_.statusCode;
+        if (headOnly || status == 204 || status == 304 || (status >= 100 && status < 200)) {
+            mode_ = BodyMode::None;
+        } else if (chunked) {
+            mode_ = BodyMode::Chunked;
+        } else if (response_.hasContentLength) {
+            mode_ = BodyMode::Length;
+            remaining_ = response_.contentLength;
+        } else {
+            mode_ = BodyMode::UntilClose;
+        }
+        finished_ = mode_ == BodyMode::None || (mode_ == BodyMode::Length && remaining_ == 0);
+        return true;
+    }
+
+    // Reads and drops a small body, so the connection can take the next request
+    void Drain()
+    {
+        std::vector<char> scratch(4096);
+        size_t total = 0;
+        size_t bytesRead = 0;
+        while (!finished_ && total < MAX_REDIRECT_BODY && Read(scratch.data(), scratch.size(), bytesRead) && bytesRead > 0) {
+            total += bytesRead;
+        }
+    }
+
+    bool Read(void* buffer, size_t size, size_t& bytesRead) override
+    {
+        bytesRead = 0;
+        if (finished_ || size == 0) {
+            return true;
+        }
+
+        if (mode_ == BodyMode::Chunked && remaining_ == 0) {
+            // Chunk boundary: "<hex size>[;ext]\r\n", size 0 ends the body
+            std::string line;
+            if (!ReadLine(line)) {
+                return false;
+            }
+            if (line.empty() && !ReadLine(line)) {
+                return false;
+            }
+            remaining_ = strtoull(line.c_str(), nullptr, 16);
+            if (remaining_ == 0) {
+                while (ReadLine(line) && !line.empty()) {
+                    // Trailers are ignored
+                }
+                finished_ = true;
+                return true;
+            }
+        }
+
+        size_t request = size;
+        if (mode_ != BodyMode::UntilClose) {
+            request = (size_t)std::min<uint64_t>(request, remaining_);
+        }
+
+        size_t received;
+        if (!Receive(buffer, request, received)) {
+            return false;
+        }
+
+        if (received == 0) {
+            // Connection closed: only legal for close-delimited bodies
+            finished_ = true;
+            return mode_ == BodyMode::UntilClose;
+        }
+
+        bytesRead = received;
+        if (mode_ != BodyMode::UntilClose) {
+            remaining_ -= received;
+            if (mode_ == BodyMode::Length && remaining_ == 0) {
+                finished_ = true;
+            }
+        }
+        return true;
+    }
+
+private:
+    bool Fill()
+    {
+        pos_ = 0;
+        end_ = 0;
+        if (!WaitReady(fd_, POLLIN, cancel_)) {
+            return false;
+        }
+        for (;;) {
+            ssize_t result = recv(fd_, buffer_.data(), buffer_.size(), 0);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result < 0) {
+                return false;
+            }
+            end_ = (size_t)result;
+            return true;
+        }
+    }
+
+    // Buffered bytes first, then large reads straight into the caller's buffer
+    bool Receive(void* destination, size_t size, size_t& received)
+    {
+        if (pos_ < end_) {
+            received = std::min(size, end_ - pos_);
+            memcpy(destination, buffer_.data() + pos_, received);
+            pos_ += received;
+            return true;
+        }
+
+        if (!WaitReady(fd_, POLLIN, cancel_)) {
+            return false;
+        }
+        for (;;) {
+            ssize_t result = recv(fd_, destination, size, 0);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result < 0) {
+                return false;
+            }
+            received = (size_t)result;
+            return true;
+        }
+    }
+
+    bool ReadLine(std::string& line)
+    {
+        line.clear();
+        for (;;) {
+            if (pos_ == end_ && (!Fill() || end_ == 0)) {
+                return false;
+            }
+            char ch = buffer_[pos_++];
+            if (ch == '\n') {
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                return true;
+            }
+            line += ch;
+            if (line.size() > 16 * 1024) {
+                return false;
+            }
+        }
+    }
+
+    int fd_;
+    std::shared_ptr<SocketHttpTransport::ConnectionPool> pool_;
+    std::string key_;
+    const CancellationToken* cancel_;
+    std::vector<char> buffer_;
+    size_t pos_;
+    size_t end_;
+    HttpResponse response_;
+    std::string location_;
+    BodyMode mode_;
+    uint64_t remaining_;
+    bool finished_;
+    bool keepAlive_;
+};
+
+// The peer closed an idle connection (or sent something unasked): not reusable
+bool IsStale(int fd)
+{
+    char probe;
+    ssize_t result = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+    return !(result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+} // namespace
+
+int SocketHttpTransport::ConnectionPool::Take(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+
+    // Most recently returned first: the likeliest to still be open
+    for (size_t i = idle_.size(); i-- > 0;) {
+        if (idle_[i].key != key && now - idle_[i].since < IDLE_TIMEOUT) {
+            continue;
+        }
+        int fd = idle_[i].fd;
+        bool usable = idle_[i].key == key && now - idle_[i].since < IDLE_TIMEOUT;
+        idle_.erase(idle_.begin() + i);
+        if (usable && !IsStale(fd)) {
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+void SocketHttpTransport::ConnectionPool::Give(const std::string& key, int fd)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = std::count_if(idle_.begin(), idle_.end(), [&key](const Idle& idle) { return idle.key == key; });
+    if (count >= MAX_IDLE_PER_HOST) {
+        close(fd);
+        return;
+    }
+    idle_.push_back({ key, fd, std::chrono::steady_clock::now() });
+}
+
+SocketHttpTransport::SocketHttpTransport()
+    : pool_(std::make_shared<ConnectionPool>())
+{
+}
+
+SocketHttpTransport::~SocketHttpTransport() = default;
+
+uint64_t SocketHttpTransport::ConnectionsOpened() const
+{
+    return pool_->opened;
+}
+
+std::unique_ptr<HttpStream> SocketHttpTransport::Open(const HttpRequest& request)
+{
+    std::string finalUrl;
+
+    // Straight to where this URL redirected last time
+    std::wstring target = redirects_.Resolve(request.url);
+    if (target != request.url) {
+        HttpRequest direct = request;
+        direct.url = target;
+        auto stream = Follow(direct, finalUrl);
+        if (stream && stream->Response().statusCode < 400) {
+            return stream;
+        }
+        if (request.cancel && request.cancel->IsCancelled()) {
+            return nullptr; // Says nothing about the target
+        }
+        redirects_.Forget(request.url);
+    }
+
+    auto stream = Follow(request, finalUrl);
+    if (stream && stream->Response().statusCode < 400) {
+        redirects_.Remember(request.url, FileSystem::FromUtf8(finalUrl));
+    }
+    return stream;
+}
+
+std::unique_ptr<HttpStream> SocketHttpTransport::Follow(const HttpRequest& request, std::string& finalUrl)
+{
+    std::string url = FileSystem::ToUtf8(request.url);
+
+    for (int redirect = 0; redirect <= MAX_REDIRECTS; ++redirect) {
+        ParsedUrl parsed;
+        if (!ParseUrl(url, parsed)) {
+            return nullptr;
+        }
+
+        std::string message = std::string(request.headOnly ? "HEAD " : "GET ") + parsed.path + " HTTP/1.1\r\n";
+        message += "Host: " + parsed.host + (parsed.port == "80" ? "" : ":" + parsed.port) + "\r\n";
+        message += "User-Agent: InstAnalyticsInstaller\r\n";
+        if (request.useRange) {
+            char range[96];
+            if (request.rangeLength > 0) {
+                snprintf(range, sizeof(range), "Range: bytes=%llu-%llu\r\n",
+                    (unsigned long long)request.rangeStart,
+                    (unsigned long long)(request.rangeStart + request.rangeLength - 1));
+            } else {
+                snprintf(range, sizeof(range), "Range: bytes=%llu-\r\n", (unsigned long long)request.rangeStart);
+            }
+            message += range;
+        }
+        if (!request.ifNoneMatch.empty()) {
+            message += "If-None-Match: " + FileSystem::ToUtf8(request.ifNoneMatch) + "\r\n";
+        }
+        if (!request.ifModifiedSince.empty()) {
+            message += "If-Modified-Since: " + FileSystem::ToUtf8(request.ifModifiedSince) + "\r\n";
+        }
+        message += "\r\n";
+
+        // A pooled connection the server has closed in the meantime fails on
+        // first use: that costs one retry on a fresh connection, nothing more
+        std::string key = parsed.host + ":" + parsed.port;
+        std::unique_ptr<SocketHttpStream> stream;
+        for (int attempt = 0; attempt < 2 && !stream; ++attempt) {
+            int fd = attempt == 0 ? pool_->Take(key) : -1;
+            bool reused = fd >= 0;
+            if (!reused) {
+                fd = Connect(parsed, request.cancel);
+                if (fd < 0) {
+                    return nullptr;
+                }
+                ++pool_->opened;
+            }
+
+            stream = std::make_unique<SocketHttpStream>(fd, pool_, key, request.cancel);
+            if (!SendAll(fd, message) || !stream->ReadHeaders(request.headOnly)) {
+                stream.reset();
+                if (!reused) {
+                    return nullptr;
+                }
+            }
+        }
+        if (!stream) {
+            return nullptr;
+        }
+
+        int status = stream->Response().statusCode;
+        bool isRedirect = status == 301 || status == 302 || status == 303 || status == 307 || status == 308;
+        if (!isRedirect || stream->Location().empty()) {
+            finalUrl = url;
+            return stream;
+        }
+
+        std::string location = stream->Location();
+        stream->Drain();
+        if (location[0] == '/') {
+            url = "http://" + parsed.host + ":" + parsed.port + location;
+        } else {
+            url = location;
+        }
+    }
+
+    return nullptr;
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,145 @@
+#include "StagedInstall.h"
+#include "FileSystem.h"
+#include "Trace.h"
+
+namespace InstAnalyticsInstaller {
+
+StagedInstall::StagedInstall(const std::wstring& installPath)
+    : installPath_(Normalized(installPath))
+    , stagingPath_(StagingPathFor(installPath))
+    , previousPath_(PreviousPathFor(installPath))
+    , committed_(false)
+{
+}
+
+StagedInstall::~StagedInstall()
+{
+    if (!committed_) {
+        Abort();
+    }
+}
+
+std::wstring StagedInstall::Normalized(const std::wstring& path)
+{
+    size_t end = path.find_last_not_of(L"/\\");
+    return end == std::wstring::npos ? path : path.substr(0, end + 1);
+}
+
+std::wstring StagedInstall::StagingPathFor(const std::wstring& installPath)
+{
+    return Normalized(installPath) + L".staging";
+}
+
+std::wstring StagedInstall::PreviousPathFor(const std::wstring& installPath)
+{
+    return Normalized(installPath) + L".previous";
+}
+
+bool StagedInstall::Recover(const std::wstring& installPath)
+{
+    std::wstring previous = PreviousPathFor(installPath);
+    if (FileSystem::DirectoryExists(Normalized(installPath)) || !FileSystem::DirectoryExists(previous)) {
+        return true;
+    }
+    return FileSystem::RenameDirectory(previous, Normalized(installPath));
+}
+
+bool StagedInstall::Prepare()
+{
+    TraceSpan span("install.prepare", "install");
+
+    committed_ = false;
+    return Recover(installPath_) && FileSystem::RemoveTree(stagingPath_) &&
+           FileSystem::CreateDirectories(stagingPath_);
+}
+
+bool StagedInstall::Commit()
+{
+    TraceSpan span("install.switch", "install");
+
+    if (!FileSystem::RemoveTree(previousPath_)) {
+        return false;
+    }
+
+    bool hadInstall = FileSystem::DirectoryExists(installPath_);
+    if (hadInstall && !FileSystem::RenameDirectory(installPath_, previousPath_)) {
+        return false;
+    }
+    if (!FileSystem::RenameDirectory(stagingPath_, installPath_)) {
+        if (hadInstall) {
+            FileSystem::RenameDirectory(previousPath_, installPath_);
+        }
+        return false;
+    }
+
+    committed_ = true;
+    return true;
+}
+
+bool StagedInstall::CarryOver(const std::wstring& relativePath)
+{
+    std::wstring target = FileSystem::JoinPath(stagingPath_, relativePath);
+    return FileSystem::CreateDirectories(FileSystem::ParentPath(target)) &&
+           FileSystem::LinkFile(FileSystem::JoinPath(installPath_, relativePath), target);
+}
+
+bool StagedInstall::CarryOverAll(const std::set<std::wstring>& skip)
+{
+    TraceSpan span("install.carry-over", "install");
+    return CarryOverDirectory(L"", skip);
+}
+
+bool StagedInstall::CarryOverDirectory(const std::wstring& relativePath, const std::set<std::wstring>& skip)
+{
+    std::vector<DirectoryEntry> entries;
+    if (!FileSystem::ListDirectory(FileSystem::JoinPath(installPath_, relativePath), entries) ||
+        !FileSystem::CreateDirectories(FileSystem::JoinPath(stagingPath_, relativePath))) {
+        return false;
+    }
+
+    for (const DirectoryEntry& entry : entries) {
+        std::wstring path = relativePath.empty() ? entry.name : relativePath + L"/" + entry.name;
+        if (skip.count(path)) {
+            continue;
+        }
+        if (entry.isDirectory ? !CarryOverDirectory(path, skip) : !CarryOver(path)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StagedInstall::Abort()
+{
+    FileSystem::RemoveTree(stagingPath_);
+}
+
+bool StagedInstall::Rollback(const std::wstring& installPath)
+{
+    std::wstring install = Normalized(installPath);
+    std::wstring previous = PreviousPathFor(installPath);
+    if (!FileSystem::DirectoryExists(previous)) {
+        return false;
+    }
+    if (!FileSystem::DirectoryExists(install)) {
+        return FileSystem::RenameDirectory(previous, install);
+    }
+
+    // Three renames through a temporary name, each one undone if the next fails
+    std::wstring swap = install + L".rollback";
+    if (!FileSystem::RemoveTree(swap) || !FileSystem::RenameDirectory(install, swap)) {
+        return false;
+    }
+    if (!FileSystem::RenameDirectory(previous, install)) {
+        FileSystem::RenameDirectory(swap, install);
+        return false;
+    }
+    if (!FileSystem::RenameDirectory(swap, previous)) {
+        FileSystem::RenameDirectory(install, previous);
+        FileSystem::RenameDirectory(swap, install);
+        return false;
+    }
+    return true;
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,118 @@
+#include "Stream.h"
+#include <algorithm>
+
+namespace InstAnalyticsInstaller {
+
+// ============================================================================
+// FileInput
+// ============================================================================
+
+bool FileInput::Open(const std::wstring& path)
+{
+    size_ = 0;
+    return file_.Open(path, File::Mode::Read) && file_.GetSize(size_);
+}
+
+bool FileInput::ReadAt(uint64_t offset, void* buffer, size_t size, size_t& bytesRead)
+{
+    return file_.ReadAt(offset, buffer, size, bytesRead);
+}
+
+// ============================================================================
+// RangeInputStream
+// ============================================================================
+
+RangeInputStream::RangeInputStream(RandomAccessInput& input, uint64_t offset, uint64_t length)
+    : input_(input)
+    , position_(offset)
+    , end_(offset + length)
+{
+}
+
+bool RangeInputStream::Read(void* buffer, size_t size, size_t& bytesRead)
+{
+    bytesRead = 0;
+    if (position_ >= end_) {
+        return true;
+    }
+
+    size_t request = (size_t)std::min<uint64_t>(size, end_ - position_);
+    if (!input_.ReadAt(position_, buffer, request, bytesRead)) {
+        return false;
+    }
+
+    position_ += bytesRead;
+    return true;
+}
+
+// ============================================================================
+// ByteReader
+// ============================================================================
+
+ByteReader::ByteReader(InputStream& stream, size_t bufferSize)
+    : stream_(stream)
+    , buffer_(HISTORY + std::max<size_t>(bufferSize, 4096))
+    , pos_(HISTORY)
+    , end_(HISTORY)
+    , base_(0 - (uint64_t)HISTORY)
+    , failed_(false)
+{
+}
+
+bool ByteReader::Fill()
+{
+    if (failed_) {
+        return false;
+    }
+
+    // Keep the tail of the previous block so Unget stays valid across refills
+    memmove(buffer_.data(), buffer_.data() + end_ - HISTORY, HISTORY);
+    base_ += end_ - HISTORY;
+    pos_ = HISTORY;
+    end_ = HISTORY;
+
+    size_t bytesRead = 0;
+    if (!stream_.Read(buffer_.data() + HISTORY, buffer_.size() - HISTORY, bytesRead)) {
+        failed_ = true;
+        return false;
+    }
+
+    end_ = HISTORY + bytesRead;
+    return bytesRead > 0;
+}
+
+bool ByteReader::ReadExact(void* destination, size_t size)
+{
+    uint8_t* cursor = (uint8_t*)destination;
+
+    while (size > 0) {
+        if (pos_ == end_ && !Fill()) {
+            return false;
+        }
+
+        size_t chunk = std::min(size, end_ - pos_);
+        memcpy(cursor, buffer_.data() + pos_, chunk);
+        pos_ += chunk;
+        cursor += chunk;
+        size -= chunk;
+    }
+
+    return true;
+}
+
+bool ByteReader::Skip(uint64_t size)
+{
+    while (size > 0) {
+        if (pos_ == end_ && !Fill()) {
+            return false;
+        }
+
+        size_t chunk = (size_t)std::min<uint64_t>(size, end_ - pos_);
+        pos_ += chunk;
+        size -= chunk;
+    }
+
+    return true;
+}
+
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,97 @@
+#include "StreamPipe.h"
+#include <algorithm>
+
+namespace InstAnalyticsInstaller {
+
+StreamPipe::StreamPipe(size_t capacity)
+    : buffer_(std::max<size_t>(capacity, 4096))
+    , head_(0)
+    , size_(0)
+    , closed_(false)
+    , aborted_(false)
+{
+}
+
+bool StreamPipe::Read(void* buffer, size_t size, size_t& bytesRead)
+{
+    bytesRead = 0;
+    if (size == 0) {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    readable_.wait(lock, [this] { return size_ > 0 || closed_ || aborted_; });
+
+    if (aborted_) {
+        return false;
+    }
+
+    // At most two copies: up to the end of the ring, then from its start
+    uint8_t* cursor = (uint8_t*)buffer;
+    size_t wanted = std::min(size, size_);
+    while (bytesRead < wanted) {
+        size_t chunk = std::min(wanted - bytesRead, buffer_.size() - head_);
+        memcpy(cursor + bytesRead, buffer_.data() + head_, chunk);
+        head_ = (head_ + chunk) % buffer_.size();
+        bytesRead += chunk;
+    }
+    size_ -= bytesRead;
+
+    lock.unlock();
+    writable_.notify_one();
+    return true;
+}
+
+bool StreamPipe::Write(const void* data, size_t size)
+{
+    const uint8_t* cursor = (const uint8_t*)data;
+
+    while (size > 0) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        writable_.wait(lock, [this] { return size_ < buffer_.size() || aborted_; });
+
+        if (aborted_ || closed_) {
+            return false;
+        }
+
+        size_t tail = (head_ + size_) % buffer_.size();
+        size_t chunk = std::min(size, buffer_.size() - size_);
+        chunk = std::min(chunk, buffer_.size() - tail);
+        memcpy(buffer_.data() + tail, cursor, chunk);
+        size_ += chunk;
+        cursor += chunk;
+        size -= chunk;
+
+        lock.unlock();
+        readable_.notify_one();
+    }
+
+    return true;
+}
+
+void StreamPipe::CloseWrite()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+    }
+    readable_.notify_all();
+}
+
+void StreamPipe::Abort()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        aborted_ = true;
+    }
+    readable_.notify_all();
+    writable_.notify_all();
+}
+
+bool StreamPipe::Aborted() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return aborted_;
+}
+
+} // namespace InstAnalyticsInstaller
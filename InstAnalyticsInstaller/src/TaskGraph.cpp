@@ -0,0 +1,245 @@
+#include "TaskGraph.h"
+#include "FileSystem.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace InstAnalyticsInstaller {
+
+TaskGraph::TaskGraph()
+    : running_(0)
+    , stopping_(false)
+    , cancelled_(false)
+    , failedTask_(NO_TASK)
+    , reported_(-1)
+{
+}
+
+TaskGraph::~TaskGraph()
+{
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+TaskGraph::TaskId TaskGraph::Add(const std::wstring& name, unsigned weight, TaskFunction run,
+    const std::vector<TaskId>& dependencies)
+{
+    TaskId id = tasks_.size();
+    Task task;
+    task.name = name;
+    task.weight = weight;
+    task.run = run;
+    task.waitingFor = 0;
+    task.state = TaskState::Pending;
+    task.progress = 0;
+
+    for (TaskId dependency : dependencies) {
+        if (dependency < id) {
+            tasks_[dependency].dependents.push_back(id);
+            ++task.waitingFor;
+        }
+    }
+
+    tasks_.push_back(std::move(task));
+    return id;
+}
+
+void TaskGraph::SetCancelHandler(TaskId task, std::function<void()> handler)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_[task].cancelHandler = handler;
+}
+
+bool TaskGraph::Run(ReportCallback callback)
+{
+    callback_ = callback;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (TaskId id = 0; id < tasks_.size(); ++id) {
+            if (tasks_[id].waitingFor == 0 && !stopping_) {
+                Start(id);
+            }
+        }
+        finished_.wait(lock, [this] { return running_ == 0; });
+    }
+
+    // No task starts once running_ is zero, so the list is final
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+
+    // Whatever never became ready was skipped
+    std::vector<TaskId> skipped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (TaskId id = 0; id < tasks_.size(); ++id) {
+            if (tasks_[id].state == TaskState::Pending) {
+                tasks_[id].state = TaskState::Skipped;
+                skipped.push_back(id);
+            }
+        }
+    }
+    for (TaskId id : skipped) {
+        if (stateCallback_) {
+            stateCallback_(id, TaskState::Skipped);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !stopping_ && std::all_of(tasks_.begin(), tasks_.end(),
+        [](const Task& task) { return task.state == TaskState::Succeeded; });
+}
+
+void TaskGraph::Start(TaskId task)
+{
+    tasks_[task].state = TaskState::Running;
+    ++running_;
+    threads_.emplace_back(&TaskGraph::Execute, this, task);
+}
+
+void TaskGraph::Execute(TaskId id)
+{
+    ReportCallback report = [this, id](int progress, const std::wstring& status) {
+        Report(id, progress, status);
+    };
+
+    if (Trace::Enabled()) {
+        Trace::SetThreadName("task " + FileSystem::ToUtf8(tasks_[id].name));
+    }
+
+    if (stateCallback_) {
+        stateCallback_(id, TaskState::Running);
+    }
+
+    bool success = false;
+    try {
+        success = tasks_[id].run(report);
+    } catch (...) {
+        success = false;
+    }
+
+    if (success) {
+        Report(id, 100, L"");
+    }
+
+    bool stop = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Task& task = tasks_[id];
+        task.state = success ? TaskState::Succeeded : TaskState::Failed;
+
+        if (!success && !stopping_) {
+            failedTask_ = id;
+            stopping_ = true;
+            stop = true;
+        }
+    }
+
+    // Reported before the dependents start, so observers see phases in order
+    if (stateCallback_) {
+        stateCallback_(id, success ? TaskState::Succeeded : TaskState::Failed);
+    }
+
+    if (success) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stopping_) {
+            for (TaskId dependent : tasks_[id].dependents) {
+                if (--tasks_[dependent].waitingFor == 0) {
+                    Start(dependent);
+                }
+            }
+        }
+    }
+
+    // A failed phase takes the phases running beside it down with it
+    if (stop) {
+        StopAll();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--running_ == 0) {
+        finished_.notify_all();
+    }
+}
+
+void TaskGraph::Report(TaskId id, int progress, const std::wstring& status)
+{
+    std::lock_guard<std::mutex> lock(reportMutex_);
+
+    Task& task = tasks_[id];
+    task.progress = std::max(task.progress, std::min(std::max(progress, 0), 100));
+
+    uint64_t total = 0;
+    uint64_t done = 0;
+    for (const auto& other : tasks_) {
+        total += other.weight;
+        done += (uint64_t)other.weight * other.progress;
+    }
+
+    // Completion reports carry no status: they only move the bar
+    int overall = total > 0 ? (int)(done / total) : 0;
+    if (!callback_ || (overall <= reported_ && status.empty())) {
+        return;
+    }
+    if (!status.empty()) {
+        status_ = status;
+    }
+    reported_ = std::max(reported_, overall);
+    callback_(reported_, status_);
+}
+
+void TaskGraph::Cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        cancelled_ = true;
+        stopping_ = true;
+    }
+    StopAll();
+}
+
+void TaskGraph::StopAll()
+{
+    std::vector<std::function<void()>> handlers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& task : tasks_) {
+            if (task.state == TaskState::Running && task.cancelHandler) {
+                handlers.push_back(task.cancelHandler);
+            }
+        }
+    }
+
+    // Outside the lock: handlers may block briefly (closing connections)
+    for (auto& handler : handlers) {
+        handler();
+    }
+}
+
+bool TaskGraph::Cancelled() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cancelled_;
+}
+
+TaskGraph::TaskState TaskGraph::State(TaskId task) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tasks_[task].state;
+}
+
+TaskGraph::TaskId TaskGraph::FailedTask() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failedTask_;
+}
+
+} // namespace InstAnalyticsInstaller
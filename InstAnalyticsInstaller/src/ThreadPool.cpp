@@ -0,0 +1,135 @@
+#include "ThreadPool.h"
+#include "Trace.h"
+
+namespace InstAnalyticsInstaller {
+
+ThreadPool::ThreadPool(unsigned threadCount)
+    : queued_(0)
+    , outstanding_(0)
+    , nextQueue_(0)
+    , stopping_(false)
+{
+    if (threadCount == 0) {
+        threadCount = DefaultThreadCount();
+    }
+
+    for (unsigned i = 0; i < threadCount; ++i) {
+        queues_.push_back(std::make_unique<WorkQueue>());
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    Wait();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+unsigned ThreadPool::DefaultThreadCount()
+{
+    unsigned count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+void ThreadPool::Submit(Task task)
+{
+    unsigned target;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        target = nextQueue_++ % (unsigned)queues_.size();
+        ++outstanding_;
+        ++queued_; // Counted before the push so workers never over-decrement
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+        queues_[target]->tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return outstanding_ == 0; });
+}
+
+bool ThreadPool::TryPop(unsigned index, Task& task)
+{
+    WorkQueue& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool ThreadPool::TrySteal(unsigned index, Task& task)
+{
+    unsigned count = (unsigned)queues_.size();
+    for (unsigned offset = 1; offset < count; ++offset) {
+        WorkQueue& victim = *queues_[(index + offset) % count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::WorkerLoop(unsigned index)
+{
+    if (Trace::Enabled()) {
+        Trace::SetThreadName("pool worker " + std::to_string(index));
+    }
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+            if (queued_ == 0 && stopping_) {
+                return;
+            }
+        }
+
+        Task task;
+        if (!TryPop(index, task) && !TrySteal(index, task)) {
+            // Another worker got there first, or the push is still landing
+            std::this_thread::yield();
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --queued_;
+        }
+
+        task(index);
+
+        bool idle;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle = --outstanding_ == 0;
+        }
+        if (idle) {
+            idle_.notify_all();
+        }
+    }
+}
+
+} // namespace InstAnalyticsInstaller
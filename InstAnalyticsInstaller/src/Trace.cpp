@@ -0,0 +1,178 @@
+#include "Trace.h"
+#include "FileSystem.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+// Per thread; when it wraps, the oldest events are lost first. Spans are
+// recorded when they end, so the long outer ones survive the longest
+constexpr size_t RING_CAPACITY = 8192;
+
+struct ThreadBuffer {
+    unsigned id;
+    std::string name;
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> written{ 0 };
+};
+
+std::mutex g_buffersMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;      // Kept after their threads exit
+std::chrono::steady_clock::time_point g_epoch;
+
+thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+
+ThreadBuffer& CurrentBuffer()
+{
+    if (!t_buffer) {
+        auto buffer = std::make_shared<ThreadBuffer>();
+        buffer->events.resize(RING_CAPACITY);
+
+        std::lock_guard<std::mutex> lock(g_buffersMutex);
+        buffer->id = (unsigned)g_buffers.size() + 1;
+        g_buffers.push_back(buffer);
+        t_buffer = buffer;
+    }
+    return *t_buffer;
+}
+
+void AppendEscaped(std::string& out, const std::string& text)
+{
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c >= 0x20) {
+            out += c;
+        }
+    }
+}
+
+void AppendMicroseconds(std::string& out, uint64_t nanoseconds)
+{
+    char number[32];
+    snprintf(number, sizeof(number), "%llu.%03u",
+        (unsigned long long)(nanoseconds / 1000), (unsigned)(nanoseconds % 1000));
+    out += number;
+}
+
+} // namespace
+
+std::atomic<bool> Trace::enabled_(false);
+
+void Trace::Enable()
+{
+    if (!enabled_) {
+        g_epoch = std::chrono::steady_clock::now();
+        enabled_ = true;
+    }
+}
+
+uint64_t Trace::Now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+void Trace::Record(const TraceEvent& event)
+{
+    ThreadBuffer& buffer = CurrentBuffer();
+    uint64_t index = buffer.written.load(std::memory_order_relaxed);
+    buffer.events[index % RING_CAPACITY] = event;
+    buffer.written.store(index + 1, std::memory_order_release);
+}
+
+void Trace::Counter(const char* name, int64_t value)
+{
+    if (!Enabled()) {
+        return;
+    }
+
+    TraceEvent event;
+    event.name = name;
+    event.category = "counter";
+    event.type = 'C';
+    event.start = Now();
+    event.duration = 0;
+    event.argCount = 1;
+    event.argNames[0] = "value";
+    event.argValues[0] = value;
+    Record(event);
+}
+
+void Trace::SetThreadName(const std::string& name)
+{
+    if (Enabled()) {
+        CurrentBuffer().name = name;
+    }
+}
+
+bool Trace::WriteChromeTrace(const std::wstring& path)
+{
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lock(g_buffersMutex);
+        buffers = g_buffers;
+    }
+
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    auto begin = [&] {
+        if (!first) {
+            json += ",\n";
+        }
+        first = false;
+    };
+
+    for (const auto& buffer : buffers) {
+        std::string tid = std::to_string(buffer->id);
+
+        if (!buffer->name.empty()) {
+            begin();
+            json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"";
+            AppendEscaped(json, buffer->name);
+            json += "\"}}";
+        }
+
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t count = written < RING_CAPACITY ? written : RING_CAPACITY;
+        for (uint64_t i = written - count; i < written; ++i) {
+            const TraceEvent& event = buffer->events[i % RING_CAPACITY];
+
+            begin();
+            json += "{\"name\":\"";
+            AppendEscaped(json, event.name);
+            json += "\",\"cat\":\"";
+            AppendEscaped(json, event.category);
+            json += "\",\"ph\":\"";
+            json += event.type;
+            json += "\",\"pid\":1,\"tid\":" + tid + ",\"ts\":";
+            AppendMicroseconds(json, event.start);
+            if (event.type == 'X') {
+                json += ",\"dur\":";
+                AppendMicroseconds(json, event.duration);
+            }
+
+            if (event.argCount > 0) {
+                json += ",\"args\":{";
+                for (unsigned arg = 0; arg < event.argCount; ++arg) {
+                    json += arg > 0 ? ",\"" : "\"";
+                    AppendEscaped(json, event.argNames[arg]);
+                    json += "\":" + std::to_string(event.argValues[arg]);
+                }
+                json += "}";
+            }
+            json += "}";
+        }
+    }
+    json += "\n]}\n";
+
+    File file;
+    return file.Open(path, File::Mode::Write) && file.Write(json.data(), json.size());
+}
+
+} // namespace InstAnalyticsInstaller
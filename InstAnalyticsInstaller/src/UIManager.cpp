@@ -25,6 +25,9 @@ constexpr int ID_PROGRESS_BAR = 1006;
 constexpr int ID_STATUS_LABEL = 1007;
 constexpr int ID_CANCEL_BUTTON = 1008;
 
+constexpr UINT_PTR ID_PROGRESS_TIMER = 1;
+constexpr UINT PROGRESS_REFRESH_MS = 100;
+
 UIManager::UIManager(HINSTANCE hInstance)
     : hInstance_(hInstance)
     , hwnd_(nullptr)
@@ -47,6 +50,7 @@ UIManager::UIManager(HINSTANCE hInstance)
     , isDragging_(false)
     , hoveredButton_(nullptr)
     , trackingMouse_(false)
+    , shownProgressVersion_(0)
 {
     dragPoint_ = { 0, 0 };
 }
@@ -136,6 +140,9 @@ bool UIManager::Initialize()
     CreateControls();
     UpdateUI();
 
+    // Progress is sampled at a fixed rate instead of pushed by every worker update
+    SetTimer(hwnd_, ID_PROGRESS_TIMER, PROGRESS_REFRESH_MS, nullptr);
+
     return true;
 }
 
@@ -271,6 +278,23 @@ void UIManager::SetState(InstallState state)
 
 void UIManager::UpdateProgress(int progress, const std::wstring& status)
 {
+    progress_.Publish(progress, status);
+}
+
+void UIManager::ApplyProgress()
+{
+    int progress;
+    std::wstring status;
+    if (!progress_.Sample(shownProgressVersion_, progress, status)) {
+        return;
+    }
+
+    // Final states own the label; a late sample must not overwrite them
+    if (currentState_ == InstallState::Completed || currentState_ == InstallState::Error ||
+        currentState_ == InstallState::Welcome) {
+        return;
+    }
+
     SendMessage(progressBar_, PBM_SETPOS, progress, 0);
     SetWindowText(statusLabel_, status.c_str());
 }
@@ -298,6 +322,7 @@ void UIManager::UpdateUI()
     case InstallState::InstallingDotNet:
     case InstallState::DownloadingApp:
     case InstallState::ExtractingApp:
+    case InstallState::VerifyingApp:
         EnableWindow(installButton_, FALSE);
         EnableWindow(pathEdit_, FALSE);
         EnableWindow(browseButton_, FALSE);
@@ -313,6 +338,8 @@ void UIManager::UpdateUI()
             SetWindowText(statusLabel_, L"Download InstAnalytics in corso...");
         else if (currentState_ == InstallState::ExtractingApp)
             SetWindowText(statusLabel_, L"Estrazione files in corso...");
+        else if (currentState_ == InstallState::VerifyingApp)
+            SetWindowText(statusLabel_, L"Verifica dei file installati...");
         break;
 
     case InstallState::Completed:
@@ -419,6 +446,11 @@ void UIManager::OnCancelButtonClick()
     // User clicked Yes - always close the application
     if (result == IDYES) {
         LogDebug(L"User clicked YES - closing application");
+        // Returns once the installation has stopped or the wait gave up, so
+        // the worker never reports into a destroyed window
+        if (isInstalling && cancelCallback_) {
+            cancelCallback_();
+        }
         DestroyWindow(hwnd_);
         LogDebug(L"After DestroyWindow");
     } else {
@@ -510,9 +542,17 @@ LRESULT UIManager::HandleMessage(UINT uMsg, WPARAM wParam, LPARAM lParam)
 
     case WM_DESTROY:
         LogDebug(L"WM_DESTROY received, calling PostQuitMessage(0)");
+        KillTimer(hwnd_, ID_PROGRESS_TIMER);
         PostQuitMessage(0);
         return 0;
 
+    case WM_TIMER:
+        if (wParam == ID_PROGRESS_TIMER) {
+            ApplyProgress();
+            return 0;
+        }
+        break;
+
     case WM_LBUTTONDOWN:
         if (HIWORD(lParam) < WindowSize::TITLE_BAR_HEIGHT) {
             isDragging_ = true;
@@ -0,0 +1,274 @@
+#include "WinInetTransport.h"
+#include "CancellationToken.h"
+#include <atomic>
+#include <vector>
+
+#pragma comment(lib, "wininet.lib")
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+std::wstring QueryString(HINTERNET request, DWORD info)
+{
+    wchar_t buffer[512];
+    DWORD size = sizeof(buffer);
+    DWORD index = 0;
+    if (!HttpQueryInfoW(request, info, buffer, &size, &index)) {
+        return L"";
+    }
+    return std::wstring(buffer, size / sizeof(wchar_t));
+}
+
+// The final URL of a request, after the redirects WinINet followed
+std::wstring QueryUrl(HINTERNET request)
+{
+    DWORD size = 0;
+    InternetQueryOptionW(request, INTERNET_OPTION_URL, nullptr, &size);
+    if (size == 0) {
+        return L"";
+    }
+    std::vector<wchar_t> buffer(size / sizeof(wchar_t) + 1);
+    if (!InternetQueryOptionW(request, INTERNET_OPTION_URL, buffer.data(), &size)) {
+        return L"";
+    }
+    return std::wstring(buffer.data());
+}
+
+// A request handle that the request's cancellation token closes: closing it
+// is what makes a blocked HttpSendRequest or InternetReadFile return
+class RequestHandle {
+public:
+    RequestHandle(HINTERNET request, const CancellationToken* cancel)
+        : request_(request)
+        , wait_(nullptr)
+    {
+        if (cancel && cancel->WaitHandle()) {
+            RegisterWaitForSingleObject(&wait_, (HANDLE)cancel->WaitHandle(), &RequestHandle::OnCancel, this,
+                INFINITE, WT_EXECUTEONLYONCE);
+        }
+    }
+
+    ~RequestHandle()
+    {
+        // Waits for a callback in flight, so it never sees a dead object
+        if (wait_) {
+            UnregisterWaitEx(wait_, INVALID_HANDLE_VALUE);
+        }
+        Close();
+    }
+
+    RequestHandle(const RequestHandle&) = delete;
+    RequestHandle& operator=(const RequestHandle&) = delete;
+
+    // nullptr once cancelled; WinINet fails calls on it
+    HINTERNET Get() const { return request_.load(); }
+
+private:
+    static VOID CALLBACK OnCancel(PVOID context, BOOLEAN)
+    {
+        static_cast<RequestHandle*>(context)->Close();
+    }
+
+    void Close()
+    {
+        HINTERNET request = request_.exchange(nullptr);
+        if (request) {
+            InternetCloseHandle(request);
+        }
+    }
+
+    std::atomic<HINTERNET> request_;
+    HANDLE wait_;
+};
+
+// Owns the request handle only: the connection belongs to the transport
+class WinInetStream : public HttpStream {
+public:
+    explicit WinInetStream(std::unique_ptr<RequestHandle> handle)
+        : handle_(std::move(handle))
+    {
+        HINTERNET request = handle_->Get();
+        DWORD status = 0;
+        DWORD size = sizeof(status);
+        DWORD index = 0;
+        HttpQueryInfoW(request, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &status, &size, &index);
+        response_.statusCode = (int)status;
+
+        std::wstring contentLength = QueryString(request, HTTP_QUERY_CONTENT_LENGTH);
+        if (!contentLength.empty()) {
+            response_.hasContentLength = true;
+            response_.contentLength = _wcstoui64(contentLength.c_str(), nullptr, 10);
+        }
+
+        response_.acceptRanges = QueryString(request, HTTP_QUERY_ACCEPT_RANGES).find(L"bytes") != std::wstring::npos;
+        response_.etag = QueryString(request, HTTP_QUERY_ETAG);
+        response_.lastModified = QueryString(request, HTTP_QUERY_LAST_MODIFIED);
+
+        // "bytes 0-1023/146515"
+        std::wstring contentRange = QueryString(request, HTTP_QUERY_CONTENT_RANGE);
+        size_t space = contentRange.find(L' ');
+        if (space != std::wstring::npos) {
+            response_.rangeStart = _wcstoui64(contentRange.c_str() + space + 1, nullptr, 10);
+        }
+        size_t slash = contentRange.find(L'/');
+        if (slash != std::wstring::npos && contentRange[slash + 1] != L'*') {
+            response_.totalLength = _wcstoui64(contentRange.c_str() + slash + 1, nullptr, 10);
+            response_.acceptRanges = true;
+        } else if (response_.statusCode == 200 && response_.hasContentLength) {
+            response_.totalLength = response_.contentLength;
+        }
+    }
+
+    const HttpResponse& Response() const override { return response_; }
+
+    bool Read(void* buffer, size_t size, size_t& bytesRead) override
+    {
+        DWORD read = 0;
+        DWORD request = size > MAXDWORD ? MAXDWORD : (DWORD)size;
+        if (!InternetReadFile(handle_->Get(), buffer, request, &read)) {
+            bytesRead = 0;
+            return false;
+        }
+        bytesRead = read;
+        return true;
+    }
+
+private:
+    std::unique_ptr<RequestHandle> handle_;
+    HttpResponse response_;
+};
+
+} // namespace
+
+WinInetTransport::WinInetTransport()
+{
+    session_ = InternetOpenW(L"InstAnalyticsInstaller",
+        INTERNET_OPEN_TYPE_DIRECT, nullptr, nullptr, 0);
+}
+
+WinInetTransport::~WinInetTransport()
+{
+    for (const auto& connection : connections_) {
+        InternetCloseHandle(connection.second);
+    }
+    if (session_) {
+        InternetCloseHandle(session_);
+    }
+}
+
+std::unique_ptr<HttpStream> WinInetTransport::Open(const HttpRequest& request)
+{
+    std::wstring finalUrl;
+
+    // Straight to where this URL redirected last time
+    std::wstring target = redirects_.Resolve(request.url);
+    if (target != request.url) {
+        HttpRequest direct = request;
+        direct.url = target;
+        auto stream = OpenUrl(direct, finalUrl);
+        if (stream && stream->Response().statusCode < 400) {
+            return stream;
+        }
+        if (request.cancel && request.cancel->IsCancelled()) {
+            return nullptr; // Says nothing about the target
+        }
+        redirects_.Forget(request.url);
+    }
+
+    auto stream = OpenUrl(request, finalUrl);
+    if (stream && stream->Response().statusCode < 400 && !finalUrl.empty()) {
+        redirects_.Remember(request.url, finalUrl);
+    }
+    return stream;
+}
+
+HINTERNET WinInetTransport::Connection(const std::wstring& host, INTERNET_PORT port)
+{
+    std::wstring key = host + L":" + std::to_wstring(port);
+
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    auto existing = connections_.find(key);
+    if (existing != connections_.end()) {
+        return existing->second;
+    }
+
+    HINTERNET connection = InternetConnectW(session_, host.c_str(), port,
+        nullptr, nullptr, INTERNET_SERVICE_HTTP, 0, 0);
+    if (connection) {
+        connections_[key] = connection;
+    }
+    return connection;
+}
+
+std::unique_ptr<HttpStream> WinInetTransport::OpenUrl(const HttpRequest& request, std::wstring& finalUrl)
+{
+    if (!session_) {
+        return nullptr;
+    }
+
+    std::vector<wchar_t> host(256);
+    std::vector<wchar_t> path(4096);
+    std::vector<wchar_t> extra(4096);
+
+    URL_COMPONENTSW parts = {};
+    parts.dwStructSize = sizeof(parts);
+    parts.lpszHostName = host.data();
+    parts.dwHostNameLength = (DWORD)host.size();
+    parts.lpszUrlPath = path.data();
+    parts.dwUrlPathLength = (DWORD)path.size();
+    parts.lpszExtraInfo = extra.data();
+    parts.dwExtraInfoLength = (DWORD)extra.size();
+
+    if (!InternetCrackUrlW(request.url.c_str(), 0, 0, &parts)) {
+        return nullptr;
+    }
+
+    HINTERNET connection = Connection(host.data(), parts.nPort);
+    if (!connection) {
+        return nullptr;
+    }
+
+    // Redirects (e.g. GitHub release assets) are followed automatically; Open
+    // remembers where they led
+    DWORD flags = INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_KEEP_CONNECTION;
+    if (parts.nScheme == INTERNET_SCHEME_HTTPS) {
+        flags |= INTERNET_FLAG_SECURE;
+    }
+
+    std::wstring object = std::wstring(path.data()) + extra.data();
+    HINTERNET httpRequest = HttpOpenRequestW(connection, request.headOnly ? L"HEAD" : L"GET",
+        object.c_str(), nullptr, nullptr, nullptr, flags, 0);
+    if (!httpRequest) {
+        return nullptr;
+    }
+    auto handle = std::make_unique<RequestHandle>(httpRequest, request.cancel);
+
+    std::wstring headers;
+    if (request.useRange) {
+        wchar_t range[96];
+        if (request.rangeLength > 0) {
+            swprintf_s(range, L"Range: bytes=%llu-%llu\r\n", request.rangeStart,
+                request.rangeStart + request.rangeLength - 1);
+        } else {
+            swprintf_s(range, L"Range: bytes=%llu-\r\n", request.rangeStart);
+        }
+        headers += range;
+    }
+    if (!request.ifNoneMatch.empty()) {
+        headers += L"If-None-Match: " + request.ifNoneMatch + L"\r\n";
+    }
+    if (!request.ifModifiedSince.empty()) {
+        headers += L"If-Modified-Since: " + request.ifModifiedSince + L"\r\n";
+    }
+
+    if (!HttpSendRequestW(handle->Get(), headers.empty() ? nullptr : headers.c_str(),
+            (DWORD)headers.size(), nullptr, 0)) {
+        return nullptr;
+    }
+
+    finalUrl = QueryUrl(handle->Get());
+    return std::make_unique<WinInetStream>(std::move(handle));
+}
+
+} // namespace InstAnalyticsInstaller
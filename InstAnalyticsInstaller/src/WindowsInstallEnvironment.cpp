@@ -0,0 +1,50 @@
+#include "WindowsInstallEnvironment.h"
+#include "DotNetChecker.h"
+
+namespace InstAnalyticsInstaller {
+
+bool WindowsInstallEnvironment::IsDotNetInstalled()
+{
+    return DotNetChecker::IsDotNet10Installed();
+}
+
+std::wstring WindowsInstallEnvironment::DotNetDownloadUrl()
+{
+    return DotNetChecker::GetDotNetDownloadUrl();
+}
+
+std::vector<std::wstring> WindowsInstallEnvironment::DotNetMirrors()
+{
+    return DotNetChecker::GetDotNetMirrors();
+}
+
+std::wstring WindowsInstallEnvironment::DotNetDownloadSha256()
+{
+    return DotNetChecker::GetDotNetDownloadSha256();
+}
+
+bool WindowsInstallEnvironment::IsTrustedDotNetInstaller(const std::wstring& installerPath)
+{
+    return DotNetChecker::IsSignedByMicrosoft(installerPath);
+}
+
+bool WindowsInstallEnvironment::InstallDotNet(const std::wstring& installerPath, const ProgressCallback& callback,
+    const std::shared_ptr<CancellationToken>& cancel, unsigned long& exitCode)
+{
+    dotnetInstaller_.SetCancellationToken(cancel);
+    bool success = dotnetInstaller_.InstallDotNet(installerPath, callback);
+    exitCode = dotnetInstaller_.GetLastExitCode();
+    return success;
+}
+
+bool WindowsInstallEnvironment::ConfigureDotNetPath()
+{
+    return DotNetChecker::VerifyAndFixDotNetPath();
+}
+
+bool WindowsInstallEnvironment::CreateShortcuts(const std::wstring& installPath)
+{
+    return shortcutInstaller_.CreateShortcuts(installPath);
+}
+
+} // namespace InstAnalyticsInstaller
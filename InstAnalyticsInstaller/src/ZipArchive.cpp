@@ -0,0 +1,451 @@
+#include "ZipArchive.h"
+#include <algorithm>
+#include <cstring>
+
+namespace InstAnalyticsInstaller {
+
+namespace {
+
+constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+constexpr uint32_t END_OF_CENTRAL_DIR_SIGNATURE = 0x06054b50;
+constexpr uint32_t ZIP64_END_OF_CENTRAL_DIR_SIGNATURE = 0x06064b50;
+constexpr uint32_t ZIP64_LOCATOR_SIGNATURE = 0x07064b50;
+constexpr uint32_t DATA_DESCRIPTOR_SIGNATURE = 0x08074b50;
+constexpr uint16_t ZIP64_EXTRA_ID = 0x0001;
+
+constexpr size_t LOCAL_HEADER_SIZE = 30;
+constexpr size_t CENTRAL_HEADER_SIZE = 46;
+constexpr size_t END_OF_CENTRAL_DIR_SIZE = 22;
+constexpr size_t ZIP64_LOCATOR_SIZE = 20;
+constexpr size_t ZIP64_END_OF_CENTRAL_DIR_SIZE = 56;
+constexpr size_t MAX_COMMENT_SIZE = 0xFFFF;
+
+inline uint16_t Read16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t Read32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t Read64(const uint8_t* p)
+{
+    return (uint64_t)Read32(p) | ((uint64_t)Read32(p + 4) << 32);
+}
+
+// Code page 437, bytes 0x80-0xFF (names without the UTF-8 flag)
+const wchar_t CP437_HIGH[128] = {
+    0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+    0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+    0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+    0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+    0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0
+};
+
+} // namespace
+
+bool ZipArchive::ReadExactAt(uint64_t offset, void* buffer, size_t size) const
+{
+    uint8_t* cursor = (uint8_t*)buffer;
+    while (size > 0) {
+        size_t bytesRead = 0;
+        if (!input_->ReadAt(offset, cursor, size, bytesRead) || bytesRead == 0) {
+            return false;
+        }
+        cursor += bytesRead;
+        offset += bytesRead;
+        size -= bytesRead;
+    }
+    return true;
+}
+
+bool ZipArchive::Open(RandomAccessInput& input)
+{
+    input_ = &input;
+    entries_.clear();
+
+    uint64_t fileSize = input.Size();
+    if (fileSize < END_OF_CENTRAL_DIR_SIZE) {
+        return false;
+    }
+
+    // The end record sits in the last 22 bytes plus an optional comment
+    size_t tailSize = (size_t)std::min<uint64_t>(fileSize, END_OF_CENTRAL_DIR_SIZE + MAX_COMMENT_SIZE);
+    uint64_t tailOffset = fileSize - tailSize;
+    std::vector<uint8_t> tail(tailSize);
+    if (!ReadExactAt(tailOffset, tail.data(), tailSize)) {
+        return false;
+    }
+
+    size_t eocd = std::string::npos;
+    for (size_t i = tailSize - END_OF_CENTRAL_DIR_SIZE + 1; i-- > 0;) {
+        if (Read32(&tail[i]) == END_OF_CENTRAL_DIR_SIGNATURE) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd == std::string::npos) {
+        return false;
+    }
+
+    const uint8_t* record = &tail[eocd];
+    uint64_t entryCount = Read16(record + 10);
+    uint64_t directorySize = Read32(record + 12);
+    uint64_t directoryOffset = Read32(record + 16);
+
+    // ZIP64: the locator immediately precedes the classic end record
+    uint64_t eocdOffset = tailOffset + eocd;
+    if (eocdOffset >= ZIP64_LOCATOR_SIZE) {
+        uint8_t locator[ZIP64_LOCATOR_SIZE];
+        if (ReadExactAt(eocdOffset - ZIP64_LOCATOR_SIZE, locator, sizeof(locator)) &&
+            Read32(locator) == ZIP64_LOCATOR_SIGNATURE) {
+            uint8_t zip64Record[ZIP64_END_OF_CENTRAL_DIR_SIZE];
+            if (!ReadExactAt(Read64(locator + 8), zip64Record, sizeof(zip64Record)) ||
+                Read32(zip64Record) != ZIP64_END_OF_CENTRAL_DIR_SIGNATURE) {
+                return false;
+            }
+            entryCount = Read64(zip64Record + 32);
+            directorySize = Read64(zip64Record + 40);
+            directoryOffset = Read64(zip64Record + 48);
+        }
+    }
+
+    if (directoryOffset > fileSize || directorySize > fileSize - directoryOffset) {
+        return false;
+    }
+
+    directoryOffset_ = directoryOffset;
+    return ReadCentralDirectory(directoryOffset, directorySize, entryCount);
+}
+
+bool ZipArchive::ReadCentralDirectory(uint64_t offset, uint64_t size, uint64_t count)
+{
+    std::vector<uint8_t> directory((size_t)size);
+    if (size > 0 && !ReadExactAt(offset, directory.data(), directory.size())) {
+        return false;
+    }
+
+    entries_.reserve((size_t)std::min<uint64_t>(count, size / CENTRAL_HEADER_SIZE));
+
+    size_t pos = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        ZipEntry entry;
+        size_t recordSize;
+        // The end record may claim more entries than the directory holds
+        if (pos >= directory.size() ||
+            !ParseCentralHeader(directory.data() + pos, directory.size() - pos, entry, recordSize)) {
+            return false;
+        }
+
+        entries_.push_back(std::move(entry));
+        pos += recordSize;
+    }
+
+    return true;
+}
+
+bool ZipArchive::ParseCentralHeader(const uint8_t* header, size_t available, ZipEntry& entry, size_t& recordSize)
+{
+    if (available < CENTRAL_HEADER_SIZE || Read32(header) != CENTRAL_HEADER_SIGNATURE) {
+        return false;
+    }
+
+    entry.flags = Read16(header + 8);
+    entry.method = Read16(header + 10);
+    entry.crc32 = Read32(header + 16);
+    entry.compressedSize = Read32(header + 20);
+    entry.uncompressedSize = Read32(header + 24);
+    size_t nameLength = Read16(header + 28);
+    size_t extraLength = Read16(header + 30);
+    size_t commentLength = Read16(header + 32);
+    entry.localHeaderOffset = Read32(header + 42);
+
+    recordSize = CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+    if (recordSize > available) {
+        return false;
+    }
+
+    const uint8_t* name = header + CENTRAL_HEADER_SIZE;
+    std::string rawName((const char*)name, nameLength);
+    entry.name = DecodeName(rawName, (entry.flags & FLAG_UTF8) != 0);
+    std::replace(entry.name.begin(), entry.name.end(), L'\\', L'/');
+    entry.isDirectory = !entry.name.empty() && entry.name.back() == L'/';
+
+    // ZIP64 extra field carries only the values whose 32-bit slot is saturated
+    const uint8_t* extra = name + nameLength;
+    size_t extraPos = 0;
+    while (extraPos + 4 <= extraLength) {
+        uint16_t id = Read16(extra + extraPos);
+        uint16_t length = Read16(extra + extraPos + 2);
+        const uint8_t* data = extra + extraPos + 4;
+        if (extraPos + 4 + length > extraLength) {
+            break;
+        }
+
+        if (id == ZIP64_EXTRA_ID) {
+            size_t fieldPos = 0;
+            if (entry.uncompressedSize == 0xFFFFFFFF && fieldPos + 8 <= length) {
+                entry.uncompressedSize = Read64(data + fieldPos);
+                fieldPos += 8;
+            }
+            if (entry.compressedSize == 0xFFFFFFFF && fieldPos + 8 <= length) {
+                entry.compressedSize = Read64(data + fieldPos);
+                fieldPos += 8;
+            }
+            if (entry.localHeaderOffset == 0xFFFFFFFF && fieldPos + 8 <= length) {
+                entry.localHeaderOffset = Read64(data + fieldPos);
+            }
+        }
+        extraPos += 4 + (size_t)length;
+    }
+
+    return true;
+}
+
+bool ZipArchive::GetDataOffset(const ZipEntry& entry, uint64_t& offset) const
+{
+    uint8_t header[LOCAL_HEADER_SIZE];
+    if (!ReadExactAt(entry.localHeaderOffset, header, sizeof(header)) ||
+        Read32(header) != LOCAL_HEADER_SIGNATURE) {
+        return false;
+    }
+
+    // Name and extra lengths in the local header may differ from the central copy
+    offset = entry.localHeaderOffset + LOCAL_HEADER_SIZE + Read16(header + 26) + Read16(header + 28);
+    return offset <= input_->Size() && entry.compressedSize <= input_->Size() - offset;
+}
+
+bool ZipArchive::IsSafePath(const std::wstring& name)
+{
+    if (name.empty() || name[0] == L'/' || name[0] == L'\\') {
+        return false;
+    }
+    if (name.size() >= 2 && name[1] == L':') {
+        return false;
+    }
+
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find_first_of(L"/\\", start);
+        if (end == std::wstring::npos) {
+            end = name.size();
+        }
+        if (name.compare(start, end - start, L"..") == 0) {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+std::wstring ZipArchive::DecodeName(const std::string& raw, bool utf8)
+{
+    if (utf8) {
+        return FileSystem::FromUtf8(raw);
+    }
+
+    std::wstring result;
+    result.reserve(raw.size());
+    for (unsigned char ch : raw) {
+        result += ch < 0x80 ? (wchar_t)ch : CP437_HIGH[ch - 0x80];
+    }
+    return result;
+}
+
+// ============================================================================
+// ZipStreamReader
+// ============================================================================
+
+ZipStreamReader::ZipStreamReader(ByteReader& input)
+    : input_(input)
+    , dataStart_(0)
+    , nextSignature_(0)
+    , zip64_(false)
+    , finished_(false)
+{
+}
+
+bool ZipStreamReader::NextEntry(ZipEntry& entry)
+{
+    if (finished_) {
+        return false;
+    }
+
+    uint64_t headerOffset = input_.Position();
+    uint8_t header[LOCAL_HEADER_SIZE];
+    if (!input_.ReadExact(header, 4)) {
+        return false;
+    }
+
+    uint32_t signature = Read32(header);
+    if (signature != LOCAL_HEADER_SIGNATURE) {
+        // The first non-local record must open the central directory (or end an empty archive)
+        finished_ = signature == CENTRAL_HEADER_SIGNATURE || signature == END_OF_CENTRAL_DIR_SIGNATURE;
+        nextSignature_ = signature;
+        return false;
+    }
+
+    if (!input_.ReadExact(header + 4, LOCAL_HEADER_SIZE - 4)) {
+        return false;
+    }
+
+    entry = ZipEntry();
+    entry.flags = Read16(header + 6);
+    entry.method = Read16(header + 8);
+    entry.crc32 = Read32(header + 14);
+    entry.compressedSize = Read32(header + 18);
+    entry.uncompressedSize = Read32(header + 22);
+    entry.localHeaderOffset = headerOffset;
+    size_t nameLength = Read16(header + 26);
+    size_t extraLength = Read16(header + 28);
+
+    std::vector<uint8_t> variable(nameLength + extraLength);
+    if (!variable.empty() && !input_.ReadExact(variable.data(), variable.size())) {
+        return false;
+    }
+
+    std::string rawName((const char*)variable.data(), nameLength);
+    entry.name = ZipArchive::DecodeName(rawName, (entry.flags & ZipArchive::FLAG_UTF8) != 0);
+    std::replace(entry.name.begin(), entry.name.end(), L'\\', L'/');
+    entry.isDirectory = !entry.name.empty() && entry.name.back() == L'/';
+
+    // Unlike the central copy, a local ZIP64 field always holds both sizes
+    zip64_ = false;
+    const uint8_t* extra = variable.data() + nameLength;
+    size_t extraPos = 0;
+    while (extraPos + 4 <= extraLength) {
+        uint16_t id = Read16(extra + extraPos);
+        uint16_t length = Read16(extra + extraPos + 2);
+        if (extraPos + 4 + length > extraLength) {
+            break;
+        }
+        if (id == ZIP64_EXTRA_ID && length >= 16) {
+            entry.uncompressedSize = Read64(extra + extraPos + 4);
+            entry.compressedSize = Read64(extra + extraPos + 12);
+            zip64_ = true;
+        }
+        extraPos += 4 + (size_t)length;
+    }
+
+    // A stored entry of unknown length has no way to find its end in a stream
+    if ((entry.flags & ZipArchive::FLAG_DATA_DESCRIPTOR) && entry.method == ZipArchive::METHOD_STORED &&
+        entry.compressedSize == 0 && !entry.isDirectory) {
+        return false;
+    }
+
+    dataStart_ = input_.Position();
+    return true;
+}
+
+bool ZipStreamReader::EndEntry(ZipEntry& entry)
+{
+    uint64_t consumed = input_.Position() - dataStart_;
+
+    if (entry.flags & ZipArchive::FLAG_DATA_DESCRIPTOR) {
+        // The descriptor signature is optional
+        uint8_t descriptor[16];
+        if (!input_.ReadExact(descriptor, 4)) {
+            return false;
+        }
+        if (Read32(descriptor) == DATA_DESCRIPTOR_SIGNATURE && !input_.ReadExact(descriptor, 4)) {
+            return false;
+        }
+        entry.crc32 = Read32(descriptor);
+
+        if (!input_.ReadExact(descriptor, zip64_ ? 16 : 8)) {
+            return false;
+        }
+        entry.compressedSize = zip64_ ? Read64(descriptor) : Read32(descriptor);
+        entry.uncompressedSize = zip64_ ? Read64(descriptor + 8) : Read32(descriptor + 4);
+    }
+
+    if (consumed != entry.compressedSize) {
+        return false;
+    }
+
+    entries_.push_back(entry);
+    return true;
+}
+
+bool ZipStreamReader::VerifyDirectory()
+{
+    if (!finished_) {
+        return false;
+    }
+
+    uint8_t fixed[ZIP64_END_OF_CENTRAL_DIR_SIZE];
+    uint32_t signature = nextSignature_;
+    size_t index = 0;
+
+    while (signature == CENTRAL_HEADER_SIGNATURE) {
+        std::vector<uint8_t> record(CENTRAL_HEADER_SIZE);
+        memcpy(record.data(), &signature, 4);
+        if (!input_.ReadExact(record.data() + 4, CENTRAL_HEADER_SIZE - 4)) {
+            return false;
+        }
+
+        size_t variableLength = (size_t)Read16(&record[28]) + Read16(&record[30]) + Read16(&record[32]);
+        record.resize(CENTRAL_HEADER_SIZE + variableLength);
+        if (variableLength > 0 && !input_.ReadExact(record.data() + CENTRAL_HEADER_SIZE, variableLength)) {
+            return false;
+        }
+
+        ZipEntry central;
+        size_t recordSize;
+        if (!ZipArchive::ParseCentralHeader(record.data(), record.size(), central, recordSize) ||
+            index >= entries_.size()) {
+            return false;
+        }
+
+        const ZipEntry& local = entries_[index++];
+        if (central.name != local.name || central.method != local.method || central.crc32 != local.crc32 ||
+            central.compressedSize != local.compressedSize || central.uncompressedSize != local.uncompressedSize ||
+            central.localHeaderOffset != local.localHeaderOffset) {
+            return false;
+        }
+
+        if (!input_.ReadExact(fixed, 4)) {
+            return false;
+        }
+        signature = Read32(fixed);
+    }
+
+    if (index != entries_.size()) {
+        return false;
+    }
+
+    // ZIP64 end record ("size of remaining record" excludes its first 12 bytes) and locator
+    if (signature == ZIP64_END_OF_CENTRAL_DIR_SIGNATURE) {
+        if (!input_.ReadExact(fixed, 8) || !input_.Skip(Read64(fixed)) || !input_.ReadExact(fixed, 4)) {
+            return false;
+        }
+        signature = Read32(fixed);
+    }
+    if (signature == ZIP64_LOCATOR_SIGNATURE) {
+        if (!input_.Skip(ZIP64_LOCATOR_SIZE - 4) || !input_.ReadExact(fixed, 4)) {
+            return false;
+        }
+        signature = Read32(fixed);
+    }
+
+    if (signature != END_OF_CENTRAL_DIR_SIGNATURE ||
+        !input_.ReadExact(fixed, END_OF_CENTRAL_DIR_SIZE - 4)) {
+        return false;
+    }
+
+    // Counts saturate at 0xFFFF when the ZIP64 record holds the real value
+    uint16_t entryCount = Read16(fixed + 6);
+    if (entryCount != 0xFFFF && entryCount != (entries_.size() & 0xFFFF)) {
+        return false;
+    }
+
+    return input_.Skip(Read16(fixed + 16));
+}
+
+} // namespace InstAnalyticsInstaller
@@ -1,121 +1,663 @@
 #include "ZipExtractor.h"
-#include <windows.h>
-#include <shlobj.h>
-#include <shobjidl.h>
-#include <atlbase.h>
+#include "Crc32.h"
+#include "FileSystem.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <memory>
+#include <mutex>
 
 namespace InstAnalyticsInstaller {
 
-bool ZipExtractor::Extract(const std::wstring& zipPath, const std::wstring& destinationPath, ExtractionProgressCallback callback)
+namespace {
+
+// Writes inflated bytes to the target file (or another sink), checking size
+// and CRC on the way. Without either the data is only checked (entries
+// skipped while streaming).
+class EntryWriter : public OutputStream {
+public:
+    EntryWriter(File* file, uint64_t expectedSize, const CancellationToken* cancel, OutputStream* sink = nullptr)
+        : file_(file)
+        , sink_(sink)
+        , cancel_(cancel)
+        , expectedSize_(expectedSize)
+        , written_(0)
+        , crc_(0)
+    {
+    }
+
+    bool Write(const void* data, size_t size) override
+    {
+        if (size > expectedSize_ - written_) {
+            return false; // More output than the central directory declared
+        }
+        if (cancel_ && cancel_->IsCancelled()) {
+            return false;
+        }
+        crc_ = Crc32::Update(crc_, data, size);
+        written_ += size;
+        return (!file_ || file_->Write(data, size)) && (!sink_ || sink_->Write(data, size));
+    }
+
+    uint64_t Written() const { return written_; }
+    uint32_t Crc() const { return crc_; }
+
+private:
+    File* file_;
+    OutputStream* sink_;
+    const CancellationToken* cancel_;
+    uint64_t expectedSize_;
+    uint64_t written_;
+    uint32_t crc_;
+};
+
+// Compressed data of an entry read ahead by ExtractStream
+class MemoryInputStream : public InputStream {
+public:
+    MemoryInputStream(const uint8_t* data, size_t size)
+        : data_(data)
+        , left_(size)
+    {
+    }
+
+    bool Read(void* buffer, size_t size, size_t& bytesRead) override
+    {
+        bytesRead = std::min(size, left_);
+        memcpy(buffer, data_, bytesRead);
+        data_ += bytesRead;
+        left_ -= bytesRead;
+        return true;
+    }
+
+private:
+    const uint8_t* data_;
+    size_t left_;
+};
+
+constexpr size_t COPY_BUFFER_SIZE = 256 * 1024;
+constexpr size_t STREAM_READ_SIZE = 1024 * 1024;
+// Compressed bytes ExtractStream reads ahead of its workers; a larger entry
+// is inflated in line
+constexpr uint64_t STREAM_READ_AHEAD = 64 * 1024 * 1024;
+// Smaller files fit in a few clusters anyway; skip the extra call
+constexpr uint64_t PREALLOCATE_MIN_SIZE = 64 * 1024;
+
+} // namespace
+
+bool ZipExtractor::Extract(const std::wstring& zipPath, const std::wstring& destinationPath,
+    ExtractionProgressCallback callback, const ExtractionOptions& options)
 {
-    return ExtractWithShell(zipPath, destinationPath);
+    FileInput input;
+    if (!input.Open(zipPath)) {
+        return false;
+    }
+    return Extract(input, destinationPath, callback, options);
 }
 
-bool ZipExtractor::ExtractWithShell(const std::wstring& zipPath, const std::wstring& destinationPath)
+bool ZipExtractor::Extract(RandomAccessInput& input, const std::wstring& destinationPath,
+    ExtractionProgressCallback callback, const ExtractionOptions& options)
 {
-    CoInitialize(nullptr);
-
-    bool success = false;
-
-    // Create temporary extraction folder
-    wchar_t tempDir[MAX_PATH];
-    GetTempPathW(MAX_PATH, tempDir);
-    std::wstring tempExtractPath = std::wstring(tempDir) + L"InstAnalytics_temp_extract";
-
-    // Create temp and destination folders
-    SHCreateDirectoryExW(nullptr, tempExtractPath.c_str(), nullptr);
-    SHCreateDirectoryExW(nullptr, destinationPath.c_str(), nullptr);
-
-    // Use Shell to extract ZIP
-    CComPtr<IShellDispatch> pShellDispatch;
-    HRESULT hr = CoCreateInstance(CLSID_Shell, nullptr, CLSCTX_INPROC_SERVER,
-        IID_IShellDispatch, (void**)&pShellDispatch);
-
-    if (SUCCEEDED(hr)) {
-        // Get source folder (ZIP file)
-        CComVariant varZipPath(zipPath.c_str());
-        CComPtr<Folder> pZipFolder;
-        hr = pShellDispatch->NameSpace(varZipPath, &pZipFolder);
-
-        if (SUCCEEDED(hr) && pZipFolder) {
-            // Get temp destination folder
-            CComVariant varTempPath(tempExtractPath.c_str());
-            CComPtr<Folder> pTempFolder;
-            hr = pShellDispatch->NameSpace(varTempPath, &pTempFolder);
-
-            if (SUCCEEDED(hr) && pTempFolder) {
-                // Get items from ZIP
-                CComPtr<FolderItems> pItems;
-                hr = pZipFolder->Items(&pItems);
-
-                if (SUCCEEDED(hr) && pItems) {
-                    CComVariant varItems(pItems);
-                    CComVariant varOptions(FOF_NO_UI); // No UI dialogs
-
-                    // Copy items to temp folder (this extracts the ZIP)
-                    hr = pTempFolder->CopyHere(varItems, varOptions);
-                    success = SUCCEEDED(hr);
-
-                    // Wait for extraction to complete
-                    Sleep(3000);
-
-                    // Now find the first (and should be only) folder in temp directory
-                    WIN32_FIND_DATAW findData;
-                    std::wstring searchPath = tempExtractPath + L"\\*";
-                    HANDLE hFind = FindFirstFileW(searchPath.c_str(), &findData);
-
-                    if (hFind != INVALID_HANDLE_VALUE) {
-                        do {
-                            if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
-                                wcscmp(findData.cFileName, L".") != 0 &&
-                                wcscmp(findData.cFileName, L"..") != 0) {
-
-                                // Found the wrapper folder - now copy its contents to destination
-                                std::wstring wrapperPath = tempExtractPath + L"\\" + findData.cFileName;
-
-                                CComVariant varWrapperPath(wrapperPath.c_str());
-                                CComPtr<Folder> pWrapperFolder;
-                                hr = pShellDispatch->NameSpace(varWrapperPath, &pWrapperFolder);
-
-                                if (SUCCEEDED(hr) && pWrapperFolder) {
-                                    CComVariant varDestPath(destinationPath.c_str());
-                                    CComPtr<Folder> pDestFolder;
-                                    hr = pShellDispatch->NameSpace(varDestPath, &pDestFolder);
-
-                                    if (SUCCEEDED(hr) && pDestFolder) {
-                                        // Get items from wrapper folder
-                                        CComPtr<FolderItems> pWrapperItems;
-                                        hr = pWrapperFolder->Items(&pWrapperItems);
-
-                                        if (SUCCEEDED(hr) && pWrapperItems) {
-                                            CComVariant varWrapperItems(pWrapperItems);
-                                            CComVariant varOptions2(FOF_NO_UI);
-
-                                            // Copy contents to final destination
-                                            hr = pDestFolder->CopyHere(varWrapperItems, varOptions2);
-                                            Sleep(2000);
-                                            success = SUCCEEDED(hr);
-                                        }
-                                    }
-                                }
-                                break;
-                            }
-                        } while (FindNextFileW(hFind, &findData));
-
-                        FindClose(hFind);
+    TraceSpan span("extract", "extract");
+
+    ZipArchive archive;
+    if (!archive.Open(input)) {
+        return false;
+    }
+
+    const std::vector<ZipEntry>& entries = archive.Entries();
+    std::vector<std::wstring> relativePaths;
+    if (!RelativePaths(entries, options, relativePaths)) {
+        return false;
+    }
+
+    if (!FileSystem::CreateDirectories(destinationPath)) {
+        return false;
+    }
+
+    // Create the directory tree up front so workers only ever write files
+    std::set<std::wstring> createdDirectories;
+    std::vector<ExtractionJob> jobs;
+    jobs.reserve(entries.size());
+    uint64_t totalBytes = 0;
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const ZipEntry& entry = entries[i];
+        std::wstring& relativePath = relativePaths[i];
+        if (relativePath.empty()) {
+            continue; // Stripped away entirely (wrapper folders themselves)
+        }
+        if (options.only && (entry.isDirectory || !options.only->count(relativePath))) {
+            continue;
+        }
+
+        std::wstring outputPath = FileSystem::JoinPath(destinationPath, relativePath);
+        std::wstring directory = entry.isDirectory ? outputPath : FileSystem::ParentPath(outputPath);
+
+        if (createdDirectories.insert(directory).second && !FileSystem::CreateDirectories(directory)) {
+            return false;
+        }
+
+        if (!entry.isDirectory) {
+            jobs.push_back({ &entry, std::move(relativePath), std::move(outputPath) });
+            totalBytes += entry.uncompressedSize;
+        }
+    }
+
+    // The central directory gives the exact total: fail before writing any file
+    uint64_t available = 0;
+    if (FileSystem::AvailableSpace(destinationPath, available) && available < totalBytes) {
+        if (options.insufficientSpace) {
+            *options.insufficientSpace = true;
+        }
+        return false;
+    }
+
+    unsigned threadCount = options.threadCount == 0 ? ThreadPool::DefaultThreadCount() : options.threadCount;
+    if (threadCount > jobs.size()) {
+        threadCount = jobs.empty() ? 1 : (unsigned)jobs.size();
+    }
+
+    std::vector<std::unique_ptr<WorkerContext>> contexts(threadCount);
+    std::atomic<bool> failed(false);
+    std::atomic<uint64_t> extractedBytes(0);
+    std::mutex callbackMutex;
+
+    auto runJob = [&](const ExtractionJob& job, unsigned worker) {
+        if (failed.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (options.cancel && options.cancel->IsCancelled()) {
+            failed = true;
+            return;
+        }
+
+        if (!contexts[worker]) {
+            contexts[worker] = std::make_unique<WorkerContext>();
+            contexts[worker]->buffer.resize(COPY_BUFFER_SIZE);
+        }
+
+        if (callback) {
+            std::lock_guard<std::mutex> lock(callbackMutex);
+            uint64_t done = extractedBytes.load(std::memory_order_relaxed);
+            callback(totalBytes > 0 ? (int)(done * 100 / totalBytes) : 0, job.relativePath);
+        }
+
+        TraceSpan entrySpan("extract.entry", "extract");
+        if (!ExtractEntry(archive, input, *job.entry, job.outputPath, *contexts[worker], options)) {
+            FileSystem::RemoveFile(job.outputPath);
+            failed = true;
+            return;
+        }
+        entrySpan.SetBytes(job.entry->uncompressedSize);
+
+        extractedBytes += job.entry->uncompressedSize;
+    };
+
+    if (threadCount == 1) {
+        for (const auto& job : jobs) {
+            runJob(job, 0);
+        }
+    } else {
+        // Largest entries first so a big DLL never starts last and
+        // leaves the other workers idle at the end
+        std::sort(jobs.begin(), jobs.end(), [](const ExtractionJob& a, const ExtractionJob& b) {
+            return a.entry->compressedSize > b.entry->compressedSize;
+        });
+
+        ThreadPool pool(threadCount);
+        for (const auto& job : jobs) {
+            pool.Submit([&runJob, &job, &failed](unsigned worker) {
+                try {
+                    runJob(job, worker);
+                } catch (...) {
+                    FileSystem::RemoveFile(job.outputPath);
+                    failed = true;
+                }
+            });
+        }
+        pool.Wait();
+    }
+
+    if (failed) {
+        return false;
+    }
+
+    span.SetArg("entries", (int64_t)jobs.size());
+    span.SetArg("threads", threadCount);
+    span.SetBytes(totalBytes);
+
+    if (callback) {
+        callback(100, L"");
+    }
+
+    return true;
+}
+
+bool ZipExtractor::PreallocateEntry(File& output, uint64_t size, const ExtractionOptions& options)
+{
+    if (size < PREALLOCATE_MIN_SIZE || output.Preallocate(size)) {
+        return true;
+    }
+    if (options.insufficientSpace) {
+        *options.insufficientSpace = true;
+    }
+    return false;
+}
+
+bool ZipExtractor::ExtractEntry(const ZipArchive& archive, RandomAccessInput& input, const ZipEntry& entry,
+    const std::wstring& outputPath, WorkerContext& context, const ExtractionOptions& options)
+{
+    File output;
+    if (!output.Open(outputPath, File::Mode::Write) || !PreallocateEntry(output, entry.uncompressedSize, options)) {
+        return false;
+    }
+
+    EntryWriter writer(&output, entry.uncompressedSize, options.cancel);
+    if (!DecodeEntry(archive, input, entry, writer, context)) {
+        return false;
+    }
+
+    // Close before reporting success so the data is on disk, not in flight
+    output.Close();
+
+    return writer.Written() == entry.uncompressedSize && writer.Crc() == entry.crc32;
+}
+
+bool ZipExtractor::ReadEntry(const ZipArchive& archive, RandomAccessInput& input, const ZipEntry& entry,
+    OutputStream& output, const CancellationToken* cancel)
+{
+    WorkerContext context;
+    context.buffer.resize(COPY_BUFFER_SIZE);
+
+    EntryWriter writer(nullptr, entry.uncompressedSize, cancel, &output);
+    return DecodeEntry(archive, input, entry, writer, context) &&
+           writer.Written() == entry.uncompressedSize && writer.Crc() == entry.crc32;
+}
+
+bool ZipExtractor::DecodeEntry(const ZipArchive& archive, RandomAccessInput& input, const ZipEntry& entry,
+    OutputStream& writer, WorkerContext& context)
+{
+    if (entry.flags & ZipArchive::FLAG_ENCRYPTED) {
+        return false;
+    }
+    if (entry.method != ZipArchive::METHOD_STORED && entry.method != ZipArchive::METHOD_DEFLATE) {
+        return false;
+    }
+
+    uint64_t dataOffset;
+    if (!archive.GetDataOffset(entry, dataOffset)) {
+        return false;
+    }
+    RangeInputStream source(input, dataOffset, entry.compressedSize);
+
+    if (entry.method == ZipArchive::METHOD_DEFLATE) {
+        ByteReader reader(source);
+        if (!context.inflater.Inflate(reader, writer)) {
+            return false;
+        }
+    } else {
+        for (;;) {
+            size_t bytesRead = 0;
+            if (!source.Read(context.buffer.data(), context.buffer.size(), bytesRead)) {
+                return false;
+            }
+            if (bytesRead == 0) {
+                break;
+            }
+            if (!writer.Write(context.buffer.data(), bytesRead)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool ZipExtractor::ExtractStream(InputStream& input, const std::wstring& destinationPath,
+    ExtractionProgressCallback callback, const ExtractionOptions& options, uint64_t archiveSize)
+{
+    TraceSpan span("extract.stream", "extract");
+
+    if (!FileSystem::CreateDirectories(destinationPath)) {
+        return false;
+    }
+
+    ByteReader reader(input, STREAM_READ_SIZE);
+    ZipStreamReader zip(reader);
+    WorkerContext context;
+    context.buffer.resize(COPY_BUFFER_SIZE);
+
+    // The common root can't be known before the last entry, so it is assumed
+    // from the entries seen so far; when a later entry narrows it, everything
+    // already written is moved one level down instead of re-extracted
+    std::wstring root;
+    bool haveRoot = false;
+    std::vector<StreamedEntry> placed;
+    std::set<std::wstring> directories;
+    uint64_t extractedBytes = 0;
+
+    // Workers inflate the entries read ahead while this thread keeps reading;
+    // their compressed bytes in flight stay within STREAM_READ_AHEAD
+    unsigned threadCount = options.threadCount == 0 ? ThreadPool::DefaultThreadCount() : options.threadCount;
+    std::vector<std::unique_ptr<WorkerContext>> contexts(threadCount);
+    std::atomic<bool> failed(false);
+    std::mutex readAheadMutex;
+    std::condition_variable readAheadFreed;
+    uint64_t readAhead = 0;
+    // Last, so it finishes its tasks before what they use goes away
+    std::unique_ptr<ThreadPool> pool;
+    if (threadCount > 1) {
+        pool = std::make_unique<ThreadPool>(threadCount);
+    }
+    auto drain = [&] {
+        if (pool) {
+            pool->Wait();
+        }
+        return !failed;
+    };
+
+    ZipEntry entry;
+    while (zip.NextEntry(entry)) {
+        if (failed || (options.cancel && options.cancel->IsCancelled())) {
+            return false;
+        }
+        if (!ZipArchive::IsSafePath(entry.name)) {
+            return false;
+        }
+
+        std::wstring name = StripComponents(entry.name, options.stripComponents);
+        // Once the root is empty nothing can narrow it further
+        if (options.stripCommonRoot && !name.empty() && (!haveRoot || !root.empty())) {
+            std::wstring narrowed = FindCommonRoot(haveRoot ? std::vector<std::wstring>{ root, name }
+                                                            : std::vector<std::wstring>{ name });
+            if (haveRoot && narrowed != root &&
+                (!drain() || !Relocate(placed, destinationPath, narrowed, directories))) {
+                return false;
+            }
+            root = narrowed;
+            haveRoot = true;
+        }
+
+        // Skipped entries are still decoded: the stream has to move past them anyway
+        std::wstring outputPath;
+        if (name.size() > root.size()) {
+            outputPath = FileSystem::JoinPath(destinationPath, name.substr(root.size()));
+            std::wstring directory = entry.isDirectory ? outputPath : FileSystem::ParentPath(outputPath);
+            if (directories.insert(directory).second && !FileSystem::CreateDirectories(directory)) {
+                return false;
+            }
+        }
+
+        if (entry.isDirectory || !name.empty()) {
+            placed.push_back({ name, outputPath, entry.isDirectory });
+        }
+
+        if (callback && !outputPath.empty() && !entry.isDirectory) {
+            int progress = archiveSize > 0 ? (int)std::min<uint64_t>(reader.Position() * 100 / archiveSize, 99) : 0;
+            callback(progress, name.substr(root.size()));
+        }
+
+        bool readAheadEntry = pool && !entry.isDirectory && !outputPath.empty() &&
+                              !(entry.flags & ZipArchive::FLAG_DATA_DESCRIPTOR) &&
+                              entry.compressedSize <= STREAM_READ_AHEAD;
+        if (readAheadEntry) {
+            {
+                std::unique_lock<std::mutex> lock(readAheadMutex);
+                readAheadFreed.wait(lock, [&] {
+                    return readAhead == 0 || readAhead + entry.compressedSize <= STREAM_READ_AHEAD || failed;
+                });
+                readAhead += entry.compressedSize;
+            }
+            auto data = std::make_shared<std::vector<uint8_t>>((size_t)entry.compressedSize);
+            if (!reader.ReadExact(data->data(), data->size()) || !zip.EndEntry(entry)) {
+                return false;
+            }
+
+            pool->Submit([&, data, entry, outputPath](unsigned worker) {
+                if (failed || (options.cancel && options.cancel->IsCancelled())) {
+                    failed = true;
+                } else {
+                    if (!contexts[worker]) {
+                        contexts[worker] = std::make_unique<WorkerContext>();
+                    }
+                    if (!ExtractBufferedEntry(*data, entry, outputPath, *contexts[worker], options)) {
+                        FileSystem::RemoveFile(outputPath);
+                        failed = true;
                     }
                 }
+                {
+                    std::lock_guard<std::mutex> lock(readAheadMutex);
+                    readAhead -= entry.compressedSize;
+                }
+                readAheadFreed.notify_all();
+            });
+        } else if (!ExtractStreamedEntry(reader, zip, entry, entry.isDirectory ? L"" : outputPath, context, options)) {
+            if (!outputPath.empty() && !entry.isDirectory) {
+                FileSystem::RemoveFile(outputPath);
             }
+            return false;
         }
+        extractedBytes += entry.uncompressedSize;
     }
 
-    // Clean up temp directory
-    std::wstring cleanupCmd = L"cmd.exe /c rd /s /q \"" + tempExtractPath + L"\"";
-    _wsystem(cleanupCmd.c_str());
+    if (!drain() || !zip.Finished() || !zip.VerifyDirectory()) {
+        return false;
+    }
+
+    // Nothing may follow the end record; this also waits for the producer to
+    // close the stream, so its own failures (e.g. a digest check) surface here
+    uint8_t trailing;
+    if (reader.ReadByte(trailing) || reader.Failed()) {
+        return false;
+    }
+
+    span.SetArg("entries", (int64_t)placed.size());
+    span.SetArg("threads", threadCount);
+    span.SetBytes(extractedBytes);
+
+    if (callback) {
+        callback(100, L"");
+    }
 
-    CoUninitialize();
+    return true;
+}
+
+bool ZipExtractor::ExtractStreamedEntry(ByteReader& reader, ZipStreamReader& zip, ZipEntry& entry,
+    const std::wstring& outputPath, WorkerContext& context, const ExtractionOptions& options)
+{
+    if (entry.flags & ZipArchive::FLAG_ENCRYPTED) {
+        return false;
+    }
+    if (entry.method != ZipArchive::METHOD_STORED && entry.method != ZipArchive::METHOD_DEFLATE) {
+        return false;
+    }
+
+    File output;
+    if (!outputPath.empty() && !output.Open(outputPath, File::Mode::Write)) {
+        return false;
+    }
+
+    // Sizes behind a data descriptor are only known once the data has been read
+    bool sizesKnown = !(entry.flags & ZipArchive::FLAG_DATA_DESCRIPTOR);
+    if (sizesKnown && output.IsOpen() && !PreallocateEntry(output, entry.uncompressedSize, options)) {
+        return false;
+    }
+    EntryWriter writer(output.IsOpen() ? &output : nullptr,
+        sizesKnown ? entry.uncompressedSize : std::numeric_limits<uint64_t>::max(), options.cancel);
+
+    if (entry.method == ZipArchive::METHOD_DEFLATE) {
+        if (!context.inflater.Inflate(reader, writer)) {
+            return false;
+        }
+    } else {
+        uint64_t remaining = entry.compressedSize;
+        while (remaining > 0) {
+            size_t chunk = (size_t)std::min<uint64_t>(remaining, context.buffer.size());
+            if (!reader.ReadExact(context.buffer.data(), chunk) || !writer.Write(context.buffer.data(), chunk)) {
+                return false;
+            }
+            remaining -= chunk;
+        }
+    }
+
+    output.Close();
+
+    return zip.EndEntry(entry) && writer.Written() == entry.uncompressedSize && writer.Crc() == entry.crc32;
+}
+
+bool ZipExtractor::ExtractBufferedEntry(const std::vector<uint8_t>& data, const ZipEntry& entry,
+    const std::wstring& outputPath, WorkerContext& context, const ExtractionOptions& options)
+{
+    if (entry.flags & ZipArchive::FLAG_ENCRYPTED) {
+        return false;
+    }
+    if (entry.method != ZipArchive::METHOD_STORED && entry.method != ZipArchive::METHOD_DEFLATE) {
+        return false;
+    }
+
+    File output;
+    if (!output.Open(outputPath, File::Mode::Write) || !PreallocateEntry(output, entry.uncompressedSize, options)) {
+        return false;
+    }
+    EntryWriter writer(&output, entry.uncompressedSize, options.cancel);
+
+    if (entry.method == ZipArchive::METHOD_DEFLATE) {
+        // The deflate stream has to end exactly where the entry's data does
+        MemoryInputStream source(data.data(), data.size());
+        ByteReader reader(source);
+        if (!context.inflater.Inflate(reader, writer) || reader.Position() != data.size()) {
+            return false;
+        }
+    } else if (!writer.Write(data.data(), data.size())) {
+        return false;
+    }
+
+    output.Close();
+
+    return writer.Written() == entry.uncompressedSize && writer.Crc() == entry.crc32;
+}
+
+bool ZipExtractor::Relocate(std::vector<StreamedEntry>& placed, const std::wstring& destinationPath,
+    const std::wstring& root, std::set<std::wstring>& directories)
+{
+    std::set<std::wstring> previousDirectories;
+    previousDirectories.swap(directories);
+
+    for (auto& entry : placed) {
+        if (entry.name.size() <= root.size()) {
+            continue;
+        }
+
+        std::wstring outputPath = FileSystem::JoinPath(destinationPath, entry.name.substr(root.size()));
+        std::wstring directory = entry.isDirectory ? outputPath : FileSystem::ParentPath(outputPath);
+        if (directories.insert(directory).second && !FileSystem::CreateDirectories(directory)) {
+            return false;
+        }
+
+        if (!entry.isDirectory && !FileSystem::RenameFile(entry.outputPath, outputPath)) {
+            return false;
+        }
+        entry.outputPath = outputPath;
+    }
+
+    // Drop the directories of the old layout that ended up empty, children first
+    for (auto it = previousDirectories.rbegin(); it != previousDirectories.rend(); ++it) {
+        if (*it != destinationPath && !directories.count(*it)) {
+            FileSystem::RemoveEmptyDirectory(*it);
+        }
+    }
+
+    return true;
+}
+
+bool ZipExtractor::ListFiles(const ZipArchive& archive, const ExtractionOptions& options,
+    std::vector<ArchiveFile>& files)
+{
+    const std::vector<ZipEntry>& entries = archive.Entries();
+    std::vector<std::wstring> relativePaths;
+    if (!RelativePaths(entries, options, relativePaths)) {
+        return false;
+    }
+
+    files.clear();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (!entries[i].isDirectory && !relativePaths[i].empty()) {
+            files.push_back({ &entries[i], std::move(relativePaths[i]) });
+        }
+    }
+    return true;
+}
+
+bool ZipExtractor::RelativePaths(const std::vector<ZipEntry>& entries, const ExtractionOptions& options,
+    std::vector<std::wstring>& paths)
+{
+    paths.clear();
+    paths.reserve(entries.size());
+    for (const auto& entry : entries) {
+        if (!ZipArchive::IsSafePath(entry.name)) {
+            return false;
+        }
+        paths.push_back(StripComponents(entry.name, options.stripComponents));
+    }
+
+    std::wstring commonRoot = options.stripCommonRoot ? FindCommonRoot(paths) : L"";
+    for (auto& path : paths) {
+        path = path.size() > commonRoot.size() ? path.substr(commonRoot.size()) : L"";
+    }
+    return true;
+}
+
+std::wstring ZipExtractor::StripComponents(const std::wstring& name, unsigned count)
+{
+    size_t start = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        size_t slash = name.find(L'/', start);
+        if (slash == std::wstring::npos) {
+            return L"";
+        }
+        start = slash + 1;
+    }
+    return name.substr(start);
+}
+
+std::wstring ZipExtractor::FindCommonRoot(const std::vector<std::wstring>& names)
+{
+    bool first = true;
+    std::wstring root;
+
+    for (const auto& name : names) {
+        if (name.empty()) {
+            continue;
+        }
+
+        // Only whole directory components count, so compare up to the last '/'
+        size_t slash = name.rfind(L'/');
+        std::wstring directory = slash == std::wstring::npos ? L"" : name.substr(0, slash + 1);
+
+        if (first) {
+            root = directory;
+            first = false;
+            continue;
+        }
+
+        size_t common = 0;
+        size_t limit = std::min(root.size(), directory.size());
+        while (common < limit && root[common] == directory[common]) {
+            ++common;
+        }
+
+        // Back off to the last complete component inside the shared prefix
+        size_t cut = common == 0 ? std::wstring::npos : root.rfind(L'/', common - 1);
+        root.resize(cut == std::wstring::npos ? 0 : cut + 1);
+
+        if (root.empty()) {
+            break;
+        }
+    }
 
-    return success;
+    return root;
 }
 
 } // namespace InstAnalyticsInstaller
@@ -1,201 +1,223 @@
 #include "UIManager.h"
-#include "DotNetChecker.h"
-#include "Downloader.h"
-#include "Installer.h"
 #include "Constants.h"
+#include "DownloadCache.h"
+#include "HeadlessInstall.h"
+#include "InstallPipeline.h"
+#include "Trace.h"
+#include "WindowsInstallEnvironment.h"
 #include <windows.h>
+#include <mutex>
 #include <thread>
+#include <vector>
 #include <shlobj.h>
+#include <shellapi.h>
 
 using namespace InstAnalyticsInstaller;
 
 UIManager* g_uiManager = nullptr;
-Downloader* g_downloader = nullptr;
-Installer* g_installer = nullptr;
+InstallPipeline* g_pipeline = nullptr;  // Guarded by g_pipelineMutex
+std::mutex g_pipelineMutex;
+std::mutex g_stateMutex;
+HANDLE g_installThread = nullptr;       // UI thread only
 
-void PerformInstallation()
-{
-    if (!g_uiManager) return;
+// How long closing the window waits for a cancelled installation to unwind
+constexpr DWORD CANCEL_WAIT_MS = 5000;
 
-    std::wstring tempPath;
-    wchar_t tempDir[MAX_PATH];
-    GetTempPathW(MAX_PATH, tempDir);
-    tempPath = tempDir;
+// Phases run concurrently; the shared UI state is switched one at a time
+static void EnterState(InstallState state)
+{
+    std::lock_guard<std::mutex> lock(g_stateMutex);
+    g_uiManager->SetState(state);
+}
 
-    try {
-        // Step 1: Check if .NET 10 is installed
-        g_uiManager->SetState(InstallState::CheckingDotNet);
-        g_uiManager->UpdateProgress(5, L"Controllo presenza .NET 10...");
+static void CancelInstallation()
+{
+    std::lock_guard<std::mutex> lock(g_pipelineMutex);
+    if (g_pipeline) {
+        g_pipeline->Cancel();
+    }
+}
 
-        Sleep(1000); // Brief pause for UI update
+// Waits up to timeoutMs for the installation thread to return. The worker
+// updates the window with SendMessage-based calls, so the UI thread keeps
+// dispatching sent messages while it waits instead of blocking on the handle
+static bool WaitForInstallation(DWORD timeoutMs)
+{
+    if (!g_installThread) {
+        return true;
+    }
 
-        bool dotNetInstalled = DotNetChecker::IsDotNet10Installed();
+    DWORD start = GetTickCount();
+    while (true) {
+        DWORD elapsed = GetTickCount() - start;
+        DWORD remaining = elapsed < timeoutMs ? timeoutMs - elapsed : 0;
+        DWORD waitResult = MsgWaitForMultipleObjects(1, &g_installThread, FALSE, remaining, QS_SENDMESSAGE);
+        if (waitResult == WAIT_OBJECT_0) {
+            CloseHandle(g_installThread);
+            g_installThread = nullptr;
+            return true;
+        }
+        if (waitResult != WAIT_OBJECT_0 + 1) {
+            return false;
+        }
+        MSG msg;
+        PeekMessage(&msg, nullptr, 0, 0, PM_NOREMOVE | PM_QS_SENDMESSAGE);
+    }
+}
 
-        if (!dotNetInstalled) {
-            // Step 2: Download .NET 10
-            g_uiManager->SetState(InstallState::DownloadingDotNet);
-            g_uiManager->UpdateProgress(10, L"Download .NET 10 in corso...");
+// Cancel callback: the window is torn down only after this returns
+static void StopInstallation()
+{
+    CancelInstallation();
+    WaitForInstallation(CANCEL_WAIT_MS);
+}
 
-            std::wstring dotnetUrl = DotNetChecker::GetDotNetDownloadUrl();
-            std::wstring dotnetInstallerPath = tempPath + L"dotnet-sdk-10.0.100-installer.exe";
+// Download folder, cache and payloads shared by the wizard and unattended runs
+static HeadlessOptions DefaultOptions(const std::wstring& installPath)
+{
+    HeadlessOptions options;
+    options.installPath = installPath;
 
-            g_downloader = new Downloader();
+    // Downloads live in a dedicated folder under names taken from their URLs,
+    // so a retry or a re-launched installer finds and resumes partial files
+    wchar_t tempDir[MAX_PATH];
+    GetTempPathW(MAX_PATH, tempDir);
+    options.downloadDirectory = std::wstring(tempDir) + L"InstAnalyticsInstaller\\";
 
-            bool downloadSuccess = g_downloader->DownloadFile(
-                dotnetUrl,
-                dotnetInstallerPath,
-                [](int progress, const std::wstring& status) {
-                    if (g_uiManager) {
-                        // Map download progress to 10-40% range
-                        int mappedProgress = 10 + (progress * 30 / 100);
-                        g_uiManager->UpdateProgress(mappedProgress, status);
-                    }
-                }
-            );
+    // Verified payloads survive the run in a per-user cache, so a retry or a
+    // re-imaged machine only revalidates them instead of downloading again
+    wchar_t localAppData[MAX_PATH];
+    if (SUCCEEDED(SHGetFolderPathW(nullptr, CSIDL_LOCAL_APPDATA, nullptr, 0, localAppData))) {
+        options.cacheDirectory = std::wstring(localAppData) + L"\\InstAnalyticsInstaller\\Cache";
+    }
 
-            delete g_downloader;
-            g_downloader = nullptr;
+    options.appUrl = URLs::INSTANALYTICS_ZIP;
+    options.appMirrors = Mirrors::INSTANALYTICS_ZIP;
+    options.appSha256 = Digests::INSTANALYTICS_ZIP;
+    options.appManifestUrl = URLs::INSTANALYTICS_MANIFEST;
+    options.appManifestSha256 = Digests::INSTANALYTICS_MANIFEST;
+    options.appPatchesUrl = URLs::INSTANALYTICS_PATCHES;
+    return options;
+}
 
-            if (!downloadSuccess) {
-                g_uiManager->SetError(L"Errore durante il download di .NET 10");
-                return;
-            }
+static InstallSettings SettingsFor(const HeadlessOptions& options)
+{
+    InstallSettings settings;
+    settings.installPath = options.installPath;
+    settings.downloadDirectory = options.downloadDirectory;
+    settings.appUrl = options.appUrl;
+    settings.appMirrors = options.appMirrors;
+    settings.appSha256 = options.appSha256;
+    settings.appManifestUrl = options.appManifestUrl;
+    settings.appManifestSha256 = options.appManifestSha256;
+    settings.appPatchesUrl = options.appPatchesUrl;
+    settings.extractThreads = options.extractThreads;
+    if (!options.cacheDirectory.empty()) {
+        settings.cache = std::make_shared<DownloadCache>(options.cacheDirectory);
+    }
+    return settings;
+}
 
-            // Step 3: Install .NET 10
-            g_uiManager->SetState(InstallState::InstallingDotNet);
-            g_uiManager->UpdateProgress(40, L"Installazione .NET 10...");
-
-            g_installer = new Installer();
-
-            bool installSuccess = g_installer->InstallDotNet(
-                dotnetInstallerPath,
-                [](int progress, const std::wstring& status) {
-                    if (g_uiManager) {
-                        // Map installation progress to 40-60% range
-                        int mappedProgress = 40 + (progress * 20 / 100);
-                        g_uiManager->UpdateProgress(mappedProgress, status);
-                    }
-                }
-            );
-
-            // Clean up installer file
-            DeleteFileW(dotnetInstallerPath.c_str());
-
-            if (!installSuccess) {
-                DWORD exitCode = g_installer->GetLastExitCode();
-                delete g_installer;
-                g_installer = nullptr;
-
-                wchar_t errorMsg[512];
-                swprintf_s(errorMsg, L"Errore durante l'installazione di .NET 10 (exit code: %d)", exitCode);
-                g_uiManager->SetError(errorMsg);
-                return;
-            }
+void PerformInstallation()
+{
+    if (!g_uiManager) return;
 
-            // Verify .NET installation and fix PATH if needed
-            g_uiManager->UpdateProgress(55, L"Verifica installazione .NET 10...");
-            Sleep(500);
+    WindowsInstallEnvironment environment;
+    InstallPipeline pipeline(environment, SettingsFor(DefaultOptions(g_uiManager->GetInstallPath())));
 
-            bool pathFixed = DotNetChecker::VerifyAndFixDotNetPath();
-            if (!pathFixed) {
-                g_uiManager->SetError(L"Impossibile configurare il PATH per .NET 10");
-                delete g_installer;
-                g_installer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(g_pipelineMutex);
+        g_pipeline = &pipeline;
+    }
+    bool success = pipeline.Run(
+        [](int progress, const std::wstring& status) {
+            if (g_uiManager) {
+                g_uiManager->UpdateProgress(progress, status);
+            }
+        },
+        [](const std::wstring& phase, InstallPipeline::PhaseEvent event, double) {
+            if (event != InstallPipeline::PhaseEvent::Started) {
                 return;
             }
-
-            g_uiManager->UpdateProgress(60, L".NET 10 configurato correttamente");
-            Sleep(300);
-        } else {
-            g_uiManager->UpdateProgress(30, L".NET 10 già installato");
-            Sleep(500);
-        }
-
-        // Step 4: Download InstAnalytics
-        g_uiManager->SetState(InstallState::DownloadingApp);
-        g_uiManager->UpdateProgress(65, L"Download InstAnalytics...");
-
-        std::wstring appZipPath = tempPath + L"InstAnalytics.zip";
-
-        g_downloader = new Downloader();
-
-        bool appDownloadSuccess = g_downloader->DownloadFile(
-            URLs::INSTANALYTICS_ZIP,
-            appZipPath,
-            [](int progress, const std::wstring& status) {
-                if (g_uiManager) {
-                    // Map download progress to 65-80% range
-                    int mappedProgress = 65 + (progress * 15 / 100);
-                    g_uiManager->UpdateProgress(mappedProgress, status);
-                }
+            if (phase == InstallPipeline::PHASE_CHECK) {
+                EnterState(InstallState::CheckingDotNet);
+            } else if (phase == InstallPipeline::PHASE_SDK_DOWNLOAD) {
+                EnterState(InstallState::DownloadingDotNet);
+            } else if (phase == InstallPipeline::PHASE_SDK_INSTALL) {
+                EnterState(InstallState::InstallingDotNet);
+            } else if (phase == InstallPipeline::PHASE_APP) {
+                EnterState(InstallState::DownloadingApp);
+            } else if (phase == InstallPipeline::PHASE_VERIFY) {
+                EnterState(InstallState::VerifyingApp);
             }
-        );
-
-        delete g_downloader;
-        g_downloader = nullptr;
-
-        if (!appDownloadSuccess) {
-            g_uiManager->SetError(L"Errore durante il download di InstAnalytics");
-            return;
-        }
-
-        // Step 5: Extract InstAnalytics
-        g_uiManager->SetState(InstallState::ExtractingApp);
-        g_uiManager->UpdateProgress(80, L"Estrazione files...");
-
-        std::wstring installPath = g_uiManager->GetInstallPath();
-
-        if (!g_installer) {
-            g_installer = new Installer();
-        }
+        });
+    {
+        std::lock_guard<std::mutex> lock(g_pipelineMutex);
+        g_pipeline = nullptr;
+    }
 
-        bool extractSuccess = g_installer->ExtractInstAnalytics(
-            appZipPath,
-            installPath,
-            [](int progress, const std::wstring& status) {
-                if (g_uiManager) {
-                    // Map extraction progress to 80-93% range
-                    int mappedProgress = 80 + (progress * 13 / 100);
-                    g_uiManager->UpdateProgress(mappedProgress, status);
-                }
-            }
-        );
+    if (pipeline.Error() == InstallError::Cancelled) {
+        return; // The window is already closing
+    }
 
-        // Clean up zip file
-        DeleteFileW(appZipPath.c_str());
+    if (!success) {
+        g_uiManager->SetError(pipeline.ErrorMessage());
+        return;
+    }
 
-        if (!extractSuccess) {
-            delete g_installer;
-            g_installer = nullptr;
-            g_uiManager->SetError(L"Errore durante l'estrazione di InstAnalytics");
-            return;
-        }
+    // Complete, naming whatever could not be done along the way
+    std::wstring status = L"Installazione completata!";
+    for (const std::wstring& warning : pipeline.Warnings()) {
+        status += L" " + warning + L".";
+    }
+    g_uiManager->UpdateProgress(100, status);
+    g_uiManager->SetState(InstallState::Completed);
+}
 
-        // Step 6: Create shortcuts
-        g_uiManager->UpdateProgress(94, L"Creazione collegamenti...");
-        g_installer->CreateShortcuts(installPath);
+static BOOL WINAPI ConsoleControlHandler(DWORD type)
+{
+    if (type == CTRL_C_EVENT || type == CTRL_BREAK_EVENT || type == CTRL_CLOSE_EVENT) {
+        CancelInstallation();
+        return TRUE;
+    }
+    return FALSE;
+}
 
-        delete g_installer;
-        g_installer = nullptr;
+// "--headless": no window, JSON events on stdout, the error as exit code
+static int RunHeadless(const std::vector<std::wstring>& args)
+{
+    // A GUI-subsystem process has no console of its own: write to the
+    // caller's, unless stdout was already redirected to a file or pipe
+    HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+    if ((output == nullptr || output == INVALID_HANDLE_VALUE) && AttachConsole(ATTACH_PARENT_PROCESS)) {
+        FILE* stream = nullptr;
+        freopen_s(&stream, "CONOUT$", "w", stdout);
+        freopen_s(&stream, "CONOUT$", "w", stderr);
+    }
 
-        // Step 7: Complete
-        g_uiManager->UpdateProgress(100, L"Installazione completata!");
-        g_uiManager->SetState(InstallState::Completed);
+    HeadlessOptions options = DefaultOptions(AppInfo::DEFAULT_INSTALL_PATH);
+    std::wstring error;
+    if (!HeadlessInstall::ParseArguments(args, options, error)) {
+        fwprintf(stderr, L"%s\n", error.c_str());
+        return HeadlessInstall::EXIT_BAD_ARGUMENTS;
+    }
 
+    WindowsInstallEnvironment environment;
+    InstallPipeline pipeline(environment, SettingsFor(options));
+    {
+        std::lock_guard<std::mutex> lock(g_pipelineMutex);
+        g_pipeline = &pipeline;
     }
-    catch (...) {
-        g_uiManager->SetError(L"Errore imprevisto durante l'installazione");
+    SetConsoleCtrlHandler(ConsoleControlHandler, TRUE);
 
-        if (g_downloader) {
-            delete g_downloader;
-            g_downloader = nullptr;
-        }
+    int result = HeadlessInstall::Run(pipeline, options, stdout);
 
-        if (g_installer) {
-            delete g_installer;
-            g_installer = nullptr;
-        }
+    SetConsoleCtrlHandler(ConsoleControlHandler, FALSE);
+    {
+        std::lock_guard<std::mutex> lock(g_pipelineMutex);
+        g_pipeline = nullptr;
     }
+    return result;
 }
 
 // Thread function to run installation without blocking UI
@@ -207,10 +229,9 @@ DWORD WINAPI InstallationThreadProc(LPVOID lpParam)
 
 void StartInstallation()
 {
-    HANDLE hThread = CreateThread(nullptr, 0, InstallationThreadProc, nullptr, 0, nullptr);
-    if (hThread) {
-        CloseHandle(hThread);
-    }
+    // A retry after an error: the previous run has already returned
+    WaitForInstallation(INFINITE);
+    g_installThread = CreateThread(nullptr, 0, InstallationThreadProc, nullptr, 0, nullptr);
 }
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
@@ -218,6 +239,29 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     // Initialize COM
     CoInitialize(nullptr);
 
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    std::vector<std::wstring> args;
+    for (int i = 1; argv && i < argc; ++i) {
+        args.push_back(argv[i]);
+    }
+    LocalFree(argv);
+
+    if (HeadlessInstall::IsRequested(args)) {
+        int result = RunHeadless(args);
+        CoUninitialize();
+        return result;
+    }
+
+    // "--trace <file>": record the installation for chrome://tracing
+    std::wstring tracePath;
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        if (args[i] == L"--trace") {
+            tracePath = args[i + 1];
+            Trace::Enable();
+        }
+    }
+
     // Create UI Manager
     UIManager uiManager(hInstance);
     g_uiManager = &uiManager;
@@ -233,10 +277,24 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 
     // Set install callback
     uiManager.SetInstallCallback(StartInstallation);
+    uiManager.SetCancelCallback(StopInstallation);
 
     // Run message loop
     int result = uiManager.Run();
 
+    // The window can also close without the cancel button (Alt+F4, the
+    // taskbar): stop the installation before the UI it reports to goes away
+    CancelInstallation();
+    if (!WaitForInstallation(CANCEL_WAIT_MS)) {
+        // Still unwinding and still using g_uiManager: end the process
+        // without running the teardown below
+        ExitProcess((UINT)result);
+    }
+
+    if (!tracePath.empty()) {
+        Trace::WriteChromeTrace(tracePath);
+    }
+
     // Cleanup
     g_uiManager = nullptr;
     CoUninitialize();
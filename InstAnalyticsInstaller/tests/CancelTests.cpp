@@ -0,0 +1,266 @@
+// Cancel latency of each stage against CANCEL_BUDGET_SECONDS: a throttled
+// segmented download, a streamed one, a request stuck waiting for the
+// server's headers, an extraction, a patch archive being applied and a
+// wait on the token (what the SDK setup's process wait blocks in). Each
+// gets a few attempts, so one scheduling hiccup on a loaded machine does
+// not fail the run
+
+#include "Test.h"
+#include "LoopbackServer.h"
+#include "SyntheticZip.h"
+#include "BinaryPatch.h"
+#include "Downloader.h"
+#include "FileSystem.h"
+#include "Sha256.h"
+#include "SocketHttpTransport.h"
+#include "StagedInstall.h"
+#include "Stream.h"
+#include "ZipExtractor.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+namespace InstAnalyticsInstaller {
+namespace Tests {
+
+namespace {
+
+constexpr double CANCEL_BUDGET_SECONDS = 0.05;
+constexpr unsigned ATTEMPTS = 3;
+constexpr size_t PAYLOAD_SIZE = 8 * 1024 * 1024;
+
+class NullOutput : public OutputStream {
+public:
+    bool Write(const void*, size_t) override { return true; }
+};
+
+// Time from Cancel() to the operation returning. False when the operation
+// finished before the cancel
+bool MeasureCancel(unsigned delayMs, const std::function<void()>& cancel, const std::function<bool()>& operation,
+    double& latency)
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point cancelled;
+    std::thread canceller([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+        cancelled = Clock::now();
+        cancel();
+    });
+    bool finished = operation();
+    Clock::time_point returned = Clock::now();
+    canceller.join();
+
+    latency = std::chrono::duration<double>(returned - cancelled).count();
+    return !finished && latency >= 0;
+}
+
+// Best of ATTEMPTS within the budget; prepare runs before each attempt
+bool WithinBudget(const std::string& what, const std::function<bool()>& prepare,
+    const std::function<bool(double&)>& attempt)
+{
+    double best = -1;
+    for (unsigned i = 0; i < ATTEMPTS; ++i) {
+        double latency = 0;
+        if (!prepare()) {
+            return Expect(false, "to set up " + what);
+        }
+        if (!attempt(latency)) {
+            return Expect(false, what + " to be interrupted by the cancel");
+        }
+        if (best < 0 || latency < best) {
+            best = latency;
+        }
+        if (best <= CANCEL_BUDGET_SECONDS) {
+            break;
+        }
+    }
+    fprintf(stderr, "    %s: %.1f ms\n", what.c_str(), best * 1000);
+    return Expect(best <= CANCEL_BUDGET_SECONDS, what + " to return within " +
+        std::to_string((int)(CANCEL_BUDGET_SECONDS * 1000)) + " ms of the cancel");
+}
+
+std::shared_ptr<std::vector<uint8_t>> Payload()
+{
+    return std::make_shared<std::vector<uint8_t>>(Bench::SyntheticContent(PAYLOAD_SIZE, 5));
+}
+
+// Slow enough that no transfer ends before the cancel
+Bench::LoopbackOptions Throttled()
+{
+    Bench::LoopbackOptions options;
+    options.bytesPerSecond = 2 * 1024 * 1024;
+    return options;
+}
+
+bool CancelDownload(const std::wstring& workDirectory)
+{
+    Bench::LoopbackServer server(Payload(), Throttled());
+    if (!Expect(server.Start(), "the loopback server to start")) {
+        return false;
+    }
+    auto transport = std::make_shared<SocketHttpTransport>();
+    std::wstring outputPath = FileSystem::JoinPath(workDirectory, L"cancelled.bin");
+    auto prepare = [&] {
+        FileSystem::RemoveFile(DownloadJournal::PathFor(outputPath));
+        return !FileSystem::FileExists(outputPath) || FileSystem::RemoveFile(outputPath);
+    };
+
+    return WithinBudget("a segmented download", prepare, [&](double& latency) {
+        Downloader downloader(transport);
+        return MeasureCancel(200, [&] { downloader.Cancel(); },
+            [&] { return downloader.DownloadFile(server.Url(), outputPath); }, latency);
+    });
+}
+
+bool CancelStream(const std::wstring&)
+{
+    Bench::LoopbackServer server(Payload(), Throttled());
+    if (!Expect(server.Start(), "the loopback server to start")) {
+        return false;
+    }
+    auto transport = std::make_shared<SocketHttpTransport>();
+
+    return WithinBudget("a streamed download", [] { return true; }, [&](double& latency) {
+        Downloader downloader(transport);
+        NullOutput output;
+        return MeasureCancel(200, [&] { downloader.Cancel(); },
+            [&] { return downloader.DownloadToStream(server.Url(), output); }, latency);
+    });
+}
+
+bool CancelStalled(const std::wstring& workDirectory)
+{
+    Bench::LoopbackOptions stalled;
+    stalled.latencyMs = 2000;
+    Bench::LoopbackServer server(Payload(), stalled);
+    if (!Expect(server.Start(), "the loopback server to start")) {
+        return false;
+    }
+    auto transport = std::make_shared<SocketHttpTransport>();
+    std::wstring outputPath = FileSystem::JoinPath(workDirectory, L"cancelled.bin");
+    auto prepare = [&] {
+        FileSystem::RemoveFile(DownloadJournal::PathFor(outputPath));
+        return !FileSystem::FileExists(outputPath) || FileSystem::RemoveFile(outputPath);
+    };
+
+    return WithinBudget("a request waiting for headers", prepare, [&](double& latency) {
+        Downloader downloader(transport);
+        return MeasureCancel(200, [&] { downloader.Cancel(); },
+            [&] { return downloader.DownloadFile(server.Url(), outputPath); }, latency);
+    });
+}
+
+// Entries done before the cancel stay whole; the one in progress is gone
+bool CancelExtract(const std::wstring& workDirectory)
+{
+    std::vector<Bench::SyntheticEntry> entries;
+    for (unsigned i = 0; i < 8; ++i) {
+        entries.push_back({ "InstAnalytics/assembly" + std::to_string(i) + ".dll",
+            Bench::SyntheticContent(PAYLOAD_SIZE / 2, 200 + i) });
+    }
+    std::wstring zipPath = FileSystem::JoinPath(workDirectory, L"cancelled.zip");
+    std::wstring extractPath = FileSystem::JoinPath(workDirectory, L"cancelled");
+    if (!Expect(Bench::WriteZip(zipPath, entries, true) != 0, "the archive to be written")) {
+        return false;
+    }
+
+    bool whole = true;
+    bool ok = WithinBudget("an extraction", [&] { return FileSystem::RemoveTree(extractPath); },
+        [&](double& latency) {
+            CancellationToken cancel;
+            ExtractionOptions options;
+            options.cancel = &cancel;
+            if (!MeasureCancel(50, [&] { cancel.Cancel(); },
+                    [&] { return ZipExtractor::Extract(zipPath, extractPath, nullptr, options); }, latency)) {
+                return false;
+            }
+            for (const auto& entry : entries) {
+                std::wstring path = FileSystem::JoinPath(extractPath, FileSystem::FromUtf8(entry.name));
+                File file;
+                uint64_t written = 0;
+                if (FileSystem::FileExists(path) &&
+                    (!file.Open(path, File::Mode::Read) || !file.GetSize(written) || written != entry.data.size())) {
+                    whole = false;
+                }
+            }
+            return true;
+        });
+    return Expect(whole, "no partially extracted entry after the cancel") && ok;
+}
+
+// The install keeps its version and no staged or temporary file remains
+bool CancelPatch(const std::wstring& workDirectory)
+{
+    // The new version repeats the old one with an edit in every copy: a
+    // small patch that takes a while to apply
+    std::vector<uint8_t> base = Bench::SyntheticContent(1024 * 1024, 300);
+    std::vector<uint8_t> target;
+    for (unsigned i = 0; i < 24; ++i) {
+        target.insert(target.end(), base.begin(), base.end());
+        target[target.size() - 1000] ^= (uint8_t)(i + 1);
+    }
+    std::vector<uint8_t> patch;
+    Sha256 sha;
+    sha.Update(base.data(), base.size());
+    std::wstring path = L"bin/assembly.dll";
+    std::wstring archivePath = FileSystem::JoinPath(workDirectory, L"cancelled.patches.zip");
+    std::string entryName = FileSystem::ToUtf8(BinaryPatch::EntryName(path, sha.FinalHex()));
+    if (!Expect(BinaryPatch::Create(base, target, patch) &&
+            Bench::WriteZip(archivePath, { { entryName, patch } }, true) != 0, "the patch archive to be written")) {
+        return false;
+    }
+
+    std::wstring installPath = FileSystem::JoinPath(workDirectory, L"install");
+    std::wstring filePath = FileSystem::JoinPath(installPath, path);
+    auto prepare = [&] {
+        File file;
+        return FileSystem::RemoveTree(installPath) && FileSystem::CreateDirectories(FileSystem::ParentPath(filePath)) &&
+               file.Open(filePath, File::Mode::Write) && file.Write(base.data(), base.size());
+    };
+
+    bool untouched = true;
+    bool ok = WithinBudget("a patch archive", prepare, [&](double& latency) {
+        CancellationToken cancel;
+        if (!MeasureCancel(20, [&] { cancel.Cancel(); },
+                [&] { return BinaryPatch::ApplyArchive(archivePath, installPath, nullptr, &cancel); }, latency)) {
+            return false;
+        }
+        File file;
+        uint64_t size = 0;
+        std::vector<DirectoryEntry> left;
+        untouched &= file.Open(filePath, File::Mode::Read) && file.GetSize(size) && size == base.size() &&
+                     FileSystem::ListDirectory(FileSystem::ParentPath(filePath), left) && left.size() == 1 &&
+                     !FileSystem::DirectoryExists(StagedInstall::StagingPathFor(installPath)) &&
+                     !FileSystem::DirectoryExists(StagedInstall::PreviousPathFor(installPath));
+        return true;
+    });
+    return Expect(untouched, "the install unchanged and nothing staged after the cancel") && ok;
+}
+
+// Nothing else to wait for: the wake-up itself is the latency
+bool CancelWait(const std::wstring&)
+{
+    return WithinBudget("a wait on the token", [] { return true; }, [](double& latency) {
+        CancellationToken cancel;
+        return MeasureCancel(20, [&] { cancel.Cancel(); },
+            [&] { return !cancel.WaitFor(std::chrono::seconds(10)); }, latency);
+    });
+}
+
+} // namespace
+
+std::vector<TestCase> CancelTests()
+{
+    return {
+        { "cancel.download", CancelDownload },
+        { "cancel.stream", CancelStream },
+        { "cancel.stalled", CancelStalled },
+        { "cancel.extract", CancelExtract },
+        { "cancel.patch", CancelPatch },
+        { "cancel.wait", CancelWait },
+    };
+}
+
+} // namespace Tests
+} // namespace InstAnalyticsInstaller
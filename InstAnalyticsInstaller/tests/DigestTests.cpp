@@ -0,0 +1,95 @@
+// The hashing kernels (PCLMULQDQ CRC-32, SHA-NI SHA-256) against published
+// vectors and against the portable code. On a CPU without the extensions
+// both sides run the portable code and the comparisons hold trivially
+
+#include "Test.h"
+#include "CpuFeatures.h"
+#include "Crc32.h"
+#include "FileSystem.h"
+#include "Sha256.h"
+#include "SyntheticZip.h"
+#include <cstdio>
+#include <cstring>
+
+namespace InstAnalyticsInstaller {
+namespace Tests {
+
+namespace {
+
+// In two updates split at split, so the buffered path is crossed too
+std::string Sha256Of(const void* data, size_t size, size_t split = 0)
+{
+    Sha256 sha;
+    sha.Update(data, split);
+    sha.Update((const uint8_t*)data + split, size - split);
+    return FileSystem::ToUtf8(sha.FinalHex());
+}
+
+bool Sha256Vectors(const std::wstring&)
+{
+    const char* twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    std::vector<uint8_t> million(1000000, 'a');
+
+    bool ok = true;
+    ok &= Expect(Sha256Of("", 0) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+        "SHA-256 of the empty string");
+    ok &= Expect(Sha256Of("abc", 3) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+        "SHA-256 of \"abc\"");
+    ok &= Expect(Sha256Of(twoBlocks, strlen(twoBlocks)) ==
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", "SHA-256 of the two-block message");
+    ok &= Expect(Sha256Of(million.data(), million.size(), 333333) ==
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", "SHA-256 of a million 'a'");
+    return ok;
+}
+
+bool Crc32Vectors(const std::wstring&)
+{
+    std::vector<uint8_t> zeros(4096, 0);
+    bool ok = true;
+    ok &= Expect(Crc32::Update(0, "", 0) == 0, "CRC-32 of nothing is 0");
+    ok &= Expect(Crc32::Update(0, "123456789", 9) == 0xCBF43926u, "CRC-32 check value of \"123456789\"");
+    ok &= Expect(Crc32::Update(0, zeros.data(), zeros.size()) == 0xC71C0011u, "CRC-32 of 4096 zero bytes");
+    return ok;
+}
+
+// Every length up to a few blocks, a spread up to 4 KB, misaligned starts
+// and split updates: the folding and the SHA-NI rounds each have their own
+// tail handling, which is where they would go wrong
+bool KernelsMatchPortable(const std::wstring&)
+{
+    const CpuFeatures& cpu = CpuFeatures::Get();
+    fprintf(stderr, "    kernels: crc32 %s, sha256 %s\n", cpu.pclmul ? "pclmul" : "portable",
+        cpu.sha ? "sha-ni" : "portable");
+
+    std::vector<uint8_t> data = Bench::SyntheticContent(4096 + 64, 7);
+    for (size_t offset = 0; offset < 16; offset += 3) {
+        for (size_t size = 0; size <= 4096; size += size < 300 ? 1 : 61) {
+            const uint8_t* start = data.data() + offset;
+            std::string sha = Sha256Of(start, size, size / 3);
+            uint32_t crc = Crc32::Update(Crc32::Update(0, start, size / 3), start + size / 3, size - size / 3);
+
+            CpuFeatures::SetAccelerationEnabled(false);
+            bool same = sha == Sha256Of(start, size) && crc == Crc32::UpdatePortable(0, start, size);
+            CpuFeatures::SetAccelerationEnabled(true);
+            if (!Expect(same, "the kernels to agree with the portable code at " + std::to_string(offset) + "+" +
+                    std::to_string(size))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::vector<TestCase> DigestTests()
+{
+    return {
+        { "digest.sha256-vectors", Sha256Vectors },
+        { "digest.crc32-vectors", Crc32Vectors },
+        { "digest.kernels-match-portable", KernelsMatchPortable },
+    };
+}
+
+} // namespace Tests
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,178 @@
+// Ranged downloads against sources that answer with the wrong bytes: a
+// 206 for another offset must never be spliced into the file, and a
+// streamed download that resumes on one moves on to the next mirror
+
+#include "Test.h"
+#include "SyntheticZip.h"
+#include "Downloader.h"
+#include "FileSystem.h"
+#include "HttpTransport.h"
+#include <algorithm>
+#include <cstring>
+
+namespace InstAnalyticsInstaller {
+namespace Tests {
+
+namespace {
+
+constexpr size_t PAYLOAD_SIZE = 8 * 1024 * 1024;
+
+class MemoryStream : public HttpStream {
+public:
+    MemoryStream(const HttpResponse& response, const uint8_t* data, size_t size)
+        : response_(response)
+        , data_(data)
+        , left_(size)
+    {
+    }
+
+    const HttpResponse& Response() const override { return response_; }
+
+    bool Read(void* buffer, size_t size, size_t& bytesRead) override
+    {
+        bytesRead = std::min(size, left_);
+        memcpy(buffer, data_, bytesRead);
+        data_ += bytesRead;
+        left_ -= bytesRead;
+        return true;
+    }
+
+private:
+    HttpResponse response_;
+    const uint8_t* data_;
+    size_t left_;
+};
+
+// Serves one payload at every URL. Ranges on a URL containing "shifted"
+// come from skew bytes away (but just as long), with a Content-Range that
+// says so; on "dropping" a whole response ends halfway, and "rangesonly"
+// answers only ranges
+class MemoryTransport : public HttpTransport {
+public:
+    MemoryTransport(const std::vector<uint8_t>& payload, uint64_t skew)
+        : payload_(payload)
+        , skew_(skew)
+    {
+    }
+
+    std::unique_ptr<HttpStream> Open(const HttpRequest& request) override
+    {
+        HttpResponse response;
+        response.acceptRanges = true;
+        response.etag = L"\"release-1\"";
+        response.totalLength = payload_.size();
+        response.hasContentLength = true;
+
+        uint64_t start = 0;
+        uint64_t end = payload_.size();
+        uint64_t sent = end;
+        if (request.useRange) {
+            start = std::min<uint64_t>(request.rangeStart, payload_.size());
+            if (request.url.find(L"shifted") != std::wstring::npos) {
+                start = start >= skew_ ? start - skew_ : start + skew_;
+            }
+            if (request.rangeLength > 0) {
+                end = std::min<uint64_t>(start + request.rangeLength, payload_.size());
+            }
+            response.statusCode = 206;
+            response.rangeStart = start;
+        } else if (request.url.find(L"rangesonly") != std::wstring::npos && !request.headOnly) {
+            response.statusCode = 503;
+            return std::unique_ptr<HttpStream>(new MemoryStream(response, payload_.data(), 0));
+        } else {
+            response.statusCode = 200;
+            if (request.url.find(L"dropping") != std::wstring::npos) {
+                sent = payload_.size() / 2;
+            }
+        }
+        response.contentLength = end - start;
+        sent = std::min(sent, end) - start;
+        return std::unique_ptr<HttpStream>(new MemoryStream(response, payload_.data() + start,
+            request.headOnly ? 0 : (size_t)sent));
+    }
+
+private:
+    const std::vector<uint8_t>& payload_;
+    uint64_t skew_;
+};
+
+bool HasContent(const std::wstring& path, const std::vector<uint8_t>& data)
+{
+    File file;
+    std::vector<uint8_t> read(data.size() + 1);
+    size_t bytesRead = 0;
+    return file.Open(path, File::Mode::Read) && file.Read(read.data(), read.size(), bytesRead) &&
+           bytesRead == data.size() && std::equal(data.begin(), data.end(), read.begin());
+}
+
+DownloadOptions Segmented()
+{
+    DownloadOptions options;
+    options.minSegmentSize = 1024 * 1024;
+    return options;
+}
+
+bool ShiftedSourceFails(const std::wstring& workDirectory)
+{
+    std::vector<uint8_t> payload = Bench::SyntheticContent(PAYLOAD_SIZE, 11);
+    Downloader downloader(std::make_shared<MemoryTransport>(payload, 4096));
+    downloader.SetOptions(Segmented());
+
+    std::wstring outputPath = FileSystem::JoinPath(workDirectory, L"shifted.bin");
+    return Expect(!downloader.DownloadFile(L"http://shifted.invalid/release.zip", outputPath),
+        "a download whose ranges start at the wrong offset to fail");
+}
+
+bool ShiftedMirrorDropped(const std::wstring& workDirectory)
+{
+    std::vector<uint8_t> payload = Bench::SyntheticContent(PAYLOAD_SIZE, 12);
+    Downloader downloader(std::make_shared<MemoryTransport>(payload, 4096));
+    downloader.SetOptions(Segmented());
+
+    std::wstring outputPath = FileSystem::JoinPath(workDirectory, L"mirrored.bin");
+    std::vector<std::wstring> sources = { L"http://shifted.invalid/release.zip", L"http://mirror.invalid/release.zip" };
+    bool ok = Expect(downloader.DownloadFile(sources, outputPath), "the good mirror to complete the download");
+    return ok && Expect(HasContent(outputPath, payload), "the downloaded file to match the payload");
+}
+
+class MemoryOutput : public OutputStream {
+public:
+    bool Write(const void* data, size_t size) override
+    {
+        bytes.insert(bytes.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+        return true;
+    }
+
+    std::vector<uint8_t> bytes;
+};
+
+// The stream starts on the only source answering in full, which drops
+// halfway and then serves its ranges from the wrong offset
+bool ShiftedResumeFailsOver(const std::wstring&)
+{
+    std::vector<uint8_t> payload = Bench::SyntheticContent(PAYLOAD_SIZE, 13);
+    Downloader downloader(std::make_shared<MemoryTransport>(payload, 4096));
+    DownloadOptions options;
+    options.retryDelayMs = 1;
+    downloader.SetOptions(options);
+
+    MemoryOutput output;
+    std::vector<std::wstring> sources = { L"http://dropping.shifted.invalid/release.zip",
+        L"http://rangesonly.invalid/release.zip" };
+    bool ok = Expect(downloader.DownloadToStream(sources, output), "the mirror to finish the streamed download");
+    return ok && Expect(output.bytes == payload, "the streamed bytes to match the payload");
+}
+
+} // namespace
+
+std::vector<TestCase> DownloadTests()
+{
+    return {
+        { "download.shifted-source-fails", ShiftedSourceFails },
+        { "download.shifted-mirror-dropped", ShiftedMirrorDropped },
+        { "download.shifted-resume-fails-over", ShiftedResumeFailsOver },
+    };
+}
+
+} // namespace Tests
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,178 @@
+// Patch archives applied to an install: every patch lands in the switch at
+// the end, or none does, and the patched version stays behind for a rollback
+
+#include "Test.h"
+#include "SyntheticZip.h"
+#include "BinaryPatch.h"
+#include "FileSystem.h"
+#include "Sha256.h"
+#include "StagedInstall.h"
+#include <algorithm>
+
+namespace InstAnalyticsInstaller {
+namespace Tests {
+
+namespace {
+
+struct Version {
+    std::string path;
+    std::vector<uint8_t> base;
+    std::vector<uint8_t> target;
+};
+
+// Two assemblies whose new version mostly moves and edits the old bytes
+std::vector<Version> Versions()
+{
+    std::vector<Version> versions;
+    for (unsigned i = 0; i < 2; ++i) {
+        Version version;
+        version.path = "bin/assembly" + std::to_string(i) + ".dll";
+        version.base = Bench::SyntheticContent(256 * 1024, 40 + i);
+        version.target = version.base;
+        version.target.insert(version.target.begin() + 1000, 4096, (uint8_t)(0x20 + i));
+        version.target[100000] ^= 0xFF;
+        versions.push_back(version);
+    }
+    return versions;
+}
+
+bool WriteBytes(const std::wstring& path, const std::vector<uint8_t>& data)
+{
+    File file;
+    return FileSystem::CreateDirectories(FileSystem::ParentPath(path)) && file.Open(path, File::Mode::Write) &&
+           file.Write(data.data(), data.size());
+}
+
+bool HasContent(const std::wstring& path, const std::vector<uint8_t>& data)
+{
+    File file;
+    std::vector<uint8_t> read(data.size() + 1);
+    size_t bytesRead = 0;
+    return file.Open(path, File::Mode::Read) && file.Read(read.data(), read.size(), bytesRead) &&
+           bytesRead == data.size() && std::equal(data.begin(), data.end(), read.begin());
+}
+
+// The install at the base versions, and an archive with a patch for each;
+// corruptLast damages the last patch's target hash, so it fails its check
+bool Prepare(const std::wstring& workDirectory, const std::vector<Version>& versions, bool corruptLast,
+    std::wstring& installPath, std::wstring& archivePath)
+{
+    installPath = FileSystem::JoinPath(workDirectory, L"install");
+    archivePath = FileSystem::JoinPath(workDirectory, L"patches.zip");
+    if (!FileSystem::RemoveTree(installPath)) {
+        return false;
+    }
+
+    std::vector<Bench::SyntheticEntry> entries;
+    for (size_t i = 0; i < versions.size(); ++i) {
+        const Version& version = versions[i];
+        std::wstring path = FileSystem::FromUtf8(version.path);
+        if (!WriteBytes(FileSystem::JoinPath(installPath, path), version.base)) {
+            return false;
+        }
+
+        Sha256 sha;
+        sha.Update(version.base.data(), version.base.size());
+        std::vector<uint8_t> patch;
+        if (!BinaryPatch::Create(version.base, version.target, patch)) {
+            return false;
+        }
+        if (corruptLast && i + 1 == versions.size()) {
+            patch[BinaryPatch::HEADER_SIZE - 1] ^= 0xFF;
+        }
+        entries.push_back({ FileSystem::ToUtf8(BinaryPatch::EntryName(path, sha.FinalHex())), patch });
+    }
+    return Bench::WriteZip(archivePath, entries, true) != 0;
+}
+
+bool AppliesAll(const std::wstring& workDirectory)
+{
+    std::vector<Version> versions = Versions();
+    std::wstring installPath;
+    std::wstring archivePath;
+    if (!Expect(Prepare(workDirectory, versions, false, installPath, archivePath), "the fixture to be written")) {
+        return false;
+    }
+
+    size_t applied = 0;
+    bool ok = Expect(BinaryPatch::ApplyArchive(archivePath, installPath, nullptr, nullptr, &applied),
+        "the patch archive to apply");
+    ok &= Expect(applied == versions.size(), "every patch to be applied");
+    for (const Version& version : versions) {
+        ok &= Expect(HasContent(FileSystem::JoinPath(installPath, FileSystem::FromUtf8(version.path)),
+            version.target), version.path + " at the new version");
+    }
+    ok &= Expect(!FileSystem::DirectoryExists(StagedInstall::StagingPathFor(installPath)),
+        "no staging directory left");
+
+    // Nothing installed matches a base any more
+    ok &= Expect(BinaryPatch::ApplyArchive(archivePath, installPath, nullptr, nullptr, &applied) && applied == 0,
+        "a second run to skip every patch");
+    return ok;
+}
+
+// Files without a patch are carried into the new version, and the one it
+// replaced can be put back
+bool KeepsPrevious(const std::wstring& workDirectory)
+{
+    std::vector<Version> versions = Versions();
+    std::wstring installPath;
+    std::wstring archivePath;
+    std::vector<uint8_t> settings = Bench::SyntheticContent(5000, 60);
+    std::wstring settingsPath = L"config/settings.json";
+    if (!Expect(Prepare(workDirectory, versions, false, installPath, archivePath) &&
+            WriteBytes(FileSystem::JoinPath(installPath, settingsPath), settings), "the fixture to be written")) {
+        return false;
+    }
+
+    bool ok = Expect(BinaryPatch::ApplyArchive(archivePath, installPath), "the patch archive to apply");
+    ok &= Expect(HasContent(FileSystem::JoinPath(installPath, settingsPath), settings),
+        "the file without a patch to be carried over");
+    std::wstring previous = StagedInstall::PreviousPathFor(installPath);
+    for (const Version& version : versions) {
+        ok &= Expect(HasContent(FileSystem::JoinPath(previous, FileSystem::FromUtf8(version.path)), version.base),
+            version.path + " at the old version beside the install");
+    }
+
+    ok &= Expect(StagedInstall::Rollback(installPath), "the rollback to succeed");
+    for (const Version& version : versions) {
+        ok &= Expect(HasContent(FileSystem::JoinPath(installPath, FileSystem::FromUtf8(version.path)),
+            version.base), version.path + " back at the old version");
+    }
+    ok &= Expect(HasContent(FileSystem::JoinPath(installPath, settingsPath), settings),
+        "the file without a patch to survive the rollback");
+    return ok;
+}
+
+bool FailureLeavesInstall(const std::wstring& workDirectory)
+{
+    std::vector<Version> versions = Versions();
+    std::wstring installPath;
+    std::wstring archivePath;
+    if (!Expect(Prepare(workDirectory, versions, true, installPath, archivePath), "the fixture to be written")) {
+        return false;
+    }
+
+    bool ok = Expect(!BinaryPatch::ApplyArchive(archivePath, installPath), "the damaged archive to fail");
+    for (const Version& version : versions) {
+        ok &= Expect(HasContent(FileSystem::JoinPath(installPath, FileSystem::FromUtf8(version.path)),
+            version.base), version.path + " untouched");
+    }
+    ok &= Expect(!FileSystem::DirectoryExists(StagedInstall::StagingPathFor(installPath)),
+        "no staging directory left");
+    return ok;
+}
+
+} // namespace
+
+std::vector<TestCase> PatchTests()
+{
+    return {
+        { "patch.applies-all", AppliesAll },
+        { "patch.failure-leaves-install", FailureLeavesInstall },
+        { "patch.keeps-previous", KeepsPrevious },
+    };
+}
+
+} // namespace Tests
+} // namespace InstAnalyticsInstaller
@@ -0,0 +1,72 @@
+// The progress snapshot under concurrent writers: every sample pairs a
+// percentage with the status published alongside it, and no update is lost
+
+#include "Test.h"
+#include "ProgressSnapshot.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+namespace Tests {
+
+namespace {
+
+constexpr unsigned WRITERS = 4;
+constexpr int UPDATES = 250000;
+
+// Writer w publishes w * UPDATES + i with the status "<that number>"
+bool SamplesArePairs(const std::wstring&)
+{
+    ProgressSnapshot snapshot;
+    std::atomic<unsigned> running(WRITERS);
+    std::vector<std::thread> writers;
+    for (unsigned w = 0; w < WRITERS; ++w) {
+        writers.emplace_back([&snapshot, &running, w] {
+            for (int i = 0; i < UPDATES; ++i) {
+                int value = (int)w * UPDATES + i;
+                snapshot.Publish(value, std::to_wstring(value));
+            }
+            --running;
+        });
+    }
+
+    uint64_t version = 0;
+    bool paired = true;
+    while (running > 0 && paired) {
+        int progress = 0;
+        std::wstring status;
+        if (snapshot.Sample(version, progress, status)) {
+            paired = status == std::to_wstring(progress);
+        }
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    if (!Expect(paired, "each sampled status to match its percentage")) {
+        return false;
+    }
+
+    // Every Publish counts, none is dropped for contention, and the last
+    // one of some writer is what stays
+    uint64_t last = 0;
+    int progress = 0;
+    std::wstring status;
+    snapshot.Sample(last, progress, status);
+    return Expect(last == (uint64_t)WRITERS * UPDATES, "one version per Publish") &&
+           Expect(progress % UPDATES == UPDATES - 1 && status == std::to_wstring(progress),
+               "the final sample to be some writer's last update");
+}
+
+} // namespace
+
+std::vector<TestCase> ProgressTests()
+{
+    return {
+        { "progress.samples-are-pairs", SamplesArePairs },
+    };
+}
+
+} // namespace Tests
+} // namespace InstAnalyticsInstaller
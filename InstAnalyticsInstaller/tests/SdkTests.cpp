@@ -0,0 +1,64 @@
+// SDK detection on a fake dotnet tree: <root>/sdk/<version>/dotnet.dll,
+// the layout SdkLocator lists instead of starting the host
+
+#include "Test.h"
+#include "FileSystem.h"
+#include "SdkLocator.h"
+
+namespace InstAnalyticsInstaller {
+namespace Tests {
+
+namespace {
+
+// An SDK folder; without the marker it is what an uninstaller leaves behind
+bool AddSdk(const std::wstring& root, const std::wstring& version, bool complete = true)
+{
+    std::wstring directory = FileSystem::JoinPath(FileSystem::JoinPath(root, L"sdk"), version);
+    File marker;
+    return FileSystem::CreateDirectories(directory) &&
+           (!complete || marker.Open(FileSystem::JoinPath(directory, L"dotnet.dll"), File::Mode::Write));
+}
+
+bool FindsNewestSdk(const std::wstring& workDirectory)
+{
+    std::wstring machine = FileSystem::JoinPath(workDirectory, L"machine");
+    std::wstring user = FileSystem::JoinPath(workDirectory, L"user");
+    if (!Expect(AddSdk(machine, L"8.0.404") && AddSdk(machine, L"10.0.100-rc.2.25502.107") &&
+            AddSdk(user, L"10.0.100") && AddSdk(user, L"10.0.200", false), "the fake trees to be written")) {
+        return false;
+    }
+
+    SdkVersion found;
+    bool ok = Expect(SdkLocator::FindSdk({ machine, user }, 10, &found), "an SDK 10 to be found");
+    ok &= Expect(found.name == L"10.0.100", "the release to outrank its preview and the empty folder");
+    ok &= Expect(SdkLocator::FindSdk({ machine }, 8), "the SDK 8 to be found");
+    return ok;
+}
+
+bool MissingSdk(const std::wstring& workDirectory)
+{
+    std::wstring root = FileSystem::JoinPath(workDirectory, L"dotnet");
+    if (!Expect(AddSdk(root, L"8.0.404") && AddSdk(root, L"9.0.101") && AddSdk(root, L"10.0.100", false),
+            "the fake tree to be written")) {
+        return false;
+    }
+
+    bool ok = Expect(!SdkLocator::FindSdk({ root }, 10), "no SDK 10 in a tree with only 8.x and 9.x");
+    ok &= Expect(!SdkLocator::FindSdk({ FileSystem::JoinPath(workDirectory, L"absent") }, 8),
+        "no SDK under a root that does not exist");
+    ok &= Expect(SdkLocator::ListSdks(root).size() == 2, "both complete SDKs to be listed");
+    return ok;
+}
+
+} // namespace
+
+std::vector<TestCase> SdkTests()
+{
+    return {
+        { "sdk.finds-newest", FindsNewestSdk },
+        { "sdk.missing", MissingSdk },
+    };
+}
+
+} // namespace Tests
+} // namespace InstAnalyticsInstaller
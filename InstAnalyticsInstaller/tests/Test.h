@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace InstAnalyticsInstaller {
+namespace Tests {
+
+// One correctness check. ctest runs each group ("InstAnalyticsTests
+// digest.") as a test of its own; workDirectory is empty and private to
+// the run
+struct TestCase {
+    std::string name;
+    bool (*run)(const std::wstring& workDirectory);
+};
+
+// Reports what was expected under the running test when condition is false
+bool Expect(bool condition, const std::string& what);
+
+std::vector<TestCase> DigestTests();
+std::vector<TestCase> CancelTests();
+std::vector<TestCase> DownloadTests();
+std::vector<TestCase> PatchTests();
+std::vector<TestCase> ProgressTests();
+std::vector<TestCase> SdkTests();
+std::vector<TestCase> ZipTests();
+
+} // namespace Tests
+} // namespace InstAnalyticsInstaller
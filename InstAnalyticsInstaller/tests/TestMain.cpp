@@ -0,0 +1,61 @@
+// Correctness tests, registered with ctest by group:
+//
+//   InstAnalyticsTests [name prefix]
+//
+// Every test whose name starts with the prefix runs (all of them without
+// one); the exit code is 1 if any failed.
+
+#include "Test.h"
+#include "FileSystem.h"
+#include <cstdio>
+#include <unistd.h>
+
+using namespace InstAnalyticsInstaller;
+using namespace InstAnalyticsInstaller::Tests;
+
+namespace InstAnalyticsInstaller {
+namespace Tests {
+
+bool Expect(bool condition, const std::string& what)
+{
+    if (!condition) {
+        fprintf(stderr, "    expected %s\n", what.c_str());
+    }
+    return condition;
+}
+
+} // namespace Tests
+} // namespace InstAnalyticsInstaller
+
+int main(int argc, char* argv[])
+{
+    std::string prefix = argc > 1 ? argv[1] : "";
+
+    std::vector<TestCase> tests;
+    for (const auto& group : { DigestTests(), CancelTests(), DownloadTests(), PatchTests(), ProgressTests(), SdkTests(), ZipTests() }) {
+        tests.insert(tests.end(), group.begin(), group.end());
+    }
+
+    std::wstring root = L"/tmp/InstAnalyticsTests-" + std::to_wstring(getpid());
+    size_t run = 0;
+    size_t failed = 0;
+    for (const TestCase& test : tests) {
+        if (test.name.compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+        std::wstring workDirectory = FileSystem::JoinPath(root, FileSystem::FromUtf8(test.name));
+        bool ok = FileSystem::RemoveTree(workDirectory) && FileSystem::CreateDirectories(workDirectory) &&
+                  test.run(workDirectory);
+        fprintf(stderr, "%-4s %s\n", ok ? "ok" : "FAIL", test.name.c_str());
+        ++run;
+        failed += ok ? 0 : 1;
+    }
+    FileSystem::RemoveTree(root);
+
+    if (run == 0) {
+        fprintf(stderr, "No test matches \"%s\"\n", prefix.c_str());
+        return 1;
+    }
+    fprintf(stderr, "%zu of %zu passed\n", run - failed, run);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+// Central directories that disagree with their end record, and streamed
+// extraction with the entries inflated on workers
+
+#include "Test.h"
+#include "SyntheticZip.h"
+#include "FileSystem.h"
+#include "Stream.h"
+#include "ZipArchive.h"
+#include "ZipExtractor.h"
+#include <algorithm>
+
+namespace InstAnalyticsInstaller {
+namespace Tests {
+
+namespace {
+
+constexpr size_t END_RECORD_SIZE = 22;
+
+// A valid archive whose end record (no comment, so the last 22 bytes) then
+// gets its entry counts raised by extra
+bool WriteOvercounted(const std::wstring& path, size_t entries, uint16_t extra)
+{
+    std::vector<Bench::SyntheticEntry> files;
+    for (size_t i = 0; i < entries; ++i) {
+        files.push_back({ "file" + std::to_string(i) + ".txt", Bench::SyntheticContent(1000, i) });
+    }
+    uint64_t size = Bench::WriteZip(path, files, false);
+    if (size < END_RECORD_SIZE) {
+        return false;
+    }
+
+    File file;
+    uint8_t record[END_RECORD_SIZE];
+    size_t bytesRead = 0;
+    if (!file.Open(path, File::Mode::ReadWrite) ||
+        !file.ReadAt(size - END_RECORD_SIZE, record, sizeof(record), bytesRead) || bytesRead != sizeof(record)) {
+        return false;
+    }
+    for (size_t offset : { 8, 10 }) {
+        uint16_t count = (uint16_t)(record[offset] | (record[offset + 1] << 8)) + extra;
+        record[offset] = (uint8_t)count;
+        record[offset + 1] = (uint8_t)(count >> 8);
+    }
+    return file.WriteAt(size - END_RECORD_SIZE, record, sizeof(record));
+}
+
+bool Opens(const std::wstring& path)
+{
+    FileInput input;
+    ZipArchive archive;
+    return input.Open(path) && archive.Open(input);
+}
+
+bool OvercountedDirectory(const std::wstring& workDirectory)
+{
+    std::wstring valid = FileSystem::JoinPath(workDirectory, L"valid.zip");
+    std::wstring overcounted = FileSystem::JoinPath(workDirectory, L"overcounted.zip");
+    std::wstring empty = FileSystem::JoinPath(workDirectory, L"empty.zip");
+    if (!Expect(WriteOvercounted(valid, 3, 0) && WriteOvercounted(overcounted, 3, 1) &&
+            WriteOvercounted(empty, 0, 1), "the archives to be written")) {
+        return false;
+    }
+
+    bool ok = Expect(Opens(valid), "the untouched archive to open");
+    ok &= Expect(!Opens(overcounted), "an end record claiming one entry too many to be rejected");
+    ok &= Expect(!Opens(empty), "an empty directory claiming an entry to be rejected");
+    return ok;
+}
+
+bool HasContent(const std::wstring& path, const std::vector<uint8_t>& data)
+{
+    File file;
+    std::vector<uint8_t> read(data.size() + 1);
+    size_t bytesRead = 0;
+    return file.Open(path, File::Mode::Read) && file.Read(read.data(), read.size(), bytesRead) &&
+           bytesRead == data.size() && std::equal(data.begin(), data.end(), read.begin());
+}
+
+bool ExtractStreamed(const std::wstring& zipPath, const std::wstring& outputPath, unsigned threads)
+{
+    FileInput input;
+    if (!input.Open(zipPath)) {
+        return false;
+    }
+    RangeInputStream stream(input, 0, input.Size());
+    ExtractionOptions options;
+    options.threadCount = threads;
+    options.stripCommonRoot = true;
+    return ZipExtractor::ExtractStream(stream, outputPath, nullptr, options);
+}
+
+// The last entry narrows the common root, so the files the workers wrote
+// under the assumed one have to move
+bool StreamParallel(const std::wstring& workDirectory)
+{
+    std::vector<Bench::SyntheticEntry> entries;
+    for (unsigned i = 0; i < 12; ++i) {
+        entries.push_back({ "release/bin/assembly" + std::to_string(i) + ".dll",
+            Bench::SyntheticContent(50000 + i * 70000, 300 + i) });
+    }
+    entries.push_back({ "release/readme.txt", Bench::SyntheticContent(100, 320) });
+
+    std::wstring zipPath = FileSystem::JoinPath(workDirectory, L"release.zip");
+    std::wstring outputPath = FileSystem::JoinPath(workDirectory, L"out");
+    uint64_t size = Bench::WriteZip(zipPath, entries, true);
+    if (!Expect(size > 0, "the archive to be written")) {
+        return false;
+    }
+
+    bool ok = Expect(ExtractStreamed(zipPath, outputPath, 4), "the streamed extraction on 4 workers to succeed");
+    for (const auto& entry : entries) {
+        std::wstring path = FileSystem::JoinPath(outputPath, FileSystem::FromUtf8(entry.name.substr(8)));
+        ok &= Expect(HasContent(path, entry.data), entry.name + " to be extracted under the narrowed root");
+    }
+
+    // A flipped byte inside the entries' data fails a worker's CRC check
+    File file;
+    uint8_t byte = 0;
+    size_t bytesRead = 0;
+    bool corrupted = file.Open(zipPath, File::Mode::ReadWrite) && file.ReadAt(size / 2, &byte, 1, bytesRead) &&
+                     bytesRead == 1;
+    byte ^= 0x55;
+    corrupted = corrupted && file.WriteAt(size / 2, &byte, 1);
+    file.Close();
+    if (!Expect(corrupted && FileSystem::RemoveTree(outputPath), "the archive to be corrupted")) {
+        return false;
+    }
+    return Expect(!ExtractStreamed(zipPath, outputPath, 4), "a corrupted entry to fail the extraction") && ok;
+}
+
+} // namespace
+
+std::vector<TestCase> ZipTests()
+{
+    return {
+        { "zip.overcounted-directory", OvercountedDirectory },
+        { "zip.stream-parallel", StreamParallel },
+    };
+}
+
+} // namespace Tests
+} // namespace InstAnalyticsInstaller